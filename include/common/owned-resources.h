@@ -97,10 +97,7 @@ protected:
         resources_[handle] = std::move(resource);
         handle->on_destroy_ = [weak_this = this->weak_from_this()](const std::weak_ptr<OwnedResourceHandleBase>& weak_handle) {
             if (auto shared_this = weak_this.lock()) {
-                auto it = shared_this->resources_.find(weak_handle);
-                if (it != shared_this->resources_.end()) {
-                    shared_this->resources_.erase(it);
-                }
+                shared_this->release(weak_handle);
             }
         };
         handle->resources_ = this->weak_from_this();
@@ -111,19 +108,29 @@ protected:
         resources_[handle] = std::move(resource);
         handle->on_destroy_ = [weak_this = this->weak_from_this()](const std::weak_ptr<OwnedResourceHandleBase>& weak_handle) {
             if (auto shared_this = weak_this.lock()) {
-                auto it = shared_this->resources_.find(weak_handle);
-                if (it != shared_this->resources_.end()) {
-                    shared_this->resources_.erase(it);
-                }
+                shared_this->release(weak_handle);
             }
         };
         return handle;
     }
+    void release(const std::weak_ptr<OwnedResourceHandleBase>& weak_handle) {
+        auto it = resources_.find(weak_handle);
+        if (it != resources_.end()) {
+            auto resource = std::move(it->second);
+            resources_.erase(it);
+            // Erase first because releasing the resource may destroy other handles of this container
+            if (on_release_) {
+                on_release_(std::move(resource));
+            }
+        }
+    }
     static std::shared_ptr<OwnedResourcesBase> Create() {
         return std::shared_ptr<OwnedResourcesBase>(new OwnedResourcesBase());
     }
     OwnedResourcesBase() {}
     std::map<std::weak_ptr<OwnedResourceHandleBase>, std::unique_ptr<T>, std::owner_less<std::weak_ptr<OwnedResourceHandleBase>>> resources_;
+    // Takes over resources whose handles are destroyed. Resources are destroyed immediately if not set.
+    std::function<void(std::unique_ptr<T>&&)> on_release_;
 };
 
 template <typename T>
@@ -144,6 +151,9 @@ public:
     OwnedResources() : base_(OwnedResourcesBase<T>::Create()) {}
     [[nodiscard]] OwnedResourceHandle<T> store(std::unique_ptr<T>&& resource) { return base_->store(std::move(resource)); }
     [[nodiscard]] OwnedResourceHandleUntyped storeUntyped(std::unique_ptr<T>&& resource) { return base_->storeUntyped(std::move(resource)); }
+    // Defer destruction of released resources, e.g. until GPU no longer uses them.
+    void setOnRelease(std::function<void(std::unique_ptr<T>&&)> on_release) { base_->on_release_ = std::move(on_release); }
+    [[nodiscard]] size_t size() const { return base_->resources_.size(); }
     [[nodiscard]] T& get(const OwnedResourceHandleUntyped& handle) { return *base_->resources_[handle]; }
     [[nodiscard]] const T& get(const OwnedResourceHandleUntyped& handle) const { return *base_->resources_[handle]; }
     [[nodiscard]] iterator begin() { return iterator(base_->resources_.begin()); }
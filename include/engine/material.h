@@ -18,6 +18,8 @@ public:
 
 public:
     std::shared_ptr<GfxPipeline> pipeline;
+    // Pipeline for InstancedDrawCommand with per instance transforms, null if the material has no instanced shader
+    std::shared_ptr<GfxPipeline> instanced_pipeline;
     std::vector<std::shared_ptr<Sampler>> samplers;
 
 protected:
@@ -54,6 +56,13 @@ public:
     void clearTextures() { textures_.clear(); }
     [[nodiscard]] const std::vector<CombinedTextureSampler>& textures() const { return textures_; }
 
+    // Vertex shader reading InstanceTransform at locations 4 to 7, e.g. shader/simple-instanced.vert.spv.
+    // Materials with one can be drawn instanced. Takes effect on the next createRenderData.
+    void setInstancedVertShader(const std::string& instanced_vert_shader_filename) {
+        instanced_vert_shader_filename_ = instanced_vert_shader_filename;
+    }
+    [[nodiscard]] const std::string& instanced_vert_shader_filename() const { return instanced_vert_shader_filename_; }
+
     std::shared_ptr<IRenderData> createRenderData() override;
     const std::shared_ptr<MaterialRenderData>& render_data() const { return render_data_; }
 
@@ -61,6 +70,7 @@ protected:
     std::string name_;
     std::string vert_shader_filename_;
     std::string frag_shader_filename_;
+    std::string instanced_vert_shader_filename_;
     MaterialConfig config_;
     std::vector<CombinedTextureSampler> textures_;
     std::shared_ptr<MaterialRenderData> render_data_;
@@ -68,6 +78,7 @@ protected:
 protected:
     Material(std::string name, std::string vert_shader_filename, std::string frag_shader_filename);
     GfxVertexFactory createVertexFactory() const;
+    GfxVertexFactory createInstancedVertexFactory() const;
     GfxPipelineState createPipelineState() const;
     GfxUniformLayout createUniformLayout() const;
     GfxSamplerLayout createSamplerLayout() const;
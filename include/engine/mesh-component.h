@@ -35,7 +35,13 @@ public:
     const Transform& transform() const { return transform_; }
 
     void setMaterial(const std::shared_ptr<Material>& material) { material_ = material; }
+    [[nodiscard]] const std::shared_ptr<Material>& material() const { return material_; }
     void setMesh(const std::shared_ptr<Mesh>& mesh) { mesh_ = mesh; }
+    [[nodiscard]] const std::shared_ptr<Mesh>& mesh() const { return mesh_; }
+    // Level of detail of the mesh to draw (see Mesh::lods), clamped to the coarsest. Takes effect on the next
+    // recording of command buffers if render data is created.
+    void setLod(uint32_t lod);
+    [[nodiscard]] uint32_t lod() const { return lod_; }
 
     std::shared_ptr<IRenderData> createRenderData() override;
     const std::shared_ptr<MeshComponentRenderData>& render_data() const { return render_data_; }
@@ -45,11 +51,13 @@ protected:
     Transform transform_;
     std::shared_ptr<Mesh> mesh_;
     std::shared_ptr<Material> material_;
+    uint32_t lod_{ 0 };
     std::shared_ptr<MeshComponentRenderData> render_data_;
 
 protected:
     explicit MeshComponent(std::string name) : name_(std::move(name)) {}
     ModelUniform createUniformObject();
+    void applyLod();
 };
 
 } // namespace wg
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "common/common.h"
+#include "gfx/gfx-buffer.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace wg {
+
+// Vertices kept by the simulated post-transform cache, a typical size for GPUs
+constexpr size_t DefaultVertexCacheSize = 16;
+
+// Post-transform vertex cache efficiency of drawing a triangle list, simulated with a FIFO cache.
+struct VertexCacheStatistics {
+    uint32_t vertices_transformed = 0;
+    // Average cache miss ratio, vertices transformed per triangle, from 3 at worst to about 0.5 for large meshes
+    float acmr = 0.f;
+    // Average transform to vertex ratio, vertices transformed per vertex referenced, 1 at best
+    float atvr = 0.f;
+
+    inline bool operator==(const VertexCacheStatistics&) const = default;
+};
+
+VertexCacheStatistics AnalyzeVertexCache(
+    const std::vector<uint32_t>& indices, size_t vertex_count, size_t cache_size = DefaultVertexCacheSize
+);
+
+// Reorder triangles for the post-transform vertex cache with Tipsify (Sander et al. 2007), fanning around vertices
+// still in the cache. Triangles keep their winding.
+std::vector<uint32_t> OptimizeVertexCache(
+    const std::vector<uint32_t>& indices, size_t vertex_count, size_t cache_size = DefaultVertexCacheSize
+);
+
+// Reorder clusters of triangles ordered by OptimizeVertexCache so that clusters facing outwards are drawn first and
+// occlude the others, independent of the view. Clusters start where the cache misses all vertices of a triangle, and
+// are split further wherever the ACMR since the last split, simulated with the cache cleared at each split, is within
+// threshold times the ACMR of the cluster, so threshold trades vertex cache efficiency for less overdraw.
+std::vector<uint32_t> OptimizeOverdraw(
+    const std::vector<SimpleVertex>& vertices, const std::vector<uint32_t>& indices, float threshold = 1.05f,
+    size_t cache_size = DefaultVertexCacheSize
+);
+
+// Reorder vertices in order of first use by indices for locality of vertex fetches, and remove unused vertices.
+void OptimizeVertexFetch(std::vector<SimpleVertex>& vertices, std::vector<uint32_t>& indices);
+
+} // namespace wg
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "common/common.h"
+#include "gfx/gfx-buffer.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace wg {
+
+// Simplify a triangle list by collapsing edges of the lowest quadric error, until at most target_index_count indices
+// are left or no collapse is possible without flipping triangles. Vertices collapse onto other vertices, so the result
+// indexes the same vertices and can share their buffer. Vertices at the same position are welded, and open
+// boundaries are kept in place by penalty quadrics.
+// out_error is set to the largest object space error of collapses done, the root mean square distance of the collapsed
+// vertex to the planes of its quadric, weighted by area.
+std::vector<uint32_t> SimplifyTriangles(
+    const std::vector<SimpleVertex>& vertices, const std::vector<uint32_t>& indices, size_t target_index_count,
+    float& out_error
+);
+
+} // namespace wg
@@ -3,14 +3,33 @@
 #include "common/common.h"
 #include "gfx/gfx-constants.h"
 #include "gfx/gfx-buffer.h"
+#include "gfx/gfx-upload.h"
+#include "gfx/geometry-pool.h"
+#include "gfx/gfx-culling.h"
 #include "gfx/draw-command.h"
 #include "engine/material.h"
+#include "engine/mesh-optimizer.h"
 
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace wg {
 
+// Level of detail of a mesh, a range of Mesh::indices
+struct MeshLod {
+    uint32_t first_index = 0;
+    uint32_t index_count = 0;
+    // Object space error of the simplification, 0 for the original indices
+    float error = 0.f;
+};
+
+// Vertex cache efficiency of the original indices before and after the last Mesh::optimize
+struct MeshOptimizationStatistics {
+    VertexCacheStatistics before;
+    VertexCacheStatistics after;
+};
+
 class MeshRenderData : public IRenderData, public std::enable_shared_from_this<MeshRenderData> {
 public:
     ~MeshRenderData() override = default;
@@ -19,6 +38,17 @@ public:
 public:
     std::shared_ptr<VertexBuffer<SimpleVertex>> vertex_buffer;
     std::shared_ptr<IndexBuffer> index_buffer;
+    // If set, buffers are placed in the pool instead of having their own resources
+    std::shared_ptr<GeometryPool> geometry_pool;
+    UploadToken upload_token;
+    // Object space center and radius enclosing all vertices, see Mesh::bounding_sphere
+    glm::vec4 bounding_sphere{ 0.f };
+    // Ranges of index_buffer, see Mesh::lods
+    std::vector<MeshLod> lods;
+
+    // Set index_buffer to the draw command, drawing the original indices only, as the buffer also holds the other
+    // levels of detail. Does nothing without indices.
+    void setIndexBuffer(DrawCommand& draw_command) const;
 
 protected:
     friend class Mesh;
@@ -35,8 +65,9 @@ public:
     static std::shared_ptr<Mesh> CreateFromVertices(
         const std::string& name, std::vector<SimpleVertex> vertices, std::vector<uint32_t> indices
     );
+    // Generates lod_count - 1 levels of detail if lod_count > 1, see generateLods.
     static std::shared_ptr<Mesh> CreateFromObjFile(
-        const std::string& name, const std::string& filename
+        const std::string& name, const std::string& filename, uint32_t lod_count = 1
     );
     static std::shared_ptr<Mesh> CreateSphere(
         const std::string& name, int level = 6, glm::vec3 color = { 1.f, 1.f, 1.f }
@@ -49,13 +80,51 @@ public:
     );
 
     [[nodiscard]] const std::vector<wg::SimpleVertex>& vertices() const { return vertices_; }
+    // Indices of all levels of detail, one after another
     [[nodiscard]] const std::vector<uint32_t>& indices() const { return indices_; }
     [[nodiscard]] primitive_topologies::PrimitiveTopology primitive_topology() const { return primitive_topology_; }
-    void setVertices(std::vector<wg::SimpleVertex> vertices) { vertices_ = std::move(vertices); }
-    void setIndices(std::vector<uint32_t> indices) { indices_ = std::move(indices); }
+    // Also computes the bounding box and bounding sphere.
+    void setVertices(std::vector<wg::SimpleVertex> vertices);
+    // Also removes levels of detail other than the indices themselves.
+    void setIndices(std::vector<uint32_t> indices);
     void setPrimitiveTopology(primitive_topologies::PrimitiveTopology primitive_topology) {
         primitive_topology_ = primitive_topology;
     }
+    // Object space bounds of vertices
+    [[nodiscard]] const BoundingBox& bounding_box() const { return bounding_box_; }
+    // Object space center and radius, centered at the bounding box
+    [[nodiscard]] const glm::vec4& bounding_sphere() const { return bounding_sphere_; }
+    // Override the computed sphere, e.g. with infinite radius for meshes positioned by shaders, which are never culled.
+    // Takes effect on next createRenderData().
+    void setBoundingSphere(const glm::vec4& bounding_sphere) { bounding_sphere_ = bounding_sphere; }
+    // Levels of detail, from the original indices at lods()[0] to the coarsest. Empty without indices.
+    [[nodiscard]] const std::vector<MeshLod>& lods() const { return lods_; }
+    // Simplify the triangles of the coarsest level of detail until lod_count levels, each with about reduction times
+    // the indices of the previous. Stops early if a level cannot be simplified further. Indexed triangle lists only.
+    // Takes effect on next createRenderData().
+    void generateLods(uint32_t lod_count, float reduction = 0.5f);
+    // Append a level of detail with indices of the vertices, e.g. made by a modeling tool. Takes effect on next
+    // createRenderData().
+    void addLod(const std::vector<uint32_t>& indices, float error);
+    // Reorder triangles of each level of detail for the vertex cache, then vertices for fetch locality, removing
+    // unused vertices. Indexed triangle lists only.
+    void optimize();
+    // Optimize on next createRenderData(), unless optimized since vertices or indices were set. Disabled by default.
+    void setOptimization(bool optimization) { optimization_ = optimization; }
+    [[nodiscard]] bool optimization() const { return optimization_; }
+    // Also reorder triangles for less overdraw when optimizing, splitting clusters of the vertex cache order where
+    // the ACMR of each piece stays within overdraw_threshold times that of its cluster (see OptimizeOverdraw).
+    // Disabled by default.
+    void setOverdrawOptimization(bool overdraw_optimization, float overdraw_threshold = 1.05f) {
+        overdraw_optimization_ = overdraw_optimization;
+        overdraw_threshold_ = overdraw_threshold;
+    }
+    [[nodiscard]] bool overdraw_optimization() const { return overdraw_optimization_; }
+    [[nodiscard]] bool optimized() const { return optimized_; }
+    [[nodiscard]] const MeshOptimizationStatistics& optimization_statistics() const { return optimization_statistics_; }
+    // Share vertex and index buffers with other meshes in the pool. Takes effect on next createRenderData().
+    void setGeometryPool(std::shared_ptr<GeometryPool> geometry_pool) { geometry_pool_ = std::move(geometry_pool); }
+    [[nodiscard]] const std::shared_ptr<GeometryPool>& geometry_pool() const { return geometry_pool_; }
 
     [[nodiscard]] const std::string& name() const { return name_; }
 
@@ -66,7 +135,16 @@ protected:
     std::string name_;
     std::vector<wg::SimpleVertex> vertices_;
     std::vector<uint32_t> indices_;
+    std::vector<MeshLod> lods_;
     primitive_topologies::PrimitiveTopology primitive_topology_{ primitive_topologies::triangle_list };
+    BoundingBox bounding_box_;
+    glm::vec4 bounding_sphere_{ 0.f };
+    bool optimization_{ false };
+    bool overdraw_optimization_{ false };
+    float overdraw_threshold_{ 1.05f };
+    bool optimized_{ false };
+    MeshOptimizationStatistics optimization_statistics_;
+    std::shared_ptr<GeometryPool> geometry_pool_;
     std::shared_ptr<MeshRenderData> render_data_;
 
 protected:
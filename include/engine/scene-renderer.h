@@ -1,15 +1,54 @@
 #pragma once
 
 #include "common/common.h"
+#include "gfx/bvh.h"
+#include "gfx/compute-command.h"
+#include "gfx/gfx-culling.h"
 #include "gfx/render-target.h"
 #include "gfx/renderer.h"
 #include "engine/mesh-component.h"
 
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace wg {
 
+// Components sharing mesh and material, drawn by one instanced draw command.
+struct SceneRendererInstanceBatch {
+    std::shared_ptr<InstancedDrawCommand> draw_command;
+    // Transform of components[i] at instance i
+    std::shared_ptr<StreamingVertexBuffer<InstanceTransform>> instance_buffer;
+    // Identity, required by the uniform layout of the material
+    std::shared_ptr<UniformBuffer<ModelUniform>> model_uniform_buffer;
+    std::vector<std::shared_ptr<MeshComponent>> components;
+};
+
+// Components sharing material and vertex buffers (of a geometry pool, or of a mesh), culled by a compute command
+// and drawn by one indirect draw command.
+struct SceneRendererCullingBatch {
+    std::shared_ptr<IndirectDrawCommand> draw_command;
+    // Transform of components[i] at instance i
+    std::shared_ptr<StreamingVertexBuffer<InstanceTransform>> instance_buffer;
+    // Identity, required by the uniform layout of the material
+    std::shared_ptr<UniformBuffer<ModelUniform>> model_uniform_buffer;
+    // Bounds and draw of components[i], drawing instance i
+    std::shared_ptr<StorageBuffer<GpuCullObject>> objects;
+    // Written by cull_command
+    std::shared_ptr<StorageBuffer<DrawIndexedIndirectCommand>> indirect_commands;
+    std::shared_ptr<StorageBuffer<uint32_t>> draw_count;
+    std::shared_ptr<ComputeCommand> cull_command;
+    std::vector<std::shared_ptr<MeshComponent>> components;
+};
+
+// Components tested by the last SceneRenderer::cullComponents
+struct SceneRendererCullingStatistics {
+    uint32_t visible_component_count = 0;
+    uint32_t culled_component_count = 0;
+};
+
 class SceneRendererRenderData : public IRenderData, public std::enable_shared_from_this<SceneRendererRenderData> {
 public:
     ~SceneRendererRenderData() override = default;
@@ -17,7 +56,35 @@ public:
 
 public:
     std::weak_ptr<RenderTarget> weak_render_target;
+    // To draw culled components without GPU culling if the device cannot draw culling batches
+    std::weak_ptr<class SceneRenderer> weak_renderer;
     std::shared_ptr<UniformBuffer<wg::CameraUniform>> camera_uniform_buffer;
+    std::vector<SceneRendererInstanceBatch> instance_batches;
+    // component => (index of instance_batches, instance index)
+    std::unordered_map<const MeshComponent*, std::pair<size_t, size_t>> batched_components;
+    // Pipeline of the culling shader, null without GPU culling
+    std::shared_ptr<ComputePipeline> cull_pipeline;
+    std::vector<SceneRendererCullingBatch> culling_batches;
+    // component => (index of culling_batches, object index)
+    std::unordered_map<const MeshComponent*, std::pair<size_t, size_t>> culled_components;
+    // World space bounds of components drawn by draw commands of the renderer, except those culled on GPU
+    BoundingSpheres component_bounds;
+    // (first, count) of draw commands drawing component_bounds[i], the instance batch for batched components
+    std::vector<std::pair<size_t, size_t>> component_draw_command_ranges;
+    // component => index of component_bounds
+    std::unordered_map<const MeshComponent*, size_t> component_bounds_indices;
+    // Result of the last culling, component_visible[i] is 1 if component_bounds[i] is visible
+    std::vector<uint8_t> component_visible;
+    // Component of component_bounds[i]
+    std::vector<std::shared_ptr<MeshComponent>> bounded_components;
+    // Nearest depth of components of each draw command, kept to reuse storage
+    std::vector<float> draw_command_depths;
+    // Boxes of component_bounds, with object i for component_bounds[i], except for infinite bounds
+    Bvh component_bvh;
+    // Indices of component_bounds with infinite bounds, which are always visible
+    std::vector<size_t> unbounded_component_indices;
+    // Indices of component_bounds of components with levels of detail drawn by their own draw commands
+    std::vector<size_t> lod_component_indices;
 
 protected:
     friend class SceneRenderer;
@@ -55,16 +122,70 @@ public:
     void setCamera(Camera camera);
     const Camera& camera() const { return camera_; }
 
-    void updateComponentTransform(const std::shared_ptr<MeshComponent>& component) {
-        component->render_data()->model_uniform_buffer->setUniformObject(
-            {
-                .model_mat = component->transform().transform
-            }
-        );
-        for (const auto& draw_command : component->render_data()->draw_commands) {
-            markUniformDirty(draw_command, uniform_attributes::model);
-        }
-    }
+    // Draw components sharing mesh and material with one instanced draw command, if the material has an instanced
+    // shader (see Material::setInstancedVertShader). Takes effect on the next createRenderData. Enabled by default.
+    void setInstancing(bool instancing) { instancing_ = instancing; }
+    [[nodiscard]] bool instancing() const { return instancing_; }
+    // Minimum number of components sharing mesh and material to be drawn instanced
+    void setMinInstanceBatchSize(size_t min_instance_batch_size) { min_instance_batch_size_ = min_instance_batch_size; }
+    [[nodiscard]] size_t min_instance_batch_size() const { return min_instance_batch_size_; }
+
+    // Cull components on GPU and draw them with indirect draw commands instead of instancing. Components with
+    // instanced materials and indexed meshes are batched by material and geometry pool (or mesh if not in a pool).
+    // cull_shader_filename is the compiled shader/static/frustum-cull.comp, empty to disable.
+    // Needs the multi_draw_indirect feature, without which components are drawn as if GPU culling is disabled.
+    // Takes effect on the next createRenderData.
+    void setGpuCullingShader(const std::string& cull_shader_filename) { cull_shader_filename_ = cull_shader_filename; }
+    [[nodiscard]] const std::string& gpu_culling_shader_filename() const { return cull_shader_filename_; }
+    // Cull batched components against the camera, called every frame before Gfx::render, which waits for it on GPU.
+    ComputeToken submitCulling(Gfx& gfx);
+    // Number of batched components drawn after the culling of token. Waits for the culling to finish.
+    uint32_t readCulledDrawCount(Gfx& gfx, const ComputeToken& token);
+
+    // Hide draw commands of components outside the camera frustum, and show the others. Called every frame before
+    // Gfx::render, with a render target recording per frame (see recording_modes::per_frame). Instance batches are
+    // hidden only if all instances are culled. Also updates sort depths, see updateSortDepths.
+    void cullComponents();
+    // Set sort depths of draw commands to the view space depth of the nearest point of the bounds of their
+    // components, so that they are recorded front to back within the same state. Draw commands culled on GPU keep
+    // depth 0. Takes effect on the next recording, like cullComponents.
+    void updateSortDepths();
+    // Cull with the bounding volume hierarchy of components instead of testing every bounding sphere. Faster for
+    // many components mostly outside the frustum, but boxes around spheres are looser. Disabled by default.
+    void setBvhCulling(bool bvh_culling) { bvh_culling_ = bvh_culling; }
+    [[nodiscard]] bool bvh_culling() const { return bvh_culling_; }
+
+    // Components with bounds (boxes around bounding spheres) intersecting the frustum or overlapping the box, including
+    // those of infinite bounds. Components culled on GPU are not included.
+    [[nodiscard]] std::vector<std::shared_ptr<MeshComponent>> queryComponents(const Frustum& frustum) const;
+    [[nodiscard]] std::vector<std::shared_ptr<MeshComponent>> queryComponents(const BoundingBox& box) const;
+    // Component with finite bounds nearest to the point, null if none
+    [[nodiscard]] std::shared_ptr<MeshComponent> queryNearestComponent(const glm::vec3& point) const;
+    [[nodiscard]] const SceneRendererCullingStatistics& culling_statistics() const { return culling_statistics_; }
+
+    // Select levels of detail of components by their projected screen sizes (see SelectLod), called every frame before
+    // Gfx::render, with a render target recording per frame (see recording_modes::per_frame). Components drawn by
+    // instance batches or culled on GPU always draw the original indices.
+    void selectLods();
+    // Screen sizes below which levels of detail 1, 2, ... are drawn, decreasing. Defaults to { 0.5, 0.25, 0.125, 0.0625 }.
+    void setLodScreenSizes(std::vector<float> lod_screen_sizes) { lod_screen_sizes_ = std::move(lod_screen_sizes); }
+    [[nodiscard]] const std::vector<float>& lod_screen_sizes() const { return lod_screen_sizes_; }
+    // Fraction the screen size must pass a threshold by to switch levels of detail, so that components near a
+    // threshold do not switch back and forth. Defaults to 0.1.
+    void setLodHysteresis(float lod_hysteresis) { lod_hysteresis_ = lod_hysteresis; }
+    [[nodiscard]] float lod_hysteresis() const { return lod_hysteresis_; }
+    // Number of components at each level of detail after the last selectLods
+    [[nodiscard]] const std::vector<uint32_t>& lod_component_counts() const { return lod_component_counts_; }
+    // Height of the bounding sphere on screen relative to the screen height, infinity if the camera is inside
+    [[nodiscard]] static float ProjectedScreenSize(const glm::vec4& bounding_sphere, const glm::vec3& camera_position, float fov_y);
+    // Level of detail for the screen size, switching from current_lod only if the screen size passes the threshold by
+    // hysteresis times the screen size
+    [[nodiscard]] static uint32_t SelectLod(
+        float screen_size, uint32_t current_lod, uint32_t lod_count, const std::vector<float>& lod_screen_sizes,
+        float hysteresis
+    );
+
+    void updateComponentTransform(const std::shared_ptr<MeshComponent>& component);
 
     std::shared_ptr<IRenderData> createRenderData() override;
     const std::shared_ptr<SceneRendererRenderData>& render_data() const { return render_data_; }
@@ -73,13 +194,28 @@ protected:
     Camera camera_;
     std::weak_ptr<RenderTarget> weak_render_target_;
     std::vector<std::shared_ptr<MeshComponent>> components_;
+    bool instancing_{ true };
+    size_t min_instance_batch_size_{ 2 };
+    std::string cull_shader_filename_;
+    bool bvh_culling_{ false };
+    SceneRendererCullingStatistics culling_statistics_;
+    std::vector<float> lod_screen_sizes_{ 0.5f, 0.25f, 0.125f, 0.0625f };
+    float lod_hysteresis_{ 0.1f };
+    std::vector<uint32_t> lod_component_counts_;
     std::shared_ptr<SceneRendererRenderData> render_data_;
 
 protected:
     friend class Gfx;
     friend class RenderTarget;
+    friend class SceneRendererRenderData;
     SceneRenderer() = default;
     CameraUniform createUniformObject() const;
+    // Batches, bounds and draw commands of components in render_data_, with culling batches if gpu_culling
+    void createDrawCommands(bool gpu_culling);
+    // Replace culling batches of render_data_ with instance batches or draw commands of components
+    void disableGpuCulling();
+    void createInstanceBatches();
+    void createCullingBatches();
 };
 
 } // namespace wg
\ No newline at end of file
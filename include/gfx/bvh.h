@@ -0,0 +1,79 @@
+#pragma once
+
+#include "common/common.h"
+#include "common/math.h"
+#include "gfx/gfx-culling.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace wg {
+
+// Bounding volume hierarchy of boxes of objects 0 .. object_count() - 1, for culling and spatial queries.
+// Built top down with binned surface area heuristic. Moving an object refits the boxes of its ancestors, which get
+// looser over time, so the hierarchy should be rebuilt when its cost has grown too much (see rebuildIfDegraded).
+class Bvh {
+public:
+    static constexpr uint32_t InvalidIndex = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t MaxLeafObjectCount = 4;
+
+    // Objects with empty boxes are not in the hierarchy and never returned by queries.
+    void build(std::vector<BoundingBox> object_boxes);
+    // Build again from the current object boxes.
+    void rebuild();
+    // Set the box of an object and refit its ancestors. An object not in the hierarchy is inserted if the box is not
+    // empty, splitting the leaf whose ancestors grow least. Non-finite boxes are ignored.
+    void update(uint32_t object, const BoundingBox& box);
+
+    // Sum of surface areas of nodes, weighted by object count for leaves
+    [[nodiscard]] float cost() const { return cost_; }
+    [[nodiscard]] float build_cost() const { return build_cost_; }
+    void setRebuildCostRatio(float rebuild_cost_ratio) { rebuild_cost_ratio_ = rebuild_cost_ratio; }
+    [[nodiscard]] float rebuild_cost_ratio() const { return rebuild_cost_ratio_; }
+    [[nodiscard]] bool degraded() const { return cost_ > build_cost_ * rebuild_cost_ratio_; }
+    // Rebuild if the cost exceeds rebuild_cost_ratio times the cost after the last build. Returns whether rebuilt.
+    bool rebuildIfDegraded();
+
+    [[nodiscard]] size_t object_count() const { return object_boxes_.size(); }
+    [[nodiscard]] const BoundingBox& object_box(uint32_t object) const { return object_boxes_[object]; }
+    [[nodiscard]] size_t node_count() const { return nodes_.size(); }
+    [[nodiscard]] uint32_t depth() const { return depth_; }
+
+    // Append objects with boxes at least partly inside the frustum to out_objects.
+    void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out_objects) const;
+    // Append objects with boxes overlapping the box to out_objects.
+    void queryOverlap(const BoundingBox& box, std::vector<uint32_t>& out_objects) const;
+    // Object with the box nearest to the point, distance 0 if inside. InvalidIndex if none is within max_distance.
+    [[nodiscard]] uint32_t queryNearest(
+        const glm::vec3& point, float max_distance = std::numeric_limits<float>::infinity()
+    ) const;
+
+protected:
+    struct Node {
+        BoundingBox box;
+        // First child for internal nodes, whose children are adjacent, or first of object_indices_ for leaves
+        uint32_t first{ 0 };
+        // 0 for internal nodes
+        uint32_t object_count{ 0 };
+        uint32_t parent{ InvalidIndex };
+    };
+    std::vector<Node> nodes_;
+    // Objects of leaves, in ranges of leaves
+    std::vector<uint32_t> object_indices_;
+    std::vector<BoundingBox> object_boxes_;
+    // object => leaf node, InvalidIndex if not in the hierarchy
+    std::vector<uint32_t> object_leaves_;
+    uint32_t depth_{ 0 };
+    float cost_{ 0.f };
+    float build_cost_{ 0.f };
+    float rebuild_cost_ratio_{ 1.5f };
+
+protected:
+    void appendObjects(uint32_t node_index, std::vector<uint32_t>& out_objects) const;
+    // Recompute boxes of the node and its ancestors until one is unchanged
+    void refit(uint32_t node_index);
+    void insert(uint32_t object);
+};
+
+} // namespace wg
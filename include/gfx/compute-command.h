@@ -0,0 +1,84 @@
+#pragma once
+
+#include "common/common.h"
+#include "gfx/gfx-buffer.h"
+#include "gfx/gfx-pipeline.h"
+#include "gfx/image.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace wg {
+
+// Identifies a submitted batch of compute commands. Rendering waits for it on the GPU, and CPU can poll or wait for it.
+class ComputeToken {
+public:
+    ComputeToken() = default;
+    [[nodiscard]] bool valid() const { return submission_index_ > 0; }
+    [[nodiscard]] uint64_t submission_index() const { return submission_index_; }
+
+protected:
+    friend class Gfx;
+    explicit ComputeToken(uint64_t submission_index) : submission_index_(submission_index) {}
+    uint64_t submission_index_{ 0 };
+};
+
+// One dispatch of a compute pipeline with its storage buffers, samplers and push constants.
+class ComputeCommand : public std::enable_shared_from_this<ComputeCommand> {
+public:
+    static std::shared_ptr<ComputeCommand> Create(std::string name, const std::shared_ptr<ComputePipeline>& pipeline);
+    ~ComputeCommand();
+
+    [[nodiscard]] const std::string& name() const { return name_; }
+    [[nodiscard]] const std::shared_ptr<ComputePipeline>& pipeline() const { return pipeline_; }
+    [[nodiscard]] bool valid() const;
+
+    // Buffers must have storage usage (see GfxBufferBase::setStorage) and GPU resources.
+    ComputeCommand& setStorageBuffer(uint32_t binding, const std::shared_ptr<GfxBufferBase>& storage_buffer);
+    void clearStorageBuffers();
+    [[nodiscard]] const std::map<uint32_t, std::shared_ptr<GfxBufferBase>>& storage_buffers() const { return storage_buffers_; }
+    // Fill the storage buffer of the binding with zeros before each dispatch, e.g. to reset counters.
+    void setClearStorageBuffer(uint32_t binding, bool clear = true);
+    [[nodiscard]] const std::set<uint32_t>& cleared_storage_buffers() const { return cleared_storage_buffers_; }
+
+    ComputeCommand& setSampler(uint32_t binding, const std::shared_ptr<Sampler>& sampler);
+    void clearSamplers();
+
+    // Copied into the push constant range of the pipeline at each dispatch.
+    template <typename PushConstantType, typename = std::enable_if_t<std::is_trivially_copyable_v<PushConstantType>>>
+    void setPushConstants(const PushConstantType& push_constants) {
+        push_constants_.resize(sizeof(PushConstantType));
+        std::memcpy(push_constants_.data(), &push_constants, sizeof(PushConstantType));
+    }
+    [[nodiscard]] const std::vector<uint8_t>& push_constants() const { return push_constants_; }
+
+    void setGroupCount(uint32_t x, uint32_t y = 1, uint32_t z = 1) { group_count_ = { x, y, z }; }
+    [[nodiscard]] const std::array<uint32_t, 3>& group_count() const { return group_count_; }
+
+protected:
+    std::string name_;
+    std::shared_ptr<ComputePipeline> pipeline_;
+    // binding => buffer
+    std::map<uint32_t, std::shared_ptr<GfxBufferBase>> storage_buffers_;
+    // Bindings of storage buffers cleared before dispatch
+    std::set<uint32_t> cleared_storage_buffers_;
+    // binding => sampler
+    std::map<uint32_t, std::shared_ptr<Sampler>> samplers_;
+    std::vector<uint8_t> push_constants_;
+    std::array<uint32_t, 3> group_count_{ 1, 1, 1 };
+
+protected:
+    friend class Gfx;
+    ComputeCommand(std::string name, const std::shared_ptr<ComputePipeline>& pipeline);
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace wg
@@ -5,6 +5,8 @@
 #include "gfx/image.h"
 
 #include <memory>
+#include <optional>
+#include <utility>
 
 namespace wg {
 
@@ -33,6 +35,7 @@ struct VertexBufferCombinedDescription {
     uint32_t stride{ 0 };
     uint32_t offset{ 0 };
     size_t vertex_buffer_index{ 0 };
+    bool per_instance{ false };
 };
 
 class DrawCommand : public std::enable_shared_from_this<DrawCommand> {
@@ -49,7 +52,10 @@ public:
     [[nodiscard]] const std::vector<std::shared_ptr<VertexBufferBase>>& vertex_buffers() const {
         return vertex_buffers_;
     }
+    // Vertex count of per vertex buffers
     [[nodiscard]] size_t vertex_count() const;
+    // Instance count of per instance buffers, 1 without them
+    [[nodiscard]] size_t instance_count() const;
     [[nodiscard]] std::vector<VertexBufferCombinedDescription> getVertexBufferCombinedDescriptions() const;
 
     void setIndexBuffer(const std::shared_ptr<IndexBuffer>& index_buffer);
@@ -63,7 +69,18 @@ public:
         primitive_topology_ = primitive_topology;
     }
     [[nodiscard]] primitive_topologies::PrimitiveTopology primitive_topology() const { return primitive_topology_; }
+    // Indices drawn, of the index range if set
     [[nodiscard]] size_t index_count() const;
+    // Draw index_count indices from first_index of the index buffer instead of all, e.g. a level of detail of a mesh
+    // (see Mesh::lods). The range must be inside the index buffer. Takes effect on the next recording of command
+    // buffers, like Renderer::setDrawCommandVisible.
+    void setIndexRange(uint32_t first_index, uint32_t index_count);
+    void clearIndexRange();
+    [[nodiscard]] const std::optional<std::pair<uint32_t, uint32_t>>& index_range() const { return index_range_; }
+    // Offsets of the draw in buffers shared with other draw commands, e.g. geometry pools, including the index range.
+    // Available after Gfx::finishDrawCommand.
+    [[nodiscard]] int32_t base_vertex() const;
+    [[nodiscard]] uint32_t first_index() const;
 
     DrawCommand& addUniformBuffer(const std::shared_ptr<UniformBufferBase>& uniform_buffer);
     void clearUniformBuffers();
@@ -71,24 +88,36 @@ public:
     DrawCommand& addSampler(uint32_t binding, const std::shared_ptr<Sampler>& sampler);
     void clearSamplers();
 
+    // Draw commands are recorded by layer (0 to 15) first. In a layer, they are grouped by pipeline, descriptor set
+    // and buffers, then recorded front to back by sort depth, e.g. distance from the camera.
+    void setRenderLayer(uint32_t render_layer) { render_layer_ = render_layer; }
+    [[nodiscard]] uint32_t render_layer() const { return render_layer_; }
+    void setSortDepth(float sort_depth) { sort_depth_ = sort_depth; }
+    [[nodiscard]] float sort_depth() const { return sort_depth_; }
+
 protected:
     std::string name_;
     std::shared_ptr<GfxPipeline> pipeline_;
     // Vertex and index buffer
     std::vector<std::shared_ptr<VertexBufferBase>> vertex_buffers_;
     std::shared_ptr<IndexBuffer> index_buffer_;
+    // (first index, index count)
+    std::optional<std::pair<uint32_t, uint32_t>> index_range_;
     primitive_topologies::PrimitiveTopology primitive_topology_{ primitive_topologies::triangle_list };
     // CPU data of draw command uniforms
     std::map<uniform_attributes::UniformAttribute,
         std::shared_ptr<UniformBufferBase>> uniform_buffers_;
     // binding => sampler 
     std::map<uint32_t, std::shared_ptr<Sampler>> samplers_;
+    uint32_t render_layer_{ 0 };
+    float sort_depth_{ 0.f };
 
 protected:
     friend class Gfx;
     explicit DrawCommand(std::string name);
     struct Impl;
     virtual Impl* getImpl() = 0;
+    virtual const Impl* getImpl() const = 0;
 };
 
 class SimpleDrawCommand : public DrawCommand {
@@ -104,6 +133,71 @@ protected:
     struct Impl;
     std::unique_ptr<Impl> impl_;
     DrawCommand::Impl* getImpl() override;
+    const DrawCommand::Impl* getImpl() const override;
+};
+
+// Draws many instances of the same geometry in one draw call. Per instance attributes are read from vertex buffers
+// of per instance vertex types, e.g. InstanceTransform, which are added like other vertex buffers. Shaders may also
+// use gl_InstanceIndex to index their own data.
+class InstancedDrawCommand : public DrawCommand {
+public:
+    static std::shared_ptr<InstancedDrawCommand> Create(
+        std::string name, const std::shared_ptr<GfxPipeline>& pipeline
+    );
+    ~InstancedDrawCommand() override = default;
+
+    // Draw only the first instances of per instance buffers. Recorded command buffers are not updated, so it takes
+    // effect on the next recording. Defaults to all instances.
+    void setDrawInstanceCount(uint32_t draw_instance_count);
+    [[nodiscard]] uint32_t draw_instance_count() const;
+
+protected:
+    friend class Gfx;
+    explicit InstancedDrawCommand(std::string name, const std::shared_ptr<GfxPipeline>& pipeline);
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+    DrawCommand::Impl* getImpl() override;
+    const DrawCommand::Impl* getImpl() const override;
+};
+
+// Draws with parameters read from an indirect buffer on GPU, e.g. written by a culling compute command, so that
+// the CPU does not touch each drawn object. Always indexed: vertex and index buffers are bound as usual, and
+// first index and vertex offset of each command are absolute in them (see DrawCommand::base_vertex).
+// Commands may draw instances of per instance vertex buffers with their first instance, which needs
+// the multi_draw_indirect feature.
+class IndirectDrawCommand : public DrawCommand {
+public:
+    static std::shared_ptr<IndirectDrawCommand> Create(
+        std::string name, const std::shared_ptr<GfxPipeline>& pipeline
+    );
+    ~IndirectDrawCommand() override = default;
+
+    // Draw up to max_draw_count commands from the start of the buffer. Needs GPU resources before
+    // Gfx::finishDrawCommand. Set 0 to draw all elements.
+    void setIndirectBuffer(
+        const std::shared_ptr<StorageBuffer<DrawIndexedIndirectCommand>>& indirect_buffer, uint32_t max_draw_count = 0
+    );
+    [[nodiscard]] const std::shared_ptr<StorageBuffer<DrawIndexedIndirectCommand>>& indirect_buffer() const {
+        return indirect_buffer_;
+    }
+    [[nodiscard]] uint32_t max_draw_count() const;
+    // The first element is the number of commands to draw if the draw_indirect_count feature is enabled.
+    // Otherwise max_draw_count commands are drawn, so unused commands must have instance count 0.
+    void setCountBuffer(const std::shared_ptr<StorageBuffer<uint32_t>>& count_buffer) { count_buffer_ = count_buffer; }
+    [[nodiscard]] const std::shared_ptr<StorageBuffer<uint32_t>>& count_buffer() const { return count_buffer_; }
+
+protected:
+    std::shared_ptr<StorageBuffer<DrawIndexedIndirectCommand>> indirect_buffer_;
+    uint32_t max_draw_count_{ 0 };
+    std::shared_ptr<StorageBuffer<uint32_t>> count_buffer_;
+
+protected:
+    friend class Gfx;
+    explicit IndirectDrawCommand(std::string name, const std::shared_ptr<GfxPipeline>& pipeline);
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+    DrawCommand::Impl* getImpl() override;
+    const DrawCommand::Impl* getImpl() const override;
 };
 
 } // namespace wg
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "common/common.h"
+#include "gfx/gfx-buffer.h"
+
+#include <cstdint>
+#include <memory>
+
+namespace wg {
+
+// Large device local vertex and index buffers shared by many meshes.
+// Vertex and index buffers placed in a pool are sub-ranges of the shared buffers, so draw commands
+// using the same pool are drawn with base vertex and first index without rebinding buffers.
+class GeometryPool : public IMovable, public std::enable_shared_from_this<GeometryPool> {
+public:
+    // Capacities are in vertices and indices. All vertices in the pool must have vertex_stride bytes.
+    static std::shared_ptr<GeometryPool> Create(
+        uint32_t vertex_stride, uint32_t vertex_capacity, uint32_t index_capacity,
+        index_types::IndexType index_type = index_types::index_32
+    );
+    ~GeometryPool() override;
+
+    [[nodiscard]] uint32_t vertex_stride() const { return vertex_stride_; }
+    [[nodiscard]] uint32_t vertex_capacity() const { return vertex_capacity_; }
+    [[nodiscard]] uint32_t index_capacity() const { return index_capacity_; }
+    [[nodiscard]] index_types::IndexType index_type() const { return index_type_; }
+    [[nodiscard]] uint32_t index_size() const { return index_type_ == index_types::index_16 ? 2U : 4U; }
+    [[nodiscard]] uint32_t used_vertex_count() const;
+    [[nodiscard]] uint32_t used_index_count() const;
+    // Number of vertex and index ranges currently allocated
+    [[nodiscard]] size_t range_count() const;
+    [[nodiscard]] bool has_gpu_resources() const;
+
+protected:
+    uint32_t vertex_stride_;
+    uint32_t vertex_capacity_;
+    uint32_t index_capacity_;
+    index_types::IndexType index_type_;
+
+protected:
+    friend class Gfx;
+    friend struct GeometryRangeResources;
+    GeometryPool(uint32_t vertex_stride, uint32_t vertex_capacity, uint32_t index_capacity, index_types::IndexType index_type);
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace wg
@@ -6,7 +6,9 @@
 
 #include <glm/gtx/hash.hpp>
 
+#include <algorithm>
 #include <cstddef>
+#include <map>
 #include <memory>
 #include <type_traits>
 #include <vector>
@@ -21,6 +23,11 @@ enum VertexAttribute {
     normal = 2,
     color = 3,
     tex_coord = 4,
+    // Columns of per instance model matrix
+    instance_model_0 = 5,
+    instance_model_1 = 6,
+    instance_model_2 = 7,
+    instance_model_3 = 8,
 };
 
 } // namespace vertex_attributes
@@ -56,6 +63,8 @@ struct VertexBufferDescription {
     gfx_formats::Format format{ gfx_formats::none };
     uint32_t stride{ 0 };
     uint32_t offset{ 0 };
+    // Advanced once per instance instead of once per vertex
+    bool per_instance{ false };
 };
 
 template <typename DescriptionType>
@@ -118,6 +127,40 @@ struct SimpleVertex {
     inline bool operator==(const SimpleVertex&) const = default;
 };
 
+// Per instance data of instanced draw commands, see InstancedDrawCommand.
+struct InstanceTransform {
+    glm::mat4 model_mat;
+
+    static std::vector<VertexBufferDescription> Descriptions() {
+        // A matrix takes one attribute per column
+        std::vector<VertexBufferDescription> descriptions;
+        for (uint32_t i = 0; i < 4; ++i) {
+            descriptions.emplace_back(
+                VertexBufferDescription{
+                    .attribute    = static_cast<vertex_attributes::VertexAttribute>(vertex_attributes::instance_model_0 + i),
+                    .format       = gfx_formats::R32G32B32A32Sfloat,
+                    .stride       = sizeof(InstanceTransform),
+                    .offset       = static_cast<uint32_t>(offsetof(InstanceTransform, model_mat) + i * sizeof(glm::vec4)),
+                    .per_instance = true
+                }
+            );
+        }
+        return descriptions;
+    }
+};
+
+// Layout of VkDrawIndexedIndirectCommand, elements of indirect buffers of IndirectDrawCommand.
+struct DrawIndexedIndirectCommand {
+    uint32_t index_count{ 0 };
+    uint32_t instance_count{ 0 };
+    uint32_t first_index{ 0 };
+    int32_t vertex_offset{ 0 };
+    uint32_t first_instance{ 0 };
+
+    inline bool operator==(const DrawIndexedIndirectCommand&) const = default;
+};
+static_assert(sizeof(DrawIndexedIndirectCommand) == 20);
+
 } // namespace wg
 
 template <>
@@ -175,6 +218,19 @@ protected:
 class GfxBufferBase : public GfxMemoryBase {
 public:
     ~GfxBufferBase() override;
+    // Byte ranges changed since the last upload, dirty_ranges()[offset] = size.
+    // Adjacent and overlapping ranges are coalesced. Only these ranges are uploaded if GPU data exists.
+    [[nodiscard]] const std::map<size_t, size_t>& dirty_ranges() const { return dirty_ranges_; }
+    void markDirty(size_t offset, size_t size);
+    void clearDirtyRanges() { dirty_ranges_.clear(); }
+    // Allow compute commands to bind the buffer as a storage buffer, e.g. to write vertices on GPU.
+    // Must be set before creating GPU resources.
+    void setStorage(bool storage) { storage_ = storage; }
+    [[nodiscard]] bool storage() const { return storage_; }
+
+protected:
+    std::map<size_t, size_t> dirty_ranges_;
+    bool storage_{ false };
 
 protected:
     friend class Gfx;
@@ -189,9 +245,17 @@ public:
     ~VertexBufferBase() override;
     [[nodiscard]] virtual std::vector<VertexBufferDescription> descriptions() const = 0;
     [[nodiscard]] size_t vertex_count() const { return vertex_count_; };
+    // Whether the buffer holds per instance attributes, where vertex_count() is the number of instances
+    [[nodiscard]] bool per_instance() const {
+        auto descriptions = this->descriptions();
+        return !descriptions.empty() && descriptions.front().per_instance;
+    }
+    // Number of GPU copies of a streaming vertex buffer, 0 for other vertex buffers
+    [[nodiscard]] uint32_t streaming_copy_count() const { return streaming_copy_count_; }
 
 protected:
     size_t vertex_count_{ 0 };
+    uint32_t streaming_copy_count_{ 0 };
 
 protected:
     explicit VertexBufferBase(bool keep_cpu_data);
@@ -210,6 +274,17 @@ public:
         vertices_ = std::move(vertices);
         has_cpu_data_ = true;
         has_gpu_data_ = false;
+        clearDirtyRanges();
+    }
+    // Overwrite vertices starting at first_vertex and mark them dirty. The vertex count cannot change,
+    // and CPU data must be available (create with keep_cpu_data to update after upload).
+    bool setVertexRange(size_t first_vertex, const std::vector<VertexType>& vertices) {
+        if (!has_cpu_data_ || first_vertex + vertices.size() > vertices_.size()) {
+            return false;
+        }
+        std::copy(vertices.begin(), vertices.end(), vertices_.begin() + static_cast<std::ptrdiff_t>(first_vertex));
+        markDirty(first_vertex * sizeof(VertexType), vertices.size() * sizeof(VertexType));
+        return true;
     }
     [[nodiscard]] std::vector<VertexBufferDescription> descriptions() const override {
         return VertexType::Descriptions();
@@ -233,6 +308,31 @@ protected:
     }
 };
 
+// Vertex buffer rewritten by CPU every frame, e.g. for CPU animated geometry.
+// GPU resources are host visible copies written directly without staging. Each swapchain image draws
+// with its own copy, which is updated in Gfx::render after the image's previous frame has finished,
+// so writing never waits for the GPU to read other frames. CPU data is always kept.
+template <typename VertexType, typename = std::enable_if_t<is_vertex_v<VertexType>>>
+class StreamingVertexBuffer : public VertexBuffer<VertexType> {
+public:
+    static constexpr uint32_t DefaultCopyCount = 3;
+
+    // copy_count should be at least the number of swapchain images of render targets drawing it.
+    static std::shared_ptr<StreamingVertexBuffer>
+    CreateFromVertexArray(std::vector<VertexType> vertices, uint32_t copy_count = DefaultCopyCount) {
+        auto vertex_buffer = std::shared_ptr<StreamingVertexBuffer<VertexType>>(new StreamingVertexBuffer<VertexType>(copy_count));
+        vertex_buffer->setVertexArray(std::move(vertices));
+        return vertex_buffer;
+    }
+    ~StreamingVertexBuffer() override = default;
+
+protected:
+    friend class Gfx;
+    explicit StreamingVertexBuffer(uint32_t copy_count) : VertexBuffer<VertexType>(true) {
+        this->streaming_copy_count_ = std::max(copy_count, 1U);
+    }
+};
+
 class IndexBuffer : public GfxBufferBase {
 public:
     template <typename IndexType, typename = std::enable_if_t<std::is_integral_v<IndexType>>>
@@ -242,51 +342,77 @@ public:
         index_buffer->setIndexArray(indices);
         return index_buffer;
     }
+    // Adopt indices without copying if their width matches index_type.
+    static std::shared_ptr<IndexBuffer>
+    CreateFromIndexArray(index_types::IndexType index_type, std::vector<uint16_t>&& indices, bool keep_cpu_data = false);
+    static std::shared_ptr<IndexBuffer>
+    CreateFromIndexArray(index_types::IndexType index_type, std::vector<uint32_t>&& indices, bool keep_cpu_data = false);
 
     template <typename IndexType, typename = std::enable_if_t<std::is_integral_v<IndexType>>>
     void setIndexArray(const std::vector<IndexType>& indices) {
-        index_count_ = indices.size();
-        indices_.clear();
-
-        if (index_type_ == index_types::index_16) {
-            size_t array_size = (indices.size() + 1U) / 2U;
-            indices_.resize(array_size);
-            uint32_t mask = 0xffff;
-            const uint8_t shift[] = { 0, 16 };
-            for (size_t i = 0; i < indices.size(); ++i) {
-                indices_[i / 2] &= ~mask;
-                indices_[i / 2] |= (static_cast<uint16_t>(indices[i] & 0xffff) << shift[i % 2]);
-                mask = ~mask;
-            }
-        } else {
-            size_t array_size = indices.size();
-            indices_.resize(array_size);
-            for (size_t i = 0; i < indices.size(); ++i) {
-                indices_[i] = static_cast<uint32_t>(indices[i]);
-            }
+        beginSetIndices(indices.size());
+        writeIndices(0, indices);
+    }
+    // Overwrite indices starting at first_index and mark them dirty. The index count cannot change,
+    // and CPU data must be available (create with keep_cpu_data to update after upload).
+    template <typename IndexType, typename = std::enable_if_t<std::is_integral_v<IndexType>>>
+    bool setIndexRange(size_t first_index, const std::vector<IndexType>& indices) {
+        if (!has_cpu_data_ || first_index + indices.size() > index_count_) {
+            return false;
         }
-
-        has_cpu_data_ = true;
-        has_gpu_data_ = false;
+        writeIndices(first_index, indices);
+        markDirty(first_index * index_size(), indices.size() * index_size());
+        return true;
     }
+    // Adopt indices without copying if their width matches index_type, otherwise convert them.
+    void setIndexArray(std::vector<uint16_t>&& indices);
+    void setIndexArray(std::vector<uint32_t>&& indices);
 
     ~IndexBuffer() override;
-    [[nodiscard]] size_t data_size() const override { return indices_.size() * sizeof(uint32_t); }
-    [[nodiscard]] const void* data() const override { return indices_.data(); };
+    [[nodiscard]] size_t data_size() const override;
+    [[nodiscard]] const void* data() const override;
     [[nodiscard]] index_types::IndexType index_type() const { return index_type_; }
     [[nodiscard]] size_t index_count() const { return index_count_; }
+    [[nodiscard]] size_t index_size() const { return index_type_ == index_types::index_16 ? sizeof(uint16_t) : sizeof(uint32_t); }
+
+    // Truncate 32-bit indices to 16 bits, vectorized where available.
+    static void NarrowIndices(const uint32_t* src, size_t count, uint16_t* dst);
 
 protected:
     index_types::IndexType index_type_;
-    std::vector<uint32_t> indices_;
+    // Only the array matching index_type_ is used
+    std::vector<uint16_t> indices_16_;
+    std::vector<uint32_t> indices_32_;
     size_t index_count_{ 0 };
 
 protected:
     friend class Gfx;
     explicit IndexBuffer(index_types::IndexType index_type, bool keep_cpu_data);
+    // Resize the array of index_type_ to count and release the other one.
+    void beginSetIndices(size_t count);
+    // Convert and write indices to the array of index_type_ starting at first_index.
+    void writeIndices(size_t first_index, const uint16_t* indices, size_t count);
+    void writeIndices(size_t first_index, const uint32_t* indices, size_t count);
+    template <typename IndexType>
+    void writeIndices(size_t first_index, const std::vector<IndexType>& indices) {
+        if constexpr (sizeof(IndexType) == sizeof(uint16_t) || sizeof(IndexType) == sizeof(uint32_t)) {
+            using SourceType = std::conditional_t<sizeof(IndexType) == sizeof(uint16_t), uint16_t, uint32_t>;
+            writeIndices(first_index, reinterpret_cast<const SourceType*>(indices.data()), indices.size());
+        } else if (index_type_ == index_types::index_16) {
+            for (size_t i = 0; i < indices.size(); ++i) {
+                indices_16_[first_index + i] = static_cast<uint16_t>(indices[i]);
+            }
+        } else {
+            for (size_t i = 0; i < indices.size(); ++i) {
+                indices_32_[first_index + i] = static_cast<uint32_t>(indices[i]);
+            }
+        }
+    }
     void clearCpuData() override {
-        std::vector<uint32_t> empty_indices;
-        std::swap(indices_, empty_indices);
+        std::vector<uint16_t> empty_indices_16;
+        std::swap(indices_16_, empty_indices_16);
+        std::vector<uint32_t> empty_indices_32;
+        std::swap(indices_32_, empty_indices_32);
         has_cpu_data_ = false;
         if (!has_gpu_data_) {
             index_count_ = 0;
@@ -294,6 +420,77 @@ protected:
     }
 };
 
+// Array of elements read and written by compute commands. Always usable as a storage buffer,
+// and as an indirect buffer of IndirectDrawCommand.
+class StorageBufferBase : public GfxBufferBase {
+public:
+    ~StorageBufferBase() override;
+    [[nodiscard]] size_t element_count() const { return element_count_; }
+    // Host visible storage buffers can be read back by Gfx::readStorageBuffer.
+    [[nodiscard]] bool host_visible() const { return host_visible_; }
+
+protected:
+    size_t element_count_{ 0 };
+    bool host_visible_;
+
+protected:
+    friend class Gfx;
+    StorageBufferBase(bool host_visible, bool keep_cpu_data);
+    // Resize CPU data to hold GPU data of element_count_ elements, and return it for writing.
+    virtual void* beginReadBack() = 0;
+};
+
+template <typename ElementType, typename = std::enable_if_t<std::is_trivially_copyable_v<ElementType>>>
+class StorageBuffer : public StorageBufferBase, public std::enable_shared_from_this<StorageBuffer<ElementType>> {
+public:
+    static std::shared_ptr<StorageBuffer>
+    CreateFromArray(std::vector<ElementType> elements, bool host_visible = false, bool keep_cpu_data = false) {
+        auto storage_buffer = std::shared_ptr<StorageBuffer<ElementType>>(new StorageBuffer<ElementType>(host_visible, keep_cpu_data));
+        storage_buffer->setArray(std::move(elements));
+        return storage_buffer;
+    }
+    // Elements are value initialized, e.g. for buffers written by compute commands only.
+    static std::shared_ptr<StorageBuffer> Create(size_t element_count, bool host_visible = false, bool keep_cpu_data = false) {
+        return CreateFromArray(std::vector<ElementType>(element_count), host_visible, keep_cpu_data);
+    }
+    void setArray(std::vector<ElementType> elements) {
+        element_count_ = elements.size();
+        elements_ = std::move(elements);
+        has_cpu_data_ = true;
+        has_gpu_data_ = false;
+        clearDirtyRanges();
+    }
+    // Overwrite elements starting at first_element and mark them dirty. The element count cannot change.
+    bool setRange(size_t first_element, const std::vector<ElementType>& elements) {
+        if (!has_cpu_data_ || first_element + elements.size() > elements_.size()) {
+            return false;
+        }
+        std::copy(elements.begin(), elements.end(), elements_.begin() + static_cast<std::ptrdiff_t>(first_element));
+        markDirty(first_element * sizeof(ElementType), elements.size() * sizeof(ElementType));
+        return true;
+    }
+    [[nodiscard]] const std::vector<ElementType>& elements() const { return elements_; }
+    [[nodiscard]] size_t data_size() const override { return elements_.size() * sizeof(ElementType); }
+    [[nodiscard]] const void* data() const override { return elements_.data(); }
+
+protected:
+    std::vector<ElementType> elements_;
+
+protected:
+    friend class Gfx;
+    StorageBuffer(bool host_visible, bool keep_cpu_data) : StorageBufferBase(host_visible, keep_cpu_data) {}
+    void* beginReadBack() override {
+        elements_.resize(element_count_);
+        has_cpu_data_ = true;
+        return elements_.data();
+    }
+    void clearCpuData() override {
+        std::vector<ElementType> empty_elements;
+        std::swap(elements_, empty_elements);
+        has_cpu_data_ = false;
+    }
+};
+
 struct UniformObjectDescription {
     uniform_attributes::UniformAttribute attribute{ uniform_attributes::none };
 };
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "common/common.h"
+#include "common/math.h"
+#include "gfx/gfx-buffer.h"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace wg {
+
+// Axis aligned box, empty if min is greater than max.
+struct BoundingBox {
+    glm::vec3 min{ std::numeric_limits<float>::max() };
+    glm::vec3 max{ std::numeric_limits<float>::lowest() };
+
+    // Box enclosing the sphere (center, radius)
+    static BoundingBox FromSphere(const glm::vec4& sphere) {
+        return { glm::vec3(sphere) - sphere.w, glm::vec3(sphere) + sphere.w };
+    }
+
+    [[nodiscard]] bool empty() const { return glm::any(glm::greaterThan(min, max)); }
+    [[nodiscard]] glm::vec3 center() const { return (min + max) * 0.5f; }
+    // 0 if empty
+    [[nodiscard]] float surface_area() const;
+    [[nodiscard]] bool overlaps(const BoundingBox& box) const {
+        return glm::all(glm::lessThanEqual(min, box.max)) && glm::all(glm::lessThanEqual(box.min, max));
+    }
+    // Squared distance from the point to the box, 0 if inside
+    [[nodiscard]] float distance_squared(const glm::vec3& point) const {
+        auto offset = glm::max(glm::max(min - point, point - max), glm::vec3(0.f));
+        return glm::dot(offset, offset);
+    }
+    void merge(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+    void merge(const BoundingBox& box) {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+    bool operator==(const BoundingBox& box) const = default;
+};
+
+// Planes (normal, distance) bounding the view volume, with normals pointing inside and normalized.
+// Ordered left, right, bottom, top, near, far.
+struct Frustum {
+    std::array<glm::vec4, 6> planes;
+
+    // Projection with depth from 0 to 1, as created by glm::perspective in this engine.
+    static Frustum FromViewProjection(const glm::mat4& view_projection);
+    static Frustum FromCameraUniform(const CameraUniform& camera_uniform);
+
+    // Whether the sphere (center, radius) is at least partly inside.
+    [[nodiscard]] bool intersectsSphere(const glm::vec4& sphere) const;
+    // Whether the box is at least partly inside. Conservative: boxes outside near corners of the frustum may pass.
+    [[nodiscard]] bool intersectsBox(const BoundingBox& box) const;
+    // Whether the box is completely inside.
+    [[nodiscard]] bool containsBox(const BoundingBox& box) const;
+};
+
+// Bounding spheres in structure of arrays layout, so that SIMD lanes test consecutive spheres.
+struct BoundingSpheres {
+    std::vector<float> center_x;
+    std::vector<float> center_y;
+    std::vector<float> center_z;
+    std::vector<float> radius;
+
+    [[nodiscard]] size_t size() const { return radius.size(); }
+    void resize(size_t size);
+    void set(size_t index, const glm::vec4& sphere);
+    [[nodiscard]] glm::vec4 get(size_t index) const;
+};
+
+// Sphere enclosing the sphere (center, radius) transformed by transform, with radius scaled by the largest axis scale.
+[[nodiscard]] glm::vec4 TransformBoundingSphere(const glm::vec4& sphere, const glm::mat4& transform);
+
+// Set out_visible[i] to 1 if spheres i is at least partly inside the frustum, or 0 otherwise, and return the number
+// of visible spheres. Tests 8 spheres at a time with AVX2 or 4 with SSE2 if enabled at compile time.
+size_t CullSpheres(const Frustum& frustum, const BoundingSpheres& spheres, std::vector<uint8_t>& out_visible);
+
+// Object culled by shader/static/frustum-cull.comp, in a storage buffer of std430 layout.
+struct GpuCullObject {
+    // World space center and radius
+    glm::vec4 bounding_sphere{ 0.f };
+    // Written to the indirect buffer if visible
+    DrawIndexedIndirectCommand draw;
+    uint32_t padding[3]{};
+};
+static_assert(sizeof(GpuCullObject) == 48);
+
+// Push constants of shader/static/frustum-cull.comp.
+struct GpuCullParameters {
+    std::array<glm::vec4, 6> planes;
+    uint32_t object_count{ 0 };
+    // Non-zero to write visible commands packed at the start of the indirect buffer, for draws with count buffer.
+    // Otherwise commands are written at object indices, with instance count 0 if culled.
+    uint32_t compact{ 0 };
+    uint32_t padding[2]{};
+
+    static constexpr uint32_t GroupSize = 64;
+    [[nodiscard]] uint32_t group_count() const { return (object_count + GroupSize - 1) / GroupSize; }
+};
+
+// What shader/static/frustum-cull.comp writes to the indirect buffer (out_commands) and count buffer (returned),
+// e.g. to check GPU results.
+uint32_t CullObjects(
+    const GpuCullParameters& parameters, const std::vector<GpuCullObject>& objects,
+    std::vector<DrawIndexedIndirectCommand>& out_commands
+);
+
+} // namespace wg
@@ -78,6 +78,24 @@ protected:
     friend class Gfx;
 };
 
+struct StorageBufferDescription {
+    uint32_t binding;
+    shader_stages::ShaderStages stages;
+};
+
+class GfxStorageBufferLayout {
+public:
+    GfxStorageBufferLayout& addDescription(StorageBufferDescription description);
+    void clearDescriptions();
+    [[nodiscard]] const std::vector<StorageBufferDescription>& descriptions() const { return descriptions_; }
+
+protected:
+    std::vector<StorageBufferDescription> descriptions_;
+
+protected:
+    friend class Gfx;
+};
+
 class GfxPipeline : public std::enable_shared_from_this<GfxPipeline> {
 public:
     static std::shared_ptr<GfxPipeline> Create();
@@ -89,6 +107,7 @@ public:
     [[nodiscard]] const GfxUniformLayout& uniform_layout() const { return uniform_layout_; }
     [[nodiscard]] const GfxSamplerLayout& sampler_layout() const { return sampler_layout_; }
     [[nodiscard]] const std::vector<std::shared_ptr<Shader>>& shaders() const { return shaders_; }
+    [[nodiscard]] const std::shared_ptr<GfxPipeline>& fallback_pipeline() const { return fallback_pipeline_; }
 
     void setVertexFactory(GfxVertexFactory vertex_factory) { vertex_factory_ = std::move(vertex_factory); }
     void setPipelineState(GfxPipelineState pipeline_state) { pipeline_state_ = pipeline_state; }
@@ -96,6 +115,10 @@ public:
     void setSamplerLayout(GfxSamplerLayout sampler_layout) { sampler_layout_ = std::move(sampler_layout); }
     void addShader(const std::shared_ptr<Shader>& shader) { shaders_.push_back(shader); }
     void clearShaders() { shaders_.clear(); }
+    // Drawn instead of this pipeline while it is compiled in background. It is created with the pipeline layout of
+    // this pipeline, so its shaders may only use uniforms and samplers of this pipeline. Without a fallback pipeline,
+    // draw commands are skipped until this pipeline is ready. Needs its own pipeline resources.
+    void setFallbackPipeline(const std::shared_ptr<GfxPipeline>& fallback_pipeline) { fallback_pipeline_ = fallback_pipeline; }
 
 protected:
     GfxVertexFactory vertex_factory_;
@@ -103,6 +126,7 @@ protected:
     GfxUniformLayout uniform_layout_;
     GfxSamplerLayout sampler_layout_;
     std::vector<std::shared_ptr<Shader>> shaders_;
+    std::shared_ptr<GfxPipeline> fallback_pipeline_;
 
 protected:
     friend class Gfx;
@@ -112,4 +136,36 @@ protected:
     std::unique_ptr<Impl> impl_;
 };
 
+// Pipeline of a single compute shader. Descriptors are storage buffers and samplers, and small
+// per dispatch parameters are given as push constants.
+class ComputePipeline : public std::enable_shared_from_this<ComputePipeline> {
+public:
+    static std::shared_ptr<ComputePipeline> Create();
+    ~ComputePipeline() = default;
+
+public:
+    [[nodiscard]] const std::shared_ptr<Shader>& shader() const { return shader_; }
+    [[nodiscard]] const GfxStorageBufferLayout& storage_buffer_layout() const { return storage_buffer_layout_; }
+    [[nodiscard]] const GfxSamplerLayout& sampler_layout() const { return sampler_layout_; }
+    [[nodiscard]] uint32_t push_constant_size() const { return push_constant_size_; }
+
+    void setShader(const std::shared_ptr<Shader>& shader) { shader_ = shader; }
+    void setStorageBufferLayout(GfxStorageBufferLayout storage_buffer_layout) { storage_buffer_layout_ = std::move(storage_buffer_layout); }
+    void setSamplerLayout(GfxSamplerLayout sampler_layout) { sampler_layout_ = std::move(sampler_layout); }
+    void setPushConstantSize(uint32_t push_constant_size) { push_constant_size_ = push_constant_size; }
+
+protected:
+    std::shared_ptr<Shader> shader_;
+    GfxStorageBufferLayout storage_buffer_layout_;
+    GfxSamplerLayout sampler_layout_;
+    uint32_t push_constant_size_{ 0 };
+
+protected:
+    friend class Gfx;
+    friend class ComputeCommand;
+    ComputePipeline();
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
 } // namespace wg
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common/common.h"
+#include "gfx/gfx-buffer.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace wg {
+
+// Identifies a submitted upload batch. Rendering waits for it on the GPU, and CPU can poll or wait for it.
+class UploadToken {
+public:
+    UploadToken() = default;
+    [[nodiscard]] bool valid() const { return submission_index_ > 0; }
+    [[nodiscard]] uint64_t submission_index() const { return submission_index_; }
+
+protected:
+    friend class Gfx;
+    explicit UploadToken(uint64_t submission_index) : submission_index_(submission_index) {}
+    uint64_t submission_index_{ 0 };
+};
+
+// Buffer copies recorded into a single transfer command buffer when submitted.
+class UploadBatch : public IMovable {
+public:
+    static std::shared_ptr<UploadBatch> Create();
+    ~UploadBatch() override = default;
+
+    void addBuffer(const std::shared_ptr<GfxBufferBase>& gfx_buffer);
+    void addReferenceBuffer(
+        const std::shared_ptr<GfxBufferBase>& cpu_buffer,
+        const std::shared_ptr<GfxBufferBase>& gpu_buffer
+    );
+    [[nodiscard]] bool empty() const { return buffers_.empty(); }
+    [[nodiscard]] size_t size() const { return buffers_.size(); }
+
+protected:
+    friend class Gfx;
+    // buffers_[] = <cpu_buffer, gpu_buffer>
+    std::vector<std::pair<std::shared_ptr<GfxBufferBase>, std::shared_ptr<GfxBufferBase>>> buffers_;
+
+protected:
+    UploadBatch() = default;
+};
+
+} // namespace wg
@@ -7,10 +7,15 @@
 #include "gfx/shader.h"
 #include "gfx/render-target.h"
 #include "gfx/gfx-pipeline.h"
+#include "gfx/compute-command.h"
+#include "gfx/gfx-culling.h"
 #include "gfx/renderer.h"
 #include "gfx/gfx-buffer.h"
+#include "gfx/gfx-upload.h"
+#include "gfx/geometry-pool.h"
 #include "gfx/image.h"
 
+#include <array>
 #include <map>
 #include <memory>
 #include <string>
@@ -32,6 +37,12 @@ enum FeatureId {
     sampler_mirror_clamp_to_edge,
     msaa,
     sample_shading,
+    memory_budget,
+    compute,
+    // Draw count and first instance of indirect draws
+    multi_draw_indirect,
+    // Draw count of indirect draws read from a buffer
+    draw_indirect_count,
     // Engine controlled features
     _must_enable_if_valid, NUM_FEATURES = _must_enable_if_valid,
     _debug_utils,
@@ -42,9 +53,67 @@ extern const char* const FEATURE_NAMES[NUM_FEATURES_TOTAL];
 
 } // namespace gfx_features
 
+namespace gfx_memory_categories {
+
+enum MemoryCategory {
+    buffer,
+    image,
+    // Attachments and per render target buffers
+    render_target,
+    NUM_MEMORY_CATEGORIES
+};
+
+extern const char* const MEMORY_CATEGORY_NAMES[NUM_MEMORY_CATEGORIES];
+
+} // namespace gfx_memory_categories
+
 struct GfxSetup {
     float max_sampler_anisotropy = 0.f;
     int msaa_samples = 1;
+    int staging_buffer_size_mb = 32;
+    // Images are evicted when a heap would exceed this percentage of its budget
+    int memory_budget_percent = 90;
+    // Threads recording command buffers of a render target (including the calling thread).
+    // With more than one thread, each thread records secondary command buffers for a slice of draw commands.
+    int recording_thread_count = 1;
+    // Record draw commands sorted by layer, state and depth instead of in renderer order
+    bool sort_draw_commands = true;
+    // Pipeline cache data is loaded from this file when creating logical device and saved on destruction.
+    // Empty to disable. Relative paths in the config are resolved against the user cache directory of the engine,
+    // e.g. ~/.cache/WEngine on Linux or %LOCALAPPDATA%/WEngine on Windows.
+    std::string pipeline_cache_path;
+    // Threads compiling graphics pipelines in background. With 0, pipelines are compiled when draw commands are
+    // submitted, blocking the calling thread.
+    int pipeline_compile_thread_count = 0;
+};
+
+struct GfxMemoryHeapStatistics {
+    uint32_t heap_index = 0;
+    uint64_t heap_size = 0;
+    bool device_local = false;
+    // Number of device memory objects allocated from this heap
+    uint32_t block_count = 0;
+    uint32_t dedicated_allocation_count = 0;
+    // Number of live allocations (sub-allocations and dedicated allocations)
+    uint32_t allocation_count = 0;
+    // Bytes allocated from the device
+    uint64_t allocated_bytes = 0;
+    // Bytes used by live allocations
+    uint64_t used_bytes = 0;
+    // Bytes used by live allocations of each memory category
+    std::array<uint64_t, gfx_memory_categories::NUM_MEMORY_CATEGORIES> category_used_bytes{};
+    // Budget and usage of the process reported by VK_EXT_memory_budget,
+    // or heap size and allocated_bytes if the extension is not available
+    uint64_t budget_bytes = 0;
+    uint64_t usage_bytes = 0;
+    // Images are evicted before used_bytes exceeds this
+    uint64_t budget_limit_bytes = 0;
+};
+
+struct GfxMemoryEvictionStatistics {
+    uint32_t evicted_image_count = 0;
+    uint32_t restored_image_count = 0;
+    uint64_t evicted_bytes = 0;
 };
 
 class GfxFeaturesManager {
@@ -104,6 +173,23 @@ protected:
     );
 };
 
+struct GfxPipelineCacheStatistics {
+    // Live pipelines and render passes in the cache
+    uint32_t pipeline_count = 0;
+    uint32_t render_pass_count = 0;
+    // Objects created on cache misses, and requests served by existing objects
+    uint32_t pipelines_created = 0;
+    uint32_t pipeline_cache_hits = 0;
+    uint32_t render_passes_created = 0;
+    uint32_t render_pass_cache_hits = 0;
+    // Pipelines being compiled in background
+    uint32_t pending_pipeline_count = 0;
+    // CPU time creating pipelines on cache misses, summed over compile threads
+    uint64_t pipeline_compile_microseconds = 0;
+    // Valid pipeline cache data loaded from pipeline cache file
+    uint64_t loaded_bytes = 0;
+};
+
 class Gfx : public std::enable_shared_from_this<Gfx> {
 public:
     static std::shared_ptr<Gfx> Create(const std::shared_ptr<App>& app);
@@ -114,6 +200,12 @@ public:
     [[nodiscard]] const GfxSetup& setup() const { return setup_; }
 
     void loadGlobalSetupFromConfig();
+    void setRecordingThreadCount(int recording_thread_count);
+    void setSortDrawCommands(bool sort_draw_commands);
+    // Takes effect on next createLogicalDevice.
+    void setPipelineCachePath(std::string pipeline_cache_path);
+    // Waits for pipelines being compiled if the thread count changes.
+    void setPipelineCompileThreadCount(int pipeline_compile_thread_count);
 
     // Surface
     void createWindowSurface(const std::shared_ptr<Window>& window);
@@ -134,6 +226,10 @@ public:
     // Logical device
     void createLogicalDevice();
     void waitDeviceIdle();
+    [[nodiscard]] std::vector<GfxMemoryHeapStatistics> memoryStatistics() const;
+    [[nodiscard]] GfxMemoryEvictionStatistics memoryEvictionStatistics() const;
+    // Heap and eviction statistics as a JSON object, e.g. for dashboards
+    [[nodiscard]] std::string memoryStatisticsJson() const;
 
     // Shader
     void createShaderResources(const std::shared_ptr<Shader>& shader);
@@ -142,6 +238,30 @@ public:
     void createPipelineResources(
         const std::shared_ptr<GfxPipeline>& pipeline
     );
+    // Draw commands and render targets with identical pipeline state share one pipeline.
+    [[nodiscard]] GfxPipelineCacheStatistics pipelineCacheStatistics() const;
+    // Save pipeline cache data to GfxSetup::pipeline_cache_path. Also done on destruction.
+    bool savePipelineCache();
+    // Start compiling pipelines of the draw commands for the render target, so that they are ready when draw commands
+    // of the same pipeline and vertex layout are submitted. Draw commands must be finished.
+    // The pipelines are kept until the render target resources are destroyed.
+    void prewarmPipelines(
+        const std::shared_ptr<RenderTarget>& render_target, const std::vector<std::shared_ptr<DrawCommand>>& draw_commands
+    );
+    // Wait until all pipelines compiled in background are ready. They are used by render targets from the next frame.
+    void waitPipelineCompilation();
+
+    // ComputePipeline
+    void createComputePipelineResources(const std::shared_ptr<ComputePipeline>& pipeline);
+
+    // ComputeCommand
+    // Write descriptors of the compute command. Call again after its storage buffers or samplers change.
+    void finishComputeCommand(const std::shared_ptr<ComputeCommand>& compute_command);
+    // Record dispatches into one command buffer of the compute queue and submit without waiting.
+    // Dispatches start after graphics submissions made so far and run in order. Rendering waits for them on GPU.
+    ComputeToken submitComputeCommands(const std::vector<std::shared_ptr<ComputeCommand>>& compute_commands);
+    [[nodiscard]] bool computeFinished(const ComputeToken& token);
+    void waitCompute(const ComputeToken& token);
 
     // DrawCommand
     void finishDrawCommand(const std::shared_ptr<DrawCommand>& draw_command);
@@ -174,15 +294,43 @@ public:
     void render(const std::shared_ptr<RenderTarget>& render_target);
 
     // Buffer
-    void createVertexBufferResources(const std::shared_ptr<VertexBufferBase>& vertex_buffer);
-    void createIndexBufferResources(const std::shared_ptr<IndexBuffer>& index_buffer);
+    // If upload_batch is given, data is added to the batch instead of being committed immediately.
+    void createVertexBufferResources(
+        const std::shared_ptr<VertexBufferBase>& vertex_buffer, const std::shared_ptr<UploadBatch>& upload_batch = {}
+    );
+    void createIndexBufferResources(
+        const std::shared_ptr<IndexBuffer>& index_buffer, const std::shared_ptr<UploadBatch>& upload_batch = {}
+    );
+    // Place buffer data in a range of the geometry pool, which must have GPU resources.
+    void createVertexBufferResources(
+        const std::shared_ptr<VertexBufferBase>& vertex_buffer, const std::shared_ptr<GeometryPool>& geometry_pool,
+        const std::shared_ptr<UploadBatch>& upload_batch = {}
+    );
+    void createIndexBufferResources(
+        const std::shared_ptr<IndexBuffer>& index_buffer, const std::shared_ptr<GeometryPool>& geometry_pool,
+        const std::shared_ptr<UploadBatch>& upload_batch = {}
+    );
     void createUniformBufferResources(const std::shared_ptr<UniformBufferBase>& uniform_buffer);
+    void createStorageBufferResources(
+        const std::shared_ptr<StorageBufferBase>& storage_buffer, const std::shared_ptr<UploadBatch>& upload_batch = {}
+    );
+    // Copy GPU data of a host visible storage buffer to its CPU data, e.g. after waitCompute.
+    bool readStorageBuffer(const std::shared_ptr<StorageBufferBase>& storage_buffer);
     void commitBuffer(const std::shared_ptr<GfxBufferBase>& gfx_buffer, bool hint_use_stage_buffer = false);
     void commitReferenceBuffer(
         const std::shared_ptr<GfxBufferBase>& cpu_buffer,
         const std::shared_ptr<GfxBufferBase>& gpu_buffer, bool hint_use_stage_buffer = false
     );
 
+    // GeometryPool
+    void createGeometryPoolResources(const std::shared_ptr<GeometryPool>& geometry_pool);
+
+    // Upload
+    // Record copies of all buffers in the batch into one transfer submission. Rendering waits for it on GPU.
+    UploadToken submitUploadBatch(const std::shared_ptr<UploadBatch>& upload_batch);
+    [[nodiscard]] bool uploadFinished(const UploadToken& token);
+    void waitUpload(const UploadToken& token);
+
     // Image
     void createImageResources(const std::shared_ptr<Image>& image);
     void commitImage(const std::shared_ptr<Image>& image);
@@ -191,6 +339,13 @@ public:
         const std::shared_ptr<Image>& gpu_image
     );
 
+    // Release GPU resources of an image not used by any render target. Returns whether the image is evicted.
+    // Evicted images are restored when used again, reloading from file if CPU data is not kept.
+    bool evictImage(const std::shared_ptr<Image>& image);
+    void restoreImage(const std::shared_ptr<Image>& image);
+    // Evict least recently used images until all heaps are under budget. Returns number of images evicted.
+    size_t enforceMemoryBudget();
+
     // Sampler
     void createSamplerResources(const std::shared_ptr<Sampler>& image);
 
@@ -10,6 +10,57 @@
 
 namespace wg {
 
+namespace recording_modes {
+
+enum RecordingMode {
+    // Command buffers of all swapchain images are recorded by Gfx::submitDrawCommands and reused every frame.
+    per_image,
+    // A command buffer of the frame in flight is recorded by Gfx::render from visible draw commands every frame.
+    per_frame
+};
+
+} // namespace recording_modes
+
+struct RenderTargetBindStatistics {
+    // State bound by recorded draw commands of one image, and binds skipped because the state was already bound
+    uint32_t pipeline_binds = 0;
+    uint32_t pipeline_binds_skipped = 0;
+    uint32_t descriptor_set_binds = 0;
+    uint32_t descriptor_set_binds_skipped = 0;
+    uint32_t push_constant_updates = 0;
+    uint32_t push_constant_updates_skipped = 0;
+    // Vertex and index buffers of a draw command count as one bind
+    uint32_t buffer_binds = 0;
+    uint32_t buffer_binds_skipped = 0;
+
+    RenderTargetBindStatistics& operator+=(const RenderTargetBindStatistics& other);
+    [[nodiscard]] uint32_t binds_skipped() const {
+        return pipeline_binds_skipped + descriptor_set_binds_skipped + push_constant_updates_skipped + buffer_binds_skipped;
+    }
+};
+
+struct RenderTargetFrameStatistics {
+    // Dirty uniforms copied into mapped memory for the last rendered frame
+    uint32_t uniform_copy_count = 0;
+    uint64_t uniform_bytes = 0;
+    // CPU data of streaming vertex buffers written to the copies of the last rendered frame
+    uint64_t streaming_vertex_bytes = 0;
+    // Draw commands recorded for the last rendered frame and CPU time recording them, in per frame recording mode only
+    uint32_t recorded_draw_command_count = 0;
+    uint64_t record_microseconds = 0;
+    RenderTargetBindStatistics bind_statistics;
+};
+
+struct RenderTargetRecordStatistics {
+    // Threads and secondary command buffers used by the last submitDrawCommands, no secondary command buffers
+    // if draw commands were recorded into the primary command buffers directly
+    uint32_t thread_count = 1;
+    uint32_t secondary_command_buffer_count = 0;
+    // CPU time recording command buffers of all images
+    uint64_t record_microseconds = 0;
+    RenderTargetBindStatistics bind_statistics;
+};
+
 class RenderTarget : public std::enable_shared_from_this<RenderTarget> {
 public:
     virtual ~RenderTarget() = default;
@@ -24,10 +75,18 @@ public:
     virtual void finishImage(class Gfx& gfx, int image_index) = 0;
     [[nodiscard]] std::shared_ptr<Renderer> renderer() const { return renderer_; }
     void setRenderer(const std::shared_ptr<Renderer>& renderer) { renderer_ = renderer; }
+    [[nodiscard]] recording_modes::RecordingMode recording_mode() const { return recording_mode_; }
+    // Call Gfx::submitDrawCommands after switching back to per image recording.
+    void setRecordingMode(recording_modes::RecordingMode recording_mode) { recording_mode_ = recording_mode; }
+    [[nodiscard]] const RenderTargetFrameStatistics& frame_statistics() const { return frame_statistics_; }
+    [[nodiscard]] const RenderTargetRecordStatistics& record_statistics() const { return record_statistics_; }
 
 protected:
     std::string name_;
     std::shared_ptr<Renderer> renderer_;
+    recording_modes::RecordingMode recording_mode_{ recording_modes::per_image };
+    RenderTargetFrameStatistics frame_statistics_;
+    RenderTargetRecordStatistics record_statistics_;
 
 protected:
     friend class Gfx;
@@ -26,6 +26,13 @@ public:
     void markUniformDirty(
         const std::shared_ptr<DrawCommand>& draw_command, uniform_attributes::UniformAttribute attribute
     );
+    // Hidden draw commands keep their resources but are not recorded. Takes effect at the next frame of render
+    // targets recording per frame, otherwise at the next Gfx::submitDrawCommands.
+    void setDrawCommandVisible(size_t draw_command_index, bool visible);
+    void setDrawCommandVisible(const std::shared_ptr<DrawCommand>& draw_command, bool visible);
+    [[nodiscard]] bool draw_command_visible(size_t draw_command_index) const {
+        return draw_command_index >= draw_command_hidden_.size() || !draw_command_hidden_[draw_command_index];
+    }
 
 protected:
     // CPU data of framebuffer uniforms
@@ -35,6 +42,8 @@ protected:
         int> dirty_framebuffer_uniforms_;
     std::map<std::tuple<size_t, uniform_attributes::UniformAttribute>,
         int> dirty_draw_command_uniforms_;
+    // draw_command_hidden_[draw_command_index], draw commands past the end are visible
+    std::vector<bool> draw_command_hidden_;
 
 protected:
     friend class Gfx;
@@ -54,8 +63,12 @@ public:
     void addDrawCommand(const std::shared_ptr<DrawCommand>& draw_command) {
         draw_commands_.push_back(draw_command);
     }
+    // Draw commands added, removed or reordered are drawn after the next Gfx::submitDrawCommands.
     void clearDrawCommands() {
         draw_commands_.clear();
+        // Per index state of the removed draw commands
+        draw_command_hidden_.clear();
+        dirty_draw_command_uniforms_.clear();
     }
 
     std::shared_ptr<IRenderData> createRenderData() override {
@@ -12,7 +12,8 @@ namespace shader_stages {
 enum ShaderStage {
     none = 0,
     vert = 1,
-    frag = 2
+    frag = 2,
+    comp = 4
 };
 
 using ShaderStages = uint32_t;
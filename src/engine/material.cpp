@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <utility>
 
 #include "engine/material.h"
@@ -24,6 +25,15 @@ void MaterialRenderData::createGfxResources(Gfx& gfx) {
         gfx.createShaderResources(shader);
     }
     gfx.createPipelineResources(pipeline);
+    if (instanced_pipeline) {
+        // The fragment shader is shared with pipeline
+        for (auto&& shader : instanced_pipeline->shaders()) {
+            if (std::find(pipeline->shaders().begin(), pipeline->shaders().end(), shader) == pipeline->shaders().end()) {
+                gfx.createShaderResources(shader);
+            }
+        }
+        gfx.createPipelineResources(instanced_pipeline);
+    }
 }
 
 std::shared_ptr<Material> Material::Create(
@@ -51,6 +61,18 @@ std::shared_ptr<IRenderData> Material::createRenderData() {
     render_data_->pipeline->addShader(vert_shader);
     render_data_->pipeline->addShader(frag_shader);
 
+    if (!instanced_vert_shader_filename_.empty()) {
+        auto instanced_vert_shader = Shader::Load(instanced_vert_shader_filename_, shader_stages::vert);
+
+        render_data_->instanced_pipeline = GfxPipeline::Create();
+        render_data_->instanced_pipeline->setVertexFactory(createInstancedVertexFactory());
+        render_data_->instanced_pipeline->setPipelineState(createPipelineState());
+        render_data_->instanced_pipeline->setUniformLayout(createUniformLayout());
+        render_data_->instanced_pipeline->setSamplerLayout(createSamplerLayout());
+        render_data_->instanced_pipeline->addShader(instanced_vert_shader);
+        render_data_->instanced_pipeline->addShader(frag_shader);
+    }
+
     for (auto&& texture : textures_) {
         render_data_->samplers.push_back(texture.sampler);
     }
@@ -67,6 +89,20 @@ GfxVertexFactory Material::createVertexFactory() const {
     };
 }
 
+GfxVertexFactory Material::createInstancedVertexFactory() const {
+    auto vertex_factory = createVertexFactory();
+    for (uint32_t i = 0; i < 4; ++i) {
+        vertex_factory.addDescription(
+            {
+                .attribute = static_cast<vertex_attributes::VertexAttribute>(vertex_attributes::instance_model_0 + i),
+                .format = wg::gfx_formats::R32G32B32A32Sfloat,
+                .location = 4 + i
+            }
+        );
+    }
+    return vertex_factory;
+}
+
 GfxPipelineState Material::createPipelineState() const {
     return {
         .min_sample_shading = config_.min_sample_shading
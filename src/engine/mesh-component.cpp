@@ -3,6 +3,8 @@
 #include "common/logger.h"
 #include "gfx/gfx.h"
 
+#include <algorithm>
+
 namespace {
 
 [[nodiscard]] auto& logger() {
@@ -33,9 +35,7 @@ std::shared_ptr<IRenderData> MeshComponent::createRenderData() {
     render_data_->draw_commands[0]->setPrimitiveTopology(mesh_->primitive_topology());
     for (auto&& draw_command : render_data_->draw_commands) {
         draw_command->addVertexBuffer(mesh_->render_data()->vertex_buffer);
-        if (mesh_->render_data()->index_buffer) {
-            draw_command->setIndexBuffer(mesh_->render_data()->index_buffer);
-        }
+        mesh_->render_data()->setIndexBuffer(*draw_command);
         draw_command->addUniformBuffer(render_data_->model_uniform_buffer);
         for (size_t i = 0; i < material_render_data_->pipeline->sampler_layout().descriptions().size(); ++i) {
             if (i < material_->textures().size()) {
@@ -45,9 +45,34 @@ std::shared_ptr<IRenderData> MeshComponent::createRenderData() {
             }
         }
     }
+    applyLod();
     return render_data_;
 }
 
+void MeshComponent::setLod(uint32_t lod) {
+    if (mesh_ && !mesh_->lods().empty()) {
+        lod = std::min(lod, static_cast<uint32_t>(mesh_->lods().size() - 1));
+    }
+    if (lod == lod_) {
+        return;
+    }
+    lod_ = lod;
+    if (render_data_) {
+        applyLod();
+    }
+}
+
+void MeshComponent::applyLod() {
+    // Meshes without levels of detail draw their whole index buffers
+    if (!mesh_ || mesh_->lods().size() <= 1) {
+        return;
+    }
+    auto& mesh_lod = mesh_->lods()[std::min(lod_, static_cast<uint32_t>(mesh_->lods().size() - 1))];
+    for (auto&& draw_command : render_data_->draw_commands) {
+        draw_command->setIndexRange(mesh_lod.first_index, mesh_lod.index_count);
+    }
+}
+
 ModelUniform MeshComponent::createUniformObject() {
     return { .model_mat = transform_.transform };
 }
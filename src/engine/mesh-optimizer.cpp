@@ -0,0 +1,270 @@
+#include "engine/mesh-optimizer.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+constexpr uint32_t InvalidVertex = std::numeric_limits<uint32_t>::max();
+
+// FIFO post-transform cache, keeping vertices by the time they entered it
+class VertexCache {
+public:
+    VertexCache(size_t vertex_count, size_t cache_size)
+        : stamps_(vertex_count, 0), cache_size_(cache_size), time_(cache_size + 1) {}
+
+    // Returns whether the vertex is transformed, i.e. missed by the cache
+    bool access(uint32_t vertex) {
+        if (time_ - stamps_[vertex] > cache_size_) {
+            stamps_[vertex] = time_++;
+            return true;
+        }
+        return false;
+    }
+    // Number of vertices of the triangle transformed
+    uint32_t accessTriangle(const uint32_t* triangle) {
+        return static_cast<uint32_t>(access(triangle[0])) + static_cast<uint32_t>(access(triangle[1])) +
+               static_cast<uint32_t>(access(triangle[2]));
+    }
+    void clear() { time_ += cache_size_ + 1; }
+
+protected:
+    std::vector<size_t> stamps_;
+    size_t cache_size_;
+    size_t time_;
+};
+
+} // unnamed namespace
+
+namespace wg {
+
+VertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertex_count, size_t cache_size) {
+    VertexCacheStatistics statistics;
+    VertexCache cache(vertex_count, cache_size);
+    std::vector<uint8_t> referenced(vertex_count, 0);
+    size_t referenced_count = 0;
+    for (auto index : indices) {
+        if (cache.access(index)) {
+            ++statistics.vertices_transformed;
+        }
+        if (!referenced[index]) {
+            referenced[index] = 1;
+            ++referenced_count;
+        }
+    }
+    if (indices.size() >= 3) {
+        statistics.acmr = static_cast<float>(statistics.vertices_transformed) / static_cast<float>(indices.size() / 3);
+    }
+    if (referenced_count > 0) {
+        statistics.atvr = static_cast<float>(statistics.vertices_transformed) / static_cast<float>(referenced_count);
+    }
+    return statistics;
+}
+
+std::vector<uint32_t> OptimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertex_count, size_t cache_size) {
+    auto triangle_count = static_cast<uint32_t>(indices.size() / 3);
+
+    // vertex => triangles, in adjacency[adjacency_offsets[vertex], adjacency_offsets[vertex + 1])
+    std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+    for (uint32_t i = 0; i < triangle_count * 3; ++i) {
+        ++adjacency_offsets[indices[i] + 1];
+    }
+    std::partial_sum(adjacency_offsets.begin(), adjacency_offsets.end(), adjacency_offsets.begin());
+    std::vector<uint32_t> adjacency(triangle_count * 3);
+    std::vector<uint32_t> adjacency_ends(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+    for (uint32_t i = 0; i < triangle_count * 3; ++i) {
+        adjacency[adjacency_ends[indices[i]]++] = i / 3;
+    }
+
+    // Triangles around vertices not emitted yet
+    std::vector<uint32_t> live_counts(vertex_count);
+    for (size_t vertex = 0; vertex < vertex_count; ++vertex) {
+        live_counts[vertex] = adjacency_offsets[vertex + 1] - adjacency_offsets[vertex];
+    }
+    std::vector<size_t> stamps(vertex_count, 0);
+    size_t time = cache_size + 1;
+    std::vector<uint8_t> emitted(triangle_count, 0);
+    // Vertices of emitted triangles, most recent last, to continue from when fanning reaches a dead end
+    std::vector<uint32_t> dead_ends;
+    uint32_t cursor = 0;
+    auto skip_dead_end = [&]() {
+        while (!dead_ends.empty()) {
+            uint32_t vertex = dead_ends.back();
+            dead_ends.pop_back();
+            if (live_counts[vertex] > 0) {
+                return vertex;
+            }
+        }
+        for (; cursor < vertex_count; ++cursor) {
+            if (live_counts[cursor] > 0) {
+                return cursor;
+            }
+        }
+        return InvalidVertex;
+    };
+
+    std::vector<uint32_t> optimized_indices;
+    optimized_indices.reserve(triangle_count * 3);
+    std::vector<uint32_t> candidates;
+    uint32_t fan_vertex = skip_dead_end();
+    while (fan_vertex != InvalidVertex) {
+        // Emit all remaining triangles around the fanning vertex
+        candidates.clear();
+        for (uint32_t i = adjacency_offsets[fan_vertex]; i < adjacency_offsets[fan_vertex + 1]; ++i) {
+            uint32_t triangle = adjacency[i];
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = 1;
+            for (uint32_t k = 0; k < 3; ++k) {
+                uint32_t vertex = indices[triangle * 3 + k];
+                optimized_indices.push_back(vertex);
+                dead_ends.push_back(vertex);
+                candidates.push_back(vertex);
+                --live_counts[vertex];
+                if (time - stamps[vertex] > cache_size) {
+                    stamps[vertex] = time++;
+                }
+            }
+        }
+
+        // Fan next around the oldest vertex that stays in the cache while its triangles are emitted
+        uint32_t next_vertex = InvalidVertex;
+        size_t best_priority = 0;
+        for (auto vertex : candidates) {
+            if (live_counts[vertex] == 0) {
+                continue;
+            }
+            size_t age = time - stamps[vertex];
+            size_t priority = age + 2 * live_counts[vertex] <= cache_size ? age : 0;
+            if (next_vertex == InvalidVertex || priority > best_priority) {
+                best_priority = priority;
+                next_vertex = vertex;
+            }
+        }
+        fan_vertex = next_vertex != InvalidVertex ? next_vertex : skip_dead_end();
+    }
+    return optimized_indices;
+}
+
+std::vector<uint32_t> OptimizeOverdraw(
+    const std::vector<SimpleVertex>& vertices, const std::vector<uint32_t>& indices, float threshold, size_t cache_size
+) {
+    auto triangle_count = static_cast<uint32_t>(indices.size() / 3);
+    if (triangle_count == 0) {
+        return indices;
+    }
+
+    // Hard boundaries where the cache misses all vertices of a triangle, e.g. after dead ends of OptimizeVertexCache
+    std::vector<uint32_t> triangle_misses(triangle_count);
+    std::vector<uint32_t> hard_starts;
+    VertexCache cache(vertices.size(), cache_size);
+    for (uint32_t triangle = 0; triangle < triangle_count; ++triangle) {
+        triangle_misses[triangle] = cache.accessTriangle(&indices[triangle * 3]);
+        if (triangle_misses[triangle] == 3) {
+            hard_starts.push_back(triangle);
+        }
+    }
+    hard_starts.push_back(triangle_count);
+
+    // Soft boundaries split hard clusters where the ACMR from the last boundary is low enough, as if the cache is
+    // empty at each boundary
+    std::vector<uint32_t> cluster_starts;
+    for (size_t i = 0; i + 1 < hard_starts.size(); ++i) {
+        uint32_t start = hard_starts[i];
+        uint32_t end = hard_starts[i + 1];
+        uint32_t hard_misses = 0;
+        for (uint32_t triangle = start; triangle < end; ++triangle) {
+            hard_misses += triangle_misses[triangle];
+        }
+        float cluster_threshold = threshold * static_cast<float>(hard_misses) / static_cast<float>(end - start);
+
+        cache.clear();
+        cluster_starts.push_back(start);
+        uint32_t cluster_start = start;
+        uint32_t cluster_misses = 0;
+        for (uint32_t triangle = start; triangle + 1 < end; ++triangle) {
+            cluster_misses += cache.accessTriangle(&indices[triangle * 3]);
+            if (static_cast<float>(cluster_misses) <= cluster_threshold * static_cast<float>(triangle + 1 - cluster_start)) {
+                cluster_start = triangle + 1;
+                cluster_starts.push_back(cluster_start);
+                cluster_misses = 0;
+                cache.clear();
+            }
+        }
+    }
+    cluster_starts.push_back(triangle_count);
+
+    // Area weighted centroids and normals
+    std::vector<glm::vec3> triangle_centers(triangle_count);
+    std::vector<glm::vec3> triangle_normals(triangle_count);
+    glm::vec3 mesh_centroid{ 0.f };
+    float mesh_area = 0.f;
+    for (uint32_t triangle = 0; triangle < triangle_count; ++triangle) {
+        auto& p0 = vertices[indices[triangle * 3]].position;
+        auto& p1 = vertices[indices[triangle * 3 + 1]].position;
+        auto& p2 = vertices[indices[triangle * 3 + 2]].position;
+        triangle_centers[triangle] = (p0 + p1 + p2) / 3.f;
+        // Length is twice the area
+        triangle_normals[triangle] = glm::cross(p1 - p0, p2 - p0);
+        float area = glm::length(triangle_normals[triangle]);
+        mesh_centroid += triangle_centers[triangle] * area;
+        mesh_area += area;
+    }
+    if (mesh_area > 0.f) {
+        mesh_centroid /= mesh_area;
+    }
+
+    // Clusters facing away from the center are in front of others from most views
+    size_t cluster_count = cluster_starts.size() - 1;
+    std::vector<float> cluster_keys(cluster_count);
+    for (size_t cluster = 0; cluster < cluster_count; ++cluster) {
+        glm::vec3 centroid{ 0.f };
+        glm::vec3 normal{ 0.f };
+        float area = 0.f;
+        for (uint32_t triangle = cluster_starts[cluster]; triangle < cluster_starts[cluster + 1]; ++triangle) {
+            float triangle_area = glm::length(triangle_normals[triangle]);
+            centroid += triangle_centers[triangle] * triangle_area;
+            normal += triangle_normals[triangle];
+            area += triangle_area;
+        }
+        float normal_length = glm::length(normal);
+        if (area > 0.f && normal_length > 0.f) {
+            cluster_keys[cluster] = glm::dot(centroid / area - mesh_centroid, normal / normal_length);
+        }
+    }
+    std::vector<size_t> cluster_order(cluster_count);
+    std::iota(cluster_order.begin(), cluster_order.end(), 0);
+    std::stable_sort(
+        cluster_order.begin(), cluster_order.end(),
+        [&cluster_keys](size_t a, size_t b) { return cluster_keys[a] > cluster_keys[b]; }
+    );
+
+    std::vector<uint32_t> optimized_indices;
+    optimized_indices.reserve(indices.size());
+    for (auto cluster : cluster_order) {
+        optimized_indices.insert(
+            optimized_indices.end(), indices.begin() + cluster_starts[cluster] * 3,
+            indices.begin() + cluster_starts[cluster + 1] * 3
+        );
+    }
+    return optimized_indices;
+}
+
+void OptimizeVertexFetch(std::vector<SimpleVertex>& vertices, std::vector<uint32_t>& indices) {
+    // old vertex => new vertex
+    std::vector<uint32_t> remap(vertices.size(), InvalidVertex);
+    std::vector<SimpleVertex> fetched_vertices;
+    fetched_vertices.reserve(vertices.size());
+    for (auto& index : indices) {
+        if (remap[index] == InvalidVertex) {
+            remap[index] = static_cast<uint32_t>(fetched_vertices.size());
+            fetched_vertices.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices = std::move(fetched_vertices);
+}
+
+} // namespace wg
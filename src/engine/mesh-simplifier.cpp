@@ -0,0 +1,281 @@
+#include "engine/mesh-simplifier.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+
+// Weight of planes through open boundary edges, relative to triangle planes
+constexpr double BoundaryWeight = 10.0;
+
+// Sum of squared distances to weighted planes, as a symmetric 4x4 matrix
+struct Quadric {
+    // a², ab, ac, ad, b², bc, bd, c², cd, d² of planes ax + by + cz + d = 0
+    std::array<double, 10> coefficients{};
+    double weight{ 0.0 };
+
+    static Quadric FromPlane(const glm::dvec3& normal, double distance, double weight) {
+        double a = normal.x;
+        double b = normal.y;
+        double c = normal.z;
+        double d = distance;
+        return {
+            .coefficients = {
+                a * a * weight, a * b * weight, a * c * weight, a * d * weight, b * b * weight,
+                b * c * weight, b * d * weight, c * c * weight, c * d * weight, d * d * weight
+            },
+            .weight = weight
+        };
+    }
+
+    Quadric& operator+=(const Quadric& quadric) {
+        for (size_t i = 0; i < coefficients.size(); ++i) {
+            coefficients[i] += quadric.coefficients[i];
+        }
+        weight += quadric.weight;
+        return *this;
+    }
+
+    [[nodiscard]] double error(const glm::vec3& position) const {
+        double x = position.x;
+        double y = position.y;
+        double z = position.z;
+        auto& q = coefficients;
+        double error = q[0] * x * x + q[4] * y * y + q[7] * z * z + q[9] +
+                       2.0 * (q[1] * x * y + q[2] * x * z + q[3] * x + q[5] * y * z + q[6] * y + q[8] * z);
+        return std::max(error, 0.0);
+    }
+};
+
+// Collapse of position from onto position to, valid while both versions are unchanged
+struct Collapse {
+    double error;
+    uint32_t from;
+    uint32_t to;
+    uint32_t from_version;
+    uint32_t to_version;
+
+    bool operator>(const Collapse& collapse) const { return error > collapse.error; }
+};
+
+struct PositionHash {
+    size_t operator()(const glm::vec3& position) const {
+        return std::bit_cast<uint32_t>(position.x) * 73856093U ^ std::bit_cast<uint32_t>(position.y) * 19349663U ^
+               std::bit_cast<uint32_t>(position.z) * 83492791U;
+    }
+};
+
+[[nodiscard]] uint64_t EdgeKey(uint32_t a, uint32_t b) {
+    return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+}
+
+} // unnamed namespace
+
+namespace wg {
+
+std::vector<uint32_t> SimplifyTriangles(
+    const std::vector<SimpleVertex>& vertices, const std::vector<uint32_t>& indices, size_t target_index_count,
+    float& out_error
+) {
+    out_error = 0.f;
+    size_t triangle_count = indices.size() / 3;
+
+    // Weld vertices at the same position, e.g. at texture seams, so that collapses do not open cracks
+    std::vector<glm::vec3> positions;
+    // position => first vertex at the position
+    std::vector<uint32_t> position_vertices;
+    std::vector<uint32_t> vertex_positions(vertices.size());
+    std::unordered_map<glm::vec3, uint32_t, PositionHash> position_indices;
+    for (uint32_t vertex = 0; vertex < static_cast<uint32_t>(vertices.size()); ++vertex) {
+        // Adding 0 turns -0 into 0, which hashes differently
+        auto position = vertices[vertex].position + glm::vec3(0.f);
+        auto [it, inserted] = position_indices.try_emplace(position, static_cast<uint32_t>(positions.size()));
+        if (inserted) {
+            positions.push_back(position);
+            position_vertices.push_back(vertex);
+        }
+        vertex_positions[vertex] = it->second;
+    }
+
+    std::vector<std::array<uint32_t, 3>> triangles(triangle_count);
+    std::vector<uint8_t> triangle_removed(triangle_count, 0);
+    std::vector<std::vector<uint32_t>> position_triangles(positions.size());
+    std::vector<Quadric> quadrics(positions.size());
+    std::unordered_map<uint64_t, uint32_t> edge_triangle_counts;
+    size_t live_triangle_count = 0;
+    for (uint32_t triangle = 0; triangle < static_cast<uint32_t>(triangle_count); ++triangle) {
+        auto& corners = triangles[triangle];
+        for (size_t k = 0; k < 3; ++k) {
+            corners[k] = vertex_positions[indices[triangle * 3 + k]];
+        }
+        if (corners[0] == corners[1] || corners[1] == corners[2] || corners[2] == corners[0]) {
+            triangle_removed[triangle] = 1;
+            continue;
+        }
+        ++live_triangle_count;
+        for (size_t k = 0; k < 3; ++k) {
+            position_triangles[corners[k]].push_back(triangle);
+            ++edge_triangle_counts[EdgeKey(corners[k], corners[(k + 1) % 3])];
+        }
+        // Planes weighted by area
+        auto p0 = glm::dvec3(positions[corners[0]]);
+        auto normal = glm::cross(glm::dvec3(positions[corners[1]]) - p0, glm::dvec3(positions[corners[2]]) - p0);
+        double length = glm::length(normal);
+        if (length > 0.0) {
+            normal /= length;
+            auto quadric = Quadric::FromPlane(normal, -glm::dot(normal, p0), length * 0.5);
+            for (auto corner : corners) {
+                quadrics[corner] += quadric;
+            }
+        }
+    }
+
+    // Keep open boundaries in place with planes perpendicular to their triangles
+    for (uint32_t triangle = 0; triangle < static_cast<uint32_t>(triangle_count); ++triangle) {
+        if (triangle_removed[triangle]) {
+            continue;
+        }
+        auto& corners = triangles[triangle];
+        auto p0 = glm::dvec3(positions[corners[0]]);
+        auto normal = glm::cross(glm::dvec3(positions[corners[1]]) - p0, glm::dvec3(positions[corners[2]]) - p0);
+        for (size_t k = 0; k < 3; ++k) {
+            uint32_t a = corners[k];
+            uint32_t b = corners[(k + 1) % 3];
+            if (edge_triangle_counts[EdgeKey(a, b)] != 1) {
+                continue;
+            }
+            auto edge = glm::dvec3(positions[b]) - glm::dvec3(positions[a]);
+            auto boundary_normal = glm::cross(edge, normal);
+            double length = glm::length(boundary_normal);
+            if (length > 0.0) {
+                boundary_normal /= length;
+                auto quadric = Quadric::FromPlane(
+                    boundary_normal, -glm::dot(boundary_normal, glm::dvec3(positions[a])), glm::dot(edge, edge) * BoundaryWeight
+                );
+                quadrics[a] += quadric;
+                quadrics[b] += quadric;
+            }
+        }
+    }
+
+    std::vector<uint32_t> versions(positions.size(), 0);
+    std::vector<uint8_t> position_removed(positions.size(), 0);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> collapses;
+    auto push_collapse = [&](uint32_t from, uint32_t to) {
+        auto quadric = quadrics[from];
+        quadric += quadrics[to];
+        collapses.push({ quadric.error(positions[to]), from, to, versions[from], versions[to] });
+    };
+    for (uint32_t triangle = 0; triangle < static_cast<uint32_t>(triangle_count); ++triangle) {
+        if (!triangle_removed[triangle]) {
+            for (size_t k = 0; k < 3; ++k) {
+                push_collapse(triangles[triangle][k], triangles[triangle][(k + 1) % 3]);
+                push_collapse(triangles[triangle][(k + 1) % 3], triangles[triangle][k]);
+            }
+        }
+    }
+
+    // Whether moving from onto to flips or degenerates a triangle around from that remains
+    auto collapse_flips = [&](uint32_t from, uint32_t to) {
+        for (auto triangle : position_triangles[from]) {
+            auto& corners = triangles[triangle];
+            if (triangle_removed[triangle] || std::find(corners.begin(), corners.end(), to) != corners.end()) {
+                continue;
+            }
+            auto new_corners = corners;
+            std::replace(new_corners.begin(), new_corners.end(), from, to);
+            auto normal = glm::cross(positions[corners[1]] - positions[corners[0]], positions[corners[2]] - positions[corners[0]]);
+            auto new_normal = glm::cross(
+                positions[new_corners[1]] - positions[new_corners[0]], positions[new_corners[2]] - positions[new_corners[0]]
+            );
+            // Also rejects normals turning by more than about 80 degrees
+            if (glm::dot(normal, new_normal) <= 0.2f * glm::length(normal) * glm::length(new_normal)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    size_t target_triangle_count = target_index_count / 3;
+    Quadric max_error_quadric;
+    double max_error = 0.0;
+    std::vector<uint32_t> neighbors;
+    while (live_triangle_count > target_triangle_count && !collapses.empty()) {
+        auto collapse = collapses.top();
+        collapses.pop();
+        uint32_t from = collapse.from;
+        uint32_t to = collapse.to;
+        if (position_removed[from] || position_removed[to] ||
+            versions[from] != collapse.from_version || versions[to] != collapse.to_version) {
+            continue;
+        }
+        if (collapse_flips(from, to)) {
+            continue;
+        }
+
+        position_removed[from] = 1;
+        for (auto triangle : position_triangles[from]) {
+            if (triangle_removed[triangle]) {
+                continue;
+            }
+            auto& corners = triangles[triangle];
+            if (std::find(corners.begin(), corners.end(), to) != corners.end()) {
+                triangle_removed[triangle] = 1;
+                --live_triangle_count;
+            } else {
+                std::replace(corners.begin(), corners.end(), from, to);
+                position_triangles[to].push_back(triangle);
+            }
+        }
+        position_triangles[from].clear();
+        quadrics[to] += quadrics[from];
+        ++versions[to];
+        if (collapse.error > max_error) {
+            max_error = collapse.error;
+            max_error_quadric = quadrics[to];
+        }
+
+        // Errors of edges around to have changed
+        std::erase_if(position_triangles[to], [&triangle_removed](uint32_t triangle) { return triangle_removed[triangle] != 0; });
+        neighbors.clear();
+        for (auto triangle : position_triangles[to]) {
+            for (auto corner : triangles[triangle]) {
+                if (corner != to) {
+                    neighbors.push_back(corner);
+                }
+            }
+        }
+        std::sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+        for (auto neighbor : neighbors) {
+            push_collapse(to, neighbor);
+            push_collapse(neighbor, to);
+        }
+    }
+
+    std::vector<uint32_t> simplified_indices;
+    simplified_indices.reserve(live_triangle_count * 3);
+    for (uint32_t triangle = 0; triangle < static_cast<uint32_t>(triangle_count); ++triangle) {
+        if (triangle_removed[triangle]) {
+            continue;
+        }
+        for (size_t k = 0; k < 3; ++k) {
+            // Keep attributes of corners which did not move
+            uint32_t vertex = indices[triangle * 3 + k];
+            uint32_t position = triangles[triangle][k];
+            simplified_indices.push_back(vertex_positions[vertex] == position ? vertex : position_vertices[position]);
+        }
+    }
+    // Root mean square distance to planes of the collapse of the largest error
+    if (max_error_quadric.weight > 0.0) {
+        out_error = static_cast<float>(std::sqrt(max_error / max_error_quadric.weight));
+    }
+    return simplified_indices;
+}
+
+} // namespace wg
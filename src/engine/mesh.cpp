@@ -2,10 +2,14 @@
 
 #include "common/logger.h"
 #include "gfx/gfx.h"
+#include "engine/mesh-simplifier.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <utility>
 
 namespace {
@@ -20,9 +24,31 @@ namespace {
 namespace wg {
 
 void MeshRenderData::createGfxResources(Gfx& gfx) {
-    gfx.createVertexBufferResources(vertex_buffer);
-    if (index_buffer) {
-        gfx.createIndexBufferResources(index_buffer);
+    auto upload_batch = UploadBatch::Create();
+    if (geometry_pool) {
+        if (!geometry_pool->has_gpu_resources()) {
+            gfx.createGeometryPoolResources(geometry_pool);
+        }
+        gfx.createVertexBufferResources(vertex_buffer, geometry_pool, upload_batch);
+        if (index_buffer) {
+            gfx.createIndexBufferResources(index_buffer, geometry_pool, upload_batch);
+        }
+    } else {
+        gfx.createVertexBufferResources(vertex_buffer, upload_batch);
+        if (index_buffer) {
+            gfx.createIndexBufferResources(index_buffer, upload_batch);
+        }
+    }
+    upload_token = gfx.submitUploadBatch(upload_batch);
+}
+
+void MeshRenderData::setIndexBuffer(DrawCommand& draw_command) const {
+    if (!index_buffer) {
+        return;
+    }
+    draw_command.setIndexBuffer(index_buffer);
+    if (lods.size() > 1) {
+        draw_command.setIndexRange(lods[0].first_index, lods[0].index_count);
     }
 }
 
@@ -44,7 +70,7 @@ std::shared_ptr<Mesh> Mesh::CreateFromVertices(
 }
 
 std::shared_ptr<Mesh> Mesh::CreateFromObjFile(
-    const std::string& name, const std::string& filename
+    const std::string& name, const std::string& filename, uint32_t lod_count
 ) {
     tinyobj::ObjReaderConfig reader_config;
     reader_config.vertex_color = true;
@@ -124,7 +150,11 @@ std::shared_ptr<Mesh> Mesh::CreateFromObjFile(
         }
     }
 
-    return CreateFromVertices(name, vertices, indices);
+    auto mesh = CreateFromVertices(name, vertices, indices);
+    if (lod_count > 1) {
+        mesh->generateLods(lod_count);
+    }
+    return mesh;
 }
 
 std::shared_ptr<Mesh> Mesh::CreateSphere(
@@ -212,7 +242,10 @@ std::shared_ptr<Mesh> Mesh::CreateFullScreenTriangle(
         { .position = { 3.f, -1.f, 1.f - 1e-4f }, .normal = { 0.f, 0.f, -1.f }, .color = color, .tex_coord = { 2.f, 0.f } },
     };
 
-    return CreateFromVertices(name, vertices);
+    auto mesh = CreateFromVertices(name, vertices);
+    // Positions are in clip space
+    mesh->setBoundingSphere({ 0.f, 0.f, 0.f, std::numeric_limits<float>::infinity() });
+    return mesh;
 }
 
 std::shared_ptr<Mesh> Mesh::CreateCoordinates(
@@ -236,15 +269,136 @@ Mesh::Mesh(std::string name)
     : name_(std::move(name)) {
 }
 
+void Mesh::setVertices(std::vector<wg::SimpleVertex> vertices) {
+    vertices_ = std::move(vertices);
+    optimized_ = false;
+    bounding_box_ = BoundingBox();
+    bounding_sphere_ = glm::vec4(0.f);
+    if (vertices_.empty()) {
+        return;
+    }
+    for (auto&& vertex : vertices_) {
+        bounding_box_.merge(vertex.position);
+    }
+    // Centered at the bounding box, which is close to the smallest sphere for most meshes
+    glm::vec3 center = bounding_box_.center();
+    float radius_squared = 0.f;
+    for (auto&& vertex : vertices_) {
+        radius_squared = std::max(radius_squared, glm::dot(vertex.position - center, vertex.position - center));
+    }
+    bounding_sphere_ = glm::vec4(center, std::sqrt(radius_squared));
+}
+
+void Mesh::setIndices(std::vector<uint32_t> indices) {
+    indices_ = std::move(indices);
+    optimized_ = false;
+    lods_.clear();
+    if (!indices_.empty()) {
+        lods_.push_back({ .first_index = 0, .index_count = static_cast<uint32_t>(indices_.size()), .error = 0.f });
+    }
+}
+
+void Mesh::generateLods(uint32_t lod_count, float reduction) {
+    if (primitive_topology_ != primitive_topologies::triangle_list || lods_.empty()) {
+        logger().error("Cannot generate levels of detail for mesh {} which is not an indexed triangle list.", name_);
+        return;
+    }
+    while (lods_.size() < lod_count) {
+        auto last_lod = lods_.back();
+        std::vector<uint32_t> last_indices(
+            indices_.begin() + last_lod.first_index, indices_.begin() + last_lod.first_index + last_lod.index_count
+        );
+        auto target_index_count = static_cast<size_t>(static_cast<float>(last_lod.index_count) * reduction);
+        float error = 0.f;
+        auto lod_indices = SimplifyTriangles(vertices_, last_indices, target_index_count, error);
+        // Not worth another level if the simplification is stuck
+        if (lod_indices.empty() || lod_indices.size() >= last_indices.size() * 9 / 10) {
+            logger().info("Mesh {} stops at {} levels of detail.", name_, lods_.size());
+            break;
+        }
+        // Errors of a level include those of levels it is simplified from
+        addLod(lod_indices, std::max(error, last_lod.error));
+    }
+}
+
+void Mesh::addLod(const std::vector<uint32_t>& indices, float error) {
+    if (lods_.empty()) {
+        logger().error("Cannot add level of detail to mesh {} without indices.", name_);
+        return;
+    }
+    if (std::any_of(indices.begin(), indices.end(), [this](uint32_t index) { return index >= vertices_.size(); })) {
+        logger().error("Cannot add level of detail to mesh {} because indices are out of range.", name_);
+        return;
+    }
+    lods_.push_back({
+        .first_index = static_cast<uint32_t>(indices_.size()),
+        .index_count = static_cast<uint32_t>(indices.size()),
+        .error = error
+    });
+    indices_.insert(indices_.end(), indices.begin(), indices.end());
+    optimized_ = false;
+}
+
+void Mesh::optimize() {
+    if (primitive_topology_ != primitive_topologies::triangle_list || lods_.empty()) {
+        logger().error("Cannot optimize mesh {} which is not an indexed triangle list.", name_);
+        return;
+    }
+    auto original_indices = [this]() {
+        return std::vector<uint32_t>(indices_.begin(), indices_.begin() + lods_[0].index_count);
+    };
+    optimization_statistics_.before = AnalyzeVertexCache(original_indices(), vertices_.size());
+
+    // Levels of detail are drawn separately, so are optimized separately and keep their ranges
+    for (auto&& lod : lods_) {
+        auto lod_begin = indices_.begin() + lod.first_index;
+        std::vector<uint32_t> lod_indices(lod_begin, lod_begin + lod.index_count);
+        lod_indices = OptimizeVertexCache(lod_indices, vertices_.size());
+        if (overdraw_optimization_) {
+            lod_indices = OptimizeOverdraw(vertices_, lod_indices, overdraw_threshold_);
+        }
+        std::copy(lod_indices.begin(), lod_indices.end(), lod_begin);
+    }
+    // In order of the original indices first, then vertices only used by coarser levels
+    OptimizeVertexFetch(vertices_, indices_);
+
+    optimization_statistics_.after = AnalyzeVertexCache(original_indices(), vertices_.size());
+    optimized_ = true;
+    logger().info(
+        "Mesh {} optimized: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}.", name_,
+        optimization_statistics_.before.acmr, optimization_statistics_.after.acmr,
+        optimization_statistics_.before.atvr, optimization_statistics_.after.atvr
+    );
+}
+
 std::shared_ptr<IRenderData> Mesh::createRenderData() {
+    if (optimization_ && !optimized_) {
+        optimize();
+    }
     render_data_ = std::shared_ptr<MeshRenderData>(new MeshRenderData());
     render_data_->vertex_buffer = wg::VertexBuffer<wg::SimpleVertex>::CreateFromVertexArray(vertices_);
+    render_data_->bounding_sphere = bounding_sphere_;
+    render_data_->lods = lods_;
+    render_data_->geometry_pool = geometry_pool_;
+    if (geometry_pool_ && geometry_pool_->vertex_stride() != sizeof(wg::SimpleVertex)) {
+        logger().warn("Mesh {} does not use geometry pool because vertex stride differs.", name_);
+        render_data_->geometry_pool.reset();
+    }
     if (!indices_.empty()) {
         auto index_type = wg::index_types::index_16;
         auto max_index = *std::max_element(indices_.begin(), indices_.end());
         if (max_index > 65535) {
             index_type = wg::index_types::index_32;
         }
+        if (render_data_->geometry_pool) {
+            // Indices in a pool share the index type of the pool.
+            if (index_type == wg::index_types::index_32 && render_data_->geometry_pool->index_type() == wg::index_types::index_16) {
+                logger().warn("Mesh {} does not use geometry pool because indices do not fit in 16 bits.", name_);
+                render_data_->geometry_pool.reset();
+            } else {
+                index_type = render_data_->geometry_pool->index_type();
+            }
+        }
 
         render_data_->index_buffer = wg::IndexBuffer::CreateFromIndexArray(index_type, indices_);
     }
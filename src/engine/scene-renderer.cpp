@@ -3,6 +3,11 @@
 #include "common/logger.h"
 #include "gfx/gfx.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+
 namespace {
 
 [[nodiscard]] auto& logger() {
@@ -10,11 +15,78 @@ namespace {
     return *logger_;
 }
 
+void AddMaterialSamplers(wg::DrawCommand& draw_command, const wg::Material& material, const wg::GfxPipeline& pipeline) {
+    for (size_t i = 0; i < pipeline.sampler_layout().descriptions().size(); ++i) {
+        if (i < material.textures().size()) {
+            auto&& description = pipeline.sampler_layout().descriptions()[i];
+            draw_command.addSampler(description.binding, material.render_data()->samplers[i]);
+        }
+    }
+}
+
 } // unnamed namespace
 
 namespace wg {
 
 void SceneRendererRenderData::createGfxResources(Gfx& gfx) {
+    // Culling batches draw their components by first instance
+    if (!culling_batches.empty() && !gfx.feature_enabled(gfx_features::multi_draw_indirect)) {
+        if (auto renderer = weak_renderer.lock()) {
+            logger().warn(
+                "Drawing {} mesh components without GPU culling because multi_draw_indirect is not enabled.",
+                culled_components.size()
+            );
+            renderer->disableGpuCulling();
+        }
+    }
+    if (cull_pipeline) {
+        gfx.createShaderResources(cull_pipeline->shader());
+        gfx.createComputePipelineResources(cull_pipeline);
+    }
+    for (auto&& batch : culling_batches) {
+        // Component draw commands are finished, giving ranges of meshes in the geometry pool
+        std::vector<GpuCullObject> objects;
+        objects.reserve(batch.components.size());
+        for (uint32_t i = 0; i < static_cast<uint32_t>(batch.components.size()); ++i) {
+            auto&& component = batch.components[i];
+            auto&& draw_command = component->render_data()->draw_commands[0];
+            objects.push_back(
+                {
+                    .bounding_sphere = TransformBoundingSphere(component->mesh()->bounding_sphere(), component->transform().transform),
+                    .draw = {
+                        .index_count = static_cast<uint32_t>(draw_command->index_count()),
+                        .instance_count = 1,
+                        .first_index = draw_command->first_index(),
+                        .vertex_offset = draw_command->base_vertex(),
+                        .first_instance = i
+                    }
+                }
+            );
+        }
+        batch.objects->setArray(std::move(objects));
+        gfx.createStorageBufferResources(batch.objects);
+        gfx.createStorageBufferResources(batch.indirect_commands);
+        gfx.createStorageBufferResources(batch.draw_count);
+        gfx.createVertexBufferResources(batch.instance_buffer);
+        if (!gfx.feature_enabled(gfx_features::multi_draw_indirect)) {
+            logger().error("Skip create resources for culling batch because multi_draw_indirect is not enabled.");
+            continue;
+        }
+        if (!batch.draw_command->valid()) {
+            logger().error("Skip create resources for culling batch because draw command is invalid.");
+            continue;
+        }
+        gfx.finishDrawCommand(batch.draw_command);
+        gfx.finishComputeCommand(batch.cull_command);
+    }
+    for (auto&& batch : instance_batches) {
+        gfx.createVertexBufferResources(batch.instance_buffer);
+        if (!batch.draw_command->valid()) {
+            logger().error("Skip create resources for instance batch because draw command is invalid.");
+            continue;
+        }
+        gfx.finishDrawCommand(batch.draw_command);
+    }
     auto render_target = weak_render_target.lock();
     gfx.createRenderTargetResources(render_target);
     gfx.submitDrawCommands(render_target);
@@ -33,18 +105,257 @@ void SceneRenderer::setCamera(Camera camera) {
     }
 }
 
+ComputeToken SceneRenderer::submitCulling(Gfx& gfx) {
+    if (!render_data_ || render_data_->culling_batches.empty()) {
+        return {};
+    }
+    auto frustum = Frustum::FromCameraUniform(createUniformObject());
+    bool compact = gfx.feature_enabled(gfx_features::draw_indirect_count);
+    std::vector<std::shared_ptr<ComputeCommand>> cull_commands;
+    for (auto&& batch : render_data_->culling_batches) {
+        if (!batch.objects->dirty_ranges().empty()) {
+            gfx.commitBuffer(batch.objects);
+        }
+        GpuCullParameters parameters{
+            .planes = frustum.planes,
+            .object_count = static_cast<uint32_t>(batch.components.size()),
+            .compact = compact ? 1U : 0U
+        };
+        batch.cull_command->setPushConstants(parameters);
+        batch.cull_command->setGroupCount(parameters.group_count());
+        cull_commands.push_back(batch.cull_command);
+    }
+    return gfx.submitComputeCommands(cull_commands);
+}
+
+uint32_t SceneRenderer::readCulledDrawCount(Gfx& gfx, const ComputeToken& token) {
+    if (!render_data_ || !token.valid()) {
+        return 0;
+    }
+    gfx.waitCompute(token);
+    uint32_t draw_count = 0;
+    for (auto&& batch : render_data_->culling_batches) {
+        if (gfx.readStorageBuffer(batch.draw_count)) {
+            draw_count += batch.draw_count->elements()[0];
+        }
+    }
+    return draw_count;
+}
+
+void SceneRenderer::cullComponents() {
+    if (!render_data_) {
+        return;
+    }
+    auto frustum = Frustum::FromCameraUniform(createUniformObject());
+    auto& visible = render_data_->component_visible;
+    size_t visible_count = 0;
+    if (bvh_culling_) {
+        // Hierarchy gets looser as components move
+        render_data_->component_bvh.rebuildIfDegraded();
+        std::vector<uint32_t> visible_indices;
+        render_data_->component_bvh.queryFrustum(frustum, visible_indices);
+        visible.assign(render_data_->component_bounds.size(), 0);
+        for (auto index : visible_indices) {
+            visible[index] = 1;
+        }
+        for (auto index : render_data_->unbounded_component_indices) {
+            visible[index] = 1;
+        }
+        visible_count = visible_indices.size() + render_data_->unbounded_component_indices.size();
+    } else {
+        visible_count = CullSpheres(frustum, render_data_->component_bounds, visible);
+    }
+    culling_statistics_ = {
+        .visible_component_count = static_cast<uint32_t>(visible_count),
+        .culled_component_count = static_cast<uint32_t>(visible.size() - visible_count)
+    };
+
+    // A draw command is visible if any of its components is
+    std::vector<uint8_t> draw_command_visible(draw_commands_.size(), 0);
+    for (size_t i = 0; i < visible.size(); ++i) {
+        auto [first, count] = render_data_->component_draw_command_ranges[i];
+        for (size_t index = first; index < first + count; ++index) {
+            draw_command_visible[index] |= visible[i];
+        }
+    }
+    for (auto&& [first, count] : render_data_->component_draw_command_ranges) {
+        for (size_t index = first; index < first + count; ++index) {
+            setDrawCommandVisible(index, draw_command_visible[index] != 0);
+        }
+    }
+    updateSortDepths();
+}
+
+void SceneRenderer::updateSortDepths() {
+    if (!render_data_) {
+        return;
+    }
+    auto forward = camera_.center - camera_.position;
+    float forward_length = glm::length(forward);
+    if (forward_length <= 0.f) {
+        return;
+    }
+    forward /= forward_length;
+
+    // Instance batches are as near as their nearest instance
+    auto& depths = render_data_->draw_command_depths;
+    depths.assign(draw_commands_.size(), std::numeric_limits<float>::infinity());
+    for (size_t i = 0; i < render_data_->component_bounds.size(); ++i) {
+        auto sphere = render_data_->component_bounds.get(i);
+        float depth = 0.f;
+        if (std::isfinite(sphere.w)) {
+            depth = std::max(glm::dot(glm::vec3(sphere) - camera_.position, forward) - sphere.w, 0.f);
+        }
+        auto [first, count] = render_data_->component_draw_command_ranges[i];
+        for (size_t index = first; index < first + count; ++index) {
+            depths[index] = std::min(depths[index], depth);
+        }
+    }
+    for (size_t index = 0; index < depths.size(); ++index) {
+        if (std::isfinite(depths[index])) {
+            draw_commands_[index]->setSortDepth(depths[index]);
+        }
+    }
+}
+
+void SceneRenderer::selectLods() {
+    lod_component_counts_.clear();
+    if (!render_data_) {
+        return;
+    }
+    for (auto index : render_data_->lod_component_indices) {
+        auto&& component = render_data_->bounded_components[index];
+        auto lod_count = static_cast<uint32_t>(component->mesh()->lods().size());
+        float screen_size = ProjectedScreenSize(render_data_->component_bounds.get(index), camera_.position, camera_.fov_y);
+        component->setLod(SelectLod(screen_size, component->lod(), lod_count, lod_screen_sizes_, lod_hysteresis_));
+        if (lod_component_counts_.size() <= component->lod()) {
+            lod_component_counts_.resize(component->lod() + 1, 0);
+        }
+        ++lod_component_counts_[component->lod()];
+    }
+}
+
+float SceneRenderer::ProjectedScreenSize(const glm::vec4& bounding_sphere, const glm::vec3& camera_position, float fov_y) {
+    float distance = glm::length(glm::vec3(bounding_sphere) - camera_position);
+    if (distance <= bounding_sphere.w) {
+        return std::numeric_limits<float>::infinity();
+    }
+    return bounding_sphere.w / (distance * std::tan(fov_y * 0.5f));
+}
+
+uint32_t SceneRenderer::SelectLod(
+    float screen_size, uint32_t current_lod, uint32_t lod_count, const std::vector<float>& lod_screen_sizes,
+    float hysteresis
+) {
+    if (lod_count == 0) {
+        return 0;
+    }
+    auto lod_of = [lod_count, &lod_screen_sizes](float size) {
+        uint32_t lod = 0;
+        while (lod + 1 < lod_count && lod < lod_screen_sizes.size() && size < lod_screen_sizes[lod]) {
+            ++lod;
+        }
+        return lod;
+    };
+    current_lod = std::min(current_lod, lod_count - 1);
+    uint32_t lod = lod_of(screen_size);
+    if (lod > current_lod) {
+        // Coarser only if still coarser when a little larger
+        return std::max(current_lod, lod_of(screen_size * (1.f + hysteresis)));
+    }
+    if (lod < current_lod) {
+        return std::min(current_lod, lod_of(screen_size * (1.f - hysteresis)));
+    }
+    return lod;
+}
+
+std::vector<std::shared_ptr<MeshComponent>> SceneRenderer::queryComponents(const Frustum& frustum) const {
+    std::vector<std::shared_ptr<MeshComponent>> components;
+    if (!render_data_) {
+        return components;
+    }
+    std::vector<uint32_t> indices;
+    render_data_->component_bvh.queryFrustum(frustum, indices);
+    indices.insert(indices.end(), render_data_->unbounded_component_indices.begin(), render_data_->unbounded_component_indices.end());
+    for (auto index : indices) {
+        components.push_back(render_data_->bounded_components[index]);
+    }
+    return components;
+}
+
+std::vector<std::shared_ptr<MeshComponent>> SceneRenderer::queryComponents(const BoundingBox& box) const {
+    std::vector<std::shared_ptr<MeshComponent>> components;
+    if (!render_data_) {
+        return components;
+    }
+    std::vector<uint32_t> indices;
+    render_data_->component_bvh.queryOverlap(box, indices);
+    indices.insert(indices.end(), render_data_->unbounded_component_indices.begin(), render_data_->unbounded_component_indices.end());
+    for (auto index : indices) {
+        components.push_back(render_data_->bounded_components[index]);
+    }
+    return components;
+}
+
+std::shared_ptr<MeshComponent> SceneRenderer::queryNearestComponent(const glm::vec3& point) const {
+    if (!render_data_) {
+        return nullptr;
+    }
+    auto index = render_data_->component_bvh.queryNearest(point);
+    return index == Bvh::InvalidIndex ? nullptr : render_data_->bounded_components[index];
+}
+
+void SceneRenderer::updateComponentTransform(const std::shared_ptr<MeshComponent>& component) {
+    if (render_data_) {
+        auto bounds_it = render_data_->component_bounds_indices.find(component.get());
+        if (bounds_it != render_data_->component_bounds_indices.end()) {
+            auto sphere = TransformBoundingSphere(component->mesh()->bounding_sphere(), component->transform().transform);
+            render_data_->component_bounds.set(bounds_it->second, sphere);
+            // Refit the hierarchy, unbounded components are not in it and stay in unbounded_component_indices
+            if (std::isfinite(sphere.w)) {
+                render_data_->component_bvh.update(static_cast<uint32_t>(bounds_it->second), BoundingBox::FromSphere(sphere));
+            }
+        }
+        auto culled_it = render_data_->culled_components.find(component.get());
+        if (culled_it != render_data_->culled_components.end()) {
+            auto [batch_index, object_index] = culled_it->second;
+            auto& batch = render_data_->culling_batches[batch_index];
+            batch.instance_buffer->setVertexRange(
+                object_index, { InstanceTransform{ .model_mat = component->transform().transform } }
+            );
+            auto object = batch.objects->elements()[object_index];
+            object.bounding_sphere = TransformBoundingSphere(component->mesh()->bounding_sphere(), component->transform().transform);
+            batch.objects->setRange(object_index, { object });
+            return;
+        }
+        auto it = render_data_->batched_components.find(component.get());
+        if (it != render_data_->batched_components.end()) {
+            auto [batch_index, instance_index] = it->second;
+            render_data_->instance_batches[batch_index].instance_buffer->setVertexRange(
+                instance_index, { InstanceTransform{ .model_mat = component->transform().transform } }
+            );
+            return;
+        }
+    }
+    component->render_data()->model_uniform_buffer->setUniformObject(
+        {
+            .model_mat = component->transform().transform
+        }
+    );
+    for (const auto& draw_command : component->render_data()->draw_commands) {
+        markUniformDirty(draw_command, uniform_attributes::model);
+    }
+}
+
 std::shared_ptr<IRenderData> SceneRenderer::createRenderData() {
     auto render_target = weak_render_target_.lock();
     render_target->setRenderer(shared_from_this());
-    for (auto&& component : components_) {
-        if (component->render_data()) {
-            auto& draw_commands = component->render_data()->draw_commands;
-            std::copy(draw_commands.begin(), draw_commands.end(), std::back_inserter(draw_commands_));
-        }
-    }
 
     render_data_ = std::shared_ptr<SceneRendererRenderData>(new SceneRendererRenderData());
     render_data_->weak_render_target = weak_render_target_;
+    render_data_->weak_renderer = std::static_pointer_cast<SceneRenderer>(shared_from_this());
+    createDrawCommands(!cull_shader_filename_.empty());
+
     render_data_->camera_uniform_buffer = UniformBuffer<CameraUniform>::Create();
     render_data_->camera_uniform_buffer->setUniformObject(createUniformObject());
     addUniformBuffer(render_data_->camera_uniform_buffer);
@@ -52,6 +363,237 @@ std::shared_ptr<IRenderData> SceneRenderer::createRenderData() {
     return render_data_;
 }
 
+void SceneRenderer::createDrawCommands(bool gpu_culling) {
+    // Draw commands of the previous render data, if any
+    clearDrawCommands();
+
+    if (gpu_culling) {
+        createCullingBatches();
+    } else if (instancing_) {
+        createInstanceBatches();
+    }
+    // Bounds of components drawn by their own draw commands or by instance batches, culled by cullComponents
+    auto add_component_bounds = [this](const std::shared_ptr<MeshComponent>& component, size_t first, size_t count) {
+        if (!component->mesh()) {
+            return;
+        }
+        size_t index = render_data_->component_bounds.size();
+        render_data_->component_bounds.resize(index + 1);
+        render_data_->component_bounds.set(
+            index, TransformBoundingSphere(component->mesh()->bounding_sphere(), component->transform().transform)
+        );
+        render_data_->component_draw_command_ranges.emplace_back(first, count);
+        render_data_->component_bounds_indices[component.get()] = index;
+        render_data_->bounded_components.push_back(component);
+    };
+    for (auto&& component : components_) {
+        if (component->render_data() && !render_data_->batched_components.contains(component.get()) &&
+            !render_data_->culled_components.contains(component.get())) {
+            auto& draw_commands = component->render_data()->draw_commands;
+            add_component_bounds(component, draw_commands_.size(), draw_commands.size());
+            if (component->mesh() && component->mesh()->lods().size() > 1) {
+                render_data_->lod_component_indices.push_back(render_data_->component_bounds.size() - 1);
+            }
+            std::copy(draw_commands.begin(), draw_commands.end(), std::back_inserter(draw_commands_));
+        }
+    }
+    for (auto&& batch : render_data_->instance_batches) {
+        for (auto&& component : batch.components) {
+            add_component_bounds(component, draw_commands_.size(), 1);
+        }
+        draw_commands_.push_back(batch.draw_command);
+    }
+    std::vector<BoundingBox> component_boxes(render_data_->component_bounds.size());
+    for (size_t i = 0; i < component_boxes.size(); ++i) {
+        auto sphere = render_data_->component_bounds.get(i);
+        if (std::isfinite(sphere.w)) {
+            component_boxes[i] = BoundingBox::FromSphere(sphere);
+        } else {
+            // Left empty, so not in the hierarchy
+            render_data_->unbounded_component_indices.push_back(i);
+        }
+    }
+    render_data_->component_bvh.build(std::move(component_boxes));
+    for (auto&& batch : render_data_->culling_batches) {
+        draw_commands_.push_back(batch.draw_command);
+    }
+}
+
+void SceneRenderer::disableGpuCulling() {
+    render_data_->cull_pipeline.reset();
+    render_data_->culling_batches.clear();
+    render_data_->culled_components.clear();
+    render_data_->instance_batches.clear();
+    render_data_->batched_components.clear();
+    render_data_->component_bounds = {};
+    render_data_->component_draw_command_ranges.clear();
+    render_data_->component_bounds_indices.clear();
+    render_data_->component_visible.clear();
+    render_data_->bounded_components.clear();
+    render_data_->unbounded_component_indices.clear();
+    render_data_->lod_component_indices.clear();
+    createDrawCommands(false);
+}
+
+void SceneRenderer::createInstanceBatches() {
+    // (mesh, material) => components, in order of first appearance
+    std::map<std::pair<const Mesh*, const Material*>, size_t> group_indices;
+    std::vector<std::vector<std::shared_ptr<MeshComponent>>> groups;
+    for (auto&& component : components_) {
+        if (!component->render_data() || !component->mesh() || !component->material()) {
+            continue;
+        }
+        auto&& mesh_render_data = component->mesh()->render_data();
+        auto&& material_render_data = component->material()->render_data();
+        if (!mesh_render_data || !material_render_data || !material_render_data->instanced_pipeline) {
+            continue;
+        }
+        auto [it, inserted] = group_indices.try_emplace({ component->mesh().get(), component->material().get() }, groups.size());
+        if (inserted) {
+            groups.emplace_back();
+        }
+        groups[it->second].push_back(component);
+    }
+
+    for (auto&& components : groups) {
+        if (components.size() < std::max<size_t>(min_instance_batch_size_, 1)) {
+            continue;
+        }
+        auto&& mesh = components[0]->mesh();
+        auto&& material = components[0]->material();
+        auto&& pipeline = material->render_data()->instanced_pipeline;
+
+        std::vector<InstanceTransform> instance_transforms;
+        instance_transforms.reserve(components.size());
+        for (auto&& component : components) {
+            instance_transforms.push_back({ .model_mat = component->transform().transform });
+        }
+
+        SceneRendererInstanceBatch batch;
+        batch.instance_buffer = StreamingVertexBuffer<InstanceTransform>::CreateFromVertexArray(std::move(instance_transforms));
+        batch.model_uniform_buffer = UniformBuffer<ModelUniform>::Create();
+        batch.model_uniform_buffer->setUniformObject({ .model_mat = glm::mat4(1.0f) });
+        batch.draw_command = InstancedDrawCommand::Create(
+            fmt::format("{} {} instanced", mesh->name(), material->name()), pipeline
+        );
+        batch.draw_command->setPrimitiveTopology(mesh->primitive_topology());
+        batch.draw_command->addVertexBuffer(mesh->render_data()->vertex_buffer);
+        batch.draw_command->addVertexBuffer(batch.instance_buffer);
+        // Instances share the original indices
+        mesh->render_data()->setIndexBuffer(*batch.draw_command);
+        batch.draw_command->addUniformBuffer(batch.model_uniform_buffer);
+        AddMaterialSamplers(*batch.draw_command, *material, *pipeline);
+
+        size_t batch_index = render_data_->instance_batches.size();
+        for (size_t instance_index = 0; instance_index < components.size(); ++instance_index) {
+            render_data_->batched_components[components[instance_index].get()] = { batch_index, instance_index };
+        }
+        batch.components = std::move(components);
+        render_data_->instance_batches.push_back(std::move(batch));
+    }
+    if (!render_data_->instance_batches.empty()) {
+        logger().info(
+            "Drawing {} mesh components with {} instanced draw commands.",
+            render_data_->batched_components.size(), render_data_->instance_batches.size()
+        );
+    }
+}
+
+void SceneRenderer::createCullingBatches() {
+    // (vertex buffers, material) => components, in order of first appearance.
+    // Meshes in the same geometry pool share vertex and index buffers.
+    std::map<std::pair<const void*, const Material*>, size_t> group_indices;
+    std::vector<std::vector<std::shared_ptr<MeshComponent>>> groups;
+    for (auto&& component : components_) {
+        if (!component->render_data() || component->render_data()->draw_commands.empty() ||
+            !component->mesh() || !component->material()) {
+            continue;
+        }
+        auto&& mesh_render_data = component->mesh()->render_data();
+        auto&& material_render_data = component->material()->render_data();
+        if (!mesh_render_data || !mesh_render_data->index_buffer ||
+            !material_render_data || !material_render_data->instanced_pipeline) {
+            continue;
+        }
+        const void* buffers_key = mesh_render_data->geometry_pool
+                                      ? static_cast<const void*>(mesh_render_data->geometry_pool.get())
+                                      : static_cast<const void*>(component->mesh().get());
+        auto [it, inserted] = group_indices.try_emplace({ buffers_key, component->material().get() }, groups.size());
+        if (inserted) {
+            groups.emplace_back();
+        }
+        groups[it->second].push_back(component);
+    }
+    if (groups.empty()) {
+        return;
+    }
+
+    render_data_->cull_pipeline = ComputePipeline::Create();
+    render_data_->cull_pipeline->setShader(Shader::Load(cull_shader_filename_, shader_stages::comp));
+    render_data_->cull_pipeline->setStorageBufferLayout(
+        GfxStorageBufferLayout{}
+            .addDescription({ .binding = 0, .stages = shader_stages::comp })
+            .addDescription({ .binding = 1, .stages = shader_stages::comp })
+            .addDescription({ .binding = 2, .stages = shader_stages::comp })
+    );
+    render_data_->cull_pipeline->setPushConstantSize(sizeof(GpuCullParameters));
+
+    for (auto&& components : groups) {
+        auto&& mesh = components[0]->mesh();
+        auto&& material = components[0]->material();
+        auto&& pipeline = material->render_data()->instanced_pipeline;
+
+        std::vector<InstanceTransform> instance_transforms;
+        instance_transforms.reserve(components.size());
+        for (auto&& component : components) {
+            instance_transforms.push_back({ .model_mat = component->transform().transform });
+        }
+
+        SceneRendererCullingBatch batch;
+        batch.instance_buffer = StreamingVertexBuffer<InstanceTransform>::CreateFromVertexArray(std::move(instance_transforms));
+        batch.model_uniform_buffer = UniformBuffer<ModelUniform>::Create();
+        batch.model_uniform_buffer->setUniformObject({ .model_mat = glm::mat4(1.0f) });
+        // Objects are filled in createGfxResources, when ranges of meshes are known
+        batch.objects = StorageBuffer<GpuCullObject>::Create(components.size(), false, true);
+        batch.indirect_commands = StorageBuffer<DrawIndexedIndirectCommand>::Create(components.size());
+        batch.draw_count = StorageBuffer<uint32_t>::Create(1, true);
+
+        batch.draw_command = IndirectDrawCommand::Create(
+            fmt::format("{} {} culled", mesh->name(), material->name()), pipeline
+        );
+        batch.draw_command->setPrimitiveTopology(mesh->primitive_topology());
+        batch.draw_command->addVertexBuffer(mesh->render_data()->vertex_buffer);
+        batch.draw_command->addVertexBuffer(batch.instance_buffer);
+        mesh->render_data()->setIndexBuffer(*batch.draw_command);
+        batch.draw_command->addUniformBuffer(batch.model_uniform_buffer);
+        AddMaterialSamplers(*batch.draw_command, *material, *pipeline);
+        batch.draw_command->setIndirectBuffer(batch.indirect_commands);
+        batch.draw_command->setCountBuffer(batch.draw_count);
+
+        batch.cull_command = ComputeCommand::Create(
+            fmt::format("{} {} cull", mesh->name(), material->name()), render_data_->cull_pipeline
+        );
+        batch.cull_command->setStorageBuffer(0, batch.objects);
+        batch.cull_command->setStorageBuffer(1, batch.indirect_commands);
+        batch.cull_command->setStorageBuffer(2, batch.draw_count);
+        batch.cull_command->setClearStorageBuffer(2);
+        GpuCullParameters parameters{ .object_count = static_cast<uint32_t>(components.size()) };
+        batch.cull_command->setPushConstants(parameters);
+        batch.cull_command->setGroupCount(parameters.group_count());
+
+        size_t batch_index = render_data_->culling_batches.size();
+        for (size_t object_index = 0; object_index < components.size(); ++object_index) {
+            render_data_->culled_components[components[object_index].get()] = { batch_index, object_index };
+        }
+        batch.components = std::move(components);
+        render_data_->culling_batches.push_back(std::move(batch));
+    }
+    logger().info(
+        "Culling {} mesh components on GPU with {} indirect draw commands.",
+        render_data_->culled_components.size(), render_data_->culling_batches.size()
+    );
+}
+
 CameraUniform SceneRenderer::createUniformObject() const {
     auto camera_uniform = CameraUniform{
         .view_mat = glm::lookAt(camera_.position, camera_.center, camera_.up),
@@ -0,0 +1,363 @@
+#include "gfx/bvh.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace {
+
+constexpr uint32_t BinCount = 16;
+
+struct Bin {
+    wg::BoundingBox box;
+    wg::BoundingBox center_box;
+    uint32_t object_count{ 0 };
+};
+
+// Empty boxes are finite, with min and max at the limits of float
+bool IsFinite(const wg::BoundingBox& box) {
+    for (glm::length_t i = 0; i < 3; ++i) {
+        if (!std::isfinite(box.min[i]) || !std::isfinite(box.max[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // unnamed namespace
+
+namespace wg {
+
+void Bvh::build(std::vector<BoundingBox> object_boxes) {
+    object_boxes_ = std::move(object_boxes);
+    rebuild();
+}
+
+void Bvh::rebuild() {
+    nodes_.clear();
+    object_indices_.clear();
+    object_leaves_.assign(object_boxes_.size(), InvalidIndex);
+    depth_ = 0;
+    cost_ = 0.f;
+    build_cost_ = 0.f;
+
+    std::vector<glm::vec3> centers(object_boxes_.size());
+    for (uint32_t object = 0; object < static_cast<uint32_t>(object_boxes_.size()); ++object) {
+        if (!object_boxes_[object].empty()) {
+            centers[object] = object_boxes_[object].center();
+            object_indices_.push_back(object);
+        }
+    }
+    if (object_indices_.empty()) {
+        return;
+    }
+
+    nodes_.reserve(2 * object_indices_.size() / MaxLeafObjectCount + 1);
+    nodes_.push_back({ .first = 0, .object_count = static_cast<uint32_t>(object_indices_.size()) });
+    BoundingBox root_center_box;
+    for (auto object : object_indices_) {
+        nodes_[0].box.merge(object_boxes_[object]);
+        root_center_box.merge(centers[object]);
+    }
+    // Nodes to split, holding their object ranges until then, with their depths and boxes of object centers
+    struct PendingNode {
+        uint32_t node_index;
+        uint32_t depth;
+        BoundingBox center_box;
+    };
+    std::vector<PendingNode> pending_nodes{ { 0, 1, root_center_box } };
+    while (!pending_nodes.empty()) {
+        auto [node_index, depth, center_box] = pending_nodes.back();
+        pending_nodes.pop_back();
+        depth_ = std::max(depth_, depth);
+
+        uint32_t first = nodes_[node_index].first;
+        uint32_t end = first + nodes_[node_index].object_count;
+        float area = nodes_[node_index].box.surface_area();
+        if (end - first <= MaxLeafObjectCount) {
+            for (uint32_t i = first; i < end; ++i) {
+                object_leaves_[object_indices_[i]] = node_index;
+            }
+            cost_ += area * static_cast<float>(end - first);
+            continue;
+        }
+        cost_ += area;
+
+        // Split along the longest axis of centers at the bin boundary of the lowest SAH cost. Bins keep boxes of
+        // objects and of their centers, giving boxes of children without another pass over objects.
+        std::array<BoundingBox, 2> child_boxes;
+        std::array<BoundingBox, 2> child_center_boxes;
+        uint32_t middle = end;
+        auto extent = center_box.max - center_box.min;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        if (extent[axis] > 0.f) {
+            float bin_scale = static_cast<float>(BinCount) / extent[axis];
+            float bin_min = center_box.min[axis];
+            auto bin_of = [&centers, axis, bin_scale, bin_min](uint32_t object) {
+                auto bin = static_cast<uint32_t>((centers[object][axis] - bin_min) * bin_scale);
+                return std::min(bin, BinCount - 1);
+            };
+            std::array<Bin, BinCount> bins{};
+            for (uint32_t i = first; i < end; ++i) {
+                auto object = object_indices_[i];
+                auto& bin = bins[bin_of(object)];
+                bin.box.merge(object_boxes_[object]);
+                bin.center_box.merge(centers[object]);
+                ++bin.object_count;
+            }
+            // Costs of bins [0, split) on the left, swept from the left, then bins [split, BinCount) from the right
+            std::array<float, BinCount> split_costs{};
+            BoundingBox left_box;
+            uint32_t left_count = 0;
+            for (uint32_t split = 1; split < BinCount; ++split) {
+                left_box.merge(bins[split - 1].box);
+                left_count += bins[split - 1].object_count;
+                split_costs[split] = left_box.surface_area() * static_cast<float>(left_count);
+            }
+            BoundingBox right_box;
+            uint32_t right_count = 0;
+            uint32_t best_split = 0;
+            float best_cost = std::numeric_limits<float>::max();
+            for (uint32_t split = BinCount - 1; split > 0; --split) {
+                right_box.merge(bins[split].box);
+                right_count += bins[split].object_count;
+                float split_cost = split_costs[split] + right_box.surface_area() * static_cast<float>(right_count);
+                if (right_count > 0 && right_count < end - first && split_cost < best_cost) {
+                    best_cost = split_cost;
+                    best_split = split;
+                }
+            }
+            // Centers span more than one bin, so both sides of the best split have objects
+            if (best_split > 0) {
+                auto* split_end = std::partition(
+                    object_indices_.data() + first, object_indices_.data() + end,
+                    [&bin_of, best_split](uint32_t object) { return bin_of(object) < best_split; }
+                );
+                middle = static_cast<uint32_t>(split_end - object_indices_.data());
+                for (uint32_t bin = 0; bin < BinCount; ++bin) {
+                    child_boxes[bin < best_split ? 0 : 1].merge(bins[bin].box);
+                    child_center_boxes[bin < best_split ? 0 : 1].merge(bins[bin].center_box);
+                }
+            }
+        }
+        if (middle == first || middle == end) {
+            // Centers at the same point, split in halves
+            middle = first + (end - first) / 2;
+            child_boxes = {};
+            child_center_boxes = {};
+            for (uint32_t i = first; i < end; ++i) {
+                child_boxes[i < middle ? 0 : 1].merge(object_boxes_[object_indices_[i]]);
+                child_center_boxes[i < middle ? 0 : 1].merge(centers[object_indices_[i]]);
+            }
+        }
+
+        auto left_index = static_cast<uint32_t>(nodes_.size());
+        nodes_.push_back({ .box = child_boxes[0], .first = first, .object_count = middle - first, .parent = node_index });
+        nodes_.push_back({ .box = child_boxes[1], .first = middle, .object_count = end - middle, .parent = node_index });
+        nodes_[node_index].first = left_index;
+        nodes_[node_index].object_count = 0;
+        pending_nodes.push_back({ left_index, depth + 1, child_center_boxes[0] });
+        pending_nodes.push_back({ left_index + 1, depth + 1, child_center_boxes[1] });
+    }
+    build_cost_ = cost_;
+}
+
+void Bvh::update(uint32_t object, const BoundingBox& box) {
+    // Infinite bounds would make costs infinite and centers NaN
+    if (object >= object_leaves_.size() || !IsFinite(box)) {
+        return;
+    }
+    object_boxes_[object] = box;
+    if (object_leaves_[object] == InvalidIndex) {
+        if (!box.empty()) {
+            insert(object);
+        }
+        return;
+    }
+    refit(object_leaves_[object]);
+}
+
+void Bvh::refit(uint32_t node_index) {
+    while (node_index != InvalidIndex) {
+        auto& node = nodes_[node_index];
+        BoundingBox node_box;
+        if (node.object_count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.object_count; ++i) {
+                node_box.merge(object_boxes_[object_indices_[i]]);
+            }
+        } else {
+            node_box.merge(nodes_[node.first].box);
+            node_box.merge(nodes_[node.first + 1].box);
+        }
+        if (node_box == node.box) {
+            break;
+        }
+        float weight = node.object_count > 0 ? static_cast<float>(node.object_count) : 1.f;
+        cost_ += (node_box.surface_area() - node.box.surface_area()) * weight;
+        node.box = node_box;
+        node_index = node.parent;
+    }
+}
+
+void Bvh::insert(uint32_t object) {
+    auto& box = object_boxes_[object];
+    if (nodes_.empty()) {
+        nodes_.push_back({ .box = box, .first = static_cast<uint32_t>(object_indices_.size()), .object_count = 1 });
+        object_indices_.push_back(object);
+        object_leaves_[object] = 0;
+        depth_ = 1;
+        cost_ += box.surface_area();
+        return;
+    }
+
+    // Descend into the child whose box grows least
+    uint32_t node_index = 0;
+    uint32_t depth = 1;
+    while (nodes_[node_index].object_count == 0) {
+        uint32_t first = nodes_[node_index].first;
+        std::array<float, 2> growths;
+        for (uint32_t i = 0; i < 2; ++i) {
+            auto child_box = nodes_[first + i].box;
+            child_box.merge(box);
+            growths[i] = child_box.surface_area() - nodes_[first + i].box.surface_area();
+        }
+        node_index = growths[0] <= growths[1] ? first : first + 1;
+        ++depth;
+    }
+
+    // Children must be adjacent, so the leaf becomes the parent of a copy of itself and a leaf of the object
+    auto leaf = nodes_[node_index];
+    auto first_child = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back({ .box = leaf.box, .first = leaf.first, .object_count = leaf.object_count, .parent = node_index });
+    nodes_.push_back(
+        { .box = box, .first = static_cast<uint32_t>(object_indices_.size()), .object_count = 1, .parent = node_index }
+    );
+    for (uint32_t i = leaf.first; i < leaf.first + leaf.object_count; ++i) {
+        object_leaves_[object_indices_[i]] = first_child;
+    }
+    object_indices_.push_back(object);
+    object_leaves_[object] = first_child + 1;
+    nodes_[node_index].first = first_child;
+    nodes_[node_index].object_count = 0;
+    // The old leaf is counted again, weighted by 1 as an internal node
+    cost_ += leaf.box.surface_area() + box.surface_area();
+    depth_ = std::max(depth_, depth + 1);
+    refit(node_index);
+}
+
+bool Bvh::rebuildIfDegraded() {
+    if (!degraded()) {
+        return false;
+    }
+    rebuild();
+    return true;
+}
+
+void Bvh::appendObjects(uint32_t node_index, std::vector<uint32_t>& out_objects) const {
+    std::vector<uint32_t> node_indices{ node_index };
+    while (!node_indices.empty()) {
+        auto& node = nodes_[node_indices.back()];
+        node_indices.pop_back();
+        if (node.object_count > 0) {
+            out_objects.insert(
+                out_objects.end(), object_indices_.begin() + node.first, object_indices_.begin() + node.first + node.object_count
+            );
+        } else {
+            node_indices.push_back(node.first);
+            node_indices.push_back(node.first + 1);
+        }
+    }
+}
+
+void Bvh::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out_objects) const {
+    if (nodes_.empty()) {
+        return;
+    }
+    std::vector<uint32_t> node_indices{ 0 };
+    while (!node_indices.empty()) {
+        uint32_t node_index = node_indices.back();
+        auto& node = nodes_[node_index];
+        node_indices.pop_back();
+        if (!frustum.intersectsBox(node.box)) {
+            continue;
+        }
+        // Subtrees completely inside need no more tests
+        if (frustum.containsBox(node.box)) {
+            appendObjects(node_index, out_objects);
+        } else if (node.object_count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.object_count; ++i) {
+                if (frustum.intersectsBox(object_boxes_[object_indices_[i]])) {
+                    out_objects.push_back(object_indices_[i]);
+                }
+            }
+        } else {
+            node_indices.push_back(node.first);
+            node_indices.push_back(node.first + 1);
+        }
+    }
+}
+
+void Bvh::queryOverlap(const BoundingBox& box, std::vector<uint32_t>& out_objects) const {
+    if (nodes_.empty()) {
+        return;
+    }
+    std::vector<uint32_t> node_indices{ 0 };
+    while (!node_indices.empty()) {
+        auto& node = nodes_[node_indices.back()];
+        node_indices.pop_back();
+        if (!node.box.overlaps(box)) {
+            continue;
+        }
+        if (node.object_count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.object_count; ++i) {
+                if (object_boxes_[object_indices_[i]].overlaps(box)) {
+                    out_objects.push_back(object_indices_[i]);
+                }
+            }
+        } else {
+            node_indices.push_back(node.first);
+            node_indices.push_back(node.first + 1);
+        }
+    }
+}
+
+uint32_t Bvh::queryNearest(const glm::vec3& point, float max_distance) const {
+    uint32_t nearest_object = InvalidIndex;
+    if (nodes_.empty()) {
+        return nearest_object;
+    }
+    float nearest_distance_squared = max_distance * max_distance;
+    // (node, squared distance to its box)
+    std::vector<std::pair<uint32_t, float>> node_distances{ { 0, nodes_[0].box.distance_squared(point) } };
+    while (!node_distances.empty()) {
+        auto [node_index, distance_squared] = node_distances.back();
+        node_distances.pop_back();
+        if (distance_squared > nearest_distance_squared) {
+            continue;
+        }
+        auto& node = nodes_[node_index];
+        if (node.object_count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.object_count; ++i) {
+                float object_distance_squared = object_boxes_[object_indices_[i]].distance_squared(point);
+                if (object_distance_squared < nearest_distance_squared) {
+                    nearest_distance_squared = object_distance_squared;
+                    nearest_object = object_indices_[i];
+                }
+            }
+        } else {
+            // Visit the nearer child first, so that the other is more likely to be skipped
+            float left_distance_squared = nodes_[node.first].box.distance_squared(point);
+            float right_distance_squared = nodes_[node.first + 1].box.distance_squared(point);
+            if (left_distance_squared < right_distance_squared) {
+                node_distances.emplace_back(node.first + 1, right_distance_squared);
+                node_distances.emplace_back(node.first, left_distance_squared);
+            } else {
+                node_distances.emplace_back(node.first, left_distance_squared);
+                node_distances.emplace_back(node.first + 1, right_distance_squared);
+            }
+        }
+    }
+    return nearest_object;
+}
+
+} // namespace wg
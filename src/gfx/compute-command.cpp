@@ -0,0 +1,449 @@
+#include "gfx/compute-command.h"
+
+#include "common/logger.h"
+#include "gfx/gfx.h"
+#include "gfx-private.h"
+#include "compute-command-private.h"
+
+#include <map>
+
+namespace {
+
+[[nodiscard]] auto& logger() {
+    static auto logger_ = wg::Logger::Get("gfx");
+    return *logger_;
+}
+
+} // unnamed namespace
+
+namespace wg {
+
+std::shared_ptr<ComputeCommand> ComputeCommand::Create(std::string name, const std::shared_ptr<ComputePipeline>& pipeline) {
+    return std::shared_ptr<ComputeCommand>(new ComputeCommand(std::move(name), pipeline));
+}
+
+ComputeCommand::ComputeCommand(std::string name, const std::shared_ptr<ComputePipeline>& pipeline)
+    : name_(std::move(name)), pipeline_(pipeline), impl_(std::make_unique<Impl>()) {}
+
+ComputeCommand::~ComputeCommand() = default;
+
+ComputeCommand& ComputeCommand::setStorageBuffer(uint32_t binding, const std::shared_ptr<GfxBufferBase>& storage_buffer) {
+    storage_buffers_[binding] = storage_buffer;
+    return *this;
+}
+
+void ComputeCommand::clearStorageBuffers() {
+    storage_buffers_.clear();
+    cleared_storage_buffers_.clear();
+}
+
+void ComputeCommand::setClearStorageBuffer(uint32_t binding, bool clear) {
+    if (clear) {
+        cleared_storage_buffers_.insert(binding);
+    } else {
+        cleared_storage_buffers_.erase(binding);
+    }
+}
+
+ComputeCommand& ComputeCommand::setSampler(uint32_t binding, const std::shared_ptr<Sampler>& sampler) {
+    samplers_[binding] = sampler;
+    return *this;
+}
+
+void ComputeCommand::clearSamplers() {
+    samplers_.clear();
+}
+
+bool ComputeCommand::valid() const {
+    if (!pipeline_ || !pipeline_->shader() || !pipeline_->shader()->valid()) {
+        return false;
+    }
+
+    for (auto&& description : pipeline_->storage_buffer_layout().descriptions()) {
+        auto it = storage_buffers_.find(description.binding);
+        if (it == storage_buffers_.end() || !it->second->storage()) {
+            return false;
+        }
+    }
+
+    for (auto&& description : pipeline_->sampler_layout().descriptions()) {
+        if (samplers_.find(description.binding) == samplers_.end()) {
+            return false;
+        }
+    }
+
+    if (pipeline_->push_constant_size() > 0 && push_constants_.size() != pipeline_->push_constant_size()) {
+        return false;
+    }
+
+    return group_count_[0] > 0 && group_count_[1] > 0 && group_count_[2] > 0;
+}
+
+void Gfx::Impl::getComputeQueue(QueueInfoRef& out_compute_queue) const {
+    // Use 0 for now
+    const auto& queue_references = gfx->logical_device_->impl_->queue_references;
+    if (gfx->features_manager().feature_enabled(gfx_features::compute) && !queue_references[gfx_queues::compute].empty()) {
+        out_compute_queue = queue_references[gfx_queues::compute][0];
+    } else {
+        out_compute_queue = queue_references[gfx_queues::graphics][0];
+    }
+}
+
+void Gfx::finishComputeCommand(const std::shared_ptr<ComputeCommand>& compute_command) {
+    compute_command->impl_->resources.reset();
+
+    if (!logical_device_) {
+        logger().error("Cannot finish compute command because logical device is not available.");
+        return;
+    }
+
+    auto& pipeline = compute_command->pipeline_;
+    auto* pipeline_resources = pipeline ? pipeline->impl_->resources.data() : nullptr;
+    if (!pipeline_resources) {
+        logger().error("Cannot finish compute command \"{}\" because pipeline resources are not available.", compute_command->name());
+        return;
+    }
+
+    if (!compute_command->valid()) {
+        logger().error("Cannot finish compute command \"{}\" because it does not match its pipeline.", compute_command->name());
+        return;
+    }
+
+    // Images are owned by the graphics queue family
+    QueueInfoRef compute_queue;
+    impl_->getComputeQueue(compute_queue);
+    uint32_t graphics_family_index = logical_device_->impl_->queue_references[gfx_queues::graphics][0].queue_family_index;
+    if (!compute_command->samplers_.empty() && compute_queue.queue_family_index != graphics_family_index) {
+        logger().error(
+            "Cannot finish compute command \"{}\" because samplers need compute queue in graphics queue family.",
+            compute_command->name()
+        );
+        return;
+    }
+
+    auto resources = std::make_unique<ComputeCommandResources>();
+
+    if (*pipeline_resources->set_layout) {
+        // Descriptor pool
+        std::map<vk::DescriptorType, uint32_t> descriptor_counts;
+        if (!pipeline->storage_buffer_layout().descriptions().empty()) {
+            descriptor_counts[vk::DescriptorType::eStorageBuffer] +=
+                static_cast<uint32_t>(pipeline->storage_buffer_layout().descriptions().size());
+        }
+        if (!pipeline->sampler_layout().descriptions().empty()) {
+            descriptor_counts[vk::DescriptorType::eCombinedImageSampler] +=
+                static_cast<uint32_t>(pipeline->sampler_layout().descriptions().size());
+        }
+        std::vector<vk::DescriptorPoolSize> descriptor_pool_sizes;
+        for (auto&&[type, count] : descriptor_counts) {
+            descriptor_pool_sizes.emplace_back(
+                vk::DescriptorPoolSize{
+                    .type = type,
+                    .descriptorCount = count
+                }
+            );
+        }
+
+        auto descriptor_pool_create_info = vk::DescriptorPoolCreateInfo{
+            .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+            .maxSets = 1
+        }
+            .setPoolSizes(descriptor_pool_sizes);
+        resources->descriptor_pool =
+            logical_device_->impl_->vk_device.createDescriptorPool(descriptor_pool_create_info);
+
+        auto set_layouts = std::array{ *pipeline_resources->set_layout };
+        auto descriptor_pool_alloc_info = vk::DescriptorSetAllocateInfo{
+            .descriptorPool = *resources->descriptor_pool
+        }
+            .setSetLayouts(set_layouts);
+        resources->descriptor_sets =
+            logical_device_->impl_->vk_device.allocateDescriptorSets(descriptor_pool_alloc_info);
+
+        std::vector<vk::WriteDescriptorSet> write_descriptor_sets;
+        // Reserved so that pointers in write_descriptor_sets stay valid
+        std::vector<vk::DescriptorBufferInfo> buffer_infos;
+        buffer_infos.reserve(pipeline->storage_buffer_layout().descriptions().size());
+        std::vector<vk::DescriptorImageInfo> image_infos;
+        image_infos.reserve(pipeline->sampler_layout().descriptions().size());
+
+        for (auto&& description : pipeline->storage_buffer_layout().descriptions()) {
+            const auto& storage_buffer = compute_command->storage_buffers_[description.binding];
+            auto* buffer_resources = storage_buffer->impl_->resources.data();
+            if (!buffer_resources) {
+                logger().error(
+                    "Cannot finish compute command \"{}\" because storage buffer resources of binding {} are not available.",
+                    compute_command->name(), description.binding
+                );
+                return;
+            }
+            buffer_infos.emplace_back(
+                vk::DescriptorBufferInfo{
+                    .buffer = *buffer_resources->buffer,
+                    .offset = 0,
+                    .range  = VK_WHOLE_SIZE
+                }
+            );
+            write_descriptor_sets.emplace_back(
+                vk::WriteDescriptorSet{
+                    .dstSet          = *resources->descriptor_sets[0],
+                    .dstBinding      = description.binding,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType  = vk::DescriptorType::eStorageBuffer,
+                    .pBufferInfo     = &buffer_infos.back()
+                }
+            );
+        }
+
+        for (auto&& description : pipeline->sampler_layout().descriptions()) {
+            const auto& sampler = compute_command->samplers_[description.binding];
+            if (sampler->image()) {
+                impl_->useImage(sampler->image());
+            }
+            auto* image_resources = sampler->image_ ? sampler->image_->impl_->resources.data() : nullptr;
+            auto* sampler_resources = sampler->impl_->resources.data();
+            if (!image_resources || !sampler_resources) {
+                logger().error(
+                    "Cannot finish compute command \"{}\" because image/sampler resources of binding {} are not available.",
+                    compute_command->name(), description.binding
+                );
+                return;
+            }
+            resources->samplers[description.binding] = sampler;
+            image_infos.emplace_back(
+                vk::DescriptorImageInfo{
+                    .sampler     = *sampler_resources->sampler,
+                    .imageView   = *image_resources->image_view,
+                    .imageLayout = image_resources->image_layout
+                }
+            );
+            write_descriptor_sets.emplace_back(
+                vk::WriteDescriptorSet{
+                    .dstSet          = *resources->descriptor_sets[0],
+                    .dstBinding      = description.binding,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType  = vk::DescriptorType::eCombinedImageSampler,
+                    .pImageInfo      = &image_infos.back()
+                }
+            );
+        }
+
+        logical_device_->impl_->vk_device.updateDescriptorSets(write_descriptor_sets, {});
+    }
+
+    compute_command->impl_->resources =
+        logical_device_->impl_->compute_command_resources.store(std::move(resources));
+}
+
+ComputeToken Gfx::submitComputeCommands(const std::vector<std::shared_ptr<ComputeCommand>>& compute_commands) {
+    if (!logical_device_) {
+        logger().error("Cannot submit compute commands because logical device is not available.");
+        return {};
+    }
+    if (compute_commands.empty()) {
+        return {};
+    }
+    auto& logical_device_impl = *logical_device_->impl_;
+
+    QueueInfoRef compute_queue;
+    impl_->getComputeQueue(compute_queue);
+
+    auto command_buffer_allocate_info = vk::CommandBufferAllocateInfo{
+        .commandPool = compute_queue.vk_command_pool,
+        .level = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1
+    };
+    auto command_buffers = (*logical_device_impl.vk_device).allocateCommandBuffers(command_buffer_allocate_info);
+    auto& command_buffer = command_buffers[0];
+    command_buffer.begin(
+        vk::CommandBufferBeginInfo{
+            .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit
+        }
+    );
+
+    // On the graphics queue, previous frames may still read buffers written here. Other queues wait for
+    // the semaphore of the last graphics submission instead, and only order after earlier compute submissions here.
+    const auto& graphics_queue = logical_device_impl.queue_references[gfx_queues::graphics][0];
+    if (compute_queue.vk_queue != graphics_queue.vk_queue) {
+        command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+            {},
+            vk::MemoryBarrier{
+                .srcAccessMask = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead,
+                .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite |
+                    vk::AccessFlagBits::eTransferWrite
+            },
+            {}, {}
+        );
+    } else {
+        command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput |
+                vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader |
+                vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+            {},
+            vk::MemoryBarrier{
+                .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+                .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite |
+                    vk::AccessFlagBits::eTransferWrite
+            },
+            {}, {}
+        );
+    }
+
+    std::vector<ComputeCommandResources*> used_resources;
+    for (auto&& compute_command : compute_commands) {
+        auto* resources = compute_command->impl_->resources.data();
+        auto* pipeline_resources = compute_command->pipeline_ ? compute_command->pipeline_->impl_->resources.data() : nullptr;
+        if (!resources || !pipeline_resources) {
+            logger().error("Skip compute command \"{}\" because it is not finished.", compute_command->name());
+            continue;
+        }
+
+        // Later dispatches may read what earlier ones wrote
+        if (!used_resources.empty()) {
+            command_buffer.pipelineBarrier(
+                vk::PipelineStageFlagBits::eComputeShader,
+                vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer, {},
+                vk::MemoryBarrier{
+                    .srcAccessMask = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead,
+                    .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite |
+                        vk::AccessFlagBits::eTransferWrite
+                },
+                {}, {}
+            );
+        }
+
+        bool cleared = false;
+        for (auto binding : compute_command->cleared_storage_buffers_) {
+            auto it = compute_command->storage_buffers_.find(binding);
+            auto* buffer_resources = it != compute_command->storage_buffers_.end() ? it->second->impl_->resources.data() : nullptr;
+            if (buffer_resources) {
+                command_buffer.fillBuffer(*buffer_resources->buffer, 0, VK_WHOLE_SIZE, 0);
+                cleared = true;
+            }
+        }
+        if (cleared) {
+            command_buffer.pipelineBarrier(
+                vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {},
+                vk::MemoryBarrier{
+                    .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+                    .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite
+                },
+                {}, {}
+            );
+        }
+
+        command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline_resources->pipeline);
+        if (!resources->descriptor_sets.empty()) {
+            command_buffer.bindDescriptorSets(
+                vk::PipelineBindPoint::eCompute, *pipeline_resources->pipeline_layout,
+                0, { *resources->descriptor_sets[0] }, {}
+            );
+        }
+        if (!compute_command->push_constants_.empty()) {
+            command_buffer.pushConstants<uint8_t>(
+                *pipeline_resources->pipeline_layout, vk::ShaderStageFlagBits::eCompute,
+                0, compute_command->push_constants_
+            );
+        }
+        const auto& group_count = compute_command->group_count_;
+        command_buffer.dispatch(group_count[0], group_count[1], group_count[2]);
+        used_resources.push_back(resources);
+    }
+
+    // Results are read on host after waiting for the fence, e.g. by readStorageBuffer
+    if (!used_resources.empty()) {
+        command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {},
+            vk::MemoryBarrier{
+                .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+                .dstAccessMask = vk::AccessFlagBits::eHostRead
+            },
+            {}, {}
+        );
+    }
+
+    command_buffer.end();
+
+    // Wait for uploads submitted since the last compute submission and the last graphics submission on GPU.
+    // Earlier compute submissions are ordered by the queue and the barrier above.
+    std::vector<vk::Semaphore> wait_semaphores;
+    std::vector<vk::PipelineStageFlags> wait_stages;
+    auto waited_semaphores = std::make_unique<std::vector<vk::raii::Semaphore>>();
+    impl_->waitPendingSignals(logical_device_impl.compute_waited_signal_submission_index, *waited_semaphores);
+    for (auto&& semaphore : *waited_semaphores) {
+        wait_semaphores.push_back(*semaphore);
+        wait_stages.emplace_back(vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer);
+    }
+    if (logical_device_impl.graphics_semaphore) {
+        wait_semaphores.push_back(**logical_device_impl.graphics_semaphore);
+        wait_stages.emplace_back(vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer);
+        waited_semaphores->emplace_back(std::move(*logical_device_impl.graphics_semaphore));
+        logical_device_impl.graphics_semaphore.reset();
+    }
+
+    auto signal_semaphore = logical_device_impl.vk_device.createSemaphore({});
+    auto signal_semaphores = std::array{ *signal_semaphore };
+
+    // Make host writes to storage buffers visible to this submission
+    logical_device_impl.memory_allocator->flushMappedRanges();
+
+    vk::Fence fence;
+    vk::Device vk_device = *logical_device_impl.vk_device;
+    vk::CommandPool vk_command_pool = compute_queue.vk_command_pool;
+    uint64_t submission_index = logical_device_impl.submission_tracker->beginSubmission(
+        fence,
+        [vk_device, vk_command_pool, command_buffers]() {
+            vk_device.freeCommandBuffers(vk_command_pool, command_buffers);
+        }
+    );
+
+    auto submit_info = vk::SubmitInfo{}
+        .setWaitSemaphores(wait_semaphores)
+        .setWaitDstStageMask(wait_stages)
+        .setCommandBuffers(command_buffers)
+        .setSignalSemaphores(signal_semaphores);
+    compute_queue.vk_queue.submit({ submit_info }, fence);
+
+    logical_device_impl.pending_signals.emplace_back(
+        GfxPendingSignal{
+            .semaphore = std::move(signal_semaphore),
+            .submission_index = submission_index
+        }
+    );
+    logical_device_impl.compute_waited_signal_submission_index = submission_index;
+    logical_device_impl.deletion_queue->retireAfter(std::move(waited_semaphores), submission_index);
+    for (auto* resources : used_resources) {
+        resources->last_used_submission_index = submission_index;
+    }
+    for (auto&& compute_command : compute_commands) {
+        for (auto&& [binding, storage_buffer] : compute_command->storage_buffers_) {
+            storage_buffer->has_gpu_data_ = true;
+            if (auto* buffer_resources = storage_buffer->impl_->resources.data()) {
+                buffer_resources->last_used_submission_index = submission_index;
+            }
+        }
+    }
+
+    return ComputeToken(submission_index);
+}
+
+bool Gfx::computeFinished(const ComputeToken& token) {
+    if (!logical_device_ || !token.valid()) {
+        return true;
+    }
+    return logical_device_->impl_->submission_tracker->finished(token.submission_index());
+}
+
+void Gfx::waitCompute(const ComputeToken& token) {
+    if (!logical_device_ || !token.valid()) {
+        return;
+    }
+    logical_device_->impl_->submission_tracker->wait(token.submission_index());
+}
+
+} // namespace wg
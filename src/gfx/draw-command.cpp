@@ -45,23 +45,66 @@ bool DrawCommand::draw_indexed() const {
 }
 
 size_t DrawCommand::vertex_count() const {
-    if (vertex_buffers_.empty()) {
-        return 0;
+    size_t result = std::numeric_limits<size_t>::max();
+    for (auto&& vertex_buffer : vertex_buffers_) {
+        if (!vertex_buffer->per_instance()) {
+            result = std::min(result, vertex_buffer->vertex_count());
+        }
     }
+    return result == std::numeric_limits<size_t>::max() ? 0 : result;
+}
+
+size_t DrawCommand::instance_count() const {
     size_t result = std::numeric_limits<size_t>::max();
     for (auto&& vertex_buffer : vertex_buffers_) {
-        result = std::min(result, vertex_buffer->vertex_count());
+        if (vertex_buffer->per_instance()) {
+            result = std::min(result, vertex_buffer->vertex_count());
+        }
     }
-    return result;
+    return result == std::numeric_limits<size_t>::max() ? 1 : result;
 }
 
 size_t DrawCommand::index_count() const {
+    if (index_range_) {
+        return index_range_->second;
+    }
     if (index_buffer_) {
         return index_buffer_->index_count();
     }
     return 0;
 }
 
+void DrawCommand::setIndexRange(uint32_t first_index, uint32_t index_count) {
+    if (!index_buffer_ || static_cast<size_t>(first_index) + index_count > index_buffer_->index_count()) {
+        logger().error("Cannot set index range of draw command \"{}\" outside of index buffer.", name_);
+        return;
+    }
+    index_range_ = { first_index, index_count };
+    // Update finished draw commands in place
+    auto* impl = getImpl();
+    if (impl->draw_indexed) {
+        impl->first_index = impl->index_buffer_first_index + first_index;
+        impl->index_count = index_count;
+    }
+}
+
+void DrawCommand::clearIndexRange() {
+    index_range_.reset();
+    auto* impl = getImpl();
+    if (impl->draw_indexed && index_buffer_) {
+        impl->first_index = impl->index_buffer_first_index;
+        impl->index_count = static_cast<uint32_t>(index_buffer_->index_count());
+    }
+}
+
+int32_t DrawCommand::base_vertex() const {
+    return getImpl()->base_vertex;
+}
+
+uint32_t DrawCommand::first_index() const {
+    return getImpl()->first_index;
+}
+
 std::vector<VertexBufferCombinedDescription> DrawCommand::getVertexBufferCombinedDescriptions() const {
     if (!pipeline_) {
         return {};
@@ -89,6 +132,7 @@ std::vector<VertexBufferCombinedDescription> DrawCommand::getVertexBufferCombine
                             .stride              = vertex_buffer_description.stride,
                             .offset              = vertex_buffer_description.offset,
                             .vertex_buffer_index = vertex_buffer_index,
+                            .per_instance        = vertex_buffer_description.per_instance,
                         }
                     );
                 }
@@ -164,6 +208,7 @@ void Gfx::finishDrawCommand(const std::shared_ptr<DrawCommand>& draw_command) {
 
     // Vertex factory
     impl->vertex_count = static_cast<uint32_t>(draw_command->vertex_count());
+    impl->instance_count = static_cast<uint32_t>(draw_command->instance_count());
     std::map<size_t, uint32_t> vb_index_to_binding;
     for (auto&& description : draw_command->getVertexBufferCombinedDescriptions()) {
         uint32_t binding = [impl, &vb_index_to_binding, &description]() {
@@ -175,7 +220,7 @@ void Gfx::finishDrawCommand(const std::shared_ptr<DrawCommand>& draw_command) {
                     vk::VertexInputBindingDescription{
                         .binding = new_binding,
                         .stride = description.stride,
-                        .inputRate = vk::VertexInputRate::eVertex
+                        .inputRate = description.per_instance ? vk::VertexInputRate::eInstance : vk::VertexInputRate::eVertex
                     }
                 );
                 return new_binding;
@@ -200,8 +245,35 @@ void Gfx::finishDrawCommand(const std::shared_ptr<DrawCommand>& draw_command) {
                 }
             );
 
+        if (impl->vertex_buffers.size() > binding) {
+            continue;
+        }
         auto&& vertex_buffer = draw_command->vertex_buffers()[description.vertex_buffer_index];
-        if (auto* vertex_buffer_resources = vertex_buffer->impl_->resources.data()) {
+        if (auto* geometry_range = vertex_buffer->impl_->geometry_range.data()) {
+            // Bind the whole pool so that draw commands in the same pool share bindings.
+            if (impl->vertex_buffers.empty()) {
+                impl->base_vertex = static_cast<int32_t>(geometry_range->first);
+            } else if (impl->base_vertex != static_cast<int32_t>(geometry_range->first)) {
+                logger().error("Vertex buffers of draw command \"{}\" do not share the same base vertex.", draw_command->name());
+            }
+            impl->vertex_buffers.emplace_back(geometry_range->buffer);
+            impl->vertex_buffer_offsets
+                .emplace_back(0);
+        } else if (!vertex_buffer->impl_->streaming_copies.empty()) {
+            std::vector<vk::Buffer> copies;
+            for (auto&& streaming_copy : vertex_buffer->impl_->streaming_copies) {
+                if (auto* copy_resources = streaming_copy.resources.data()) {
+                    copies.emplace_back(*copy_resources->buffer);
+                }
+            }
+            if (copies.empty()) {
+                continue;
+            }
+            impl->vertex_buffers.emplace_back(copies[0]);
+            impl->vertex_buffer_offsets
+                .emplace_back(0);
+            impl->streaming_vertex_buffers.emplace_back(binding, std::move(copies));
+        } else if (auto* vertex_buffer_resources = vertex_buffer->impl_->resources.data()) {
             impl->vertex_buffers.emplace_back(*vertex_buffer_resources->buffer);
             impl->vertex_buffer_offsets
                 .emplace_back(0);
@@ -210,14 +282,22 @@ void Gfx::finishDrawCommand(const std::shared_ptr<DrawCommand>& draw_command) {
 
     impl->draw_indexed = draw_command->draw_indexed();
     if (impl->draw_indexed) {
-        if (auto* index_buffer_resources = draw_command->index_buffer_->impl_->resources.data()) {
+        if (auto* geometry_range = draw_command->index_buffer_->impl_->geometry_range.data()) {
+            impl->index_buffer = geometry_range->buffer;
+            impl->index_buffer_first_index = geometry_range->first;
+        } else if (auto* index_buffer_resources = draw_command->index_buffer_->impl_->resources.data()) {
             impl->index_buffer = *index_buffer_resources->buffer;
         }
         impl->index_buffer_offset = 0;
         impl->index_type = index_types::ToVkIndexType(draw_command->index_buffer_->index_type());
+        impl->first_index = impl->index_buffer_first_index + (draw_command->index_range_ ? draw_command->index_range_->first : 0);
         impl->index_count = static_cast<uint32_t>(draw_command->index_count());
     }
 
+    if (auto* indirect_draw_command = dynamic_cast<IndirectDrawCommand*>(draw_command.get())) {
+        impl_->finishIndirectDrawCommand(*indirect_draw_command);
+    }
+
     impl->vertex_input_create_info = vk::PipelineVertexInputStateCreateInfo{}
         .setVertexBindingDescriptions(impl->vertex_bindings)
         .setVertexAttributeDescriptions(impl->vertex_attributes);
@@ -243,15 +323,167 @@ DrawCommand::Impl* SimpleDrawCommand::getImpl() {
     return impl_.get();
 }
 
-void SimpleDrawCommand::Impl::draw(vk::CommandBuffer& command_buffer) {
-    command_buffer.bindVertexBuffers(0, vertex_buffers, vertex_buffer_offsets);
-    if (draw_indexed) {
+const DrawCommand::Impl* SimpleDrawCommand::getImpl() const {
+    return impl_.get();
+}
+
+std::shared_ptr<InstancedDrawCommand> InstancedDrawCommand::Create(
+    std::string name, const std::shared_ptr<GfxPipeline>& pipeline
+) {
+    return std::shared_ptr<InstancedDrawCommand>(new InstancedDrawCommand(std::move(name), pipeline));
+}
+
+InstancedDrawCommand::InstancedDrawCommand(std::string name, const std::shared_ptr<GfxPipeline>& pipeline)
+    : DrawCommand(std::move(name)), impl_(std::make_unique<Impl>()) {
+    pipeline_ = pipeline;
+}
+
+DrawCommand::Impl* InstancedDrawCommand::getImpl() {
+    return impl_.get();
+}
+
+const DrawCommand::Impl* InstancedDrawCommand::getImpl() const {
+    return impl_.get();
+}
+
+void InstancedDrawCommand::setDrawInstanceCount(uint32_t draw_instance_count) {
+    impl_->draw_instance_count = draw_instance_count;
+}
+
+uint32_t InstancedDrawCommand::draw_instance_count() const {
+    return std::min(impl_->draw_instance_count, impl_->instance_count);
+}
+
+std::shared_ptr<IndirectDrawCommand> IndirectDrawCommand::Create(
+    std::string name, const std::shared_ptr<GfxPipeline>& pipeline
+) {
+    return std::shared_ptr<IndirectDrawCommand>(new IndirectDrawCommand(std::move(name), pipeline));
+}
+
+IndirectDrawCommand::IndirectDrawCommand(std::string name, const std::shared_ptr<GfxPipeline>& pipeline)
+    : DrawCommand(std::move(name)), impl_(std::make_unique<Impl>()) {
+    pipeline_ = pipeline;
+}
+
+DrawCommand::Impl* IndirectDrawCommand::getImpl() {
+    return impl_.get();
+}
+
+const DrawCommand::Impl* IndirectDrawCommand::getImpl() const {
+    return impl_.get();
+}
+
+void IndirectDrawCommand::setIndirectBuffer(
+    const std::shared_ptr<StorageBuffer<DrawIndexedIndirectCommand>>& indirect_buffer, uint32_t max_draw_count
+) {
+    indirect_buffer_ = indirect_buffer;
+    max_draw_count_ = max_draw_count;
+}
+
+uint32_t IndirectDrawCommand::max_draw_count() const {
+    if (!indirect_buffer_) {
+        return 0;
+    }
+    auto element_count = static_cast<uint32_t>(indirect_buffer_->element_count());
+    return max_draw_count_ > 0 ? std::min(max_draw_count_, element_count) : element_count;
+}
+
+void Gfx::Impl::finishIndirectDrawCommand(IndirectDrawCommand& draw_command) {
+    auto& impl = *draw_command.impl_;
+    impl.indirect_buffer = nullptr;
+    impl.count_buffer = nullptr;
+    impl.max_draw_count = 0;
+    impl.draw_indexed_indirect_count = nullptr;
+    impl.multi_draw_indirect = gfx->features_manager().feature_enabled(gfx_features::multi_draw_indirect);
+
+    if (!draw_command.draw_indexed()) {
+        logger().error("Cannot finish indirect draw command \"{}\" because it has no index buffer.", draw_command.name());
+        return;
+    }
+    auto* indirect_buffer_resources = draw_command.indirect_buffer_ ? draw_command.indirect_buffer_->impl_->resources.data() : nullptr;
+    if (!indirect_buffer_resources) {
+        logger().error("Cannot finish indirect draw command \"{}\" because indirect buffer resources are not available.", draw_command.name());
+        return;
+    }
+    impl.indirect_buffer = *indirect_buffer_resources->buffer;
+    impl.max_draw_count = draw_command.max_draw_count();
+
+    auto* count_buffer_resources = draw_command.count_buffer_ ? draw_command.count_buffer_->impl_->resources.data() : nullptr;
+    if (count_buffer_resources && gfx->features_manager().feature_enabled(gfx_features::draw_indirect_count)) {
+        impl.count_buffer = *count_buffer_resources->buffer;
+        impl.draw_indexed_indirect_count =
+            gfx->logical_device_->impl_->vk_device.getDispatcher()->vkCmdDrawIndexedIndirectCountKHR;
+    }
+}
+
+bool DrawCommand::Impl::bindBuffers(vk::CommandBuffer& command_buffer, DrawCommandBufferBindings& bindings, size_t image_index) const {
+    bool bound = false;
+    const auto* image_vertex_buffers = &vertex_buffers;
+    std::vector<vk::Buffer> streaming_image_vertex_buffers;
+    if (!streaming_vertex_buffers.empty()) {
+        streaming_image_vertex_buffers = vertex_buffers;
+        for (auto&& [binding, copies] : streaming_vertex_buffers) {
+            streaming_image_vertex_buffers[binding] = copies[image_index % copies.size()];
+        }
+        image_vertex_buffers = &streaming_image_vertex_buffers;
+    }
+    if (*image_vertex_buffers != bindings.vertex_buffers || vertex_buffer_offsets != bindings.vertex_buffer_offsets) {
+        command_buffer.bindVertexBuffers(0, *image_vertex_buffers, vertex_buffer_offsets);
+        bindings.vertex_buffers = *image_vertex_buffers;
+        bindings.vertex_buffer_offsets = vertex_buffer_offsets;
+        bound = true;
+    }
+    if (draw_indexed && (
+        index_buffer != bindings.index_buffer || index_buffer_offset != bindings.index_buffer_offset ||
+        index_type != bindings.index_type
+    )) {
         command_buffer.bindIndexBuffer(
             index_buffer, index_buffer_offset, index_type
         );
-        command_buffer.drawIndexed(index_count, 1, 0, 0, 0);
+        bindings.index_buffer = index_buffer;
+        bindings.index_buffer_offset = index_buffer_offset;
+        bindings.index_type = index_type;
+        bound = true;
+    }
+    return bound;
+}
+
+void SimpleDrawCommand::Impl::draw(vk::CommandBuffer& command_buffer) {
+    if (draw_indexed) {
+        command_buffer.drawIndexed(index_count, 1, first_index, base_vertex, 0);
     } else {
-        command_buffer.draw(vertex_count, 1, 0, 0);
+        command_buffer.draw(vertex_count, 1, static_cast<uint32_t>(base_vertex), 0);
+    }
+}
+
+void InstancedDrawCommand::Impl::draw(vk::CommandBuffer& command_buffer) {
+    uint32_t count = std::min(draw_instance_count, instance_count);
+    if (count == 0) {
+        return;
+    }
+    if (draw_indexed) {
+        command_buffer.drawIndexed(index_count, count, first_index, base_vertex, 0);
+    } else {
+        command_buffer.draw(vertex_count, count, static_cast<uint32_t>(base_vertex), 0);
+    }
+}
+
+void IndirectDrawCommand::Impl::draw(vk::CommandBuffer& command_buffer) {
+    if (!indirect_buffer || max_draw_count == 0) {
+        return;
+    }
+    constexpr auto stride = static_cast<uint32_t>(sizeof(DrawIndexedIndirectCommand));
+    if (draw_indexed_indirect_count) {
+        draw_indexed_indirect_count(
+            static_cast<VkCommandBuffer>(command_buffer), static_cast<VkBuffer>(indirect_buffer), 0,
+            static_cast<VkBuffer>(count_buffer), 0, max_draw_count, stride
+        );
+    } else if (multi_draw_indirect) {
+        command_buffer.drawIndexedIndirect(indirect_buffer, 0, max_draw_count, stride);
+    } else {
+        for (uint32_t i = 0; i < max_draw_count; ++i) {
+            command_buffer.drawIndexedIndirect(indirect_buffer, vk::DeviceSize{ i } * stride, 1, stride);
+        }
     }
 }
 
@@ -0,0 +1,212 @@
+#include "gfx/geometry-pool.h"
+
+#include "common/logger.h"
+#include "gfx/gfx.h"
+#include "gfx-private.h"
+#include "geometry-pool-private.h"
+
+namespace {
+
+[[nodiscard]] auto& logger() {
+    static auto logger_ = wg::Logger::Get("gfx");
+    return *logger_;
+}
+
+} // unnamed namespace
+
+namespace wg {
+
+std::shared_ptr<GeometryPool> GeometryPool::Create(
+    uint32_t vertex_stride, uint32_t vertex_capacity, uint32_t index_capacity, index_types::IndexType index_type
+) {
+    return std::shared_ptr<GeometryPool>(new GeometryPool(vertex_stride, vertex_capacity, index_capacity, index_type));
+}
+
+GeometryPool::GeometryPool(
+    uint32_t vertex_stride, uint32_t vertex_capacity, uint32_t index_capacity, index_types::IndexType index_type
+) : vertex_stride_(vertex_stride), vertex_capacity_(vertex_capacity), index_capacity_(index_capacity),
+    index_type_(index_type), impl_(std::make_unique<Impl>(vertex_capacity, index_capacity)) {}
+
+GeometryPool::~GeometryPool() = default;
+
+uint32_t GeometryPool::used_vertex_count() const {
+    return static_cast<uint32_t>(impl_->vertex_allocator.used_size());
+}
+
+uint32_t GeometryPool::used_index_count() const {
+    return static_cast<uint32_t>(impl_->index_allocator.used_size());
+}
+
+size_t GeometryPool::range_count() const {
+    return impl_->vertex_allocator.allocation_count() + impl_->index_allocator.allocation_count();
+}
+
+bool GeometryPool::has_gpu_resources() const {
+    return impl_->vertex_resources.data() != nullptr;
+}
+
+GeometryRangeResources::~GeometryRangeResources() {
+    if (!pool) {
+        return;
+    }
+    auto& allocator = index ? pool->impl_->index_allocator : pool->impl_->vertex_allocator;
+    allocator.free(first);
+}
+
+void Gfx::createGeometryPoolResources(const std::shared_ptr<GeometryPool>& geometry_pool) {
+    auto& pool_impl = *geometry_pool->impl_;
+    pool_impl.vertex_resources.reset();
+    pool_impl.vertex_memory_resources.reset();
+    pool_impl.index_resources.reset();
+    pool_impl.index_memory_resources.reset();
+
+    if (!logical_device_) {
+        logger().error("Cannot create geometry pool resources because logical device is not available.");
+        return;
+    }
+    if (geometry_pool->vertex_capacity() == 0 || geometry_pool->vertex_stride() == 0) {
+        logger().error("Cannot create geometry pool resources because vertex capacity is empty.");
+        return;
+    }
+
+    QueueInfoRef transfer_queue;
+    auto sharing_mode = impl_->getTransferQueue(transfer_queue);
+    uint32_t graphics_family_index = logical_device_->impl_->queue_references[gfx_queues::graphics][0].queue_family_index;
+    std::vector<uint32_t> queue_family_indices = { graphics_family_index };
+    if (graphics_family_index != transfer_queue.queue_family_index) {
+        queue_family_indices.push_back(transfer_queue.queue_family_index);
+    }
+
+    auto create_pool_buffer = [this, sharing_mode, &queue_family_indices](
+        vk::DeviceSize size, vk::BufferUsageFlags usage,
+        OwnedResourceHandle<GfxMemoryResources>& out_memory_resources,
+        OwnedResourceHandle<GfxBufferResources>& out_resources
+    ) {
+        auto resources = std::make_unique<GfxBufferResources>();
+        resources->cpu_data_size = size;
+        impl_->createBuffer(size, vk::BufferUsageFlagBits::eTransferDst | usage, sharing_mode, queue_family_indices, *resources);
+
+        // Pools are large and live long, so they get their own device memory.
+        auto memory_resources = std::make_unique<GfxMemoryResources>();
+        if (!impl_->createGfxMemory(
+            resources->buffer.getMemoryRequirements(), vk::MemoryPropertyFlagBits::eDeviceLocal,
+            *memory_resources, gfx_memory_kinds::dedicated
+        )) {
+            return false;
+        }
+        resources->buffer.bindMemory(memory_resources->allocation.memory(), memory_resources->allocation.offset());
+        out_memory_resources = logical_device_->impl_->memory_resources.store(std::move(memory_resources));
+        out_resources = logical_device_->impl_->buffer_resources.store(std::move(resources));
+        return true;
+    };
+
+    const auto vertex_buffer_size = static_cast<vk::DeviceSize>(geometry_pool->vertex_capacity()) * geometry_pool->vertex_stride();
+    if (!create_pool_buffer(
+        vertex_buffer_size, vk::BufferUsageFlagBits::eVertexBuffer,
+        pool_impl.vertex_memory_resources, pool_impl.vertex_resources
+    )) {
+        logger().error("Cannot create geometry pool resources because vertex buffer memory allocation failed.");
+        return;
+    }
+
+    if (geometry_pool->index_capacity() > 0) {
+        const auto index_buffer_size = static_cast<vk::DeviceSize>(geometry_pool->index_capacity()) * geometry_pool->index_size();
+        if (!create_pool_buffer(
+            index_buffer_size, vk::BufferUsageFlagBits::eIndexBuffer,
+            pool_impl.index_memory_resources, pool_impl.index_resources
+        )) {
+            logger().error("Cannot create geometry pool resources because index buffer memory allocation failed.");
+            pool_impl.vertex_resources.reset();
+            pool_impl.vertex_memory_resources.reset();
+            return;
+        }
+    }
+
+    logger().info(
+        "Geometry pool created with {} vertices and {} indices.",
+        geometry_pool->vertex_capacity(), geometry_pool->index_capacity()
+    );
+}
+
+bool Gfx::Impl::createGeometryRangeResources(
+    const std::shared_ptr<GfxBufferBase>& gfx_buffer, const std::shared_ptr<GeometryPool>& geometry_pool,
+    bool index, uint32_t count, uint32_t element_size
+) {
+    gfx_buffer->impl_->memory_resources.reset();
+    gfx_buffer->impl_->resources.reset();
+    gfx_buffer->impl_->geometry_range.reset();
+    gfx_buffer->has_gpu_data_ = false;
+
+    if (!gfx->logical_device_) {
+        logger().error("Cannot create geometry range because logical device is not available.");
+        return false;
+    }
+
+    auto& pool_impl = *geometry_pool->impl_;
+    auto* pool_resources = index ? pool_impl.index_resources.data() : pool_impl.vertex_resources.data();
+    if (!pool_resources) {
+        logger().error("Cannot create geometry range because geometry pool resources are not available.");
+        return false;
+    }
+
+    auto& allocator = index ? pool_impl.index_allocator : pool_impl.vertex_allocator;
+    uint64_t first = allocator.allocate(count);
+    if (first == GfxFreeListAllocator::InvalidOffset) {
+        logger().error(
+            "Cannot allocate {} {} from geometry pool, largest free range has {}.",
+            count, index ? "indices" : "vertices", allocator.largest_free_range()
+        );
+        return false;
+    }
+
+    auto resources = std::make_unique<GeometryRangeResources>();
+    resources->pool = geometry_pool;
+    resources->buffer = *pool_resources->buffer;
+    resources->index = index;
+    resources->first = static_cast<uint32_t>(first);
+    resources->count = count;
+    resources->offset = static_cast<vk::DeviceSize>(first) * element_size;
+    resources->size = static_cast<vk::DeviceSize>(count) * element_size;
+    gfx_buffer->impl_->geometry_range = gfx->logical_device_->impl_->geometry_range_resources.store(std::move(resources));
+    return true;
+}
+
+void Gfx::createVertexBufferResources(
+    const std::shared_ptr<VertexBufferBase>& vertex_buffer, const std::shared_ptr<GeometryPool>& geometry_pool,
+    const std::shared_ptr<UploadBatch>& upload_batch
+) {
+    const auto vertex_count = static_cast<uint32_t>(vertex_buffer->vertex_count());
+    if (vertex_buffer->data_size() != static_cast<size_t>(vertex_count) * geometry_pool->vertex_stride()) {
+        logger().error("Cannot place vertex buffer in geometry pool because vertex stride differs from the pool.");
+        return;
+    }
+    if (!impl_->createGeometryRangeResources(vertex_buffer, geometry_pool, false, vertex_count, geometry_pool->vertex_stride())) {
+        return;
+    }
+    if (upload_batch) {
+        upload_batch->addBuffer(vertex_buffer);
+    } else {
+        commitBuffer(vertex_buffer, true);
+    }
+}
+
+void Gfx::createIndexBufferResources(
+    const std::shared_ptr<IndexBuffer>& index_buffer, const std::shared_ptr<GeometryPool>& geometry_pool,
+    const std::shared_ptr<UploadBatch>& upload_batch
+) {
+    if (index_buffer->index_type() != geometry_pool->index_type()) {
+        logger().error("Cannot place index buffer in geometry pool because index type differs from the pool.");
+        return;
+    }
+    const auto index_count = static_cast<uint32_t>(index_buffer->index_count());
+    if (!impl_->createGeometryRangeResources(index_buffer, geometry_pool, true, index_count, geometry_pool->index_size())) {
+        return;
+    }
+    if (upload_batch) {
+        upload_batch->addBuffer(index_buffer);
+    } else {
+        commitBuffer(index_buffer, true);
+    }
+}
+
+} // namespace wg
@@ -0,0 +1,441 @@
+#include "gfx/gfx.h"
+
+#include "common/logger.h"
+#include "gfx-private.h"
+#include "gfx-allocator-private.h"
+
+#include <algorithm>
+
+namespace {
+
+[[nodiscard]] auto& logger() {
+    static auto logger_ = wg::Logger::Get("gfx");
+    return *logger_;
+}
+
+} // unnamed namespace
+
+namespace wg {
+
+GfxBuddyAllocator::GfxBuddyAllocator(uint64_t size, uint64_t min_allocation_size)
+    : size_(size), min_allocation_size_(std::min(min_allocation_size, size)), num_levels_(1) {
+    for (uint64_t node_size = size_; node_size > min_allocation_size_; node_size >>= 1) {
+        ++num_levels_;
+    }
+    free_lists_.resize(num_levels_);
+    free_lists_[0].insert(0);
+}
+
+uint64_t GfxBuddyAllocator::RoundUpToPowerOf2(uint64_t value) {
+    uint64_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+uint64_t GfxBuddyAllocator::allocate(uint64_t size, uint64_t alignment) {
+    // Nodes are aligned to their own size, so a node large enough for both size and alignment satisfies both.
+    const uint64_t node_size = RoundUpToPowerOf2(std::max({ size, alignment, min_allocation_size_ }));
+    if (node_size > size_) {
+        return InvalidOffset;
+    }
+
+    uint32_t target_level = 0;
+    while ((size_ >> target_level) > node_size) {
+        ++target_level;
+    }
+
+    // Find the smallest free node that can hold the allocation.
+    int level = static_cast<int>(target_level);
+    while (level >= 0 && free_lists_[level].empty()) {
+        --level;
+    }
+    if (level < 0) {
+        return InvalidOffset;
+    }
+
+    uint64_t offset = *free_lists_[level].begin();
+    free_lists_[level].erase(free_lists_[level].begin());
+
+    // Split down to target level, keeping the lower half and freeing the upper half.
+    for (auto split_level = static_cast<uint32_t>(level) + 1; split_level <= target_level; ++split_level) {
+        free_lists_[split_level].insert(offset + (size_ >> split_level));
+    }
+
+    allocated_levels_[offset] = target_level;
+    used_size_ += node_size;
+    return offset;
+}
+
+void GfxBuddyAllocator::free(uint64_t offset) {
+    auto it = allocated_levels_.find(offset);
+    if (it == allocated_levels_.end()) {
+        logger().error("Cannot free memory range at offset {} because it is not allocated.", offset);
+        return;
+    }
+
+    uint32_t level = it->second;
+    allocated_levels_.erase(it);
+    used_size_ -= size_ >> level;
+
+    // Merge with free buddies.
+    while (level > 0) {
+        uint64_t buddy = offset ^ (size_ >> level);
+        auto buddy_it = free_lists_[level].find(buddy);
+        if (buddy_it == free_lists_[level].end()) {
+            break;
+        }
+        free_lists_[level].erase(buddy_it);
+        offset = std::min(offset, buddy);
+        --level;
+    }
+    free_lists_[level].insert(offset);
+}
+
+GfxFreeListAllocator::GfxFreeListAllocator(uint64_t size)
+    : size_(size) {
+    if (size_ > 0) {
+        free_ranges_[0] = size_;
+    }
+}
+
+uint64_t GfxFreeListAllocator::allocate(uint64_t size, uint64_t alignment) {
+    if (size == 0) {
+        return InvalidOffset;
+    }
+    alignment = std::max<uint64_t>(alignment, 1);
+
+    for (auto it = free_ranges_.begin(); it != free_ranges_.end(); ++it) {
+        const uint64_t range_offset = it->first;
+        const uint64_t range_size = it->second;
+        const uint64_t offset = AlignUp(range_offset, alignment);
+        if (offset + size > range_offset + range_size) {
+            continue;
+        }
+
+        // Split the free range, keeping padding before and remainder after the allocation.
+        free_ranges_.erase(it);
+        if (offset > range_offset) {
+            free_ranges_[range_offset] = offset - range_offset;
+        }
+        if (offset + size < range_offset + range_size) {
+            free_ranges_[offset + size] = range_offset + range_size - offset - size;
+        }
+
+        allocated_sizes_[offset] = size;
+        used_size_ += size;
+        return offset;
+    }
+    return InvalidOffset;
+}
+
+void GfxFreeListAllocator::free(uint64_t offset) {
+    auto it = allocated_sizes_.find(offset);
+    if (it == allocated_sizes_.end()) {
+        logger().error("Cannot free range at offset {} because it is not allocated.", offset);
+        return;
+    }
+
+    uint64_t size = it->second;
+    allocated_sizes_.erase(it);
+    used_size_ -= size;
+
+    // Coalesce with the free ranges right after and right before.
+    auto next = free_ranges_.lower_bound(offset);
+    if (next != free_ranges_.end() && next->first == offset + size) {
+        size += next->second;
+        next = free_ranges_.erase(next);
+    }
+    if (next != free_ranges_.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += size;
+            return;
+        }
+    }
+    free_ranges_[offset] = size;
+}
+
+uint64_t GfxFreeListAllocator::largest_free_range() const {
+    uint64_t result = 0;
+    for (auto&& [offset, size] : free_ranges_) {
+        result = std::max(result, size);
+    }
+    return result;
+}
+
+GfxMemoryAllocation::GfxMemoryAllocation(
+    std::shared_ptr<GfxMemoryBlock> block, vk::DeviceSize offset, vk::DeviceSize size,
+    gfx_memory_categories::MemoryCategory category
+) : block_(std::move(block)), offset_(offset), size_(size), category_(category) {
+    if (block_) {
+        block_->category_used_bytes[category_] += size_;
+    }
+}
+
+GfxMemoryAllocation::GfxMemoryAllocation(GfxMemoryAllocation&& other) noexcept
+    : block_(std::move(other.block_)), offset_(other.offset_), size_(other.size_), category_(other.category_) {
+    other.block_.reset();
+}
+
+GfxMemoryAllocation& GfxMemoryAllocation::operator=(GfxMemoryAllocation&& other) noexcept {
+    if (this != &other) {
+        reset();
+        block_ = std::move(other.block_);
+        offset_ = other.offset_;
+        size_ = other.size_;
+        category_ = other.category_;
+        other.block_.reset();
+    }
+    return *this;
+}
+
+GfxMemoryAllocation::~GfxMemoryAllocation() {
+    reset();
+}
+
+void GfxMemoryAllocation::reset() {
+    if (block_) {
+        block_->category_used_bytes[category_] -= size_;
+        if (block_->sub_allocator) {
+            block_->sub_allocator->free(offset_);
+        }
+    }
+    block_.reset();
+    offset_ = 0;
+    size_ = 0;
+}
+
+GfxMemoryAllocator::GfxMemoryAllocator(
+    const vk::raii::Device& vk_device, const vk::PhysicalDeviceMemoryProperties& memory_properties,
+    vk::DeviceSize non_coherent_atom_size
+) : vk_device_(vk_device), memory_properties_(memory_properties), non_coherent_atom_size_(std::max<vk::DeviceSize>(non_coherent_atom_size, 1)) {
+    pools_.resize(memory_properties_.memoryTypeCount);
+}
+
+vk::DeviceSize GfxMemoryAllocator::getBlockSize(uint32_t memory_type_index) const {
+    const uint32_t heap_index = memory_properties_.memoryTypes[memory_type_index].heapIndex;
+    const vk::DeviceSize heap_size = memory_properties_.memoryHeaps[heap_index].size;
+
+    // Small heaps (e.g. host visible device local memory) get 1/8 of heap size per block.
+    vk::DeviceSize block_size = DefaultBlockSize;
+    while (block_size > MinAllocationSize && block_size > heap_size / 8) {
+        block_size >>= 1;
+    }
+    return block_size;
+}
+
+std::shared_ptr<GfxMemoryBlock> GfxMemoryAllocator::createBlock(vk::DeviceSize size, uint32_t memory_type_index, bool sub_allocated) {
+    auto memory_allocate_info = vk::MemoryAllocateInfo{
+        .allocationSize = size,
+        .memoryTypeIndex = memory_type_index
+    };
+
+    auto block = std::make_shared<GfxMemoryBlock>();
+    block->memory = vk_device_.allocateMemory(memory_allocate_info);
+    block->memory_type_index = memory_type_index;
+    block->size = size;
+    const auto property_flags = memory_properties_.memoryTypes[memory_type_index].propertyFlags;
+    if (property_flags & vk::MemoryPropertyFlagBits::eHostVisible) {
+        block->mapped = block->memory.mapMemory(0, VK_WHOLE_SIZE, {});
+        block->host_coherent = static_cast<bool>(property_flags & vk::MemoryPropertyFlagBits::eHostCoherent);
+    }
+    if (sub_allocated) {
+        block->sub_allocator = std::make_unique<GfxBuddyAllocator>(size, MinAllocationSize);
+    }
+    return block;
+}
+
+bool GfxMemoryAllocator::allocate(
+    vk::MemoryRequirements memory_requirements, uint32_t memory_type_index,
+    gfx_memory_kinds::MemoryKind kind, gfx_memory_categories::MemoryCategory category,
+    GfxMemoryAllocation& out_allocation
+) {
+    out_allocation.reset();
+    if (memory_type_index >= pools_.size()) {
+        logger().error("Cannot allocate memory because memory type index {} is invalid.", memory_type_index);
+        return false;
+    }
+
+    const vk::DeviceSize block_size = getBlockSize(memory_type_index);
+
+    // Flushes are done in whole atoms, so allocations of non-coherent memory must not share atoms.
+    const auto property_flags = memory_properties_.memoryTypes[memory_type_index].propertyFlags;
+    if ((property_flags & vk::MemoryPropertyFlagBits::eHostVisible) && !(property_flags & vk::MemoryPropertyFlagBits::eHostCoherent)) {
+        memory_requirements.alignment = std::max(memory_requirements.alignment, non_coherent_atom_size_);
+    }
+
+    // Resources larger than half a block would waste most of a buddy node.
+    if (kind == gfx_memory_kinds::dedicated || memory_requirements.size > block_size / 2) {
+        auto block = createBlock(memory_requirements.size, memory_type_index, false);
+        dedicated_blocks_.erase(
+            std::remove_if(
+                dedicated_blocks_.begin(), dedicated_blocks_.end(),
+                [](const std::weak_ptr<GfxMemoryBlock>& weak_block) { return weak_block.expired(); }
+            ),
+            dedicated_blocks_.end()
+        );
+        dedicated_blocks_.emplace_back(block);
+        out_allocation = GfxMemoryAllocation(std::move(block), 0, memory_requirements.size, category);
+        return true;
+    }
+
+    auto& blocks = pools_[memory_type_index][kind];
+    for (auto&& block : blocks) {
+        uint64_t offset = block->sub_allocator->allocate(memory_requirements.size, memory_requirements.alignment);
+        if (offset != GfxBuddyAllocator::InvalidOffset) {
+            out_allocation = GfxMemoryAllocation(block, offset, memory_requirements.size, category);
+            return true;
+        }
+    }
+
+    releaseEmptyBlocks();
+
+    auto block = createBlock(block_size, memory_type_index, true);
+    uint64_t offset = block->sub_allocator->allocate(memory_requirements.size, memory_requirements.alignment);
+    if (offset == GfxBuddyAllocator::InvalidOffset) {
+        logger().error("Cannot allocate {} bytes from a new memory block of {} bytes.", memory_requirements.size, block_size);
+        return false;
+    }
+    blocks.emplace_back(block);
+    out_allocation = GfxMemoryAllocation(std::move(block), offset, memory_requirements.size, category);
+    return true;
+}
+
+void GfxMemoryAllocator::releaseEmptyBlocks(bool keep_one_per_pool) {
+    for (auto&& pool : pools_) {
+        for (auto&& blocks : pool) {
+            bool kept = !keep_one_per_pool;
+            blocks.erase(
+                std::remove_if(
+                    blocks.begin(), blocks.end(),
+                    [&kept](const std::shared_ptr<GfxMemoryBlock>& block) {
+                        if (!block->sub_allocator->empty()) {
+                            return false;
+                        }
+                        if (!kept) {
+                            kept = true;
+                            return false;
+                        }
+                        return true;
+                    }
+                ),
+                blocks.end()
+            );
+        }
+    }
+}
+
+void GfxMemoryAllocator::addFlushRange(const GfxMemoryAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) {
+    if (!allocation.block_ || allocation.block_->host_coherent || size == 0) {
+        return;
+    }
+    pending_flush_ranges_.emplace_back(
+        FlushRange{
+            .block = allocation.block_,
+            .offset = allocation.offset_ + offset,
+            .size = size
+        }
+    );
+}
+
+void GfxMemoryAllocator::flushMappedRanges() {
+    if (pending_flush_ranges_.empty()) {
+        return;
+    }
+
+    std::sort(
+        pending_flush_ranges_.begin(), pending_flush_ranges_.end(),
+        [](const FlushRange& a, const FlushRange& b) {
+            return a.block != b.block ? a.block.get() < b.block.get() : a.offset < b.offset;
+        }
+    );
+
+    // Round to atoms (or the end of memory) and merge overlapping ranges of the same memory.
+    std::vector<vk::MappedMemoryRange> ranges;
+    const GfxMemoryBlock* last_block = nullptr;
+    for (auto&& flush_range : pending_flush_ranges_) {
+        const vk::DeviceSize begin = flush_range.offset / non_coherent_atom_size_ * non_coherent_atom_size_;
+        const vk::DeviceSize end = std::min(
+            (flush_range.offset + flush_range.size + non_coherent_atom_size_ - 1) / non_coherent_atom_size_ * non_coherent_atom_size_,
+            flush_range.block->size
+        );
+        if (last_block == flush_range.block.get() && begin <= ranges.back().offset + ranges.back().size) {
+            ranges.back().size = std::max(ranges.back().size, end - ranges.back().offset);
+            continue;
+        }
+        ranges.emplace_back(
+            vk::MappedMemoryRange{
+                .memory = *flush_range.block->memory,
+                .offset = begin,
+                .size = end - begin
+            }
+        );
+        last_block = flush_range.block.get();
+    }
+
+    vk_device_.flushMappedMemoryRanges(ranges);
+    pending_flush_ranges_.clear();
+}
+
+void GfxMemoryAllocator::invalidateMappedRange(const GfxMemoryAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) {
+    if (!allocation.block_ || allocation.block_->host_coherent || size == 0) {
+        return;
+    }
+    const vk::DeviceSize begin = (allocation.offset_ + offset) / non_coherent_atom_size_ * non_coherent_atom_size_;
+    const vk::DeviceSize end = std::min(
+        (allocation.offset_ + offset + size + non_coherent_atom_size_ - 1) / non_coherent_atom_size_ * non_coherent_atom_size_,
+        allocation.block_->size
+    );
+    vk_device_.invalidateMappedMemoryRanges(
+        vk::MappedMemoryRange{
+            .memory = *allocation.block_->memory,
+            .offset = begin,
+            .size = end - begin
+        }
+    );
+}
+
+std::vector<GfxMemoryHeapStatistics> GfxMemoryAllocator::statistics() const {
+    std::vector<GfxMemoryHeapStatistics> heap_statistics(memory_properties_.memoryHeapCount);
+    for (uint32_t heap_index = 0; heap_index < memory_properties_.memoryHeapCount; ++heap_index) {
+        auto& stats = heap_statistics[heap_index];
+        stats.heap_index = heap_index;
+        stats.heap_size = memory_properties_.memoryHeaps[heap_index].size;
+        stats.device_local = static_cast<bool>(memory_properties_.memoryHeaps[heap_index].flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+    }
+
+    for (uint32_t memory_type_index = 0; memory_type_index < pools_.size(); ++memory_type_index) {
+        auto& stats = heap_statistics[memory_properties_.memoryTypes[memory_type_index].heapIndex];
+        for (auto&& blocks : pools_[memory_type_index]) {
+            for (auto&& block : blocks) {
+                ++stats.block_count;
+                stats.allocation_count += static_cast<uint32_t>(block->sub_allocator->allocation_count());
+                stats.allocated_bytes += block->size;
+                stats.used_bytes += block->sub_allocator->used_size();
+                for (size_t category = 0; category < gfx_memory_categories::NUM_MEMORY_CATEGORIES; ++category) {
+                    stats.category_used_bytes[category] += block->category_used_bytes[category];
+                }
+            }
+        }
+    }
+
+    for (auto&& weak_block : dedicated_blocks_) {
+        if (auto block = weak_block.lock()) {
+            auto& stats = heap_statistics[memory_properties_.memoryTypes[block->memory_type_index].heapIndex];
+            ++stats.block_count;
+            ++stats.dedicated_allocation_count;
+            ++stats.allocation_count;
+            stats.allocated_bytes += block->size;
+            stats.used_bytes += block->size;
+            for (size_t category = 0; category < gfx_memory_categories::NUM_MEMORY_CATEGORIES; ++category) {
+                stats.category_used_bytes[category] += block->category_used_bytes[category];
+            }
+        }
+    }
+
+    return heap_statistics;
+}
+
+} // namespace wg
@@ -0,0 +1,367 @@
+#include "gfx/gfx.h"
+
+#include "common/logger.h"
+#include "gfx-private.h"
+#include "gfx-budget-private.h"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+[[nodiscard]] auto& logger() {
+    static auto logger_ = wg::Logger::Get("gfx");
+    return *logger_;
+}
+
+} // unnamed namespace
+
+namespace wg {
+
+namespace gfx_memory_categories {
+
+const char* const MEMORY_CATEGORY_NAMES[NUM_MEMORY_CATEGORIES] = {
+    "buffer",
+    "image",
+    "render_target",
+};
+
+} // namespace gfx_memory_categories
+
+GfxMemoryBudget::GfxMemoryBudget(GfxSubmissionTracker& submission_tracker)
+    : submission_tracker_(submission_tracker) {}
+
+void GfxMemoryBudget::touchImage(const std::shared_ptr<Image>& image) {
+    auto it = image_positions_.find(image.get());
+    if (it != image_positions_.end()) {
+        images_.erase(it->second);
+    }
+    image_positions_[image.get()] = images_.insert(images_.end(), image);
+}
+
+std::vector<std::shared_ptr<Image>> GfxMemoryBudget::leastRecentlyUsedImages() {
+    std::vector<std::shared_ptr<Image>> result;
+    for (auto it = images_.begin(); it != images_.end();) {
+        if (auto image = it->lock()) {
+            result.emplace_back(std::move(image));
+            ++it;
+            continue;
+        }
+        // A new image may have been touched at the same address
+        auto position_it = std::find_if(
+            image_positions_.begin(), image_positions_.end(),
+            [it](const auto& kv) { return kv.second == it; }
+        );
+        if (position_it != image_positions_.end()) {
+            image_positions_.erase(position_it);
+        }
+        it = images_.erase(it);
+    }
+    return result;
+}
+
+void GfxMemoryBudget::addPendingEviction(uint32_t heap_index, vk::DeviceSize size) {
+    pending_evictions_.emplace_back(
+        PendingEviction{
+            .heap_index = heap_index,
+            .size = size,
+            .submission_index = submission_tracker_.last_submission_index()
+        }
+    );
+}
+
+void GfxMemoryBudget::setHeapUsage(uint32_t heap_index, vk::DeviceSize used_bytes, vk::DeviceSize budget_limit_bytes) {
+    if (heap_index >= heap_usages_.size()) {
+        heap_usages_.resize(heap_index + 1);
+    }
+    heap_usages_[heap_index] = {
+        .used_bytes = used_bytes,
+        .budget_limit_bytes = budget_limit_bytes,
+        .known = true
+    };
+}
+
+void GfxMemoryBudget::addHeapUsage(uint32_t heap_index, vk::DeviceSize size) {
+    if (heap_index < heap_usages_.size()) {
+        heap_usages_[heap_index].used_bytes += size;
+    }
+}
+
+void GfxMemoryBudget::invalidateHeapUsages() {
+    for (auto&& heap_usage : heap_usages_) {
+        heap_usage.known = false;
+    }
+}
+
+bool GfxMemoryBudget::mayExceedBudget(uint32_t heap_index, vk::DeviceSize size) const {
+    if (heap_index >= heap_usages_.size() || !heap_usages_[heap_index].known) {
+        return true;
+    }
+    const auto& heap_usage = heap_usages_[heap_index];
+    return heap_usage.used_bytes + size > heap_usage.budget_limit_bytes;
+}
+
+vk::DeviceSize GfxMemoryBudget::pendingEvictionBytes(uint32_t heap_index) {
+    pending_evictions_.erase(
+        std::remove_if(
+            pending_evictions_.begin(), pending_evictions_.end(),
+            [this](const PendingEviction& pending_eviction) {
+                return submission_tracker_.finished(pending_eviction.submission_index);
+            }
+        ),
+        pending_evictions_.end()
+    );
+
+    vk::DeviceSize result = 0;
+    for (auto&& pending_eviction : pending_evictions_) {
+        if (pending_eviction.heap_index == heap_index) {
+            result += pending_eviction.size;
+        }
+    }
+    return result;
+}
+
+std::vector<GfxMemoryHeapStatistics> Gfx::memoryStatistics() const {
+    if (!logical_device_ || !logical_device_->impl_->memory_allocator) {
+        return {};
+    }
+    auto heap_statistics = logical_device_->impl_->memory_allocator->statistics();
+
+    bool has_budget_properties = false;
+    vk::PhysicalDeviceMemoryBudgetPropertiesEXT budget_properties;
+    if (features_manager().feature_enabled(gfx_features::memory_budget)) {
+        auto memory_properties = physical_device().impl_->vk_physical_device.getMemoryProperties2KHR<
+            vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT
+        >();
+        budget_properties = memory_properties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        has_budget_properties = true;
+    }
+
+    for (auto&& stats : heap_statistics) {
+        // Some drivers report zero budget for heaps they do not track
+        if (has_budget_properties && budget_properties.heapBudget[stats.heap_index] > 0) {
+            stats.budget_bytes = budget_properties.heapBudget[stats.heap_index];
+            stats.usage_bytes = budget_properties.heapUsage[stats.heap_index];
+        } else {
+            stats.budget_bytes = stats.heap_size;
+            stats.usage_bytes = stats.allocated_bytes;
+        }
+        stats.budget_limit_bytes = stats.budget_bytes / 100 * static_cast<uint64_t>(setup_.memory_budget_percent);
+    }
+    return heap_statistics;
+}
+
+GfxMemoryEvictionStatistics Gfx::memoryEvictionStatistics() const {
+    if (!logical_device_ || !logical_device_->impl_->memory_budget) {
+        return {};
+    }
+    return logical_device_->impl_->memory_budget->eviction_statistics();
+}
+
+std::string Gfx::memoryStatisticsJson() const {
+    std::string result = R"({"heaps":[)";
+    auto out = std::back_inserter(result);
+    bool first_heap = true;
+    for (auto&& stats : memoryStatistics()) {
+        fmt::format_to(
+            out,
+            R"({}{{"index":{},"size":{},"device_local":{},"budget":{},"budget_limit":{},"usage":{},)"
+            R"("blocks":{},"dedicated_allocations":{},"allocations":{},"allocated_bytes":{},"used_bytes":{},"categories":{{)",
+            first_heap ? "" : ",", stats.heap_index, stats.heap_size, stats.device_local,
+            stats.budget_bytes, stats.budget_limit_bytes, stats.usage_bytes,
+            stats.block_count, stats.dedicated_allocation_count, stats.allocation_count,
+            stats.allocated_bytes, stats.used_bytes
+        );
+        for (size_t category = 0; category < gfx_memory_categories::NUM_MEMORY_CATEGORIES; ++category) {
+            fmt::format_to(
+                out, R"({}"{}":{})", category == 0 ? "" : ",",
+                gfx_memory_categories::MEMORY_CATEGORY_NAMES[category], stats.category_used_bytes[category]
+            );
+        }
+        result += "}}";
+        first_heap = false;
+    }
+
+    auto eviction_statistics = memoryEvictionStatistics();
+    fmt::format_to(
+        std::back_inserter(result), R"(],"eviction":{{"evicted_images":{},"restored_images":{},"evicted_bytes":{}}}}})",
+        eviction_statistics.evicted_image_count, eviction_statistics.restored_image_count, eviction_statistics.evicted_bytes
+    );
+    return result;
+}
+
+std::unordered_set<const Image*> Gfx::Impl::getImagesInUse() const {
+    std::unordered_set<const Image*> images_in_use;
+    for (auto&& render_target_resources : gfx->logical_device_->impl_->render_target_resources) {
+        for (auto&& draw_command_resources_of_images : render_target_resources.draw_command_resources) {
+            for (auto&& draw_command_resources : draw_command_resources_of_images) {
+                for (auto&& [binding, sampler] : draw_command_resources.samplers) {
+                    if (sampler && sampler->image()) {
+                        images_in_use.insert(sampler->image().get());
+                    }
+                }
+            }
+        }
+    }
+    for (auto&& compute_command_resources : gfx->logical_device_->impl_->compute_command_resources) {
+        for (auto&& [binding, sampler] : compute_command_resources.samplers) {
+            if (sampler && sampler->image()) {
+                images_in_use.insert(sampler->image().get());
+            }
+        }
+    }
+    return images_in_use;
+}
+
+bool Gfx::Impl::evictImage(const std::shared_ptr<Image>& image, const std::unordered_set<const Image*>& images_in_use) {
+    auto* memory_resources = image->impl_->memory_resources.data();
+    if (!memory_resources || !memory_resources->allocation.valid()) {
+        return false;
+    }
+    if (images_in_use.contains(image.get())) {
+        return false;
+    }
+    // Images without file or CPU data cannot be restored
+    if (image->filename().empty() && image->data_size() == 0) {
+        return false;
+    }
+
+    auto& logical_device_impl = *gfx->logical_device_->impl_;
+    const vk::DeviceSize size = memory_resources->allocation.size();
+    const uint32_t heap_index = logical_device_impl.memory_allocator->getHeapIndex(memory_resources->allocation.memory_type_index());
+
+    logger().info("Evicting image \"{}\" ({} bytes).", image->filename(), size);
+    image->impl_->resources.reset();
+    image->impl_->memory_resources.reset();
+    image->has_gpu_data_ = false;
+    image->impl_->evicted = true;
+
+    logical_device_impl.memory_budget->addPendingEviction(heap_index, size);
+    auto& eviction_statistics = logical_device_impl.memory_budget->eviction_statistics();
+    ++eviction_statistics.evicted_image_count;
+    eviction_statistics.evicted_bytes += size;
+    return true;
+}
+
+size_t Gfx::Impl::makeRoomInHeap(uint32_t heap_index, vk::DeviceSize size) {
+    auto& logical_device_impl = *gfx->logical_device_->impl_;
+    if (!logical_device_impl.memory_budget) {
+        return 0;
+    }
+
+    auto& memory_budget = *logical_device_impl.memory_budget;
+    // Usage is only queried when the estimate says the allocation may not fit
+    if (!memory_budget.mayExceedBudget(heap_index, size)) {
+        memory_budget.addHeapUsage(heap_index, size);
+        return 0;
+    }
+
+    auto get_pressure = [this, &logical_device_impl, &memory_budget, heap_index, size]() -> int64_t {
+        logical_device_impl.deletion_queue->collect();
+        auto heap_statistics = gfx->memoryStatistics();
+        if (heap_index >= heap_statistics.size()) {
+            return 0;
+        }
+        const auto& stats = heap_statistics[heap_index];
+        // Usage outside this allocator (e.g. other processes) counts when the budget extension reports it
+        const uint64_t external_bytes = stats.usage_bytes > stats.allocated_bytes ? stats.usage_bytes - stats.allocated_bytes : 0;
+        const uint64_t used_bytes = stats.used_bytes + external_bytes;
+        const uint64_t pending_bytes = memory_budget.pendingEvictionBytes(heap_index);
+        memory_budget.setHeapUsage(heap_index, used_bytes - std::min(used_bytes, pending_bytes), stats.budget_limit_bytes);
+        return static_cast<int64_t>(used_bytes - std::min(used_bytes, pending_bytes) + size) - static_cast<int64_t>(stats.budget_limit_bytes);
+    };
+
+    int64_t pressure = get_pressure();
+    if (pressure <= 0) {
+        memory_budget.addHeapUsage(heap_index, size);
+        return 0;
+    }
+
+    auto images_in_use = getImagesInUse();
+    size_t evicted_count = 0;
+    for (auto&& image : memory_budget.leastRecentlyUsedImages()) {
+        auto* memory_resources = image->impl_->memory_resources.data();
+        if (!memory_resources || !memory_resources->allocation.valid()) {
+            continue;
+        }
+        if (logical_device_impl.memory_allocator->getHeapIndex(memory_resources->allocation.memory_type_index()) != heap_index) {
+            continue;
+        }
+        const auto image_size = static_cast<int64_t>(memory_resources->allocation.size());
+        if (evictImage(image, images_in_use)) {
+            ++evicted_count;
+            pressure -= image_size;
+            if (pressure <= 0) {
+                break;
+            }
+        }
+    }
+
+    if (evicted_count > 0) {
+        pressure = get_pressure();
+    }
+    if (pressure > 0) {
+        logger().warn("Memory heap {} is over budget by {} bytes and no more images can be evicted.", heap_index, pressure);
+    }
+    memory_budget.addHeapUsage(heap_index, size);
+    return evicted_count;
+}
+
+void Gfx::Impl::useImage(const std::shared_ptr<Image>& image) {
+    if (!gfx->logical_device_ || !gfx->logical_device_->impl_->memory_budget) {
+        return;
+    }
+    if (image->impl_->evicted) {
+        gfx->restoreImage(image);
+    }
+    gfx->logical_device_->impl_->memory_budget->touchImage(image);
+}
+
+bool Gfx::evictImage(const std::shared_ptr<Image>& image) {
+    if (!logical_device_ || !logical_device_->impl_->memory_budget) {
+        logger().error("Cannot evict image because logical device is not available.");
+        return false;
+    }
+    return impl_->evictImage(image, impl_->getImagesInUse());
+}
+
+void Gfx::restoreImage(const std::shared_ptr<Image>& image) {
+    if (!logical_device_ || !logical_device_->impl_->memory_budget) {
+        logger().error("Cannot restore image because logical device is not available.");
+        return;
+    }
+    if (!image->impl_->evicted) {
+        return;
+    }
+
+    if (image->data_size() == 0) {
+        if (!image->load(image->filename_, image->image_format_, image->image_type_, image->file_format_)) {
+            logger().error("Cannot restore image \"{}\" because it cannot be reloaded.", image->filename());
+            return;
+        }
+    }
+    image->impl_->evicted = false;
+    createImageResources(image);
+    if (image->has_gpu_data()) {
+        ++logical_device_->impl_->memory_budget->eviction_statistics().restored_image_count;
+    }
+}
+
+size_t Gfx::enforceMemoryBudget() {
+    if (!logical_device_ || !logical_device_->impl_->memory_allocator) {
+        return 0;
+    }
+    // Budgets may have changed, e.g. by other processes
+    if (logical_device_->impl_->memory_budget) {
+        logical_device_->impl_->memory_budget->invalidateHeapUsages();
+    }
+    size_t evicted_count = 0;
+    for (auto&& stats : memoryStatistics()) {
+        evicted_count += impl_->makeRoomInHeap(stats.heap_index, 0);
+    }
+    return evicted_count;
+}
+
+} // namespace wg
@@ -2,9 +2,22 @@
 
 #include "common/logger.h"
 #include "gfx/gfx.h"
+#include "gfx/gfx-upload.h"
 #include "gfx-private.h"
 #include "gfx-buffer-private.h"
 
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__)
+#define WG_INDEX_NARROWING_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WG_INDEX_NARROWING_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace {
 
 [[nodiscard]] auto& logger() {
@@ -28,6 +41,29 @@ GfxMemoryBase::Impl* GfxBufferBase::getImpl() {
     return impl_.get();
 }
 
+void GfxBufferBase::markDirty(size_t offset, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    size_t begin = offset;
+    size_t end = offset + size;
+
+    // Merge with ranges overlapping or touching [begin, end).
+    auto it = dirty_ranges_.upper_bound(begin);
+    if (it != dirty_ranges_.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second >= begin) {
+            it = prev;
+        }
+    }
+    while (it != dirty_ranges_.end() && it->first <= end) {
+        begin = std::min(begin, it->first);
+        end = std::max(end, it->first + it->second);
+        it = dirty_ranges_.erase(it);
+    }
+    dirty_ranges_.emplace(begin, end - begin);
+}
+
 VertexBufferBase::VertexBufferBase(bool keep_cpu_data) : GfxBufferBase(keep_cpu_data) {}
 VertexBufferBase::~VertexBufferBase() = default;
 
@@ -35,6 +71,116 @@ IndexBuffer::IndexBuffer(index_types::IndexType index_type, bool keep_cpu_data)
     : GfxBufferBase(keep_cpu_data), index_type_(index_type) {}
 IndexBuffer::~IndexBuffer() = default;
 
+std::shared_ptr<IndexBuffer> IndexBuffer::CreateFromIndexArray(
+    index_types::IndexType index_type, std::vector<uint16_t>&& indices, bool keep_cpu_data
+) {
+    auto index_buffer = std::shared_ptr<IndexBuffer>(new IndexBuffer(index_type, keep_cpu_data));
+    index_buffer->setIndexArray(std::move(indices));
+    return index_buffer;
+}
+
+std::shared_ptr<IndexBuffer> IndexBuffer::CreateFromIndexArray(
+    index_types::IndexType index_type, std::vector<uint32_t>&& indices, bool keep_cpu_data
+) {
+    auto index_buffer = std::shared_ptr<IndexBuffer>(new IndexBuffer(index_type, keep_cpu_data));
+    index_buffer->setIndexArray(std::move(indices));
+    return index_buffer;
+}
+
+size_t IndexBuffer::data_size() const {
+    return index_type_ == index_types::index_16 ? indices_16_.size() * sizeof(uint16_t) : indices_32_.size() * sizeof(uint32_t);
+}
+
+const void* IndexBuffer::data() const {
+    return index_type_ == index_types::index_16 ? static_cast<const void*>(indices_16_.data()) : indices_32_.data();
+}
+
+void IndexBuffer::beginSetIndices(size_t count) {
+    index_count_ = count;
+    if (index_type_ == index_types::index_16) {
+        std::vector<uint32_t>().swap(indices_32_);
+        indices_16_.resize(count);
+    } else {
+        std::vector<uint16_t>().swap(indices_16_);
+        indices_32_.resize(count);
+    }
+    has_cpu_data_ = true;
+    has_gpu_data_ = false;
+    clearDirtyRanges();
+}
+
+void IndexBuffer::writeIndices(size_t first_index, const uint16_t* indices, size_t count) {
+    if (index_type_ == index_types::index_16) {
+        std::copy_n(indices, count, indices_16_.data() + first_index);
+    } else {
+        std::copy_n(indices, count, indices_32_.data() + first_index);
+    }
+}
+
+void IndexBuffer::writeIndices(size_t first_index, const uint32_t* indices, size_t count) {
+    if (index_type_ == index_types::index_16) {
+        NarrowIndices(indices, count, indices_16_.data() + first_index);
+    } else {
+        std::copy_n(indices, count, indices_32_.data() + first_index);
+    }
+}
+
+void IndexBuffer::setIndexArray(std::vector<uint16_t>&& indices) {
+    if (index_type_ != index_types::index_16) {
+        beginSetIndices(indices.size());
+        writeIndices(0, indices.data(), indices.size());
+        return;
+    }
+    beginSetIndices(0);
+    index_count_ = indices.size();
+    indices_16_ = std::move(indices);
+}
+
+void IndexBuffer::setIndexArray(std::vector<uint32_t>&& indices) {
+    if (index_type_ != index_types::index_32) {
+        beginSetIndices(indices.size());
+        writeIndices(0, indices.data(), indices.size());
+        return;
+    }
+    beginSetIndices(0);
+    index_count_ = indices.size();
+    indices_32_ = std::move(indices);
+}
+
+void IndexBuffer::NarrowIndices(const uint32_t* src, size_t count, uint16_t* dst) {
+    size_t i = 0;
+#if defined(WG_INDEX_NARROWING_AVX2)
+    // packs works within 128-bit lanes, so the two lanes of each result are reordered afterwards.
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 8));
+        // Sign extend the low 16 bits so that signed saturation keeps them unchanged
+        a = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+        b = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+    }
+#endif
+#if defined(WG_INDEX_NARROWING_SSE2)
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4));
+        a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+        b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(a, b));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = static_cast<uint16_t>(src[i]);
+    }
+}
+
+StorageBufferBase::StorageBufferBase(bool host_visible, bool keep_cpu_data)
+    : GfxBufferBase(keep_cpu_data), host_visible_(host_visible) {
+    storage_ = true;
+}
+StorageBufferBase::~StorageBufferBase() = default;
+
 UniformBufferBase::UniformBufferBase() : GfxBufferBase(true) {}
 UniformBufferBase::~UniformBufferBase() = default;
 
@@ -53,10 +199,11 @@ std::shared_ptr<UniformBufferBase> UniformBufferBase::Create(uniform_attributes:
     }
 }
 
-void Gfx::Impl::singleTimeCommand(
+uint64_t Gfx::Impl::singleTimeCommand(
     const QueueInfoRef& queue, const std::function<void(vk::CommandBuffer&)>& func,
     std::vector<vk::Semaphore> wait_semaphores, std::vector<vk::PipelineStageFlags> wait_stages, std::vector<vk::Semaphore> signal_semaphores
 ) {
+    auto& logical_device_impl = *gfx->logical_device_->impl_;
     auto command_buffer_allocate_info = vk::CommandBufferAllocateInfo{
         .commandPool = queue.vk_command_pool,
         .level = vk::CommandBufferLevel::ePrimary,
@@ -65,8 +212,7 @@ void Gfx::Impl::singleTimeCommand(
 
     // Do not use vk::raii::CommandBuffer because there might be compiling errors on MSVC
     // Since we are allocating from the pool, we can destruct command buffers together.
-    auto command_buffers =
-        (*gfx->logical_device_->impl_->vk_device).allocateCommandBuffers(command_buffer_allocate_info);
+    auto command_buffers = (*logical_device_impl.vk_device).allocateCommandBuffers(command_buffer_allocate_info);
     auto& command_buffer = command_buffers[0];
     command_buffer.begin(
         vk::CommandBufferBeginInfo{
@@ -83,15 +229,23 @@ void Gfx::Impl::singleTimeCommand(
         .setWaitSemaphores(wait_semaphores)
         .setWaitDstStageMask(wait_stages)
         .setSignalSemaphores(signal_semaphores);
-    queue.vk_queue.submit({ submit_info });
-    queue.vk_queue.waitIdle();
 
-    (*gfx->logical_device_->impl_->vk_device).freeCommandBuffers(queue.vk_command_pool, command_buffers);
+    // Wait for this submission only instead of the whole queue.
+    vk::Fence fence;
+    uint64_t submission_index = logical_device_impl.submission_tracker->beginSubmission(fence);
+    // Make host writes to non-coherent memory visible to this submission
+    logical_device_impl.memory_allocator->flushMappedRanges();
+    queue.vk_queue.submit({ submit_info }, fence);
+    logical_device_impl.submission_tracker->wait(submission_index);
+
+    (*logical_device_impl.vk_device).freeCommandBuffers(queue.vk_command_pool, command_buffers);
+    return submission_index;
 }
 
 bool Gfx::Impl::createGfxMemory(
     vk::MemoryRequirements memory_requirements, vk::MemoryPropertyFlags memory_properties,
-    GfxMemoryResources& out_resources
+    GfxMemoryResources& out_resources, gfx_memory_kinds::MemoryKind kind,
+    gfx_memory_categories::MemoryCategory category
 ) {
     int memory_type_index = gfx->physical_device().impl_->findMemoryTypeIndex(memory_requirements, memory_properties);
 
@@ -100,13 +254,17 @@ bool Gfx::Impl::createGfxMemory(
         return false;
     }
 
-    auto memory_allocate_info = vk::MemoryAllocateInfo{
-        .allocationSize = memory_requirements.size,
-        .memoryTypeIndex = static_cast<uint32_t>(memory_type_index)
-    };
+    auto& memory_allocator = *gfx->logical_device_->impl_->memory_allocator;
+    makeRoomInHeap(memory_allocator.getHeapIndex(static_cast<uint32_t>(memory_type_index)), memory_requirements.size);
 
-    out_resources.memory = gfx->logical_device_->impl_->vk_device.allocateMemory(memory_allocate_info);
-    out_resources.memory_properties = memory_properties;
+    if (!memory_allocator.allocate(
+        memory_requirements, static_cast<uint32_t>(memory_type_index), kind, category, out_resources.allocation
+    )) {
+        logger().error("Cannot create memory resources because memory allocation failed.");
+        return false;
+    }
+    // Record actual properties, e.g. host coherent memory may be given when not required
+    out_resources.memory_properties = memory_allocator.getMemoryPropertyFlags(static_cast<uint32_t>(memory_type_index));
     return true;
 }
 
@@ -126,15 +284,6 @@ void Gfx::Impl::createBuffer(
     out_resources.sharing_mode = sharing_mode;
 }
 
-void Gfx::Impl::copyBuffer(const QueueInfoRef& transfer_queue, vk::Buffer src, vk::Buffer dst, vk::DeviceSize size) {
-    singleTimeCommand(
-        transfer_queue,
-        [&src, &dst, size](vk::CommandBuffer& command_buffer) {
-            command_buffer.copyBuffer(src, dst, { { .srcOffset = 0, .dstOffset = 0, .size = size } });
-        }
-    );
-}
-
 vk::SharingMode Gfx::Impl::getTransferQueue(QueueInfoRef& out_transfer_queue) const {
     bool transfer_queue_different_family = false;
     if (gfx->features_manager().feature_enabled(gfx_features::separate_transfer)) {
@@ -150,6 +299,23 @@ vk::SharingMode Gfx::Impl::getTransferQueue(QueueInfoRef& out_transfer_queue) co
     return transfer_queue_different_family ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive;
 }
 
+std::vector<std::pair<vk::DeviceSize, vk::DeviceSize>> Gfx::Impl::GetBufferUploadRanges(
+    const std::shared_ptr<GfxBufferBase>& cpu_buffer, const std::shared_ptr<GfxBufferBase>& gpu_buffer,
+    vk::DeviceSize data_size
+) {
+    if (!gpu_buffer->has_gpu_data_ || cpu_buffer->dirty_ranges_.empty()) {
+        return { { 0, data_size } };
+    }
+    std::vector<std::pair<vk::DeviceSize, vk::DeviceSize>> ranges;
+    for (auto&& [offset, size] : cpu_buffer->dirty_ranges_) {
+        if (offset >= data_size) {
+            break;
+        }
+        ranges.emplace_back(offset, std::min<vk::DeviceSize>(size, data_size - offset));
+    }
+    return ranges;
+}
+
 void Gfx::Impl::createBufferResources(
     const std::shared_ptr<GfxBufferBase>& gfx_buffer,
     vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memory_properties
@@ -170,7 +336,6 @@ void Gfx::Impl::createReferenceBufferResources(
         logger().error("Cannot create buffer resources because logical device is not available.");
         return;
     }
-    gfx->waitDeviceIdle();
 
     auto resources = std::make_unique<GfxBufferResources>();
 
@@ -184,6 +349,17 @@ void Gfx::Impl::createReferenceBufferResources(
         queue_family_indices.push_back(transfer_queue.queue_family_index);
     }
 
+    // Storage buffers are also accessed by the compute queue
+    if (gpu_buffer->storage()) {
+        usage |= vk::BufferUsageFlagBits::eStorageBuffer;
+        QueueInfoRef compute_queue;
+        getComputeQueue(compute_queue);
+        if (std::find(queue_family_indices.begin(), queue_family_indices.end(), compute_queue.queue_family_index) == queue_family_indices.end()) {
+            queue_family_indices.push_back(compute_queue.queue_family_index);
+            resources->sharing_mode = vk::SharingMode::eConcurrent;
+        }
+    }
+
     createBuffer(
         resources->cpu_data_size,
         vk::BufferUsageFlagBits::eTransferDst | usage,
@@ -196,7 +372,8 @@ void Gfx::Impl::createReferenceBufferResources(
         return;
     }
 
-    resources->buffer.bindMemory(*memory_resources->memory, 0);
+    resources->buffer.bindMemory(memory_resources->allocation.memory(), memory_resources->allocation.offset());
+    resources->mapped = memory_resources->allocation.mapped();
     gpu_buffer->impl_->memory_resources = gfx->logical_device_->impl_->memory_resources.store(std::move(memory_resources));
     gpu_buffer->impl_->resources = gfx->logical_device_->impl_->buffer_resources.store(std::move(resources));
 }
@@ -213,7 +390,14 @@ void Gfx::commitReferenceBuffer(
         logger().error("Skip creating buffer resources because has no CPU data.");
         return;
     }
-    waitDeviceIdle();
+
+    if (gpu_buffer->impl_->geometry_range) {
+        // Geometry pools are device local, so always copy through staging.
+        auto upload_batch = UploadBatch::Create();
+        upload_batch->addReferenceBuffer(cpu_buffer, gpu_buffer);
+        submitUploadBatch(upload_batch);
+        return;
+    }
 
     auto* memory_resources = gpu_buffer->impl_->memory_resources.data();
     auto* resources = gpu_buffer->impl_->resources.data();
@@ -227,75 +411,204 @@ void Gfx::commitReferenceBuffer(
         return;
     }
 
-    QueueInfoRef transfer_queue;
-    impl_->getTransferQueue(transfer_queue);
-
     const size_t data_size = cpu_buffer->data_size();
     bool use_stage_buffer = !(memory_resources->memory_properties & vk::MemoryPropertyFlagBits::eHostVisible);
     if (hint_use_stage_buffer) {
         use_stage_buffer = true;
     }
 
-    GfxMemoryResources staging_memory_resources;
-    GfxBufferResources staging_resources;
-    vk::raii::DeviceMemory* memory = &memory_resources->memory;
     if (use_stage_buffer) {
-        // Allocate stage buffer.
-        impl_->createBuffer(
-            data_size, vk::BufferUsageFlagBits::eTransferSrc,
-            vk::SharingMode::eExclusive, { transfer_queue.queue_family_index },
-            staging_resources
-        );
-        if (!impl_->createGfxMemory(
-            staging_resources.buffer.getMemoryRequirements(),
-            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-            staging_memory_resources
-        )) {
-            return;
-        }
-        staging_resources.buffer.bindMemory(*staging_memory_resources.memory, 0);
-        memory = &staging_memory_resources.memory;
+        // Copy on transfer queue asynchronously.
+        auto upload_batch = UploadBatch::Create();
+        upload_batch->addReferenceBuffer(cpu_buffer, gpu_buffer);
+        submitUploadBatch(upload_batch);
+        return;
     }
 
-    // Copy data to target buffer or stage buffer.
-    void* mapped = memory->mapMemory(0, data_size, {});
-    std::memcpy(mapped, cpu_buffer->data(), data_size);
-    memory->unmapMemory();
-
-    if (use_stage_buffer) {
-        // Copy content.
-        impl_->copyBuffer(transfer_queue, *staging_resources.buffer, *resources->buffer, data_size);
+    // Copy data to target buffer (host visible memory is persistently mapped), after frames in flight have read it.
+    impl_->waitBufferIdle(*resources);
+    const auto* data = static_cast<const char*>(cpu_buffer->data());
+    for (auto&& [offset, size] : Impl::GetBufferUploadRanges(cpu_buffer, gpu_buffer, data_size)) {
+        std::memcpy(static_cast<char*>(resources->mapped) + offset, data + offset, size);
+        logical_device_->impl_->memory_allocator->addFlushRange(memory_resources->allocation, offset, size);
     }
 
     gpu_buffer->has_gpu_data_ = true;
+    cpu_buffer->clearDirtyRanges();
     if (!cpu_buffer->keep_cpu_data_) {
         cpu_buffer->clearCpuData();
     }
 }
 
-void Gfx::createVertexBufferResources(const std::shared_ptr<VertexBufferBase>& vertex_buffer) {
+void Gfx::Impl::createStreamingVertexBufferResources(const std::shared_ptr<VertexBufferBase>& vertex_buffer) {
+    auto& buffer_impl = *vertex_buffer->impl_;
+    buffer_impl.memory_resources.reset();
+    buffer_impl.resources.reset();
+    buffer_impl.streaming_copies.clear();
+    vertex_buffer->has_gpu_data_ = false;
+
+    if (!gfx->logical_device_) {
+        logger().error("Cannot create streaming vertex buffer resources because logical device is not available.");
+        return;
+    }
+    const vk::DeviceSize data_size = vertex_buffer->data_size();
+    if (data_size == 0) {
+        logger().error("Cannot create streaming vertex buffer resources because vertex buffer is empty.");
+        return;
+    }
+
+    auto& logical_device_impl = *gfx->logical_device_->impl_;
+    uint32_t graphics_family_index = logical_device_impl.queue_references[gfx_queues::graphics][0].queue_family_index;
+    buffer_impl.streaming_copies.resize(vertex_buffer->streaming_copy_count());
+    for (auto&& streaming_copy : buffer_impl.streaming_copies) {
+        auto resources = std::make_unique<GfxBufferResources>();
+        resources->cpu_data_size = data_size;
+        // Only read by graphics queue, no ownership transfer needed
+        createBuffer(data_size, vk::BufferUsageFlagBits::eVertexBuffer, vk::SharingMode::eExclusive, { graphics_family_index }, *resources);
+
+        // Prefer device local memory visible to host (e.g. resizable BAR) if there is any.
+        auto memory_requirements = resources->buffer.getMemoryRequirements();
+        auto memory_properties = vk::MemoryPropertyFlags{ vk::MemoryPropertyFlagBits::eHostVisible };
+        if (gfx->physical_device().impl_->findMemoryTypeIndex(
+            memory_requirements, memory_properties | vk::MemoryPropertyFlagBits::eDeviceLocal
+        ) >= 0) {
+            memory_properties |= vk::MemoryPropertyFlagBits::eDeviceLocal;
+        }
+        auto memory_resources = std::make_unique<GfxMemoryResources>();
+        if (!createGfxMemory(memory_requirements, memory_properties, *memory_resources)) {
+            logger().error("Cannot create streaming vertex buffer resources because memory allocation failed.");
+            buffer_impl.streaming_copies.clear();
+            return;
+        }
+        resources->buffer.bindMemory(memory_resources->allocation.memory(), memory_resources->allocation.offset());
+        resources->mapped = memory_resources->allocation.mapped();
+
+        std::memcpy(resources->mapped, vertex_buffer->data(), data_size);
+        logical_device_impl.memory_allocator->addFlushRange(memory_resources->allocation, 0, data_size);
+        streaming_copy.version = buffer_impl.streaming_version;
+        streaming_copy.memory_resources = logical_device_impl.memory_resources.store(std::move(memory_resources));
+        streaming_copy.resources = logical_device_impl.buffer_resources.store(std::move(resources));
+    }
+    vertex_buffer->has_gpu_data_ = true;
+    vertex_buffer->clearDirtyRanges();
+}
+
+vk::DeviceSize Gfx::Impl::updateStreamingCopy(const std::shared_ptr<VertexBufferBase>& vertex_buffer, uint32_t image_index) {
+    auto& buffer_impl = *vertex_buffer->impl_;
+    if (buffer_impl.streaming_copies.empty()) {
+        return 0;
+    }
+
+    // Any change since the last frame makes all copies stale.
+    if (!vertex_buffer->has_gpu_data_ || !vertex_buffer->dirty_ranges_.empty()) {
+        ++buffer_impl.streaming_version;
+        vertex_buffer->has_gpu_data_ = true;
+        vertex_buffer->clearDirtyRanges();
+    }
+
+    auto& streaming_copy = buffer_impl.streaming_copies[image_index % buffer_impl.streaming_copies.size()];
+    if (streaming_copy.version == buffer_impl.streaming_version) {
+        return 0;
+    }
+    auto* memory_resources = streaming_copy.memory_resources.data();
+    auto* resources = streaming_copy.resources.data();
+    if (!memory_resources || !resources) {
+        return 0;
+    }
+    const vk::DeviceSize data_size = vertex_buffer->data_size();
+    if (data_size > resources->cpu_data_size) {
+        logger().error("Cannot update streaming vertex buffer because vertex count is larger than its GPU copies.");
+        return 0;
+    }
+
+    // Copies are not shared between images unless there are fewer copies than images.
+    gfx->logical_device_->impl_->submission_tracker->wait(streaming_copy.last_used_submission_index);
+    std::memcpy(resources->mapped, vertex_buffer->data(), data_size);
+    gfx->logical_device_->impl_->memory_allocator->addFlushRange(memory_resources->allocation, 0, data_size);
+    streaming_copy.version = buffer_impl.streaming_version;
+    return data_size;
+}
+
+void Gfx::createVertexBufferResources(
+    const std::shared_ptr<VertexBufferBase>& vertex_buffer, const std::shared_ptr<UploadBatch>& upload_batch
+) {
+    if (vertex_buffer->streaming_copy_count() > 0) {
+        impl_->createStreamingVertexBufferResources(vertex_buffer);
+        return;
+    }
     impl_->createBufferResources(
         vertex_buffer,
         vk::BufferUsageFlagBits::eVertexBuffer,
         vk::MemoryPropertyFlagBits::eDeviceLocal
     );
-    commitBuffer(vertex_buffer, true);
+    if (upload_batch) {
+        upload_batch->addBuffer(vertex_buffer);
+    } else {
+        commitBuffer(vertex_buffer, true);
+    }
 }
 
-void Gfx::createIndexBufferResources(const std::shared_ptr<IndexBuffer>& index_buffer) {
+void Gfx::createIndexBufferResources(
+    const std::shared_ptr<IndexBuffer>& index_buffer, const std::shared_ptr<UploadBatch>& upload_batch
+) {
     impl_->createBufferResources(
         index_buffer,
         vk::BufferUsageFlagBits::eIndexBuffer,
         vk::MemoryPropertyFlagBits::eDeviceLocal
     );
-    commitBuffer(index_buffer, true);
+    if (upload_batch) {
+        upload_batch->addBuffer(index_buffer);
+    } else {
+        commitBuffer(index_buffer, true);
+    }
+}
+
+void Gfx::createStorageBufferResources(
+    const std::shared_ptr<StorageBufferBase>& storage_buffer, const std::shared_ptr<UploadBatch>& upload_batch
+) {
+    impl_->createBufferResources(
+        storage_buffer,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+        storage_buffer->host_visible() ? vk::MemoryPropertyFlagBits::eHostVisible : vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+    if (!storage_buffer->has_cpu_data()) {
+        return;
+    }
+    if (upload_batch) {
+        upload_batch->addBuffer(storage_buffer);
+    } else {
+        commitBuffer(storage_buffer, !storage_buffer->host_visible());
+    }
+}
+
+bool Gfx::readStorageBuffer(const std::shared_ptr<StorageBufferBase>& storage_buffer) {
+    if (!logical_device_) {
+        logger().error("Cannot read storage buffer because logical device is not available.");
+        return false;
+    }
+    auto* memory_resources = storage_buffer->impl_->memory_resources.data();
+    auto* resources = storage_buffer->impl_->resources.data();
+    if (!memory_resources || !resources) {
+        logger().error("Cannot read storage buffer because resources are not available.");
+        return false;
+    }
+    if (!resources->mapped) {
+        logger().error("Cannot read storage buffer because it is not host visible.");
+        return false;
+    }
+
+    const vk::DeviceSize data_size = resources->cpu_data_size;
+    logical_device_->impl_->memory_allocator->invalidateMappedRange(memory_resources->allocation, 0, data_size);
+    std::memcpy(storage_buffer->beginReadBack(), resources->mapped, data_size);
+    storage_buffer->clearDirtyRanges();
+    return true;
 }
 
 void Gfx::createUniformBufferResources(const std::shared_ptr<UniformBufferBase>& uniform_buffer) {
     impl_->createBufferResources(
         uniform_buffer,
         vk::BufferUsageFlagBits::eUniformBuffer,
-        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+        vk::MemoryPropertyFlagBits::eHostVisible
     );
     if (uniform_buffer->has_cpu_data()) {
         commitBuffer(uniform_buffer, false);
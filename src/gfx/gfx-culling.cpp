@@ -0,0 +1,207 @@
+#include "gfx/gfx-culling.h"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__AVX2__)
+#define WG_FRUSTUM_CULLING_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WG_FRUSTUM_CULLING_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Test spheres [begin, end) one at a time, returning the number of visible spheres
+size_t CullSpheresScalar(
+    const wg::Frustum& frustum, const wg::BoundingSpheres& spheres, size_t begin, size_t end, uint8_t* out_visible
+) {
+    size_t visible_count = 0;
+    for (size_t i = begin; i < end; ++i) {
+        bool visible = true;
+        for (auto&& plane : frustum.planes) {
+            // Same order of operations as SIMD lanes
+            float distance = (plane.x * spheres.center_x[i] + plane.y * spheres.center_y[i]) +
+                             (plane.z * spheres.center_z[i] + plane.w);
+            visible = visible && distance >= -spheres.radius[i];
+        }
+        out_visible[i] = visible ? 1 : 0;
+        visible_count += visible ? 1 : 0;
+    }
+    return visible_count;
+}
+
+} // unnamed namespace
+
+namespace wg {
+
+void BoundingSpheres::resize(size_t size) {
+    center_x.resize(size);
+    center_y.resize(size);
+    center_z.resize(size);
+    radius.resize(size);
+}
+
+void BoundingSpheres::set(size_t index, const glm::vec4& sphere) {
+    center_x[index] = sphere.x;
+    center_y[index] = sphere.y;
+    center_z[index] = sphere.z;
+    radius[index] = sphere.w;
+}
+
+glm::vec4 BoundingSpheres::get(size_t index) const {
+    return { center_x[index], center_y[index], center_z[index], radius[index] };
+}
+
+glm::vec4 TransformBoundingSphere(const glm::vec4& sphere, const glm::mat4& transform) {
+    auto center = glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.f));
+    float scale = std::max(
+        { glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) }
+    );
+    return { center, sphere.w * scale };
+}
+
+size_t CullSpheres(const Frustum& frustum, const BoundingSpheres& spheres, std::vector<uint8_t>& out_visible) {
+    size_t count = spheres.size();
+    out_visible.resize(count);
+    size_t visible_count = 0;
+    size_t i = 0;
+#if defined(WG_FRUSTUM_CULLING_AVX2)
+    for (; i + 8 <= count; i += 8) {
+        __m256 center_x = _mm256_loadu_ps(spheres.center_x.data() + i);
+        __m256 center_y = _mm256_loadu_ps(spheres.center_y.data() + i);
+        __m256 center_z = _mm256_loadu_ps(spheres.center_z.data() + i);
+        __m256 negative_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(spheres.radius.data() + i));
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (auto&& plane : frustum.planes) {
+            __m256 distance = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), center_x), _mm256_mul_ps(_mm256_set1_ps(plane.y), center_y)),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), center_z), _mm256_set1_ps(plane.w))
+            );
+            visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, negative_radius, _CMP_GE_OQ));
+        }
+        auto mask = static_cast<uint32_t>(_mm256_movemask_ps(visible));
+        for (size_t lane = 0; lane < 8; ++lane) {
+            out_visible[i + lane] = static_cast<uint8_t>((mask >> lane) & 1U);
+        }
+        visible_count += static_cast<size_t>(std::popcount(mask));
+    }
+#endif
+#if defined(WG_FRUSTUM_CULLING_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128 center_x = _mm_loadu_ps(spheres.center_x.data() + i);
+        __m128 center_y = _mm_loadu_ps(spheres.center_y.data() + i);
+        __m128 center_z = _mm_loadu_ps(spheres.center_z.data() + i);
+        __m128 negative_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius.data() + i));
+        __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (auto&& plane : frustum.planes) {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), center_x), _mm_mul_ps(_mm_set1_ps(plane.y), center_y)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), center_z), _mm_set1_ps(plane.w))
+            );
+            visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, negative_radius));
+        }
+        auto mask = static_cast<uint32_t>(_mm_movemask_ps(visible));
+        for (size_t lane = 0; lane < 4; ++lane) {
+            out_visible[i + lane] = static_cast<uint8_t>((mask >> lane) & 1U);
+            visible_count += (mask >> lane) & 1U;
+        }
+    }
+#endif
+    visible_count += CullSpheresScalar(frustum, spheres, i, count, out_visible.data());
+    return visible_count;
+}
+
+float BoundingBox::surface_area() const {
+    if (empty()) {
+        return 0.f;
+    }
+    auto extent = max - min;
+    return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+Frustum Frustum::FromViewProjection(const glm::mat4& view_projection) {
+    // Rows of the matrix, which is stored by columns
+    auto row = [&view_projection](int i) {
+        return glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+    };
+    Frustum frustum{
+        .planes = {
+            row(3) + row(0),
+            row(3) - row(0),
+            row(3) + row(1),
+            row(3) - row(1),
+            row(2),
+            row(3) - row(2),
+        }
+    };
+    for (auto&& plane : frustum.planes) {
+        float length = glm::length(glm::vec3(plane));
+        if (length > 0.f) {
+            plane /= length;
+        }
+    }
+    return frustum;
+}
+
+Frustum Frustum::FromCameraUniform(const CameraUniform& camera_uniform) {
+    return FromViewProjection(camera_uniform.project_mat * camera_uniform.view_mat);
+}
+
+bool Frustum::intersectsSphere(const glm::vec4& sphere) const {
+    auto center = glm::vec3(sphere);
+    return std::all_of(planes.begin(), planes.end(), [&center, &sphere](const glm::vec4& plane) {
+        return glm::dot(glm::vec3(plane), center) + plane.w >= -sphere.w;
+    });
+}
+
+bool Frustum::intersectsBox(const BoundingBox& box) const {
+    if (box.empty()) {
+        return false;
+    }
+    // Test the corner furthest along each normal
+    return std::all_of(planes.begin(), planes.end(), [&box](const glm::vec4& plane) {
+        auto corner = glm::mix(box.min, box.max, glm::greaterThanEqual(glm::vec3(plane), glm::vec3(0.f)));
+        return glm::dot(glm::vec3(plane), corner) + plane.w >= 0.f;
+    });
+}
+
+bool Frustum::containsBox(const BoundingBox& box) const {
+    if (box.empty()) {
+        return false;
+    }
+    // Test the corner furthest against each normal
+    return std::all_of(planes.begin(), planes.end(), [&box](const glm::vec4& plane) {
+        auto corner = glm::mix(box.max, box.min, glm::greaterThanEqual(glm::vec3(plane), glm::vec3(0.f)));
+        return glm::dot(glm::vec3(plane), corner) + plane.w >= 0.f;
+    });
+}
+
+uint32_t CullObjects(
+    const GpuCullParameters& parameters, const std::vector<GpuCullObject>& objects,
+    std::vector<DrawIndexedIndirectCommand>& out_commands
+) {
+    auto object_count = std::min<size_t>(parameters.object_count, objects.size());
+    out_commands.assign(object_count, DrawIndexedIndirectCommand{});
+    Frustum frustum{ .planes = parameters.planes };
+    uint32_t draw_count = 0;
+    for (size_t i = 0; i < object_count; ++i) {
+        bool visible = frustum.intersectsSphere(objects[i].bounding_sphere);
+        if (parameters.compact) {
+            if (visible) {
+                out_commands[draw_count] = objects[i].draw;
+            }
+        } else {
+            out_commands[i] = objects[i].draw;
+            if (!visible) {
+                out_commands[i].instance_count = 0;
+            }
+        }
+        draw_count += visible ? 1 : 0;
+    }
+    return draw_count;
+}
+
+} // namespace wg
@@ -0,0 +1,37 @@
+#include "gfx-deletion-private.h"
+
+namespace wg {
+
+GfxDeletionQueue::GfxDeletionQueue(GfxSubmissionTracker& submission_tracker)
+    : submission_tracker_(submission_tracker) {}
+
+GfxDeletionQueue::~GfxDeletionQueue() {
+    collect(true);
+}
+
+void GfxDeletionQueue::collect(bool wait_all) {
+    // Destroying a resource may retire others (e.g. buffers held by render targets), so repeat until stable.
+    while (!retired_resources_.empty()) {
+        if (wait_all) {
+            submission_tracker_.wait(submission_tracker_.last_submission_index());
+        }
+        std::vector<std::shared_ptr<void>> finished_resources;
+        for (auto it = retired_resources_.begin(); it != retired_resources_.end();) {
+            if (submission_tracker_.finished(it->submission_index)) {
+                finished_resources.emplace_back(std::move(it->resource));
+                it = retired_resources_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (finished_resources.empty()) {
+            break;
+        }
+        // Destroy in retire order
+        for (auto&& resource : finished_resources) {
+            resource.reset();
+        }
+    }
+}
+
+} // namespace wg
@@ -2,9 +2,13 @@
 
 #include "gfx/gfx.h"
 #include "common/config.h"
+#include "common/constants.h"
 #include "common/logger.h"
 #include "gfx-private.h"
 
+#include <cstdlib>
+#include <filesystem>
+
 namespace {
 
 [[nodiscard]] auto& logger() {
@@ -12,6 +16,31 @@ namespace {
     return *logger_;
 }
 
+// Cache directory of the engine for the current user, e.g. ~/.cache/WEngine. The temporary directory if unknown.
+[[nodiscard]] std::filesystem::path GetUserCacheDirectory() {
+    std::filesystem::path base_path;
+#if defined(_WIN32)
+    if (const char* local_app_data = std::getenv("LOCALAPPDATA"); local_app_data && *local_app_data) {
+        base_path = local_app_data;
+    }
+#elif defined(__APPLE__)
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        base_path = std::filesystem::path(home) / "Library" / "Caches";
+    }
+#else
+    if (const char* xdg_cache_home = std::getenv("XDG_CACHE_HOME"); xdg_cache_home && *xdg_cache_home) {
+        base_path = xdg_cache_home;
+    } else if (const char* home = std::getenv("HOME"); home && *home) {
+        base_path = std::filesystem::path(home) / ".cache";
+    }
+#endif
+    if (base_path.empty()) {
+        std::error_code error_code;
+        base_path = std::filesystem::temp_directory_path(error_code);
+    }
+    return base_path / wg::EngineConstants::Get().name();
+}
+
 } // unnamed namespace
 
 namespace wg {
@@ -26,6 +55,10 @@ const char* const FEATURE_NAMES[NUM_FEATURES_TOTAL] = {
     "sampler_mirror_clamp_to_edge",
     "msaa",
     "sample_shading",
+    "memory_budget",
+    "compute",
+    "multi_draw_indirect",
+    "draw_indirect_count",
     "_must_enable_if_valid",
     "_debug_utils"
 };
@@ -107,6 +140,33 @@ VulkanFeatures VulkanFeatures::GetVulkanFeatures(wg::gfx_features::FeatureId fea
                 features.sampleRateShading = true;
             }
         };
+    case wg::gfx_features::memory_budget:
+        return {
+            .instance_extensions = { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME },
+            .device_extensions = { VK_EXT_MEMORY_BUDGET_EXTENSION_NAME }
+        };
+    case wg::gfx_features::compute:
+        return []() {
+            auto vk_features = VulkanFeatures();
+            vk_features.device_queues[wg::gfx_queues::compute] = 1;
+            return vk_features;
+        }();
+    case wg::gfx_features::multi_draw_indirect:
+        return {
+            .check_properties_and_features_func = [](
+                const vk::PhysicalDeviceProperties& properties, const vk::PhysicalDeviceFeatures& features
+            ) -> bool {
+                return features.multiDrawIndirect && features.drawIndirectFirstInstance;
+            },
+            .set_feature_func = [](vk::PhysicalDeviceFeatures& features) {
+                features.multiDrawIndirect = true;
+                features.drawIndirectFirstInstance = true;
+            }
+        };
+    case wg::gfx_features::draw_indirect_count:
+        return {
+            .device_extensions = { VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME }
+        };
     case wg::gfx_features::_must_enable_if_valid:
         // VUID-VkDeviceCreateInfo-pProperties-04451
         // https://vulkan.lunarg.com/doc/view/1.2.198.1/mac/1.2-extensions/vkspec.html#VUID-VkDeviceCreateInfo-pProperties-04451
@@ -173,6 +233,57 @@ void GfxFeaturesManager::enableFeaturesByConfig(const PhysicalDevice& physical_d
 }
 
 void Gfx::loadGlobalSetupFromConfig() {
+    EngineConfig& config = EngineConfig::Get();
+
+    auto staging_buffer_size_mb = config.get<int>("gfx-staging-buffer-size-mb");
+    if (staging_buffer_size_mb > 0) {
+        setup_.staging_buffer_size_mb = staging_buffer_size_mb;
+    }
+
+    auto memory_budget_percent = config.get<int>("gfx-memory-budget-percent");
+    if (memory_budget_percent > 0) {
+        setup_.memory_budget_percent = std::min(memory_budget_percent, 100);
+    }
+
+    auto recording_thread_count = config.get<int>("gfx-recording-threads");
+    if (recording_thread_count > 0) {
+        setup_.recording_thread_count = recording_thread_count;
+    }
+
+    if (config.get<bool>("gfx-disable-draw-command-sorting")) {
+        setup_.sort_draw_commands = false;
+    }
+
+    // Relative to the user cache directory rather than the working directory, which may not be writable
+    auto pipeline_cache_path = config.get<std::string>("gfx-pipeline-cache-path");
+    if (!pipeline_cache_path.empty() && std::filesystem::path(pipeline_cache_path).is_relative()) {
+        pipeline_cache_path = (GetUserCacheDirectory() / pipeline_cache_path).string();
+    }
+    setup_.pipeline_cache_path = pipeline_cache_path;
+
+    auto pipeline_compile_thread_count = config.get<int>("gfx-pipeline-compile-threads");
+    if (pipeline_compile_thread_count >= 0) {
+        setup_.pipeline_compile_thread_count = pipeline_compile_thread_count;
+    }
+}
+
+void Gfx::setRecordingThreadCount(int recording_thread_count) {
+    setup_.recording_thread_count = std::max(recording_thread_count, 1);
+}
+
+void Gfx::setSortDrawCommands(bool sort_draw_commands) {
+    setup_.sort_draw_commands = sort_draw_commands;
+}
+
+void Gfx::setPipelineCachePath(std::string pipeline_cache_path) {
+    setup_.pipeline_cache_path = std::move(pipeline_cache_path);
+}
+
+void Gfx::setPipelineCompileThreadCount(int pipeline_compile_thread_count) {
+    setup_.pipeline_compile_thread_count = std::max(pipeline_compile_thread_count, 0);
+    if (logical_device_ && logical_device_->impl_->pipeline_cache) {
+        logical_device_->impl_->pipeline_cache->setCompileThreadCount(static_cast<uint32_t>(setup_.pipeline_compile_thread_count));
+    }
 }
 
 } // namespace wg
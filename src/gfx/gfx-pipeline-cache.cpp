@@ -0,0 +1,703 @@
+#include "gfx/gfx.h"
+
+#include "common/constants.h"
+#include "common/logger.h"
+#include "gfx-private.h"
+#include "gfx-pipeline-cache-private.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iterator>
+
+namespace {
+
+[[nodiscard]] auto& logger() {
+    static auto logger_ = wg::Logger::Get("gfx");
+    return *logger_;
+}
+
+[[nodiscard]] uint64_t HashBytes(const uint8_t* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+void AddAttachmentReferences(wg::GfxPipelineStateKey& key, uint32_t count, const vk::AttachmentReference* references) {
+    key.add(references ? count : 0u);
+    for (uint32_t i = 0; references && i < count; ++i) {
+        key.add(references[i].attachment);
+        key.add(references[i].layout);
+    }
+}
+
+[[nodiscard]] wg::GfxPipelineFuture MakeReadyPipelineFuture(std::shared_ptr<vk::raii::Pipeline> pipeline) {
+    std::promise<std::shared_ptr<vk::raii::Pipeline>> promise;
+    promise.set_value(std::move(pipeline));
+    return promise.get_future().share();
+}
+
+[[nodiscard]] bool IsReady(const wg::GfxPipelineFuture& future) {
+    return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+} // unnamed namespace
+
+namespace wg {
+
+void GfxPipelineStateKey::addString(const char* value) {
+    // Terminating zero separates strings from following fields
+    for (const char* c = value ? value : ""; ; ++c) {
+        add(*c);
+        if (*c == '\0') {
+            break;
+        }
+    }
+}
+
+void GfxGraphicsPipelineState::assign(const vk::GraphicsPipelineCreateInfo& info) {
+    create_info = info;
+
+    stages_.assign(info.pStages, info.pStages + info.stageCount);
+    entry_names_.clear();
+    specializations_.clear();
+    specialization_map_entries_.clear();
+    specialization_data_.clear();
+    // Reserved so that pointers to elements stay valid
+    specializations_.reserve(stages_.size());
+    for (auto&& stage : stages_) {
+        entry_names_.emplace_back(stage.pName ? stage.pName : "");
+        if (const auto* specialization = stage.pSpecializationInfo) {
+            const auto& map_entries = specialization_map_entries_.emplace_back(
+                specialization->pMapEntries, specialization->pMapEntries + specialization->mapEntryCount
+            );
+            const auto* data = static_cast<const uint8_t*>(specialization->pData);
+            const auto& specialization_data = specialization_data_.emplace_back(data, data + specialization->dataSize);
+            stage.pSpecializationInfo = &specializations_.emplace_back(
+                vk::SpecializationInfo{
+                    .mapEntryCount = static_cast<uint32_t>(map_entries.size()),
+                    .pMapEntries   = map_entries.data(),
+                    .dataSize      = specialization_data.size(),
+                    .pData         = specialization_data.data()
+                }
+            );
+        }
+    }
+    // Strings are moved while entry_names_ grows, so names are pointed to afterwards
+    for (size_t i = 0; i < stages_.size(); ++i) {
+        stages_[i].pName = entry_names_[i].c_str();
+    }
+    create_info.setStages(stages_);
+
+    if (info.pVertexInputState) {
+        vertex_input_ = *info.pVertexInputState;
+        vertex_bindings_.assign(
+            vertex_input_.pVertexBindingDescriptions,
+            vertex_input_.pVertexBindingDescriptions + vertex_input_.vertexBindingDescriptionCount
+        );
+        vertex_attributes_.assign(
+            vertex_input_.pVertexAttributeDescriptions,
+            vertex_input_.pVertexAttributeDescriptions + vertex_input_.vertexAttributeDescriptionCount
+        );
+        vertex_input_.setVertexBindingDescriptions(vertex_bindings_);
+        vertex_input_.setVertexAttributeDescriptions(vertex_attributes_);
+        create_info.pVertexInputState = &vertex_input_;
+    }
+    if (info.pInputAssemblyState) {
+        input_assembly_ = *info.pInputAssemblyState;
+        create_info.pInputAssemblyState = &input_assembly_;
+    }
+    if (info.pViewportState) {
+        viewport_ = *info.pViewportState;
+        viewports_.clear();
+        scissors_.clear();
+        if (viewport_.pViewports) {
+            viewports_.assign(viewport_.pViewports, viewport_.pViewports + viewport_.viewportCount);
+            viewport_.pViewports = viewports_.data();
+        }
+        if (viewport_.pScissors) {
+            scissors_.assign(viewport_.pScissors, viewport_.pScissors + viewport_.scissorCount);
+            viewport_.pScissors = scissors_.data();
+        }
+        create_info.pViewportState = &viewport_;
+    }
+    if (info.pRasterizationState) {
+        rasterization_ = *info.pRasterizationState;
+        create_info.pRasterizationState = &rasterization_;
+    }
+    if (info.pMultisampleState) {
+        multisample_ = *info.pMultisampleState;
+        if (multisample_.pSampleMask) {
+            auto sample_mask_count = (static_cast<uint32_t>(multisample_.rasterizationSamples) + 31) / 32;
+            sample_mask_.assign(multisample_.pSampleMask, multisample_.pSampleMask + sample_mask_count);
+            multisample_.pSampleMask = sample_mask_.data();
+        }
+        create_info.pMultisampleState = &multisample_;
+    }
+    if (info.pDepthStencilState) {
+        depth_stencil_ = *info.pDepthStencilState;
+        create_info.pDepthStencilState = &depth_stencil_;
+    }
+    if (info.pColorBlendState) {
+        color_blend_ = *info.pColorBlendState;
+        color_blend_attachments_.assign(color_blend_.pAttachments, color_blend_.pAttachments + color_blend_.attachmentCount);
+        color_blend_.setAttachments(color_blend_attachments_);
+        create_info.pColorBlendState = &color_blend_;
+    }
+    if (info.pDynamicState) {
+        dynamic_state_ = *info.pDynamicState;
+        dynamic_states_.assign(dynamic_state_.pDynamicStates, dynamic_state_.pDynamicStates + dynamic_state_.dynamicStateCount);
+        dynamic_state_.setDynamicStates(dynamic_states_);
+        create_info.pDynamicState = &dynamic_state_;
+    }
+}
+
+GfxPipelineStateKey MakeGraphicsPipelineStateKey(const vk::GraphicsPipelineCreateInfo& create_info) {
+    GfxPipelineStateKey key;
+    key.add(create_info.flags);
+
+    key.add(create_info.stageCount);
+    for (uint32_t i = 0; i < create_info.stageCount; ++i) {
+        const auto& stage = create_info.pStages[i];
+        key.add(stage.stage);
+        key.add(static_cast<VkShaderModule>(stage.module));
+        key.addString(stage.pName);
+        const auto* specialization = stage.pSpecializationInfo;
+        key.add(specialization ? specialization->mapEntryCount : 0u);
+        for (uint32_t j = 0; specialization && j < specialization->mapEntryCount; ++j) {
+            key.add(specialization->pMapEntries[j].constantID);
+            key.add(specialization->pMapEntries[j].offset);
+            key.add(specialization->pMapEntries[j].size);
+        }
+        key.add(specialization ? specialization->dataSize : size_t{ 0 });
+        for (size_t j = 0; specialization && j < specialization->dataSize; ++j) {
+            key.add(static_cast<const uint8_t*>(specialization->pData)[j]);
+        }
+    }
+
+    const auto* vertex_input = create_info.pVertexInputState;
+    key.add(vertex_input != nullptr);
+    if (vertex_input) {
+        key.add(vertex_input->vertexBindingDescriptionCount);
+        for (uint32_t i = 0; i < vertex_input->vertexBindingDescriptionCount; ++i) {
+            const auto& binding = vertex_input->pVertexBindingDescriptions[i];
+            key.add(binding.binding);
+            key.add(binding.stride);
+            key.add(binding.inputRate);
+        }
+        key.add(vertex_input->vertexAttributeDescriptionCount);
+        for (uint32_t i = 0; i < vertex_input->vertexAttributeDescriptionCount; ++i) {
+            const auto& attribute = vertex_input->pVertexAttributeDescriptions[i];
+            key.add(attribute.location);
+            key.add(attribute.binding);
+            key.add(attribute.format);
+            key.add(attribute.offset);
+        }
+    }
+
+    const auto* input_assembly = create_info.pInputAssemblyState;
+    key.add(input_assembly != nullptr);
+    if (input_assembly) {
+        key.add(input_assembly->topology);
+        key.add(input_assembly->primitiveRestartEnable);
+    }
+
+    // Viewports and scissors are baked into pipelines unless they are dynamic states
+    const auto* viewport = create_info.pViewportState;
+    key.add(viewport != nullptr);
+    if (viewport) {
+        key.add(viewport->viewportCount);
+        for (uint32_t i = 0; viewport->pViewports && i < viewport->viewportCount; ++i) {
+            const auto& v = viewport->pViewports[i];
+            key.add(v.x);
+            key.add(v.y);
+            key.add(v.width);
+            key.add(v.height);
+            key.add(v.minDepth);
+            key.add(v.maxDepth);
+        }
+        key.add(viewport->scissorCount);
+        for (uint32_t i = 0; viewport->pScissors && i < viewport->scissorCount; ++i) {
+            const auto& scissor = viewport->pScissors[i];
+            key.add(scissor.offset.x);
+            key.add(scissor.offset.y);
+            key.add(scissor.extent.width);
+            key.add(scissor.extent.height);
+        }
+    }
+
+    const auto* rasterization = create_info.pRasterizationState;
+    key.add(rasterization != nullptr);
+    if (rasterization) {
+        key.add(rasterization->depthClampEnable);
+        key.add(rasterization->rasterizerDiscardEnable);
+        key.add(rasterization->polygonMode);
+        key.add(rasterization->cullMode);
+        key.add(rasterization->frontFace);
+        key.add(rasterization->depthBiasEnable);
+        key.add(rasterization->depthBiasConstantFactor);
+        key.add(rasterization->depthBiasClamp);
+        key.add(rasterization->depthBiasSlopeFactor);
+        key.add(rasterization->lineWidth);
+    }
+
+    const auto* multisample = create_info.pMultisampleState;
+    key.add(multisample != nullptr);
+    if (multisample) {
+        key.add(multisample->rasterizationSamples);
+        key.add(multisample->sampleShadingEnable);
+        key.add(multisample->minSampleShading);
+        key.add(multisample->pSampleMask != nullptr);
+        if (multisample->pSampleMask) {
+            auto sample_mask_count = (static_cast<uint32_t>(multisample->rasterizationSamples) + 31) / 32;
+            for (uint32_t i = 0; i < sample_mask_count; ++i) {
+                key.add(multisample->pSampleMask[i]);
+            }
+        }
+        key.add(multisample->alphaToCoverageEnable);
+        key.add(multisample->alphaToOneEnable);
+    }
+
+    const auto* depth_stencil = create_info.pDepthStencilState;
+    key.add(depth_stencil != nullptr);
+    if (depth_stencil) {
+        key.add(depth_stencil->depthTestEnable);
+        key.add(depth_stencil->depthWriteEnable);
+        key.add(depth_stencil->depthCompareOp);
+        key.add(depth_stencil->depthBoundsTestEnable);
+        key.add(depth_stencil->stencilTestEnable);
+        for (auto&& stencil : { depth_stencil->front, depth_stencil->back }) {
+            key.add(stencil.failOp);
+            key.add(stencil.passOp);
+            key.add(stencil.depthFailOp);
+            key.add(stencil.compareOp);
+            key.add(stencil.compareMask);
+            key.add(stencil.writeMask);
+            key.add(stencil.reference);
+        }
+        key.add(depth_stencil->minDepthBounds);
+        key.add(depth_stencil->maxDepthBounds);
+    }
+
+    const auto* color_blend = create_info.pColorBlendState;
+    key.add(color_blend != nullptr);
+    if (color_blend) {
+        key.add(color_blend->logicOpEnable);
+        key.add(color_blend->logicOp);
+        key.add(color_blend->attachmentCount);
+        for (uint32_t i = 0; i < color_blend->attachmentCount; ++i) {
+            const auto& attachment = color_blend->pAttachments[i];
+            key.add(attachment.blendEnable);
+            key.add(attachment.srcColorBlendFactor);
+            key.add(attachment.dstColorBlendFactor);
+            key.add(attachment.colorBlendOp);
+            key.add(attachment.srcAlphaBlendFactor);
+            key.add(attachment.dstAlphaBlendFactor);
+            key.add(attachment.alphaBlendOp);
+            key.add(attachment.colorWriteMask);
+        }
+        for (float blend_constant : color_blend->blendConstants) {
+            key.add(blend_constant);
+        }
+    }
+
+    const auto* dynamic_state = create_info.pDynamicState;
+    key.add(dynamic_state ? dynamic_state->dynamicStateCount : 0u);
+    for (uint32_t i = 0; dynamic_state && i < dynamic_state->dynamicStateCount; ++i) {
+        key.add(dynamic_state->pDynamicStates[i]);
+    }
+
+    key.add(static_cast<VkPipelineLayout>(create_info.layout));
+    // Compatible render passes are the same object, see GfxPipelineCache::getRenderPass
+    key.add(static_cast<VkRenderPass>(create_info.renderPass));
+    key.add(create_info.subpass);
+    return key;
+}
+
+GfxPipelineStateKey MakeRenderPassStateKey(const vk::RenderPassCreateInfo& create_info) {
+    GfxPipelineStateKey key;
+    key.add(create_info.flags);
+
+    key.add(create_info.attachmentCount);
+    for (uint32_t i = 0; i < create_info.attachmentCount; ++i) {
+        const auto& attachment = create_info.pAttachments[i];
+        key.add(attachment.flags);
+        key.add(attachment.format);
+        key.add(attachment.samples);
+        key.add(attachment.loadOp);
+        key.add(attachment.storeOp);
+        key.add(attachment.stencilLoadOp);
+        key.add(attachment.stencilStoreOp);
+        key.add(attachment.initialLayout);
+        key.add(attachment.finalLayout);
+    }
+
+    key.add(create_info.subpassCount);
+    for (uint32_t i = 0; i < create_info.subpassCount; ++i) {
+        const auto& subpass = create_info.pSubpasses[i];
+        key.add(subpass.flags);
+        key.add(subpass.pipelineBindPoint);
+        AddAttachmentReferences(key, subpass.inputAttachmentCount, subpass.pInputAttachments);
+        AddAttachmentReferences(key, subpass.colorAttachmentCount, subpass.pColorAttachments);
+        AddAttachmentReferences(key, subpass.pResolveAttachments ? subpass.colorAttachmentCount : 0, subpass.pResolveAttachments);
+        AddAttachmentReferences(key, subpass.pDepthStencilAttachment ? 1 : 0, subpass.pDepthStencilAttachment);
+        key.add(subpass.preserveAttachmentCount);
+        for (uint32_t j = 0; j < subpass.preserveAttachmentCount; ++j) {
+            key.add(subpass.pPreserveAttachments[j]);
+        }
+    }
+
+    key.add(create_info.dependencyCount);
+    for (uint32_t i = 0; i < create_info.dependencyCount; ++i) {
+        const auto& dependency = create_info.pDependencies[i];
+        key.add(dependency.srcSubpass);
+        key.add(dependency.dstSubpass);
+        key.add(dependency.srcStageMask);
+        key.add(dependency.dstStageMask);
+        key.add(dependency.srcAccessMask);
+        key.add(dependency.dstAccessMask);
+        key.add(dependency.dependencyFlags);
+    }
+    return key;
+}
+
+GfxPipelineCacheFileHeader MakePipelineCacheFileHeader(const vk::PhysicalDeviceProperties& properties, uint32_t engine_version) {
+    GfxPipelineCacheFileHeader header;
+    header.vendor_id = properties.vendorID;
+    header.device_id = properties.deviceID;
+    header.driver_version = properties.driverVersion;
+    header.engine_version = engine_version;
+    std::copy(properties.pipelineCacheUUID.begin(), properties.pipelineCacheUUID.end(), header.pipeline_cache_uuid.begin());
+    return header;
+}
+
+std::vector<uint8_t> SerializePipelineCacheFile(GfxPipelineCacheFileHeader header, const std::vector<uint8_t>& data) {
+    header.data_size = data.size();
+    header.data_hash = HashBytes(data.data(), data.size());
+    std::vector<uint8_t> file_content(sizeof(GfxPipelineCacheFileHeader) + data.size());
+    std::memcpy(file_content.data(), &header, sizeof(GfxPipelineCacheFileHeader));
+    std::copy(data.begin(), data.end(), file_content.begin() + sizeof(GfxPipelineCacheFileHeader));
+    return file_content;
+}
+
+std::vector<uint8_t> ParsePipelineCacheFile(
+    const std::vector<uint8_t>& file_content, const GfxPipelineCacheFileHeader& device_header
+) {
+    if (file_content.size() < sizeof(GfxPipelineCacheFileHeader)) {
+        logger().warn("Ignoring pipeline cache file because it is too small.");
+        return {};
+    }
+    GfxPipelineCacheFileHeader header;
+    std::memcpy(&header, file_content.data(), sizeof(GfxPipelineCacheFileHeader));
+    if (header.magic != GfxPipelineCacheFileHeader::MAGIC || header.header_version != GfxPipelineCacheFileHeader::VERSION) {
+        logger().warn("Ignoring pipeline cache file because it is not a pipeline cache file of this version.");
+        return {};
+    }
+    if (header.vendor_id != device_header.vendor_id || header.device_id != device_header.device_id ||
+        header.driver_version != device_header.driver_version || header.pipeline_cache_uuid != device_header.pipeline_cache_uuid) {
+        logger().info("Ignoring pipeline cache file because it was written by another device or driver.");
+        return {};
+    }
+    if (header.engine_version != device_header.engine_version) {
+        logger().info("Ignoring pipeline cache file because it was written by another engine version.");
+        return {};
+    }
+    const uint8_t* data = file_content.data() + sizeof(GfxPipelineCacheFileHeader);
+    if (header.data_size != file_content.size() - sizeof(GfxPipelineCacheFileHeader) ||
+        header.data_hash != HashBytes(data, header.data_size)) {
+        logger().warn("Ignoring pipeline cache file because it is truncated or corrupted.");
+        return {};
+    }
+
+    // VkPipelineCacheHeaderVersionOne, which drivers also check, but not all of them reliably
+    struct {
+        uint32_t header_size;
+        uint32_t header_version;
+        uint32_t vendor_id;
+        uint32_t device_id;
+        std::array<uint8_t, VK_UUID_SIZE> pipeline_cache_uuid;
+    } data_header{};
+    static_assert(sizeof(data_header) == 32);
+    if (header.data_size < sizeof(data_header)) {
+        logger().warn("Ignoring pipeline cache file because its data has no header.");
+        return {};
+    }
+    std::memcpy(&data_header, data, sizeof(data_header));
+    if (data_header.header_size < sizeof(data_header) || data_header.header_size > header.data_size ||
+        data_header.header_version != static_cast<uint32_t>(vk::PipelineCacheHeaderVersion::eOne) ||
+        data_header.vendor_id != device_header.vendor_id || data_header.device_id != device_header.device_id ||
+        data_header.pipeline_cache_uuid != device_header.pipeline_cache_uuid) {
+        logger().warn("Ignoring pipeline cache file because its data header does not match the device.");
+        return {};
+    }
+    return { data, data + header.data_size };
+}
+
+GfxPipelineCache::GfxPipelineCache(vk::raii::Device& device, const std::vector<uint8_t>& initial_data)
+    : device_(device) {
+    auto pipeline_cache_create_info = vk::PipelineCacheCreateInfo{
+        .initialDataSize = initial_data.size(),
+        .pInitialData    = initial_data.data()
+    };
+    vk_pipeline_cache_ = device_.createPipelineCache(pipeline_cache_create_info);
+    statistics_.loaded_bytes = initial_data.size();
+}
+
+GfxPipelineCache::~GfxPipelineCache() {
+    waitPendingPipelines();
+}
+
+std::vector<uint8_t> GfxPipelineCache::data() const {
+    return vk_pipeline_cache_.getData();
+}
+
+void GfxPipelineCache::setCompileThreadCount(uint32_t compile_thread_count) {
+    if (compile_thread_count == this->compile_thread_count()) {
+        return;
+    }
+    // Tasks not started yet would be dropped with the queue
+    waitPendingPipelines();
+    compile_queue_.reset();
+    if (compile_thread_count > 0) {
+        compile_queue_ = std::make_unique<GfxTaskQueue>(compile_thread_count);
+    }
+}
+
+GfxPipelineFuture GfxPipelineCache::requestGraphicsPipeline(const std::shared_ptr<GfxGraphicsPipelineState>& state, bool async) {
+    collectPendingPipelines();
+    auto key = MakeGraphicsPipelineStateKey(state->create_info);
+    auto it = pipelines_.find(key);
+    if (it != pipelines_.end() && it->second.owners_alive()) {
+        if (it->second.pending.valid()) {
+            ++statistics_.pipeline_cache_hits;
+            if (!async) {
+                it->second.pending.wait();
+            }
+            return it->second.pending;
+        }
+        if (auto pipeline = it->second.pipeline.lock()) {
+            ++statistics_.pipeline_cache_hits;
+            return MakeReadyPipelineFuture(std::move(pipeline));
+        }
+    }
+
+    // Drop entries of destroyed pipelines, so that the map does not grow with every rebuild
+    std::erase_if(pipelines_, [](const auto& kv) {
+        return !kv.second.pending.valid() && (kv.second.pipeline.expired() || !kv.second.owners_alive());
+    });
+    auto& entry = pipelines_[std::move(key)];
+    entry = PipelineEntry{
+        .layout_owner = OwnedResourceWeakHandle<GfxPipelineResources>(state->layout_owner)
+    };
+    for (auto&& shader_owner : state->shader_owners) {
+        entry.shader_owners.emplace_back(shader_owner);
+    }
+    if (!async || !compile_queue_) {
+        auto pipeline = createGraphicsPipeline(*state);
+        entry.pipeline = pipeline;
+        return MakeReadyPipelineFuture(std::move(pipeline));
+    }
+
+    // The entry keeps the state alive until the task has finished, so the task does not own it
+    auto task = std::make_shared<std::packaged_task<std::shared_ptr<vk::raii::Pipeline>()>>(
+        [this, state = state.get()]() { return createGraphicsPipeline(*state); }
+    );
+    entry.pending = task->get_future().share();
+    entry.pending_state = state;
+    ++pending_pipeline_count_;
+    compile_queue_->post([task]() { (*task)(); });
+    return entry.pending;
+}
+
+std::shared_ptr<vk::raii::Pipeline> GfxPipelineCache::createGraphicsPipeline(const GfxGraphicsPipelineState& state) {
+    auto compile_begin_time = std::chrono::steady_clock::now();
+    std::shared_ptr<vk::raii::Pipeline> pipeline;
+    try {
+        // VkPipelineCache is internally synchronized, so compile threads share it
+        pipeline = std::make_shared<vk::raii::Pipeline>(device_.createGraphicsPipeline(vk_pipeline_cache_, state.create_info));
+    } catch (const std::exception& e) {
+        logger().error("Cannot create graphics pipeline: {}", e.what());
+        return nullptr;
+    }
+    ++pipelines_created_;
+    pipeline_compile_microseconds_ += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - compile_begin_time).count()
+    );
+    return pipeline;
+}
+
+void GfxPipelineCache::collectPendingPipelines() {
+    if (pending_pipeline_count_ == 0) {
+        return;
+    }
+    for (auto it = pipelines_.begin(); it != pipelines_.end();) {
+        auto& entry = it->second;
+        if (entry.pending.valid() && IsReady(entry.pending)) {
+            entry.pipeline = entry.pending.get();
+            entry.pending = {};
+            entry.pending_state.reset();
+            --pending_pipeline_count_;
+            // Failed, or no longer requested by anyone
+            if (entry.pipeline.expired()) {
+                it = pipelines_.erase(it);
+                continue;
+            }
+        }
+        ++it;
+    }
+}
+
+void GfxPipelineCache::waitPendingPipelines() {
+    for (auto&& [key, entry] : pipelines_) {
+        if (entry.pending.valid()) {
+            entry.pending.wait();
+        }
+    }
+    collectPendingPipelines();
+}
+
+std::shared_ptr<vk::raii::RenderPass> GfxPipelineCache::getRenderPass(const vk::RenderPassCreateInfo& create_info) {
+    auto key = MakeRenderPassStateKey(create_info);
+    auto it = render_passes_.find(key);
+    if (it != render_passes_.end()) {
+        if (auto render_pass = it->second.lock()) {
+            ++statistics_.render_pass_cache_hits;
+            return render_pass;
+        }
+    }
+
+    auto render_pass = std::make_shared<vk::raii::RenderPass>(device_.createRenderPass(create_info));
+    ++statistics_.render_passes_created;
+    std::erase_if(render_passes_, [](const auto& kv) { return kv.second.expired(); });
+    render_passes_[std::move(key)] = render_pass;
+    return render_pass;
+}
+
+GfxPipelineCacheStatistics GfxPipelineCache::statistics() const {
+    auto result = statistics_;
+    result.pipelines_created = pipelines_created_;
+    result.pipeline_compile_microseconds = pipeline_compile_microseconds_;
+    result.pending_pipeline_count = static_cast<uint32_t>(
+        std::count_if(pipelines_.begin(), pipelines_.end(), [](const auto& kv) {
+            return kv.second.pending.valid() && !IsReady(kv.second.pending);
+        })
+    );
+    result.pipeline_count = static_cast<uint32_t>(
+        std::count_if(pipelines_.begin(), pipelines_.end(), [](const auto& kv) { return !kv.second.pipeline.expired(); })
+    );
+    result.render_pass_count = static_cast<uint32_t>(
+        std::count_if(render_passes_.begin(), render_passes_.end(), [](const auto& kv) { return !kv.second.expired(); })
+    );
+    return result;
+}
+
+void Gfx::Impl::createPipelineCache() {
+    auto& logical_device_impl = *gfx->logical_device_->impl_;
+    std::vector<uint8_t> initial_data;
+    const auto& path = gfx->setup_.pipeline_cache_path;
+    if (!path.empty() && std::filesystem::exists(path)) {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<uint8_t> file_content{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+        initial_data = ParsePipelineCacheFile(file_content, getPipelineCacheFileHeader());
+        if (!initial_data.empty()) {
+            logger().info("Pipeline cache loaded from \"{}\" ({} bytes).", path, initial_data.size());
+        }
+    }
+    logical_device_impl.pipeline_cache = std::make_unique<GfxPipelineCache>(logical_device_impl.vk_device, initial_data);
+    logical_device_impl.pipeline_cache->setCompileThreadCount(static_cast<uint32_t>(gfx->setup_.pipeline_compile_thread_count));
+}
+
+GfxPipelineCacheFileHeader Gfx::Impl::getPipelineCacheFileHeader() const {
+    const EngineConstants& engine_constants = EngineConstants::Get();
+    return MakePipelineCacheFileHeader(
+        gfx->physical_device().impl_->vk_physical_device.getProperties(),
+        VK_MAKE_VERSION(engine_constants.major_version(), engine_constants.minor_version(), engine_constants.patch_version())
+    );
+}
+
+bool Gfx::savePipelineCache() {
+    if (!logical_device_ || !logical_device_->impl_->pipeline_cache) {
+        logger().error("Cannot save pipeline cache because logical device is not available.");
+        return false;
+    }
+    const auto& path = setup_.pipeline_cache_path;
+    if (path.empty()) {
+        logger().error("Cannot save pipeline cache because pipeline cache path is not set.");
+        return false;
+    }
+
+    auto file_content = SerializePipelineCacheFile(impl_->getPipelineCacheFileHeader(), logical_device_->impl_->pipeline_cache->data());
+    std::error_code error_code;
+    auto parent_path = std::filesystem::path(path).parent_path();
+    if (!parent_path.empty()) {
+        std::filesystem::create_directories(parent_path, error_code);
+    }
+    // Written to a temporary file first, so that a crash never leaves a partial cache file behind
+    auto temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(file_content.data()), static_cast<std::streamsize>(file_content.size()));
+        if (!file) {
+            logger().error("Cannot save pipeline cache because \"{}\" cannot be written.", temp_path);
+            return false;
+        }
+    }
+    std::filesystem::rename(temp_path, path, error_code);
+    if (error_code) {
+        logger().error("Cannot save pipeline cache to \"{}\": {}", path, error_code.message());
+        return false;
+    }
+    logger().info("Pipeline cache saved to \"{}\" ({} bytes).", path, file_content.size());
+    return true;
+}
+
+void Gfx::prewarmPipelines(
+    const std::shared_ptr<RenderTarget>& render_target, const std::vector<std::shared_ptr<DrawCommand>>& draw_commands
+) {
+    if (!logical_device_ || !logical_device_->impl_->pipeline_cache) {
+        logger().error("Cannot prewarm pipelines because logical device is not available.");
+        return;
+    }
+    auto* resources = render_target->impl_->resources.data();
+    if (!resources) {
+        logger().error("Cannot prewarm pipelines because render target resources are not available.");
+        return;
+    }
+
+    auto& pipeline_cache = *logical_device_->impl_->pipeline_cache;
+    for (auto&& draw_command : draw_commands) {
+        const auto& pipeline = draw_command->pipeline_;
+        auto* impl = draw_command->getImpl();
+        if (!pipeline || !pipeline->impl_->resources.data() || !impl) {
+            logger().error(
+                R"(Cannot prewarm pipeline of draw command "{}" because it is not finished or its pipeline has no resources.)",
+                draw_command->name()
+            );
+            continue;
+        }
+        // Prewarming the same pipeline again replaces the future, so that the list does not grow with every call
+        auto state = impl_->createGraphicsPipelineState(*render_target, *resources, *impl, *pipeline, *pipeline);
+        auto key = MakeGraphicsPipelineStateKey(state->create_info);
+        resources->prewarmed_pipelines[std::move(key)] = pipeline_cache.requestGraphicsPipeline(state, true);
+    }
+}
+
+void Gfx::waitPipelineCompilation() {
+    if (!logical_device_ || !logical_device_->impl_->pipeline_cache) {
+        return;
+    }
+    logical_device_->impl_->pipeline_cache->waitPendingPipelines();
+}
+
+GfxPipelineCacheStatistics Gfx::pipelineCacheStatistics() const {
+    if (!logical_device_ || !logical_device_->impl_->pipeline_cache) {
+        return {};
+    }
+    return logical_device_->impl_->pipeline_cache->statistics();
+}
+
+} // namespace wg
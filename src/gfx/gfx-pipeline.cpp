@@ -5,12 +5,17 @@
 #include "gfx/gfx.h"
 #include "gfx/gfx-buffer.h"
 #include "gfx-private.h"
+#include "gfx-allocator-private.h"
 #include "draw-command-private.h"
 #include "gfx-constants-private.h"
 #include "gfx-pipeline-private.h"
 #include "render-target-private.h"
 
+#include <algorithm>
+#include <chrono>
+#include <future>
 #include <iterator>
+#include <map>
 
 namespace {
 
@@ -64,6 +69,15 @@ void GfxSamplerLayout::clearDescriptions() {
     descriptions_.clear();
 }
 
+GfxStorageBufferLayout& GfxStorageBufferLayout::addDescription(StorageBufferDescription description) {
+    AddDescriptionByBindingImplTemplate(descriptions_, description);
+    return *this;
+}
+
+void GfxStorageBufferLayout::clearDescriptions() {
+    descriptions_.clear();
+}
+
 std::shared_ptr<GfxPipeline> GfxPipeline::Create() {
     return std::shared_ptr<GfxPipeline>(new GfxPipeline());
 }
@@ -72,6 +86,14 @@ GfxPipeline::GfxPipeline()
     : impl_(std::make_unique<Impl>()) {
 }
 
+std::shared_ptr<ComputePipeline> ComputePipeline::Create() {
+    return std::shared_ptr<ComputePipeline>(new ComputePipeline());
+}
+
+ComputePipeline::ComputePipeline()
+    : impl_(std::make_unique<Impl>()) {
+}
+
 void Gfx::createPipelineResources(
     const std::shared_ptr<GfxPipeline>& pipeline
 ) {
@@ -80,7 +102,6 @@ void Gfx::createPipelineResources(
         logger().error("Cannot create pipeline resources because logical device is not available.");
         return;
     }
-    waitDeviceIdle();
 
     auto resources = std::make_unique<GfxPipelineResources>();
 
@@ -100,7 +121,7 @@ void Gfx::createPipelineResources(
             layout_bindings.emplace_back(
                 vk::DescriptorSetLayoutBinding{
                     .binding            = description.binding,
-                    .descriptorType     = vk::DescriptorType::eUniformBuffer,
+                    .descriptorType     = GetUniformDescriptorType(description.attribute),
                     .descriptorCount    = 1,
                     .stageFlags         = GetShaderStageFlags(description.stages),
                     .pImmutableSamplers = nullptr
@@ -241,47 +262,95 @@ void Gfx::createPipelineResources(
         logical_device_->impl_->gfx_pipeline_resources.store(std::move(resources));
 }
 
-void Gfx::createDrawCommandResourcesForRenderTarget(
-    const std::shared_ptr<RenderTarget>& render_target,
-    const std::shared_ptr<DrawCommand>& draw_command
-) {
-    logger().info(
-        R"(Creating resources of draw command "{}" for render target "{}".)",
-        draw_command->name(), render_target->name()
-    );
-    auto& pipeline = draw_command->pipeline_;
+void Gfx::createComputePipelineResources(const std::shared_ptr<ComputePipeline>& pipeline) {
+    pipeline->impl_->resources.reset();
 
-    if (!pipeline) {
-        logger().error("Cannot create draw command resources because pipeline is not available.");
+    if (!logical_device_) {
+        logger().error("Cannot create compute pipeline resources because logical device is not available.");
         return;
     }
 
-    if (!logical_device_) {
-        logger().error("Cannot create draw command resources for render target because logical device is not available.");
+    const auto& shader = pipeline->shader_;
+    if (!shader || !shader->valid()) {
+        logger().error("Cannot create compute pipeline resources because shader resources are not available.");
         return;
     }
-    waitDeviceIdle();
-
-    auto* resources = render_target->impl_->resources.data();
-    if (!resources) {
-        logger().error("Cannot create draw command resources for render target because render target resources are not available.");
+    if (shader->stage() != shader_stages::comp) {
+        logger().error("Cannot create compute pipeline resources because shader \"{}\" is not a compute shader.", shader->filename());
         return;
     }
 
-    auto* pipeline_resources = pipeline->impl_->resources.data();
-    if (!pipeline_resources) {
-        logger().error("Cannot create draw command resources for render target because pipeline resources are not available.");
-        return;
+    auto resources = std::make_unique<ComputePipelineResources>();
+
+    std::vector<vk::DescriptorSetLayoutBinding> layout_bindings;
+    for (auto&& description : pipeline->storage_buffer_layout_.descriptions_) {
+        layout_bindings.emplace_back(
+            vk::DescriptorSetLayoutBinding{
+                .binding            = description.binding,
+                .descriptorType     = vk::DescriptorType::eStorageBuffer,
+                .descriptorCount    = 1,
+                .stageFlags         = GetShaderStageFlags(description.stages),
+                .pImmutableSamplers = nullptr
+            }
+        );
+    }
+    for (auto&& description : pipeline->sampler_layout_.descriptions_) {
+        layout_bindings.emplace_back(
+            vk::DescriptorSetLayoutBinding{
+                .binding            = description.binding,
+                .descriptorType     = vk::DescriptorType::eCombinedImageSampler,
+                .descriptorCount    = 1,
+                .stageFlags         = GetShaderStageFlags(description.stages),
+                .pImmutableSamplers = nullptr
+            }
+        );
     }
 
-    auto* impl = draw_command->getImpl();
-    if (!impl) {
-        logger().error("Cannot create draw command resources for render target because draw command impl are not available.");
-        return;
+    std::vector<vk::DescriptorSetLayout> set_layouts;
+    if (!layout_bindings.empty()) {
+        auto set_layout_create_info = vk::DescriptorSetLayoutCreateInfo{}
+            .setBindings(layout_bindings);
+        resources->set_layout =
+            logical_device_->impl_->vk_device.createDescriptorSetLayout(set_layout_create_info);
+        set_layouts.push_back(*resources->set_layout);
+    }
+
+    std::vector<vk::PushConstantRange> push_constant_ranges;
+    if (pipeline->push_constant_size_ > 0) {
+        push_constant_ranges.emplace_back(
+            vk::PushConstantRange{
+                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+                .offset = 0,
+                .size = pipeline->push_constant_size_,
+            }
+        );
     }
 
-    // Pipeline state
-    auto[width, height] = render_target->extent();
+    auto pipeline_layout_create_info = vk::PipelineLayoutCreateInfo{}
+        .setSetLayouts(set_layouts)
+        .setPushConstantRanges(push_constant_ranges);
+    resources->pipeline_layout =
+        logical_device_->impl_->vk_device.createPipelineLayout(pipeline_layout_create_info);
+
+    auto pipeline_create_info = vk::ComputePipelineCreateInfo{
+        .stage  = shader->impl_->shader_stage_create_info,
+        .layout = *resources->pipeline_layout,
+    };
+    resources->pipeline =
+        logical_device_->impl_->vk_device.createComputePipeline(logical_device_->impl_->pipeline_cache->vk_pipeline_cache(), pipeline_create_info);
+
+    pipeline->impl_->resources =
+        logical_device_->impl_->compute_pipeline_resources.store(std::move(resources));
+}
+
+std::shared_ptr<GfxGraphicsPipelineState> Gfx::Impl::createGraphicsPipelineState(
+    const RenderTarget& render_target, const RenderTargetResources& resources, DrawCommand::Impl& draw_command_impl,
+    const GfxPipeline& pipeline, const GfxPipeline& layout_pipeline
+) {
+    auto* pipeline_resources = pipeline.impl_->resources.data();
+    auto* layout_pipeline_resources = layout_pipeline.impl_->resources.data();
+
+    auto[width, height] = render_target.extent();
     std::vector<vk::Viewport> viewports;
     viewports.reserve(pipeline_resources->viewports.size());
     for (auto&& viewport : pipeline_resources->viewports) {
@@ -313,80 +382,200 @@ void Gfx::createDrawCommandResourcesForRenderTarget(
         .setViewports(viewports)
         .setScissors(scissors);
 
-    auto& render_target_pipeline_resources = resources->pipeline_resources.emplace_back();
+    auto state = std::make_shared<GfxGraphicsPipelineState>();
+    state->assign(
+        vk::GraphicsPipelineCreateInfo{
+            .pVertexInputState   = &draw_command_impl.vertex_input_create_info,
+            .pInputAssemblyState = &draw_command_impl.input_assembly_create_info,
+            .pViewportState      = &viewport_create_info,
+            .pRasterizationState = &pipeline_resources->rasterization_create_info,
+            .pMultisampleState   = &pipeline_resources->multisample_create_info,
+            .pDepthStencilState  = &pipeline_resources->depth_stencil_create_info,
+            .pColorBlendState    = &pipeline_resources->color_blend_create_info,
+            .pDynamicState       = &pipeline_resources->dynamic_state_create_info,
+            .layout              = *layout_pipeline_resources->pipeline_layout,
+            .renderPass          = **resources.render_pass,
+            .subpass             = 0,
+        }
+            .setStages(pipeline_resources->shader_stages)
+    );
+    state->layout_owner = layout_pipeline.impl_->resources;
+    state->render_pass = resources.render_pass;
+    state->shaders = pipeline.shaders();
+    for (auto&& shader : state->shaders) {
+        state->shader_owners.push_back(shader->impl_->resources);
+    }
+    return state;
+}
 
-    // Pipeline
-    auto pipeline_create_info = vk::GraphicsPipelineCreateInfo{
-        .pVertexInputState   = &impl->vertex_input_create_info,
-        .pInputAssemblyState = &impl->input_assembly_create_info,
-        .pViewportState      = &viewport_create_info,
-        .pRasterizationState = &pipeline_resources->rasterization_create_info,
-        .pMultisampleState   = &pipeline_resources->multisample_create_info,
-        .pDepthStencilState  = &pipeline_resources->depth_stencil_create_info,
-        .pColorBlendState    = &pipeline_resources->color_blend_create_info,
-        .pDynamicState       = &pipeline_resources->dynamic_state_create_info,
-        .layout              = *pipeline_resources->pipeline_layout,
-        .renderPass          = *resources->render_pass,
-        .subpass             = 0,
-    }
-        .setStages(pipeline_resources->shader_stages);
-
-    render_target_pipeline_resources.pipeline =
-        logical_device_->impl_->vk_device.createGraphicsPipeline({ nullptr }, pipeline_create_info);
-
-    // Descriptor pool
-    size_t image_count = resources->framebuffer_resources.size();
-    std::vector<vk::DescriptorPoolSize> descriptor_pool_sizes;
-    if (*pipeline_resources->set_layout) {
-        auto uniform_descriptors_count = [&pipeline]() -> uint32_t {
-            uint32_t count = 0;
-            for (auto&& description : pipeline->uniform_layout().descriptions()) {
-                if (description.binding != std::numeric_limits<uint32_t>::max()) {
-                    count++;
-                }
-            }
-            return count;
-        }() * static_cast<uint32_t>(image_count);
-        if (uniform_descriptors_count > 0) {
-            descriptor_pool_sizes.emplace_back(
-                vk::DescriptorPoolSize{
-                    .type = vk::DescriptorType::eUniformBuffer,
-                    .descriptorCount = uniform_descriptors_count
+void Gfx::createDrawCommandResourcesForRenderTarget(
+    const std::shared_ptr<RenderTarget>& render_target,
+    const std::shared_ptr<DrawCommand>& draw_command
+) {
+    logger().info(
+        R"(Creating resources of draw command "{}" for render target "{}".)",
+        draw_command->name(), render_target->name()
+    );
+    auto& pipeline = draw_command->pipeline_;
+
+    if (!pipeline) {
+        logger().error("Cannot create draw command resources because pipeline is not available.");
+        return;
+    }
+
+    if (!logical_device_) {
+        logger().error("Cannot create draw command resources for render target because logical device is not available.");
+        return;
+    }
+
+    auto* resources = render_target->impl_->resources.data();
+    if (!resources) {
+        logger().error("Cannot create draw command resources for render target because render target resources are not available.");
+        return;
+    }
+
+    auto* pipeline_resources = pipeline->impl_->resources.data();
+    if (!pipeline_resources) {
+        logger().error("Cannot create draw command resources for render target because pipeline resources are not available.");
+        return;
+    }
+
+    auto* impl = draw_command->getImpl();
+    if (!impl) {
+        logger().error("Cannot create draw command resources for render target because draw command impl are not available.");
+        return;
+    }
+
+    // Uniform arena ranges, at the same offsets in every image
+    std::vector<RenderTargetUniformRange> uniform_ranges;
+    std::vector<std::shared_ptr<UniformBufferBase>> push_constants;
+    vk::DeviceSize uniform_arena_size = resources->uniform_arena_size;
+    for (auto&&[attribute, cpu_uniform] : draw_command->uniform_buffers_) {
+        auto* description = pipeline->uniform_layout().getDescription(attribute);
+        if (description && description->binding == std::numeric_limits<uint32_t>::max()) {
+            push_constants.emplace_back(cpu_uniform);
+        } else if (IsDynamicUniform(attribute)) {
+            vk::DeviceSize offset = AlignUp(uniform_arena_size, resources->uniform_arena_alignment);
+            uniform_ranges.emplace_back(
+                RenderTargetUniformRange{
+                    .attribute = attribute,
+                    .offset = offset,
+                    .size = cpu_uniform->data_size()
                 }
             );
+            uniform_arena_size = offset + cpu_uniform->data_size();
         }
-        auto sampler_descriptors_count =
-            static_cast<uint32_t>(pipeline->sampler_layout().descriptions().size() * image_count);
-        if (sampler_descriptors_count > 0) {
-            descriptor_pool_sizes.emplace_back(
-                vk::DescriptorPoolSize{
-                    .type = vk::DescriptorType::eCombinedImageSampler,
-                    .descriptorCount = sampler_descriptors_count
-                }
+    }
+    if (uniform_arena_size > resources->uniform_arena_capacity) {
+        logger().error("Cannot create draw command resources for render target because uniform arena is full.");
+        return;
+    }
+    resources->uniform_arena_size = uniform_arena_size;
+
+    auto find_uniform_range = [&uniform_ranges](uniform_attributes::UniformAttribute attribute) -> const RenderTargetUniformRange* {
+        for (auto&& uniform_range : uniform_ranges) {
+            if (uniform_range.attribute == attribute) {
+                return &uniform_range;
+            }
+        }
+        return nullptr;
+    };
+
+    // Dynamic offsets are consumed in binding order
+    std::vector<UniformDescription> dynamic_uniform_descriptions;
+    for (auto&& description : pipeline->uniform_layout().descriptions()) {
+        if (description.binding != std::numeric_limits<uint32_t>::max() && IsDynamicUniform(description.attribute)) {
+            dynamic_uniform_descriptions.emplace_back(description);
+        }
+    }
+    std::sort(
+        dynamic_uniform_descriptions.begin(), dynamic_uniform_descriptions.end(),
+        [](const UniformDescription& a, const UniformDescription& b) { return a.binding < b.binding; }
+    );
+    std::vector<uint32_t> dynamic_offsets;
+    for (auto&& description : dynamic_uniform_descriptions) {
+        const auto* uniform_range = find_uniform_range(description.attribute);
+        if (!uniform_range) {
+            logger().error(
+                "Cannot find uniform {} for binding {} in draw command {}.",
+                static_cast<int>(description.attribute), description.binding, draw_command->name()
             );
         }
+        dynamic_offsets.push_back(uniform_range ? static_cast<uint32_t>(uniform_range->offset) : 0);
     }
 
-    auto descriptor_pool_create_info = vk::DescriptorPoolCreateInfo{
-        .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
-        .maxSets = static_cast<uint32_t>(image_count)
-    }
-        .setPoolSizes(descriptor_pool_sizes);
+    size_t render_target_pipeline_resources_index = resources->pipeline_resources.size();
+    auto& render_target_pipeline_resources = resources->pipeline_resources.emplace_back();
+    render_target_pipeline_resources.draw_command_index = resources->draw_command_resources.size();
 
-    render_target_pipeline_resources.descriptor_pool =
-        logical_device_->impl_->vk_device.createDescriptorPool(descriptor_pool_create_info);
+    // Pipeline, created in background if there are compile threads
+    auto& pipeline_cache = *logical_device_->impl_->pipeline_cache;
+    auto pipeline_future = pipeline_cache.requestGraphicsPipeline(
+        impl_->createGraphicsPipelineState(*render_target, *resources, *impl, *pipeline, *pipeline), true
+    );
+    if (pipeline_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        render_target_pipeline_resources.pipeline = pipeline_future.get();
+    } else {
+        // Drawn with the fallback pipeline or skipped until the pipeline is ready, see resolvePendingPipelines
+        render_target_pipeline_resources.pending_pipeline = std::move(pipeline_future);
+        ++resources->pending_pipeline_count;
+        const auto& fallback_pipeline = pipeline->fallback_pipeline();
+        if (fallback_pipeline && fallback_pipeline->impl_->resources.data()) {
+            render_target_pipeline_resources.pipeline = pipeline_cache.requestGraphicsPipeline(
+                impl_->createGraphicsPipelineState(*render_target, *resources, *impl, *fallback_pipeline, *pipeline), false
+            ).get();
+        }
+    }
 
-    // Descriptor
-    resources->draw_command_resources.emplace_back();
+    size_t image_count = resources->framebuffer_resources.size();
 
-    std::vector<vk::DescriptorSetLayout> set_layouts;
-    for (int i = 0; i < image_count; ++i) {
-        if (*pipeline_resources->set_layout) {
-            set_layouts.push_back(*pipeline_resources->set_layout);
+    // Descriptor sets only differ by samplers, since draw command uniforms are addressed by dynamic offsets.
+    const bool share_descriptor_sets = pipeline->sampler_layout().descriptions().empty();
+    const RenderTargetPipelineResources* descriptor_sets_owner = &render_target_pipeline_resources;
+    bool write_descriptor_sets = true;
+    if (share_descriptor_sets) {
+        auto it = resources->shared_descriptor_sets.find(pipeline_resources);
+        if (it != resources->shared_descriptor_sets.end()) {
+            descriptor_sets_owner = &resources->pipeline_resources[it->second];
+            write_descriptor_sets = false;
+        } else {
+            resources->shared_descriptor_sets[pipeline_resources] = render_target_pipeline_resources_index;
         }
     }
 
-    if (!set_layouts.empty()) {
+    if (write_descriptor_sets && *pipeline_resources->set_layout) {
+        // Descriptor pool
+        std::map<vk::DescriptorType, uint32_t> descriptor_counts;
+        for (auto&& description : pipeline->uniform_layout().descriptions()) {
+            if (description.binding != std::numeric_limits<uint32_t>::max()) {
+                descriptor_counts[GetUniformDescriptorType(description.attribute)] += static_cast<uint32_t>(image_count);
+            }
+        }
+        if (!pipeline->sampler_layout().descriptions().empty()) {
+            descriptor_counts[vk::DescriptorType::eCombinedImageSampler] +=
+                static_cast<uint32_t>(pipeline->sampler_layout().descriptions().size() * image_count);
+        }
+        std::vector<vk::DescriptorPoolSize> descriptor_pool_sizes;
+        for (auto&&[type, count] : descriptor_counts) {
+            descriptor_pool_sizes.emplace_back(
+                vk::DescriptorPoolSize{
+                    .type = type,
+                    .descriptorCount = count
+                }
+            );
+        }
+
+        auto descriptor_pool_create_info = vk::DescriptorPoolCreateInfo{
+            .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+            .maxSets = static_cast<uint32_t>(image_count)
+        }
+            .setPoolSizes(descriptor_pool_sizes);
+
+        render_target_pipeline_resources.descriptor_pool =
+            logical_device_->impl_->vk_device.createDescriptorPool(descriptor_pool_create_info);
+
+        // Descriptor sets
+        std::vector<vk::DescriptorSetLayout> set_layouts(image_count, *pipeline_resources->set_layout);
         auto descriptor_pool_alloc_info = vk::DescriptorSetAllocateInfo{
             .descriptorPool = *render_target_pipeline_resources.descriptor_pool
         }
@@ -397,21 +586,20 @@ void Gfx::createDrawCommandResourcesForRenderTarget(
     }
 
     // Create draw command resources
-    for (size_t i = 0; i < image_count; ++i) {
-        std::vector<std::shared_ptr<UniformBufferBase>> gpu_uniforms;
-        std::vector<std::shared_ptr<UniformBufferBase>> push_constants;
-        for (auto&&[attribute, cpu_uniform] : draw_command->uniform_buffers_) {
-            auto* description = pipeline->uniform_layout().getDescription(attribute);
-            if (description && description->binding == std::numeric_limits<uint32_t>::max()) {
-                push_constants.emplace_back(cpu_uniform);
-            } else {
-                auto& gpu_uniform = gpu_uniforms.emplace_back(UniformBufferBase::Create(attribute));
-                createUniformBufferResources(gpu_uniform);
-                if (cpu_uniform->has_cpu_data()) {
-                    commitReferenceBuffer(cpu_uniform, gpu_uniform);
-                }
-            }
+    auto& draw_command_resources_of_images = resources->draw_command_resources.emplace_back();
+    std::vector<UniformDescription> push_constant_descriptions;
+    for (auto&& description : pipeline->uniform_layout().descriptions()) {
+        if (description.binding == std::numeric_limits<uint32_t>::max()) {
+            push_constant_descriptions.emplace_back(description);
         }
+    }
+    // Sampled images may have been evicted under memory pressure
+    for (auto&& [binding, sampler] : draw_command->samplers_) {
+        if (sampler && sampler->image()) {
+            impl_->useImage(sampler->image());
+        }
+    }
+    for (size_t i = 0; i < image_count; ++i) {
         std::map<uint32_t, std::shared_ptr<Sampler>> samplers;
         for (auto&& description : pipeline->sampler_layout_.descriptions_) {
             auto it = draw_command->samplers_.find(description.binding);
@@ -422,123 +610,134 @@ void Gfx::createDrawCommandResourcesForRenderTarget(
             }
         }
         vk::DescriptorSet descriptor_set = nullptr;
-        if (!render_target_pipeline_resources.descriptor_sets.empty()) {
-            descriptor_set = *render_target_pipeline_resources.descriptor_sets[i];
-        }
-        
-        std::vector<UniformDescription> push_constant_descriptions;
-        for (auto&& description : pipeline->uniform_layout().descriptions()) {
-            if (description.binding == std::numeric_limits<uint32_t>::max()) {
-                push_constant_descriptions.emplace_back(description);
-            }
+        if (!descriptor_sets_owner->descriptor_sets.empty()) {
+            descriptor_set = *descriptor_sets_owner->descriptor_sets[i];
         }
 
-        resources->draw_command_resources.back().emplace_back(
+        draw_command_resources_of_images.emplace_back(
             RenderTargetDrawCommandResources{
-                .pipeline        = *render_target_pipeline_resources.pipeline,
+                .pipeline        = render_target_pipeline_resources.pipeline ? **render_target_pipeline_resources.pipeline : vk::Pipeline{},
                 .pipeline_layout = *pipeline_resources->pipeline_layout,
                 .descriptor_set  = descriptor_set,
-                .uniforms        = std::move(gpu_uniforms),
+                .uniform_ranges  = uniform_ranges,
+                .dynamic_offsets = dynamic_offsets,
                 .samplers        = std::move(samplers),
-                .push_constants  = std::move(push_constants),
-                .push_constant_descriptions = std::move(push_constant_descriptions),
+                .push_constants  = push_constants,
+                .push_constant_descriptions = push_constant_descriptions,
             }
         );
+
+        // Initial uniform data
+        if (i < resources->uniform_arenas.size()) {
+            for (auto&& uniform_range : uniform_ranges) {
+                const auto& cpu_uniform = draw_command->uniform_buffers_[uniform_range.attribute];
+                if (cpu_uniform->has_cpu_data()) {
+                    impl_->writeUniformArena(resources->uniform_arenas[i], uniform_range.offset, cpu_uniform->data(), uniform_range.size);
+                }
+            }
+        }
+    }
+
+    if (!write_descriptor_sets || render_target_pipeline_resources.descriptor_sets.empty()) {
+        return;
     }
 
     for (size_t i = 0; i < image_count; ++i) {
         auto& framebuffer_resources = resources->framebuffer_resources[i];
-        auto& draw_command_resources = resources->draw_command_resources.back()[i];
+        auto& draw_command_resources = draw_command_resources_of_images[i];
         std::vector<vk::WriteDescriptorSet> write_descriptor_sets;
-        std::vector<std::vector<vk::DescriptorBufferInfo>> buffer_infos;
-        std::vector<std::vector<vk::DescriptorImageInfo>> image_infos;
+        // Reserved so that pointers in write_descriptor_sets stay valid
+        std::vector<vk::DescriptorBufferInfo> buffer_infos;
+        buffer_infos.reserve(pipeline->uniform_layout_.descriptions_.size());
+        std::vector<vk::DescriptorImageInfo> image_infos;
+        image_infos.reserve(pipeline->sampler_layout_.descriptions_.size());
 
         for (auto&& description : pipeline->uniform_layout_.descriptions_) {
-            // Find GPU uniform data
-            const auto* gpu_uniform = [description, &framebuffer_resources, &draw_command_resources]()
-                -> const std::shared_ptr<UniformBufferBase>* {
-                for (auto&& uniform_buffer : framebuffer_resources.uniforms) {
-                    if (description.attribute == uniform_buffer->description().attribute) {
-                        return &uniform_buffer;
-                    }
+            if (description.binding == std::numeric_limits<uint32_t>::max()) {
+                continue;
+            }
+
+            if (IsDynamicUniform(description.attribute)) {
+                // Offset is given at bind time, only the range matters here
+                const auto* uniform_range = find_uniform_range(description.attribute);
+                if (!uniform_range || i >= resources->uniform_arenas.size()) {
+                    logger().error("Uniform arena not available.");
+                    continue;
                 }
-                for (auto&& uniform_buffer : draw_command_resources.uniforms) {
-                    if (description.attribute == uniform_buffer->description().attribute) {
-                        return &uniform_buffer;
+                buffer_infos.emplace_back(
+                    vk::DescriptorBufferInfo{
+                        .buffer = *resources->uniform_arenas[i].buffer_resources.buffer,
+                        .offset = 0,
+                        .range  = uniform_range->size
+                    }
+                );
+            } else {
+                // Find GPU uniform data
+                const auto* gpu_uniform = [description, &framebuffer_resources]()
+                    -> const std::shared_ptr<UniformBufferBase>* {
+                    for (auto&& uniform_buffer : framebuffer_resources.uniforms) {
+                        if (description.attribute == uniform_buffer->description().attribute) {
+                            return &uniform_buffer;
+                        }
                     }
+                    return nullptr;
+                }();
+                auto* buffer_resources = gpu_uniform ? (*gpu_uniform)->impl_->resources.data() : nullptr;
+                if (!buffer_resources) {
+                    logger().error("Uniform buffer resources not available.");
+                    continue;
                 }
-                return nullptr;
-            }();
-
-            std::vector<vk::DescriptorBufferInfo> buffer_info;
-            if (auto* buffer_resources = (*gpu_uniform)->impl_->resources.data()) {
-                buffer_info.emplace_back(
+                buffer_infos.emplace_back(
                     vk::DescriptorBufferInfo{
                         .buffer = *buffer_resources->buffer,
                         .offset = 0,
                         .range  = (*gpu_uniform)->data_size()
                     }
                 );
-            } else {
-                logger().error("Uniform buffer resources not available.");
             }
-            buffer_infos.emplace_back(std::move(buffer_info));
-        }
 
-        for (size_t j = 0; j < pipeline->uniform_layout_.descriptions_.size(); ++j) {
-            auto& description = pipeline->uniform_layout_.descriptions_[j];
-            if (description.binding == std::numeric_limits<uint32_t>::max()) {
-                continue;
-            }
-            auto write_description_set = vk::WriteDescriptorSet{
-                .dstSet          = *render_target_pipeline_resources.descriptor_sets[i],
-                .dstBinding      = description.binding,
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType  = vk::DescriptorType::eUniformBuffer
-            }
-                .setBufferInfo(buffer_infos[j]);
-            write_descriptor_sets.emplace_back(write_description_set);
+            write_descriptor_sets.emplace_back(
+                vk::WriteDescriptorSet{
+                    .dstSet          = *render_target_pipeline_resources.descriptor_sets[i],
+                    .dstBinding      = description.binding,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType  = GetUniformDescriptorType(description.attribute),
+                    .pBufferInfo     = &buffer_infos.back()
+                }
+            );
         }
 
         for (auto&& description : pipeline->sampler_layout_.descriptions_) {
-            std::vector<vk::DescriptorImageInfo> image_info;
-            if (draw_command_resources.samplers.find(description.binding) == draw_command_resources.samplers.end()) {
-                image_infos.emplace_back(std::move(image_info));
+            auto it = draw_command_resources.samplers.find(description.binding);
+            if (it == draw_command_resources.samplers.end()) {
                 continue;
             }
 
-            auto&& sampler = draw_command_resources.samplers[description.binding];
-            if (auto* image_resources = sampler->image_->impl_->resources.data()) {
-                if (auto* sampler_resources = sampler->impl_->resources.data()) {
-                    image_info.emplace_back(
-                        vk::DescriptorImageInfo{
-                            .sampler     = *sampler_resources->sampler,
-                            .imageView   = *image_resources->image_view,
-                            .imageLayout = image_resources->image_layout
-                        }
-                    );
-                    image_infos.emplace_back(std::move(image_info));
-                }
-            } else {
+            auto&& sampler = it->second;
+            auto* image_resources = sampler->image_->impl_->resources.data();
+            auto* sampler_resources = sampler->impl_->resources.data();
+            if (!image_resources || !sampler_resources) {
                 logger().error("Image/sampler resources not available.");
-            }
-        }
-
-        for (size_t j = 0; j < pipeline->sampler_layout_.descriptions_.size(); ++j) {
-            auto& description = pipeline->sampler_layout_.descriptions_[j];
-            if (image_infos[j].empty()) {
                 continue;
             }
-            auto write_description_set = vk::WriteDescriptorSet{
-                .dstSet          = *render_target_pipeline_resources.descriptor_sets[i],
-                .dstBinding      = description.binding,
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType  = vk::DescriptorType::eCombinedImageSampler,
-            }
-                .setImageInfo(image_infos[j]);
-            write_descriptor_sets.emplace_back(write_description_set);
+            image_infos.emplace_back(
+                vk::DescriptorImageInfo{
+                    .sampler     = *sampler_resources->sampler,
+                    .imageView   = *image_resources->image_view,
+                    .imageLayout = image_resources->image_layout
+                }
+            );
+            write_descriptor_sets.emplace_back(
+                vk::WriteDescriptorSet{
+                    .dstSet          = *render_target_pipeline_resources.descriptor_sets[i],
+                    .dstBinding      = description.binding,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType  = vk::DescriptorType::eCombinedImageSampler,
+                    .pImageInfo      = &image_infos.back()
+                }
+            );
         }
 
         logical_device_->impl_->vk_device.updateDescriptorSets(write_descriptor_sets, {});
@@ -596,22 +795,19 @@ void Gfx::commitDrawCommandUniformBuffers(
     size_t image_count = resources->framebuffer_resources.size();
     int start_index = image_index >= 0 ? image_index : 0;
     int end_index = image_index >= 0 ? image_index + 1 : static_cast<int>(image_count);
+    end_index = std::min(end_index, static_cast<int>(resources->uniform_arenas.size()));
     for (int i = start_index; i < end_index; ++i) {
         auto& draw_command_resources = resources->draw_command_resources[draw_command_index][i];
-        for (auto&&[attribute, cpu_uniform] : draw_command->uniform_buffers_) {
-            if (specified_attribute == uniform_attributes::none || specified_attribute == attribute) {
-                // Find GPU uniform data
-                const auto* gpu_uniform = [attrib = attribute, &draw_command_resources]()
-                    -> const std::shared_ptr<UniformBufferBase>* {
-                    for (auto&& uniform_buffer : draw_command_resources.uniforms) {
-                        if (attrib == uniform_buffer->description().attribute) {
-                            return &uniform_buffer;
-                        }
-                    }
-                    return nullptr;
-                }();
-                commitReferenceBuffer(cpu_uniform, *gpu_uniform);
+        for (auto&& uniform_range : draw_command_resources.uniform_ranges) {
+            if (specified_attribute != uniform_attributes::none && specified_attribute != uniform_range.attribute) {
+                continue;
+            }
+            auto it = draw_command->uniform_buffers_.find(uniform_range.attribute);
+            if (it == draw_command->uniform_buffers_.end() || !it->second->has_cpu_data()) {
+                logger().error("Skip committing draw command uniform buffer because has no CPU data.");
+                continue;
             }
+            impl_->writeUniformArena(resources->uniform_arenas[i], uniform_range.offset, it->second->data(), uniform_range.size);
         }
     }
 }
@@ -0,0 +1,64 @@
+#include "gfx-sort-private.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+namespace wg {
+
+namespace {
+
+[[nodiscard]] uint64_t ClampField(uint32_t value, uint32_t bits) {
+    return std::min<uint64_t>(value, (uint64_t{ 1 } << bits) - 1);
+}
+
+} // unnamed namespace
+
+uint64_t MakeDrawSortStateKey(uint32_t pipeline_id, uint32_t material_id, uint32_t mesh_id) {
+    using namespace gfx_draw_sort_keys;
+    return ClampField(pipeline_id, PIPELINE_BITS) << PIPELINE_SHIFT |
+        ClampField(material_id, MATERIAL_BITS) << MATERIAL_SHIFT |
+        ClampField(mesh_id, MESH_BITS) << MESH_SHIFT;
+}
+
+uint64_t MakeDrawSortKey(uint64_t state_key, uint32_t layer, float depth) {
+    using namespace gfx_draw_sort_keys;
+    // Bits of non-negative floats are ordered like the floats, so the highest bits are a coarse depth.
+    uint32_t depth_bits = depth > 0.f ? std::bit_cast<uint32_t>(depth) >> (32 - DEPTH_BITS) : 0;
+    return ClampField(layer, LAYER_BITS) << LAYER_SHIFT | state_key | static_cast<uint64_t>(depth_bits) << DEPTH_SHIFT;
+}
+
+void RadixSortDrawSortItems(std::vector<GfxDrawSortItem>& items, std::vector<GfxDrawSortItem>& scratch) {
+    if (items.size() <= 1) {
+        return;
+    }
+    scratch.resize(items.size());
+
+    // Histograms of all passes in one read
+    std::array<std::array<uint32_t, 256>, 8> counts{};
+    for (auto&& item : items) {
+        for (uint32_t pass = 0; pass < 8; ++pass) {
+            ++counts[pass][(item.key >> (pass * 8)) & 0xff];
+        }
+    }
+
+    for (uint32_t pass = 0; pass < 8; ++pass) {
+        auto& pass_counts = counts[pass];
+        // Skip bytes equal in all keys, e.g. unused layers or depth
+        if (pass_counts[(items[0].key >> (pass * 8)) & 0xff] == items.size()) {
+            continue;
+        }
+        std::array<uint32_t, 256> offsets{};
+        uint32_t offset = 0;
+        for (uint32_t byte = 0; byte < 256; ++byte) {
+            offsets[byte] = offset;
+            offset += pass_counts[byte];
+        }
+        for (auto&& item : items) {
+            scratch[offsets[(item.key >> (pass * 8)) & 0xff]++] = item;
+        }
+        items.swap(scratch);
+    }
+}
+
+} // namespace wg
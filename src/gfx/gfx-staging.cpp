@@ -0,0 +1,189 @@
+#include "gfx/gfx.h"
+
+#include "common/logger.h"
+#include "gfx-private.h"
+#include "gfx-allocator-private.h"
+#include "gfx-staging-private.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+[[nodiscard]] auto& logger() {
+    static auto logger_ = wg::Logger::Get("gfx");
+    return *logger_;
+}
+
+} // unnamed namespace
+
+namespace wg {
+
+GfxStagingRing::GfxStagingRing(GfxSubmissionTracker& submission_tracker, vk::DeviceSize capacity)
+    : submission_tracker_(submission_tracker), capacity_(capacity) {}
+
+GfxStagingRing::~GfxStagingRing() {
+    reclaim(true);
+}
+
+bool GfxStagingRing::tryAllocate(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& out_offset) {
+    if (used_size_ == 0) {
+        head_ = tail_ = 0;
+    }
+    const bool wrapped = head_ < tail_ || (head_ == tail_ && used_size_ > 0);
+
+    vk::DeviceSize offset = AlignUp(head_, alignment);
+    if (!wrapped) {
+        if (offset + size <= capacity_) {
+            used_size_ += offset + size - head_;
+            uncommitted_size_ += offset + size - head_;
+            head_ = offset + size;
+            out_offset = offset;
+            return true;
+        }
+        // Wrap around to the beginning, wasting the rest of the ring.
+        if (size <= tail_) {
+            used_size_ += capacity_ - head_ + size;
+            uncommitted_size_ += capacity_ - head_ + size;
+            head_ = size;
+            out_offset = 0;
+            return true;
+        }
+        return false;
+    }
+
+    if (offset + size <= tail_) {
+        used_size_ += offset + size - head_;
+        uncommitted_size_ += offset + size - head_;
+        head_ = offset + size;
+        out_offset = offset;
+        return true;
+    }
+    return false;
+}
+
+bool GfxStagingRing::allocate(vk::DeviceSize size, vk::DeviceSize alignment, GfxStagingRegion& out_region) {
+    if (size > capacity_) {
+        return false;
+    }
+
+    reclaim();
+    vk::DeviceSize offset = 0;
+    while (!tryAllocate(size, alignment, offset)) {
+        if (pending_submissions_.empty()) {
+            // Remaining space is held by regions not yet submitted.
+            return false;
+        }
+        popPendingSubmission();
+    }
+
+    out_region = GfxStagingRegion{
+        .buffer = *buffer_resources.buffer,
+        .offset = offset,
+        .size = size,
+        .mapped = static_cast<char*>(memory_resources.allocation.mapped()) + offset
+    };
+    return true;
+}
+
+void GfxStagingRing::commit(uint64_t submission_index) {
+    pending_submissions_.emplace_back(
+        PendingSubmission{
+            .submission_index = submission_index,
+            .end = head_,
+            .size = uncommitted_size_
+        }
+    );
+    uncommitted_size_ = 0;
+}
+
+void GfxStagingRing::popPendingSubmission() {
+    auto& submission = pending_submissions_.front();
+    submission_tracker_.wait(submission.submission_index);
+
+    tail_ = submission.end;
+    used_size_ -= submission.size;
+    pending_submissions_.pop_front();
+}
+
+void GfxStagingRing::reclaim(bool wait_all) {
+    while (!pending_submissions_.empty()) {
+        if (!wait_all && !submission_tracker_.finished(pending_submissions_.front().submission_index)) {
+            break;
+        }
+        popPendingSubmission();
+    }
+}
+
+void Gfx::Impl::createStagingRing() {
+    auto& logical_device_impl = *gfx->logical_device_->impl_;
+    const auto capacity = static_cast<vk::DeviceSize>(gfx->setup_.staging_buffer_size_mb) * 1024 * 1024;
+
+    auto staging_ring = std::make_unique<GfxStagingRing>(*logical_device_impl.submission_tracker, capacity);
+
+    QueueInfoRef transfer_queue;
+    getTransferQueue(transfer_queue);
+    createBuffer(
+        capacity, vk::BufferUsageFlagBits::eTransferSrc,
+        vk::SharingMode::eExclusive, { transfer_queue.queue_family_index },
+        staging_ring->buffer_resources
+    );
+    if (!createGfxMemory(
+        staging_ring->buffer_resources.buffer.getMemoryRequirements(),
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+        staging_ring->memory_resources, gfx_memory_kinds::dedicated
+    )) {
+        logger().error("Cannot create staging ring because memory allocation failed.");
+        return;
+    }
+    staging_ring->buffer_resources.buffer.bindMemory(
+        staging_ring->memory_resources.allocation.memory(), staging_ring->memory_resources.allocation.offset()
+    );
+
+    logger().info("Staging ring created with {} MB.", gfx->setup_.staging_buffer_size_mb);
+    logical_device_impl.staging_ring = std::move(staging_ring);
+}
+
+bool Gfx::Impl::uploadThroughStagingRing(
+    const QueueInfoRef& transfer_queue, const void* data, vk::DeviceSize data_size,
+    vk::DeviceSize alignment, vk::DeviceSize chunk_granularity, const StagingCopyFunc& record_copy
+) {
+    auto* staging_ring = gfx->logical_device_->impl_->staging_ring.get();
+    if (!staging_ring) {
+        logger().error("Cannot upload data because staging ring is not available.");
+        return false;
+    }
+
+    // Payloads larger than the ring are split into chunks, each submitted separately.
+    vk::DeviceSize max_chunk_size = staging_ring->capacity() - alignment;
+    if (chunk_granularity > 1) {
+        max_chunk_size = max_chunk_size / chunk_granularity * chunk_granularity;
+    }
+    if (max_chunk_size == 0) {
+        logger().error("Cannot upload data because staging ring is too small for chunks of {} bytes.", chunk_granularity);
+        return false;
+    }
+
+    for (vk::DeviceSize data_offset = 0; data_offset < data_size;) {
+        const vk::DeviceSize chunk_size = std::min(max_chunk_size, data_size - data_offset);
+
+        GfxStagingRegion region;
+        if (!staging_ring->allocate(chunk_size, alignment, region)) {
+            logger().error("Cannot upload data because staging ring allocation failed.");
+            return false;
+        }
+        std::memcpy(region.mapped, static_cast<const char*>(data) + data_offset, chunk_size);
+
+        uint64_t submission_index = singleTimeCommand(
+            transfer_queue,
+            [&record_copy, &region, data_offset](vk::CommandBuffer& command_buffer) {
+                record_copy(command_buffer, region, data_offset);
+            }
+        );
+        staging_ring->commit(submission_index);
+        data_offset += chunk_size;
+    }
+    return true;
+}
+
+} // namespace wg
@@ -0,0 +1,322 @@
+#include "gfx/gfx-upload.h"
+
+#include "common/logger.h"
+#include "gfx/gfx.h"
+#include "gfx-private.h"
+#include "gfx-upload-private.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+[[nodiscard]] auto& logger() {
+    static auto logger_ = wg::Logger::Get("gfx");
+    return *logger_;
+}
+
+} // unnamed namespace
+
+namespace wg {
+
+std::shared_ptr<UploadBatch> UploadBatch::Create() {
+    return std::shared_ptr<UploadBatch>(new UploadBatch());
+}
+
+void UploadBatch::addBuffer(const std::shared_ptr<GfxBufferBase>& gfx_buffer) {
+    addReferenceBuffer(gfx_buffer, gfx_buffer);
+}
+
+void UploadBatch::addReferenceBuffer(
+    const std::shared_ptr<GfxBufferBase>& cpu_buffer,
+    const std::shared_ptr<GfxBufferBase>& gpu_buffer
+) {
+    buffers_.emplace_back(cpu_buffer, gpu_buffer);
+}
+
+GfxSubmissionTracker::GfxSubmissionTracker(const vk::raii::Device& vk_device)
+    : vk_device_(vk_device) {}
+
+GfxSubmissionTracker::~GfxSubmissionTracker() {
+    wait(last_submission_index());
+}
+
+uint64_t GfxSubmissionTracker::beginSubmission(vk::Fence& out_fence, OnFinishedFunc on_finished) {
+    PendingSubmission submission;
+    if (free_fences_.empty()) {
+        submission.fence = vk_device_.createFence({});
+    } else {
+        submission.fence = std::move(free_fences_.back());
+        free_fences_.pop_back();
+    }
+    submission.submission_index = next_submission_index_++;
+    submission.on_finished = std::move(on_finished);
+
+    out_fence = *submission.fence;
+    pending_submissions_.emplace_back(std::move(submission));
+    return pending_submissions_.back().submission_index;
+}
+
+void GfxSubmissionTracker::popPendingSubmission() {
+    auto& submission = pending_submissions_.front();
+    vk_device_.resetFences({ *submission.fence });
+    if (submission.on_finished) {
+        submission.on_finished();
+    }
+
+    finished_submission_index_ = submission.submission_index;
+    free_fences_.emplace_back(std::move(submission.fence));
+    pending_submissions_.pop_front();
+}
+
+bool GfxSubmissionTracker::finished(uint64_t submission_index) {
+    while (!pending_submissions_.empty() && pending_submissions_.front().fence.getStatus() == vk::Result::eSuccess) {
+        popPendingSubmission();
+    }
+    return submission_index <= finished_submission_index_;
+}
+
+void GfxSubmissionTracker::wait(uint64_t submission_index) {
+    while (!pending_submissions_.empty() && pending_submissions_.front().submission_index <= submission_index) {
+        auto& submission = pending_submissions_.front();
+        auto result = vk_device_.waitForFences({ *submission.fence }, true, UINT64_MAX);
+        if (result != vk::Result::eSuccess) {
+            logger().error("Wait for fence error: {}", vk::to_string(result));
+        }
+        popPendingSubmission();
+    }
+}
+
+void Gfx::Impl::waitPendingSignals(uint64_t& waited_submission_index, std::vector<vk::raii::Semaphore>& out_semaphores) {
+    auto& logical_device_impl = *gfx->logical_device_->impl_;
+    auto& submission_tracker = *logical_device_impl.submission_tracker;
+    auto& pending_signals = logical_device_impl.pending_signals;
+    // Finished signals need no waiting, and their semaphores are no longer in use
+    std::erase_if(
+        pending_signals,
+        [&submission_tracker](const GfxPendingSignal& signal) { return submission_tracker.finished(signal.submission_index); }
+    );
+    for (auto&& signal : pending_signals) {
+        if (signal.submission_index <= waited_submission_index) {
+            continue;
+        }
+        waited_submission_index = signal.submission_index;
+        if (*signal.semaphore) {
+            out_semaphores.emplace_back(std::move(signal.semaphore));
+        } else {
+            submission_tracker.wait(signal.submission_index);
+        }
+    }
+}
+
+void Gfx::Impl::waitBufferIdle(const GfxBufferResources& resources) {
+    gfx->logical_device_->impl_->submission_tracker->wait(resources.last_used_submission_index);
+}
+
+uint64_t Gfx::Impl::submitBufferCopies(
+    const QueueInfoRef& transfer_queue, const std::vector<GfxBufferCopy>& copies, vk::Semaphore signal_semaphore
+) {
+    auto& logical_device_impl = *gfx->logical_device_->impl_;
+    auto command_buffer_allocate_info = vk::CommandBufferAllocateInfo{
+        .commandPool = transfer_queue.vk_command_pool,
+        .level = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1
+    };
+    auto command_buffers = (*logical_device_impl.vk_device).allocateCommandBuffers(command_buffer_allocate_info);
+    auto& command_buffer = command_buffers[0];
+    command_buffer.begin(
+        vk::CommandBufferBeginInfo{
+            .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit
+        }
+    );
+
+    // Merge consecutive copies between the same buffers into one command.
+    std::vector<vk::BufferCopy> regions;
+    for (size_t i = 0; i < copies.size(); ++i) {
+        regions.push_back(copies[i].region);
+        if (i + 1 == copies.size() || copies[i + 1].src != copies[i].src || copies[i + 1].dst != copies[i].dst) {
+            command_buffer.copyBuffer(copies[i].src, copies[i].dst, regions);
+            regions.clear();
+        }
+    }
+
+    command_buffer.end();
+
+    vk::Fence fence;
+    vk::Device vk_device = *logical_device_impl.vk_device;
+    vk::CommandPool vk_command_pool = transfer_queue.vk_command_pool;
+    uint64_t submission_index = logical_device_impl.submission_tracker->beginSubmission(
+        fence,
+        [vk_device, vk_command_pool, command_buffers]() {
+            vk_device.freeCommandBuffers(vk_command_pool, command_buffers);
+        }
+    );
+
+    auto submit_info = vk::SubmitInfo{}
+        .setCommandBuffers(command_buffers);
+    if (signal_semaphore) {
+        submit_info.setSignalSemaphores(signal_semaphore);
+    }
+    // Make host writes to non-coherent memory, e.g. mapped buffers of the batch, visible to this submission
+    logical_device_impl.memory_allocator->flushMappedRanges();
+    transfer_queue.vk_queue.submit({ submit_info }, fence);
+    return submission_index;
+}
+
+UploadToken Gfx::submitUploadBatch(const std::shared_ptr<UploadBatch>& upload_batch) {
+    if (!logical_device_) {
+        logger().error("Cannot submit upload batch because logical device is not available.");
+        return {};
+    }
+    if (upload_batch->empty()) {
+        return {};
+    }
+    auto& logical_device_impl = *logical_device_->impl_;
+    auto* staging_ring = logical_device_impl.staging_ring.get();
+    if (!staging_ring) {
+        logger().error("Cannot submit upload batch because staging ring is not available.");
+        return {};
+    }
+
+    QueueInfoRef transfer_queue;
+    impl_->getTransferQueue(transfer_queue);
+
+    std::vector<GfxBufferCopy> copies;
+    uint64_t last_submission_index = 0;
+    auto flush_copies = [&](vk::Semaphore signal_semaphore) {
+        last_submission_index = impl_->submitBufferCopies(transfer_queue, copies, signal_semaphore);
+        staging_ring->commit(last_submission_index);
+        copies.clear();
+        return last_submission_index;
+    };
+
+    for (auto&& [cpu_buffer, gpu_buffer] : upload_batch->buffers_) {
+        if (!cpu_buffer->has_cpu_data()) {
+            logger().error("Skip uploading buffer because has no CPU data.");
+            continue;
+        }
+
+        const auto* data = static_cast<const char*>(cpu_buffer->data());
+        vk::DeviceSize data_size = cpu_buffer->data_size();
+        vk::Buffer dst_buffer;
+        vk::DeviceSize dst_offset = 0;
+
+        if (auto* geometry_range = gpu_buffer->impl_->geometry_range.data()) {
+            if (data_size < geometry_range->size) {
+                logger().error("Cannot upload buffer because cpu data is smaller than geometry range.");
+                continue;
+            }
+            data_size = geometry_range->size;
+            dst_buffer = geometry_range->buffer;
+            dst_offset = geometry_range->offset;
+        } else {
+            auto* memory_resources = gpu_buffer->impl_->memory_resources.data();
+            auto* resources = gpu_buffer->impl_->resources.data();
+            if (!memory_resources || !resources) {
+                logger().error("Cannot upload buffer because resources are not available.");
+                continue;
+            }
+            if (data_size != resources->cpu_data_size) {
+                logger().error("Cannot upload buffer because cpu data size differs from gpu resources.");
+                continue;
+            }
+
+            // Frames in flight may still read the old data
+            impl_->waitBufferIdle(*resources);
+            if (resources->mapped) {
+                // Host visible memory is persistently mapped, no need to stage.
+                for (auto&& [offset, size] : Impl::GetBufferUploadRanges(cpu_buffer, gpu_buffer, data_size)) {
+                    std::memcpy(static_cast<char*>(resources->mapped) + offset, data + offset, size);
+                    logical_device_impl.memory_allocator->addFlushRange(memory_resources->allocation, offset, size);
+                }
+                gpu_buffer->has_gpu_data_ = true;
+                cpu_buffer->clearDirtyRanges();
+                if (!cpu_buffer->keep_cpu_data_) {
+                    cpu_buffer->clearCpuData();
+                }
+                continue;
+            }
+            dst_buffer = *resources->buffer;
+        }
+
+        // Only dirty ranges are copied if GPU data exists, each as one region of the same copy command.
+        // Ranges larger than the ring are split into chunks.
+        const vk::DeviceSize max_chunk_size = staging_ring->capacity() - 4;
+        bool staged = true;
+        for (auto&& [range_offset, range_size] : Impl::GetBufferUploadRanges(cpu_buffer, gpu_buffer, data_size)) {
+            const vk::DeviceSize range_end = range_offset + range_size;
+            for (vk::DeviceSize data_offset = range_offset; staged && data_offset < range_end;) {
+                const vk::DeviceSize chunk_size = std::min(max_chunk_size, range_end - data_offset);
+
+                GfxStagingRegion region;
+                if (!staging_ring->allocate(chunk_size, 4, region)) {
+                    // Ring is filled by copies of this batch, so submit them first.
+                    if (copies.empty()) {
+                        logger().error("Cannot upload buffer because staging ring allocation failed.");
+                        staged = false;
+                        break;
+                    }
+                    flush_copies({});
+                    continue;
+                }
+                std::memcpy(region.mapped, data + data_offset, chunk_size);
+                copies.emplace_back(
+                    GfxBufferCopy{
+                        .src = region.buffer,
+                        .dst = dst_buffer,
+                        .region = { .srcOffset = region.offset, .dstOffset = dst_offset + data_offset, .size = chunk_size }
+                    }
+                );
+                data_offset += chunk_size;
+            }
+            if (!staged) {
+                break;
+            }
+        }
+        // Keep dirty ranges and CPU data, so that uploading again writes the whole of them, including chunks copied
+        // before the failure
+        if (!staged) {
+            continue;
+        }
+
+        gpu_buffer->has_gpu_data_ = true;
+        cpu_buffer->clearDirtyRanges();
+        if (!cpu_buffer->keep_cpu_data_) {
+            cpu_buffer->clearCpuData();
+        }
+    }
+
+    // Nothing to copy, e.g. all buffers are host visible. Flush now rather than relying on the next submission.
+    if (copies.empty() && last_submission_index == 0) {
+        logical_device_impl.memory_allocator->flushMappedRanges();
+        return {};
+    }
+
+    // Graphics submission waits for the semaphore instead of the CPU waiting for the transfer.
+    auto semaphore = logical_device_impl.vk_device.createSemaphore({});
+    uint64_t submission_index = flush_copies(*semaphore);
+    logical_device_impl.pending_signals.emplace_back(
+        GfxPendingSignal{
+            .semaphore = std::move(semaphore),
+            .submission_index = submission_index
+        }
+    );
+
+    return UploadToken(submission_index);
+}
+
+bool Gfx::uploadFinished(const UploadToken& token) {
+    if (!logical_device_ || !token.valid()) {
+        return true;
+    }
+    return logical_device_->impl_->submission_tracker->finished(token.submission_index());
+}
+
+void Gfx::waitUpload(const UploadToken& token) {
+    if (!logical_device_ || !token.valid()) {
+        return;
+    }
+    logical_device_->impl_->submission_tracker->wait(token.submission_index());
+}
+
+} // namespace wg
@@ -0,0 +1,116 @@
+#include "gfx-workers-private.h"
+
+namespace wg {
+
+GfxWorkerPool::GfxWorkerPool(uint32_t thread_count) {
+    for (uint32_t i = 1; i < thread_count; ++i) {
+        threads_.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+GfxWorkerPool::~GfxWorkerPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    wake_condition_.notify_all();
+    for (auto&& thread : threads_) {
+        thread.join();
+    }
+}
+
+void GfxWorkerPool::parallelFor(size_t job_count, const std::function<void(size_t)>& func) {
+    if (threads_.empty() || job_count <= 1) {
+        for (size_t i = 0; i < job_count; ++i) {
+            func(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex_);
+        func_ = &func;
+        job_count_ = job_count;
+        next_job_ = 0;
+        pending_workers_ = threads_.size();
+        ++generation_;
+    }
+    wake_condition_.notify_all();
+
+    runJobs();
+
+    std::unique_lock lock(mutex_);
+    done_condition_.wait(lock, [this]() { return pending_workers_ == 0; });
+    func_ = nullptr;
+}
+
+void GfxWorkerPool::workerLoop() {
+    uint64_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            wake_condition_.wait(lock, [this, generation]() { return stopping_ || generation_ != generation; });
+            if (stopping_) {
+                return;
+            }
+            generation = generation_;
+        }
+
+        runJobs();
+
+        std::lock_guard lock(mutex_);
+        if (--pending_workers_ == 0) {
+            done_condition_.notify_one();
+        }
+    }
+}
+
+void GfxWorkerPool::runJobs() {
+    for (size_t i = next_job_.fetch_add(1); i < job_count_; i = next_job_.fetch_add(1)) {
+        (*func_)(i);
+    }
+}
+
+GfxTaskQueue::GfxTaskQueue(uint32_t thread_count) {
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+GfxTaskQueue::~GfxTaskQueue() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+        tasks_.clear();
+    }
+    wake_condition_.notify_all();
+    for (auto&& thread : threads_) {
+        thread.join();
+    }
+}
+
+void GfxTaskQueue::post(std::function<void()> task) {
+    {
+        std::lock_guard lock(mutex_);
+        tasks_.emplace_back(std::move(task));
+    }
+    wake_condition_.notify_one();
+}
+
+void GfxTaskQueue::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mutex_);
+            wake_condition_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+} // namespace wg
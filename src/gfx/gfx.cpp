@@ -253,6 +253,10 @@ Gfx::Gfx(const std::shared_ptr<App>& app)
 
     GfxFeaturesManager::AddFeatureImpl(gfx_features::_must_enable_if_valid, features_manager_.instance_enabled_);
     GfxFeaturesManager::AddFeatureImpl(gfx_features::_must_enable_if_valid, features_manager_.defaults_);
+    GfxFeaturesManager::AddFeatureImpl(gfx_features::memory_budget, features_manager_.defaults_);
+    GfxFeaturesManager::AddFeatureImpl(gfx_features::compute, features_manager_.defaults_);
+    GfxFeaturesManager::AddFeatureImpl(gfx_features::multi_draw_indirect, features_manager_.defaults_);
+    GfxFeaturesManager::AddFeatureImpl(gfx_features::draw_indirect_count, features_manager_.defaults_);
 #ifndef NDEBUG
     // Adding debug layers and extensions
     GfxFeaturesManager::AddFeatureImpl(gfx_features::_debug_utils, features_manager_.instance_enabled_);
@@ -323,6 +327,9 @@ Gfx::Gfx(const std::shared_ptr<App>& app)
 
 Gfx::~Gfx() {
     waitDeviceIdle();
+    if (logical_device_ && !setup_.pipeline_cache_path.empty()) {
+        savePipelineCache();
+    }
     logger().info("Destroying gfx.");
 }
 
@@ -846,6 +853,10 @@ void Gfx::createLogicalDevice() {
 
     logical_device_ = std::make_unique<LogicalDevice>();
     logical_device_->impl_ = std::make_unique<LogicalDevice::Impl>(std::move(vk_device));
+    logical_device_->impl_->memory_allocator = std::make_unique<GfxMemoryAllocator>(
+        logical_device_->impl_->vk_device, vk_physical_device.getMemoryProperties(),
+        vk_physical_device.getProperties().limits.nonCoherentAtomSize
+    );
 
     // Get all queues
     logical_device_->impl_->allocated_queues.resize(physical_device().impl_->num_queues.size());
@@ -888,6 +899,13 @@ void Gfx::createLogicalDevice() {
 
     logger().info("Logical device created.");
 
+    logical_device_->impl_->submission_tracker = std::make_unique<GfxSubmissionTracker>(logical_device_->impl_->vk_device);
+    logical_device_->impl_->deletion_queue = std::make_unique<GfxDeletionQueue>(*logical_device_->impl_->submission_tracker);
+    logical_device_->impl_->memory_budget = std::make_unique<GfxMemoryBudget>(*logical_device_->impl_->submission_tracker);
+    impl_->createPipelineCache();
+    logical_device_->impl_->deferResourceDestruction();
+    impl_->createStagingRing();
+
     // Create swapchains for surfaces
     for (auto& window_surface : impl_->window_resources_) {
         bool result = createSurfaceResources(window_surface.surface);
@@ -900,6 +918,9 @@ void Gfx::createLogicalDevice() {
 void Gfx::waitDeviceIdle() {
     if (logical_device_) {
         logical_device_->impl_->vk_device.waitIdle();
+        if (logical_device_->impl_->deletion_queue) {
+            logical_device_->impl_->deletion_queue->collect(true);
+        }
     }
 }
 
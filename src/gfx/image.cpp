@@ -8,6 +8,9 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include <algorithm>
+#include <numeric>
+
 namespace {
 
 [[nodiscard]] auto& logger() {
@@ -159,10 +162,14 @@ GfxMemoryBase::Impl* Image::getImpl() {
 }
 
 void Gfx::createImageResources(const std::shared_ptr<Image>& image) {
+    image->impl_->evicted = false;
     impl_->createReferenceImageResources(image, image);
     if (image->has_cpu_data()) {
         commitImage(image);
     }
+    if (logical_device_ && logical_device_->impl_->memory_budget) {
+        logical_device_->impl_->memory_budget->touchImage(image);
+    }
 }
 
 void Gfx::Impl::transitionImageLayout(
@@ -303,27 +310,44 @@ void Gfx::Impl::transitionImageLayout(
     }
 }
 
-void Gfx::Impl::copyBufferToImage(
-    const QueueInfoRef& transfer_queue, vk::Buffer src, vk::Image dst, 
+bool Gfx::Impl::copyBufferToImage(
+    const QueueInfoRef& transfer_queue, const void* data, vk::DeviceSize data_size, vk::Image dst,
     uint32_t width, uint32_t height, vk::ImageLayout image_layout, uint32_t layer_count
 ) {
-    auto buffer_image_copy = vk::BufferImageCopy{
-        .bufferOffset       = 0,
-        .bufferRowLength    = 0,
-        .bufferImageHeight  = 0,
-        .imageSubresource   = {
-            .aspectMask     = vk::ImageAspectFlagBits::eColor,
-            .mipLevel       = 0,
-            .baseArrayLayer = 0,
-            .layerCount     = layer_count,
-        },
-        .imageOffset        = { 0, 0, 0 },
-        .imageExtent        = { width, height, 1 }
-    };
-    singleTimeCommand(
-        transfer_queue,
-        [&src, &dst, &image_layout, &buffer_image_copy](vk::CommandBuffer& command_buffer) {
-            command_buffer.copyBufferToImage(src, dst, image_layout, { buffer_image_copy });
+    // Chunks are made of whole rows so that each one maps to rectangles of the image.
+    const vk::DeviceSize row_size = data_size / (static_cast<vk::DeviceSize>(height) * layer_count);
+    const vk::DeviceSize texel_size = row_size / width;
+    // Buffer offsets must be multiples of both texel size and 4.
+    const vk::DeviceSize alignment = std::lcm(texel_size, vk::DeviceSize{ 4 });
+
+    return uploadThroughStagingRing(
+        transfer_queue, data, data_size, alignment, row_size,
+        [dst, image_layout, width, height, row_size](vk::CommandBuffer& command_buffer, const GfxStagingRegion& region, vk::DeviceSize data_offset) {
+            std::vector<vk::BufferImageCopy> buffer_image_copies;
+            auto row = static_cast<uint32_t>(data_offset / row_size);
+            const auto end_row = static_cast<uint32_t>((data_offset + region.size) / row_size);
+            while (row < end_row) {
+                const uint32_t layer = row / height;
+                const uint32_t row_in_layer = row % height;
+                const uint32_t row_count = std::min(end_row - row, height - row_in_layer);
+                buffer_image_copies.emplace_back(
+                    vk::BufferImageCopy{
+                        .bufferOffset       = region.offset + (row * row_size - data_offset),
+                        .bufferRowLength    = 0,
+                        .bufferImageHeight  = 0,
+                        .imageSubresource   = {
+                            .aspectMask     = vk::ImageAspectFlagBits::eColor,
+                            .mipLevel       = 0,
+                            .baseArrayLayer = layer,
+                            .layerCount     = 1,
+                        },
+                        .imageOffset        = { 0, static_cast<int32_t>(row_in_layer), 0 },
+                        .imageExtent        = { width, row_count, 1 }
+                    }
+                );
+                row += row_count;
+            }
+            command_buffer.copyBufferToImage(region.buffer, dst, image_layout, buffer_image_copies);
         }
     );
 }
@@ -346,7 +370,6 @@ void Gfx::Impl::createReferenceImageResources(
         logger().error("Cannot create image resources because logical device is not available.");
         return;
     }
-    gfx->waitDeviceIdle();
 
     if (!cpu_image->has_cpu_data()) {
         logger().warn("Skip creating image resources because image \"{}\" is not loaded.", cpu_image->filename());
@@ -399,7 +422,6 @@ void Gfx::Impl::createImage(
         logger().error("Cannot create image resources because logical device is not available.");
         return;
     }
-    gfx->waitDeviceIdle();
 
     vk::SampleCountFlagBits max_sample_count = getMaxSampleCount(usage, aspect);
     if (sample_count > max_sample_count) {
@@ -447,14 +469,19 @@ void Gfx::Impl::createImage(
 
     out_image_resources.image = gfx->logical_device_->impl_->vk_device.createImage(image_create_info);
 
+    // Attachments are recreated with the swapchain, so give them their own memory.
+    const auto attachment_usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eDepthStencilAttachment;
+    const bool attachment = static_cast<bool>(usage & attachment_usage);
     if (!createGfxMemory(
         out_image_resources.image.getMemoryRequirements(),
-        vk::MemoryPropertyFlagBits::eDeviceLocal, out_memory_resources
+        vk::MemoryPropertyFlagBits::eDeviceLocal, out_memory_resources,
+        attachment ? gfx_memory_kinds::dedicated : gfx_memory_kinds::optimal,
+        attachment ? gfx_memory_categories::render_target : gfx_memory_categories::image
     )) {
         return;
     }
 
-    out_image_resources.image.bindMemory(*out_memory_resources.memory, 0);
+    out_image_resources.image.bindMemory(out_memory_resources.allocation.memory(), out_memory_resources.allocation.offset());
 
     auto image_view_create_info = vk::ImageViewCreateInfo{
         .image              = *out_image_resources.image,
@@ -507,12 +534,12 @@ void Gfx::createSamplerResources(const std::shared_ptr<Sampler>& sampler) {
         logger().error("Cannot create sampler resources because logical device is not available.");
         return;
     }
-    waitDeviceIdle();
 
     if (!sampler->image_) {
         logger().error("Cannot create sampler resources because image is not available.");
         return;
     }
+    impl_->useImage(sampler->image_);
 
     auto image_resources = sampler->image_->impl_->resources.data();
     if (!image_resources) {
@@ -531,7 +558,6 @@ void Gfx::Impl::createSampler(const ImageResources& image_resources, SamplerConf
         logger().error("Cannot create image resources because logical device is not available.");
         return;
     }
-    gfx->waitDeviceIdle();
 
     auto device_properties = gfx->physical_device().impl_->vk_physical_device.getProperties();
     float max_anisotropy = std::min(config.max_anisotropy, gfx->setup_.max_sampler_anisotropy);
@@ -658,36 +684,15 @@ void Gfx::commitReferenceImage(
 
     const size_t data_size = cpu_image->data_size();
 
-    GfxMemoryResources staging_memory_resources;
-    GfxBufferResources staging_resources;
-
-    // Allocate stage buffer.
-    impl_->createBuffer(
-        data_size, vk::BufferUsageFlagBits::eTransferSrc,
-        vk::SharingMode::eExclusive, { transfer_queue.queue_family_index },
-        staging_resources
-    );
-    if (!impl_->createGfxMemory(
-        staging_resources.buffer.getMemoryRequirements(),
-        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-        staging_memory_resources
-    )) {
-        return;
-    }
-    staging_resources.buffer.bindMemory(*staging_memory_resources.memory, 0);
-
-    // Copy data to target buffer or stage buffer.
-    void* mapped = staging_memory_resources.memory.mapMemory(0, data_size, {});
-    std::memcpy(mapped, cpu_image->data(), data_size);
-    staging_memory_resources.memory.unmapMemory();
-
     // Copy content.
     auto graphics_queue = resources->queue;
     impl_->transitionImageLayout(resources, vk::ImageLayout::eTransferDstOptimal, transfer_queue);
-    impl_->copyBufferToImage(
-        transfer_queue, *staging_resources.buffer, *resources->image, 
+    if (!impl_->copyBufferToImage(
+        transfer_queue, cpu_image->data(), data_size, *resources->image,
         resources->width, resources->height, resources->image_layout, resources->layer_count
-    );
+    )) {
+        return;
+    }
 
     // Generate mipmaps
     if (cpu_image->mip_levels_ < static_cast<int>(resources->mip_levels)) {
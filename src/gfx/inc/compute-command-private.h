@@ -0,0 +1,30 @@
+#pragma once
+
+#include "platform/inc/platform.inc"
+
+#include "gfx/compute-command.h"
+
+#include "common/owned-resources.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace wg {
+
+struct ComputeCommandResources {
+    vk::raii::DescriptorPool descriptor_pool{ nullptr };
+    // Empty if the pipeline has no descriptors
+    std::vector<vk::raii::DescriptorSet> descriptor_sets;
+    // Bound by descriptor_sets, so their images cannot be evicted
+    std::map<uint32_t, std::shared_ptr<Sampler>> samplers;
+    // Descriptors are not rewritten, resources are replaced after this submission has finished
+    uint64_t last_used_submission_index{ 0 };
+};
+
+struct ComputeCommand::Impl {
+    OwnedResourceHandle<ComputeCommandResources> resources;
+};
+
+} // namespace wg
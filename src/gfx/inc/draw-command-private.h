@@ -8,6 +8,7 @@
 #include "gfx-pipeline-private.h"
 
 #include <functional>
+#include <limits>
 
 namespace wg {
 
@@ -42,6 +43,15 @@ inline vk::PrimitiveTopology ToVkPrimitiveTopology(PrimitiveTopology primitive_t
 
 } // namespace primitive_types
 
+// Vertex and index buffers currently bound to a command buffer.
+struct DrawCommandBufferBindings {
+    std::vector<vk::Buffer> vertex_buffers;
+    std::vector<vk::DeviceSize> vertex_buffer_offsets;
+    vk::Buffer index_buffer{ nullptr };
+    vk::DeviceSize index_buffer_offset{ 0 };
+    vk::IndexType index_type = vk::IndexType::eUint16;
+};
+
 struct DrawCommand::Impl {
     std::vector<vk::Buffer> vertex_buffers;
     std::vector<vk::DeviceSize> vertex_buffer_offsets;
@@ -50,13 +60,25 @@ struct DrawCommand::Impl {
     vk::IndexType index_type = vk::IndexType::eUint16;
     uint32_t vertex_count{ 0 };
     uint32_t index_count{ 0 };
+    uint32_t instance_count{ 1 };
+    // Offsets of the draw in buffers shared with other draw commands, e.g. geometry pools
+    int32_t base_vertex{ 0 };
+    // Of the index buffer, plus the start of the index range for first_index
+    uint32_t index_buffer_first_index{ 0 };
+    uint32_t first_index{ 0 };
     bool draw_indexed{ false };
+    // streaming_vertex_buffers[] = <binding, copies>, copies[image_index % size] replaces vertex_buffers[binding]
+    std::vector<std::pair<uint32_t, std::vector<vk::Buffer>>> streaming_vertex_buffers;
 
     std::vector<vk::VertexInputBindingDescription> vertex_bindings;
     std::vector<vk::VertexInputAttributeDescription> vertex_attributes;
     vk::PipelineVertexInputStateCreateInfo vertex_input_create_info;
     vk::PipelineInputAssemblyStateCreateInfo input_assembly_create_info;
 
+    // Bind vertex and index buffers for the image, skipping those already bound by a previous draw command.
+    // Returns whether anything was bound.
+    bool bindBuffers(vk::CommandBuffer& command_buffer, DrawCommandBufferBindings& bindings, size_t image_index) const;
+    // Draw with buffers already bound.
     virtual void draw(vk::CommandBuffer& command_buffer) = 0;
 };
 
@@ -64,4 +86,20 @@ struct SimpleDrawCommand::Impl : public DrawCommand::Impl {
     void draw(vk::CommandBuffer& command_buffer) override;
 };
 
+struct IndirectDrawCommand::Impl : public DrawCommand::Impl {
+    vk::Buffer indirect_buffer{ nullptr };
+    vk::Buffer count_buffer{ nullptr };
+    uint32_t max_draw_count{ 0 };
+    // Loaded if count_buffer is used
+    PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count{ nullptr };
+    bool multi_draw_indirect{ false };
+    void draw(vk::CommandBuffer& command_buffer) override;
+};
+
+struct InstancedDrawCommand::Impl : public DrawCommand::Impl {
+    // Clamped to instance_count, see InstancedDrawCommand::setDrawInstanceCount
+    uint32_t draw_instance_count{ std::numeric_limits<uint32_t>::max() };
+    void draw(vk::CommandBuffer& command_buffer) override;
+};
+
 } // namespace wg
\ No newline at end of file
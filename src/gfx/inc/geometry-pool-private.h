@@ -0,0 +1,26 @@
+#pragma once
+
+#include "platform/inc/platform.inc"
+
+#include "gfx/geometry-pool.h"
+
+#include "common/owned-resources.h"
+#include "gfx-allocator-private.h"
+#include "gfx-buffer-private.h"
+
+namespace wg {
+
+struct GeometryPool::Impl {
+    OwnedResourceHandle<GfxMemoryResources> vertex_memory_resources;
+    OwnedResourceHandle<GfxBufferResources> vertex_resources;
+    OwnedResourceHandle<GfxMemoryResources> index_memory_resources;
+    OwnedResourceHandle<GfxBufferResources> index_resources;
+    // Offsets and sizes in vertices and indices
+    GfxFreeListAllocator vertex_allocator;
+    GfxFreeListAllocator index_allocator;
+
+    Impl(uint32_t vertex_capacity, uint32_t index_capacity)
+        : vertex_allocator(vertex_capacity), index_allocator(index_capacity) {}
+};
+
+} // namespace wg
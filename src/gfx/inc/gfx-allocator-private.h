@@ -0,0 +1,199 @@
+#pragma once
+
+#include "platform/inc/platform.inc"
+
+#include "gfx/gfx.h"
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace wg {
+
+// Round value up to a multiple of alignment, unchanged if alignment is 0 or 1
+[[nodiscard]] inline vk::DeviceSize AlignUp(vk::DeviceSize value, vk::DeviceSize alignment) {
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+// Buddy allocator managing offsets inside one memory block. Does not touch any device memory.
+class GfxBuddyAllocator {
+public:
+    static constexpr uint64_t InvalidOffset = UINT64_MAX;
+
+    // size and min_allocation_size must be powers of 2.
+    GfxBuddyAllocator(uint64_t size, uint64_t min_allocation_size);
+
+    // Allocate a range with at least size bytes whose offset is a multiple of alignment.
+    // Returns InvalidOffset if no free range is large enough.
+    [[nodiscard]] uint64_t allocate(uint64_t size, uint64_t alignment);
+    void free(uint64_t offset);
+
+    [[nodiscard]] uint64_t size() const { return size_; }
+    [[nodiscard]] uint64_t used_size() const { return used_size_; }
+    [[nodiscard]] size_t allocation_count() const { return allocated_levels_.size(); }
+    [[nodiscard]] bool empty() const { return allocated_levels_.empty(); }
+
+    [[nodiscard]] static uint64_t RoundUpToPowerOf2(uint64_t value);
+
+protected:
+    uint64_t size_;
+    uint64_t min_allocation_size_;
+    uint32_t num_levels_;
+    uint64_t used_size_{ 0 };
+    // free_lists_[level] = offsets of free nodes of size (size_ >> level)
+    std::vector<std::set<uint64_t>> free_lists_;
+    // allocated_levels_[offset] = level of allocated node
+    std::map<uint64_t, uint32_t> allocated_levels_;
+};
+
+// First-fit free list allocator managing offsets inside one range. Unlike the buddy allocator,
+// sizes are not rounded up, and adjacent free ranges are coalesced on free.
+class GfxFreeListAllocator {
+public:
+    static constexpr uint64_t InvalidOffset = UINT64_MAX;
+
+    explicit GfxFreeListAllocator(uint64_t size);
+
+    // Allocate size units whose offset is a multiple of alignment.
+    // Returns InvalidOffset if no free range is large enough.
+    [[nodiscard]] uint64_t allocate(uint64_t size, uint64_t alignment = 1);
+    void free(uint64_t offset);
+
+    [[nodiscard]] uint64_t size() const { return size_; }
+    [[nodiscard]] uint64_t used_size() const { return used_size_; }
+    [[nodiscard]] size_t allocation_count() const { return allocated_sizes_.size(); }
+    [[nodiscard]] bool empty() const { return allocated_sizes_.empty(); }
+    [[nodiscard]] size_t free_range_count() const { return free_ranges_.size(); }
+    [[nodiscard]] uint64_t largest_free_range() const;
+
+protected:
+    uint64_t size_;
+    uint64_t used_size_{ 0 };
+    // free_ranges_[offset] = size, never adjacent to each other
+    std::map<uint64_t, uint64_t> free_ranges_;
+    // allocated_sizes_[offset] = size
+    std::map<uint64_t, uint64_t> allocated_sizes_;
+};
+
+struct GfxMemoryBlock {
+    vk::raii::DeviceMemory memory{ nullptr };
+    uint32_t memory_type_index{ 0 };
+    vk::DeviceSize size{ 0 };
+    // Host visible blocks are mapped for their whole lifetime.
+    void* mapped{ nullptr };
+    // Host writes to non-coherent blocks must be flushed before device reads them.
+    bool host_coherent{ true };
+    // nullptr for dedicated allocations
+    std::unique_ptr<GfxBuddyAllocator> sub_allocator;
+    // Bytes requested by live allocations of each category
+    std::array<vk::DeviceSize, gfx_memory_categories::NUM_MEMORY_CATEGORIES> category_used_bytes{};
+};
+
+// A range of a memory block. The range is returned to the block on destruction.
+class GfxMemoryAllocation {
+public:
+    GfxMemoryAllocation() = default;
+    GfxMemoryAllocation(
+        std::shared_ptr<GfxMemoryBlock> block, vk::DeviceSize offset, vk::DeviceSize size,
+        gfx_memory_categories::MemoryCategory category
+    );
+    GfxMemoryAllocation(GfxMemoryAllocation&& other) noexcept;
+    GfxMemoryAllocation& operator=(GfxMemoryAllocation&& other) noexcept;
+    GfxMemoryAllocation(const GfxMemoryAllocation&) = delete;
+    GfxMemoryAllocation& operator=(const GfxMemoryAllocation&) = delete;
+    ~GfxMemoryAllocation();
+
+    void reset();
+
+    [[nodiscard]] bool valid() const { return static_cast<bool>(block_); }
+    [[nodiscard]] vk::DeviceMemory memory() const { return block_ ? *block_->memory : vk::DeviceMemory{}; }
+    [[nodiscard]] vk::DeviceSize offset() const { return offset_; }
+    [[nodiscard]] vk::DeviceSize size() const { return size_; }
+    [[nodiscard]] bool dedicated() const { return block_ && !block_->sub_allocator; }
+    [[nodiscard]] gfx_memory_categories::MemoryCategory category() const { return category_; }
+    [[nodiscard]] uint32_t memory_type_index() const { return block_ ? block_->memory_type_index : 0; }
+    // Mapped pointer at offset(), or nullptr if memory is not host visible.
+    [[nodiscard]] void* mapped() const {
+        return block_ && block_->mapped ? static_cast<char*>(block_->mapped) + offset_ : nullptr;
+    }
+
+protected:
+    friend class GfxMemoryAllocator;
+    std::shared_ptr<GfxMemoryBlock> block_;
+    vk::DeviceSize offset_{ 0 };
+    vk::DeviceSize size_{ 0 };
+    gfx_memory_categories::MemoryCategory category_{ gfx_memory_categories::buffer };
+};
+
+namespace gfx_memory_kinds {
+
+enum MemoryKind {
+    // Buffers and linear images
+    linear,
+    // Optimal tiling images, kept in separate blocks to respect bufferImageGranularity
+    optimal,
+    // Always get a dedicated device memory allocation
+    dedicated,
+    NUM_MEMORY_KINDS = dedicated
+};
+
+} // namespace gfx_memory_kinds
+
+class GfxMemoryAllocator {
+public:
+    static constexpr vk::DeviceSize DefaultBlockSize = 64ULL * 1024 * 1024;
+    static constexpr vk::DeviceSize MinAllocationSize = 256;
+
+    GfxMemoryAllocator(
+        const vk::raii::Device& vk_device, const vk::PhysicalDeviceMemoryProperties& memory_properties,
+        vk::DeviceSize non_coherent_atom_size
+    );
+
+    bool allocate(
+        vk::MemoryRequirements memory_requirements, uint32_t memory_type_index,
+        gfx_memory_kinds::MemoryKind kind, gfx_memory_categories::MemoryCategory category,
+        GfxMemoryAllocation& out_allocation
+    );
+    // Release blocks with no live allocations.
+    void releaseEmptyBlocks(bool keep_one_per_pool = true);
+
+    // Record a host write to a mapped allocation. Ignored for host coherent memory.
+    void addFlushRange(const GfxMemoryAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size);
+    // Flush all recorded writes with one call. Should be called before submissions reading them.
+    void flushMappedRanges();
+    // Make device writes to a mapped allocation visible to host reads. Ignored for host coherent memory.
+    void invalidateMappedRange(const GfxMemoryAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size);
+
+    [[nodiscard]] vk::DeviceSize getBlockSize(uint32_t memory_type_index) const;
+    [[nodiscard]] vk::MemoryPropertyFlags getMemoryPropertyFlags(uint32_t memory_type_index) const {
+        return memory_properties_.memoryTypes[memory_type_index].propertyFlags;
+    }
+    [[nodiscard]] uint32_t getHeapIndex(uint32_t memory_type_index) const {
+        return memory_properties_.memoryTypes[memory_type_index].heapIndex;
+    }
+    [[nodiscard]] std::vector<GfxMemoryHeapStatistics> statistics() const;
+
+protected:
+    struct FlushRange {
+        // Keeps memory alive even if the allocation is released before flushing
+        std::shared_ptr<GfxMemoryBlock> block;
+        vk::DeviceSize offset{ 0 };
+        vk::DeviceSize size{ 0 };
+    };
+
+    const vk::raii::Device& vk_device_;
+    vk::PhysicalDeviceMemoryProperties memory_properties_;
+    vk::DeviceSize non_coherent_atom_size_;
+    std::vector<FlushRange> pending_flush_ranges_;
+    // pools_[memory_type_index][kind] = blocks
+    std::vector<std::array<std::vector<std::shared_ptr<GfxMemoryBlock>>, gfx_memory_kinds::NUM_MEMORY_KINDS>> pools_;
+    // Dedicated blocks are owned by their allocations only.
+    std::vector<std::weak_ptr<GfxMemoryBlock>> dedicated_blocks_;
+
+    std::shared_ptr<GfxMemoryBlock> createBlock(vk::DeviceSize size, uint32_t memory_type_index, bool sub_allocated);
+};
+
+} // namespace wg
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "platform/inc/platform.inc"
+
+#include "gfx/gfx.h"
+#include "gfx/image.h"
+
+#include "gfx-upload-private.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace wg {
+
+// Tracks recently used images and memory released by eviction. Does not touch any device memory.
+class GfxMemoryBudget {
+public:
+    explicit GfxMemoryBudget(GfxSubmissionTracker& submission_tracker);
+
+    // Mark the image as most recently used.
+    void touchImage(const std::shared_ptr<Image>& image);
+    // Live images, least recently used first
+    [[nodiscard]] std::vector<std::shared_ptr<Image>> leastRecentlyUsedImages();
+
+    // Memory of evicted images is released once submissions made so far have finished.
+    void addPendingEviction(uint32_t heap_index, vk::DeviceSize size);
+    [[nodiscard]] vk::DeviceSize pendingEvictionBytes(uint32_t heap_index);
+
+    // Estimated usage of a heap, set from memory statistics and increased by allocations since. Freed memory is
+    // not subtracted, so the estimate only errs towards querying statistics again.
+    void setHeapUsage(uint32_t heap_index, vk::DeviceSize used_bytes, vk::DeviceSize budget_limit_bytes);
+    void addHeapUsage(uint32_t heap_index, vk::DeviceSize size);
+    // Forget estimates, e.g. when budgets may have changed.
+    void invalidateHeapUsages();
+    // Whether size more bytes may exceed the budget limit of the heap, true if the usage is not estimated yet.
+    [[nodiscard]] bool mayExceedBudget(uint32_t heap_index, vk::DeviceSize size) const;
+
+    [[nodiscard]] GfxMemoryEvictionStatistics& eviction_statistics() { return eviction_statistics_; }
+    [[nodiscard]] const GfxMemoryEvictionStatistics& eviction_statistics() const { return eviction_statistics_; }
+
+protected:
+    struct PendingEviction {
+        uint32_t heap_index{ 0 };
+        vk::DeviceSize size{ 0 };
+        uint64_t submission_index{ 0 };
+    };
+
+    struct HeapUsage {
+        vk::DeviceSize used_bytes{ 0 };
+        vk::DeviceSize budget_limit_bytes{ 0 };
+        bool known{ false };
+    };
+
+    using ImageList = std::list<std::weak_ptr<Image>>;
+
+    GfxSubmissionTracker& submission_tracker_;
+    // Least recently used first
+    ImageList images_;
+    std::unordered_map<const Image*, ImageList::iterator> image_positions_;
+    std::vector<PendingEviction> pending_evictions_;
+    std::vector<HeapUsage> heap_usages_;
+    GfxMemoryEvictionStatistics eviction_statistics_;
+};
+
+} // namespace wg
@@ -5,11 +5,15 @@
 #include "gfx/gfx-buffer.h"
 
 #include "common/owned-resources.h"
+#include "gfx/inc/gfx-allocator-private.h"
 
 namespace wg {
 
+class GeometryPool;
+
 struct GfxMemoryResources {
-    vk::raii::DeviceMemory memory{ nullptr };
+    // Range of a (possibly shared) device memory block
+    GfxMemoryAllocation allocation;
 
     vk::MemoryPropertyFlags memory_properties;
 };
@@ -23,10 +27,46 @@ struct GfxBufferResources {
 
     vk::DeviceSize cpu_data_size{ 0 };
     vk::SharingMode sharing_mode;
+    // Cached pointer into persistently mapped memory, or nullptr if not host visible
+    void* mapped{ nullptr };
+    // Last submission known to read the buffer, i.e. frames reading framebuffer uniforms and compute submissions
+    uint64_t last_used_submission_index{ 0 };
+};
+
+// Range of a geometry pool used as a vertex or index buffer. The range is returned to the pool on destruction.
+struct GeometryRangeResources {
+    // Keeps the pool and its buffers alive while the range is in use
+    std::shared_ptr<GeometryPool> pool;
+    vk::Buffer buffer;
+    bool index{ false };
+    // In vertices or indices
+    uint32_t first{ 0 };
+    uint32_t count{ 0 };
+    // In bytes
+    vk::DeviceSize offset{ 0 };
+    vk::DeviceSize size{ 0 };
+
+    ~GeometryRangeResources();
+};
+
+// One host visible copy of a streaming vertex buffer
+struct GfxStreamingCopy {
+    OwnedResourceHandle<GfxMemoryResources> memory_resources;
+    OwnedResourceHandle<GfxBufferResources> resources;
+    // Version of CPU data last written to this copy
+    uint64_t version{ 0 };
+    // The copy can be rewritten after this submission has finished
+    uint64_t last_used_submission_index{ 0 };
 };
 
 struct GfxBufferBase::Impl : public GfxMemoryBase::Impl {
     OwnedResourceHandle<GfxBufferResources> resources;
+    // Set instead of resources if the buffer is placed in a geometry pool
+    OwnedResourceHandle<GeometryRangeResources> geometry_range;
+    // Set instead of resources for streaming vertex buffers, streaming_copies[image_index % size]
+    std::vector<GfxStreamingCopy> streaming_copies;
+    // Incremented when CPU data of a streaming vertex buffer changes
+    uint64_t streaming_version{ 0 };
 };
 
 namespace index_types {
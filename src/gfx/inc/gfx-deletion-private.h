@@ -0,0 +1,49 @@
+#pragma once
+
+#include "platform/inc/platform.inc"
+
+#include "gfx-upload-private.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace wg {
+
+// Keeps released resources alive until submissions that may use them have finished.
+class GfxDeletionQueue {
+public:
+    explicit GfxDeletionQueue(GfxSubmissionTracker& submission_tracker);
+    ~GfxDeletionQueue();
+
+    // Destroy the resource after all submissions made so far.
+    template <typename T>
+    void retire(std::unique_ptr<T>&& resource) {
+        retireAfter(std::move(resource), submission_tracker_.last_submission_index());
+    }
+    // Destroy the resource after the submission that last used it.
+    template <typename T>
+    void retireAfter(std::unique_ptr<T>&& resource, uint64_t last_used_submission_index) {
+        retired_resources_.emplace_back(
+            RetiredResource{
+                .submission_index = last_used_submission_index,
+                .resource = std::shared_ptr<void>(std::move(resource))
+            }
+        );
+    }
+    // Destroy resources whose submissions have finished.
+    void collect(bool wait_all = false);
+
+    [[nodiscard]] size_t size() const { return retired_resources_.size(); }
+
+protected:
+    struct RetiredResource {
+        uint64_t submission_index{ 0 };
+        std::shared_ptr<void> resource;
+    };
+
+    GfxSubmissionTracker& submission_tracker_;
+    std::vector<RetiredResource> retired_resources_;
+};
+
+} // namespace wg
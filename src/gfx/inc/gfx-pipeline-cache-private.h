@@ -0,0 +1,197 @@
+#pragma once
+
+#include "platform/inc/platform.inc"
+
+#include "gfx/gfx.h"
+#include "common/owned-resources.h"
+
+#include "gfx-pipeline-private.h"
+#include "gfx-workers-private.h"
+#include "shader-private.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace wg {
+
+// Serialized create info of a pipeline or render pass. Equal keys create interchangeable objects.
+class GfxPipelineStateKey {
+public:
+    template <typename T, typename = std::enable_if_t<std::is_trivially_copyable_v<T>>>
+    void add(const T& value) {
+        // Fields are added one by one, so that padding of Vulkan structures is never hashed
+        auto offset = data_.size();
+        data_.resize(offset + sizeof(T));
+        std::memcpy(data_.data() + offset, &value, sizeof(T));
+        for (size_t i = offset; i < data_.size(); ++i) {
+            hash_ = (hash_ ^ data_[i]) * 0x100000001b3ull; // FNV-1a
+        }
+    }
+    void addString(const char* value);
+
+    [[nodiscard]] size_t hash() const { return static_cast<size_t>(hash_); }
+    bool operator==(const GfxPipelineStateKey& other) const { return hash_ == other.hash_ && data_ == other.data_; }
+
+    struct Hash {
+        size_t operator()(const GfxPipelineStateKey& key) const { return key.hash(); }
+    };
+
+protected:
+    std::vector<uint8_t> data_;
+    uint64_t hash_{ 0xcbf29ce484222325ull };
+};
+
+// Shader modules, vertex input, topology, viewport, rasterization, multisample, depth, blend and dynamic states,
+// layout and render pass of the create info.
+[[nodiscard]] GfxPipelineStateKey MakeGraphicsPipelineStateKey(const vk::GraphicsPipelineCreateInfo& create_info);
+// Attachments, subpasses and dependencies, which decide render pass compatibility.
+[[nodiscard]] GfxPipelineStateKey MakeRenderPassStateKey(const vk::RenderPassCreateInfo& create_info);
+
+// Header of pipeline cache files. Data is only loaded by the same device, driver and engine version.
+struct GfxPipelineCacheFileHeader {
+    static constexpr uint32_t MAGIC = 0x43504757; // "WGPC"
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t magic{ MAGIC };
+    uint32_t header_version{ VERSION };
+    uint32_t vendor_id{ 0 };
+    uint32_t device_id{ 0 };
+    uint32_t driver_version{ 0 };
+    uint32_t engine_version{ 0 };
+    std::array<uint8_t, VK_UUID_SIZE> pipeline_cache_uuid{};
+    uint64_t data_size{ 0 };
+    // FNV-1a of data, to reject truncated or corrupted files
+    uint64_t data_hash{ 0 };
+};
+
+[[nodiscard]] GfxPipelineCacheFileHeader MakePipelineCacheFileHeader(const vk::PhysicalDeviceProperties& properties, uint32_t engine_version);
+// File content of pipeline cache data, starting with the header.
+[[nodiscard]] std::vector<uint8_t> SerializePipelineCacheFile(GfxPipelineCacheFileHeader header, const std::vector<uint8_t>& data);
+// Pipeline cache data in the file content if it was written for the device of device_header, otherwise empty.
+// The header of the data itself (VkPipelineCacheHeaderVersionOne) is checked as well.
+[[nodiscard]] std::vector<uint8_t> ParsePipelineCacheFile(
+    const std::vector<uint8_t>& file_content, const GfxPipelineCacheFileHeader& device_header
+);
+
+// Graphics pipeline create info owning copies of everything it points to, so that it can be compiled on another thread.
+// Also keeps the pipeline layout, render pass and shader modules alive until the pipeline is created.
+// Extension structures (pNext) are not copied.
+struct GfxGraphicsPipelineState {
+    GfxGraphicsPipelineState() = default;
+    GfxGraphicsPipelineState(const GfxGraphicsPipelineState&) = delete;
+    GfxGraphicsPipelineState& operator=(const GfxGraphicsPipelineState&) = delete;
+
+    // Copy the structures referenced by info, and point create_info to the copies.
+    void assign(const vk::GraphicsPipelineCreateInfo& info);
+
+    vk::GraphicsPipelineCreateInfo create_info;
+    // Owner of create_info.layout
+    OwnedResourceHandle<GfxPipelineResources> layout_owner;
+    std::shared_ptr<vk::raii::RenderPass> render_pass;
+    // Owners of the shader modules of create_info.pStages
+    std::vector<std::shared_ptr<Shader>> shaders;
+    std::vector<OwnedResourceHandle<ShaderResources>> shader_owners;
+
+protected:
+    std::vector<vk::PipelineShaderStageCreateInfo> stages_;
+    std::vector<std::string> entry_names_;
+    std::vector<vk::SpecializationInfo> specializations_;
+    std::vector<std::vector<vk::SpecializationMapEntry>> specialization_map_entries_;
+    std::vector<std::vector<uint8_t>> specialization_data_;
+    vk::PipelineVertexInputStateCreateInfo vertex_input_;
+    std::vector<vk::VertexInputBindingDescription> vertex_bindings_;
+    std::vector<vk::VertexInputAttributeDescription> vertex_attributes_;
+    vk::PipelineInputAssemblyStateCreateInfo input_assembly_;
+    vk::PipelineViewportStateCreateInfo viewport_;
+    std::vector<vk::Viewport> viewports_;
+    std::vector<vk::Rect2D> scissors_;
+    vk::PipelineRasterizationStateCreateInfo rasterization_;
+    vk::PipelineMultisampleStateCreateInfo multisample_;
+    std::vector<vk::SampleMask> sample_mask_;
+    vk::PipelineDepthStencilStateCreateInfo depth_stencil_;
+    vk::PipelineColorBlendStateCreateInfo color_blend_;
+    std::vector<vk::PipelineColorBlendAttachmentState> color_blend_attachments_;
+    vk::PipelineDynamicStateCreateInfo dynamic_state_;
+    std::vector<vk::DynamicState> dynamic_states_;
+};
+
+// Ready when the pipeline has been created. Holds nullptr if creation failed.
+using GfxPipelineFuture = std::shared_future<std::shared_ptr<vk::raii::Pipeline>>;
+
+// Graphics pipelines and render passes shared by all render targets of the logical device.
+// Objects are kept alive by their users only, so the cache never holds destroyed handles.
+// Pipelines are created through one VkPipelineCache, which can be saved to and loaded from a file.
+// With compile threads, graphics pipelines can be created in background. All other functions are called from one thread.
+class GfxPipelineCache {
+public:
+    // initial_data is data of a VkPipelineCache created by the same device before, or empty.
+    GfxPipelineCache(vk::raii::Device& device, const std::vector<uint8_t>& initial_data);
+    // Waits for pending pipelines, whose futures would otherwise be broken when queued tasks are dropped
+    ~GfxPipelineCache();
+
+    // Threads creating pipelines requested with async. 0 to create all pipelines on the calling thread.
+    // Waits for pending pipelines before replacing the threads.
+    void setCompileThreadCount(uint32_t compile_thread_count);
+    [[nodiscard]] uint32_t compile_thread_count() const { return compile_queue_ ? compile_queue_->thread_count() : 0; }
+
+    // Return the pipeline created from an identical create info, or create one.
+    // With async and compile threads, a new pipeline is created on a compile thread and the future is ready later.
+    // Otherwise the future is ready on return. Pipelines are only shared while state->layout_owner and
+    // state->shader_owners are alive, because keys hold their handles, which may be reused after destruction.
+    GfxPipelineFuture requestGraphicsPipeline(const std::shared_ptr<GfxGraphicsPipelineState>& state, bool async);
+    // Forget states of pipelines created in background. Called by requestGraphicsPipeline as well.
+    void collectPendingPipelines();
+    void waitPendingPipelines();
+    // Return the render pass created from an identical create info, or create one.
+    std::shared_ptr<vk::raii::RenderPass> getRenderPass(const vk::RenderPassCreateInfo& create_info);
+
+    [[nodiscard]] const vk::raii::PipelineCache& vk_pipeline_cache() const { return vk_pipeline_cache_; }
+    // Data of the VkPipelineCache to be saved
+    [[nodiscard]] std::vector<uint8_t> data() const;
+
+    [[nodiscard]] GfxPipelineCacheStatistics statistics() const;
+
+protected:
+    // Called on compile threads. Returns nullptr on failure.
+    std::shared_ptr<vk::raii::Pipeline> createGraphicsPipeline(const GfxGraphicsPipelineState& state);
+
+    struct PipelineEntry {
+        std::weak_ptr<vk::raii::Pipeline> pipeline;
+        OwnedResourceWeakHandle<GfxPipelineResources> layout_owner;
+        std::vector<OwnedResourceWeakHandle<ShaderResources>> shader_owners;
+        // Valid while the pipeline is created on a compile thread
+        GfxPipelineFuture pending;
+        // Used by the compile thread until pending is ready. Released by collectPendingPipelines,
+        // because releasing the resources it owns is not thread safe.
+        std::shared_ptr<GfxGraphicsPipelineState> pending_state;
+
+        // Whether the layout and shader modules in the key are still the objects the pipeline was created with
+        [[nodiscard]] bool owners_alive() const {
+            return !layout_owner.expired() &&
+                   std::none_of(shader_owners.begin(), shader_owners.end(), [](const auto& owner) { return owner.expired(); });
+        }
+    };
+
+    vk::raii::Device& device_;
+    vk::raii::PipelineCache vk_pipeline_cache_{ nullptr };
+    std::unordered_map<GfxPipelineStateKey, PipelineEntry, GfxPipelineStateKey::Hash> pipelines_;
+    std::unordered_map<GfxPipelineStateKey, std::weak_ptr<vk::raii::RenderPass>, GfxPipelineStateKey::Hash> render_passes_;
+    size_t pending_pipeline_count_{ 0 };
+    GfxPipelineCacheStatistics statistics_;
+    // Updated by compile threads
+    std::atomic<uint32_t> pipelines_created_{ 0 };
+    std::atomic<uint64_t> pipeline_compile_microseconds_{ 0 };
+    // Declared last so that compile threads are stopped before anything they use is destroyed
+    std::unique_ptr<GfxTaskQueue> compile_queue_;
+};
+
+} // namespace wg
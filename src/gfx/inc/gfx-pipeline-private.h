@@ -24,8 +24,28 @@ struct GfxPipelineResources {
     std::vector<vk::PipelineShaderStageCreateInfo> shader_stages;
 };
 
+// Draw command uniforms are stored in uniform arenas and bound with dynamic offsets.
+inline bool IsDynamicUniform(uniform_attributes::UniformAttribute attribute) {
+    return attribute >= uniform_attributes::DRAW_COMMAND_UNIFORMS_START &&
+        attribute < uniform_attributes::DRAW_COMMAND_UNIFORMS_END;
+}
+
+inline vk::DescriptorType GetUniformDescriptorType(uniform_attributes::UniformAttribute attribute) {
+    return IsDynamicUniform(attribute) ? vk::DescriptorType::eUniformBufferDynamic : vk::DescriptorType::eUniformBuffer;
+}
+
 struct GfxPipeline::Impl {
     OwnedResourceHandle <GfxPipelineResources> resources;
 };
 
+struct ComputePipelineResources {
+    vk::raii::DescriptorSetLayout set_layout{ nullptr };
+    vk::raii::PipelineLayout pipeline_layout{ nullptr };
+    vk::raii::Pipeline pipeline{ nullptr };
+};
+
+struct ComputePipeline::Impl {
+    OwnedResourceHandle<ComputePipelineResources> resources;
+};
+
 } // namespace wg
\ No newline at end of file
@@ -8,14 +8,25 @@
 #include "gfx/inc/surface-private.h"
 #include "gfx/inc/shader-private.h"
 #include "gfx/inc/gfx-pipeline-private.h"
+#include "gfx/inc/compute-command-private.h"
 #include "gfx/inc/render-target-private.h"
+#include "gfx/inc/gfx-allocator-private.h"
 #include "gfx/inc/gfx-buffer-private.h"
+#include "gfx/inc/geometry-pool-private.h"
+#include "gfx/inc/gfx-upload-private.h"
+#include "gfx/inc/gfx-deletion-private.h"
+#include "gfx/inc/gfx-staging-private.h"
+#include "gfx/inc/gfx-budget-private.h"
 #include "gfx/inc/image-private.h"
+#include "gfx/inc/gfx-workers-private.h"
+#include "gfx/inc/gfx-sort-private.h"
+#include "gfx/inc/gfx-pipeline-cache-private.h"
 
 #include <array>
 #include <bitset>
 #include <vector>
 #include <tuple>
+#include <unordered_set>
 
 namespace wg {
 
@@ -32,8 +43,11 @@ struct Gfx::Impl {
     OwnedResources<WindowResources> window_resources_;
     OwnedResources<WindowSurfaceResources> window_surface_resources_;
     Gfx* gfx;
+    // Created on demand for GfxSetup::recording_thread_count
+    std::unique_ptr<GfxWorkerPool> recording_workers;
 
-    void singleTimeCommand(
+    // Submit and wait for the submission to finish. Returns submission index.
+    uint64_t singleTimeCommand(
         const QueueInfoRef& queue, const std::function<void(vk::CommandBuffer&)>& func,
         std::vector<vk::Semaphore> wait_semaphores = {}, std::vector<vk::PipelineStageFlags> wait_stages = {}, 
         std::vector<vk::Semaphore> signal_semaphores = {}
@@ -41,16 +55,87 @@ struct Gfx::Impl {
 
     bool createGfxMemory(
         vk::MemoryRequirements memory_requirements, vk::MemoryPropertyFlags memory_properties,
-        GfxMemoryResources& out_resources
+        GfxMemoryResources& out_resources, gfx_memory_kinds::MemoryKind kind = gfx_memory_kinds::linear,
+        gfx_memory_categories::MemoryCategory category = gfx_memory_categories::buffer
     );
+    // Evict least recently used images until size more bytes fit in the heap budget. Returns number of images evicted.
+    size_t makeRoomInHeap(uint32_t heap_index, vk::DeviceSize size);
+    // Images sampled by draw commands of any render target
+    [[nodiscard]] std::unordered_set<const Image*> getImagesInUse() const;
+    bool evictImage(const std::shared_ptr<Image>& image, const std::unordered_set<const Image*>& images_in_use);
+    // Restore the image if evicted, and mark it as most recently used.
+    void useImage(const std::shared_ptr<Image>& image);
 
     void createBuffer(
         vk::DeviceSize data_size, vk::BufferUsageFlags usage,
         vk::SharingMode sharing_mode, const std::vector<uint32_t>& queue_family_indices,
         GfxBufferResources& out_resources
     );
-    void copyBuffer(const QueueInfoRef& transfer_queue, vk::Buffer src, vk::Buffer dst, vk::DeviceSize size);
     vk::SharingMode getTransferQueue(QueueInfoRef& out_transfer_queue) const;
+    // Compute queue if the compute feature is enabled, otherwise the graphics queue.
+    void getComputeQueue(QueueInfoRef& out_compute_queue) const;
+
+    // Record copies into one command buffer and submit without waiting. Returns submission index.
+    uint64_t submitBufferCopies(
+        const QueueInfoRef& transfer_queue, const std::vector<GfxBufferCopy>& copies, vk::Semaphore signal_semaphore
+    );
+    // Semaphores a submission must wait for, for signals submitted since waited_submission_index, which is updated.
+    // A semaphore is waited by one submission only, so signals already waited by another consumer are waited for on
+    // CPU if they are still pending.
+    void waitPendingSignals(uint64_t& waited_submission_index, std::vector<vk::raii::Semaphore>& out_semaphores);
+    // Wait on CPU until submissions that may read the buffer have finished, before the host or a copy writes it.
+    void waitBufferIdle(const GfxBufferResources& resources);
+    void createStagingRing();
+    // Create the pipeline cache of the logical device, loading data saved by the same device if available.
+    void createPipelineCache();
+    [[nodiscard]] GfxPipelineCacheFileHeader getPipelineCacheFileHeader() const;
+    // record_copy(command_buffer, staging_region, data_offset) copies one chunk from staging_region
+    using StagingCopyFunc = std::function<void(vk::CommandBuffer&, const GfxStagingRegion&, vk::DeviceSize)>;
+    bool uploadThroughStagingRing(
+        const QueueInfoRef& transfer_queue, const void* data, vk::DeviceSize data_size,
+        vk::DeviceSize alignment, vk::DeviceSize chunk_granularity, const StagingCopyFunc& record_copy
+    );
+    // Begin the render pass of the render target on the framebuffer of the image, clearing all attachments.
+    static void BeginRenderPass(
+        const RenderTargetResources& resources, vk::CommandBuffer command_buffer, size_t image_index,
+        vk::Extent2D extent, vk::SubpassContents contents
+    );
+    // Assign sort state keys of draw commands by pipeline, material and mesh of their resources.
+    static void UpdateDrawSortStateKeys(
+        RenderTargetResources& resources, const std::vector<std::shared_ptr<DrawCommand>>& draw_commands
+    );
+    // Fill resources.draw_order with visible draw commands, sorted by key unless sorting is disabled.
+    void buildDrawOrder(
+        RenderTargetResources& resources, const Renderer& renderer, const std::vector<std::shared_ptr<DrawCommand>>& draw_commands
+    );
+    // Record draw commands resources.draw_order[begin, end) for the image, skipping state that is already bound.
+    // Only reads shared state, so slices can be recorded in parallel.
+    static void RecordDrawCommands(
+        const RenderTargetResources& resources, const std::vector<std::shared_ptr<DrawCommand>>& draw_commands,
+        vk::CommandBuffer command_buffer, size_t image_index, size_t begin, size_t end,
+        RenderTargetBindStatistics& bind_statistics
+    );
+    // Record command buffers of all images for per image recording mode. Previous frames of the render target
+    // must have finished.
+    void recordCommandBuffers(RenderTarget& render_target, RenderTargetResources& resources);
+    // Replace fallback pipelines of draw commands by their pipelines compiled in background. Returns true if any was
+    // replaced, in which case command buffers of per image recording mode must be recorded again.
+    bool resolvePendingPipelines(RenderTargetResources& resources);
+    // Record visible draw commands into the command buffer of the current frame in flight.
+    vk::CommandBuffer recordFrameCommandBuffer(
+        RenderTarget& render_target, RenderTargetResources& resources, const Renderer& renderer, size_t image_index
+    );
+    // State of the pipeline drawing the draw command on the render target, with shader stages and fixed function
+    // states of pipeline and the pipeline layout of layout_pipeline. Both pipelines must have resources.
+    [[nodiscard]] std::shared_ptr<GfxGraphicsPipelineState> createGraphicsPipelineState(
+        const RenderTarget& render_target, const RenderTargetResources& resources, DrawCommand::Impl& draw_command_impl,
+        const GfxPipeline& pipeline, const GfxPipeline& layout_pipeline
+    );
+    // Resolve indirect and count buffers of the draw command. Called by Gfx::finishDrawCommand.
+    void finishIndirectDrawCommand(IndirectDrawCommand& draw_command);
+    // Create one uniform arena per image of the render target, replacing old ones.
+    void createUniformArenas(RenderTargetResources& resources, vk::DeviceSize capacity);
+    void writeUniformArena(RenderTargetUniformArena& arena, vk::DeviceSize offset, const void* data, vk::DeviceSize size);
     void createBufferResources(
         const std::shared_ptr<GfxBufferBase>& gfx_buffer,
         vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memory_properties
@@ -60,6 +145,21 @@ struct Gfx::Impl {
         const std::shared_ptr<GfxBufferBase>& gpu_buffer,
         vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memory_properties
     );
+    // Byte ranges <offset, size> of cpu_buffer to upload: its dirty ranges if gpu_buffer already has data,
+    // otherwise the whole buffer.
+    [[nodiscard]] static std::vector<std::pair<vk::DeviceSize, vk::DeviceSize>> GetBufferUploadRanges(
+        const std::shared_ptr<GfxBufferBase>& cpu_buffer, const std::shared_ptr<GfxBufferBase>& gpu_buffer,
+        vk::DeviceSize data_size
+    );
+    // Create one host visible copy per frame for a streaming vertex buffer and fill them with CPU data.
+    void createStreamingVertexBufferResources(const std::shared_ptr<VertexBufferBase>& vertex_buffer);
+    // Bring the copy of the streaming vertex buffer used by image_index up to date. Returns bytes written.
+    vk::DeviceSize updateStreamingCopy(const std::shared_ptr<VertexBufferBase>& vertex_buffer, uint32_t image_index);
+    // Place the buffer in a range of the geometry pool instead of creating its own resources.
+    bool createGeometryRangeResources(
+        const std::shared_ptr<GfxBufferBase>& gfx_buffer, const std::shared_ptr<GeometryPool>& geometry_pool,
+        bool index, uint32_t count, uint32_t element_size
+    );
 
     void transitionImageLayout(
         ImageResources* image_resources,
@@ -70,8 +170,8 @@ struct Gfx::Impl {
     void transitionImageLayout(
         ImageResources* image_resources, vk::ImageLayout new_layout, const QueueInfoRef& new_queue
     );
-    void copyBufferToImage(
-        const QueueInfoRef& transfer_queue, vk::Buffer src, vk::Image dst, 
+    bool copyBufferToImage(
+        const QueueInfoRef& transfer_queue, const void* data, vk::DeviceSize data_size, vk::Image dst,
         uint32_t width, uint32_t height, vk::ImageLayout image_layout, uint32_t layer_count
     );
     void createImageResources(const std::shared_ptr<Image>& image);
@@ -132,19 +232,68 @@ struct LogicalDevice::Impl {
     std::vector<std::vector<std::unique_ptr<QueueInfo>>> allocated_queues;
     // queue_references[queue_id][] = QueueInfoRef
     std::array<std::vector<QueueInfoRef>, gfx_queues::NUM_QUEUES> queue_references;
+    // Must outlive all memory resources below
+    std::unique_ptr<GfxMemoryAllocator> memory_allocator;
+    // Signaled by upload batches and compute submissions, in submission order, see Gfx::Impl::waitPendingSignals
+    std::vector<GfxPendingSignal> pending_signals;
+    // Last pending signal waited by compute submissions
+    uint64_t compute_waited_signal_submission_index{ 0 };
+    // Signaled by the last graphics submission if compute runs on another queue, to be waited by the next compute submission
+    std::unique_ptr<vk::raii::Semaphore> graphics_semaphore;
+    uint64_t graphics_semaphore_submission_index{ 0 };
+    // Waits for pending submissions on destruction
+    std::unique_ptr<GfxSubmissionTracker> submission_tracker;
+    std::unique_ptr<GfxStagingRing> staging_ring;
+    // Released resources wait here for submissions that may use them
+    std::unique_ptr<GfxDeletionQueue> deletion_queue;
+    std::unique_ptr<GfxMemoryBudget> memory_budget;
+    // Pipelines and render passes shared by render targets
+    std::unique_ptr<GfxPipelineCache> pipeline_cache;
 
     // resources (which may be accessed by buffer using OwnedResourcesHandle)
     OwnedResources<SurfaceResources> surface_resources;
     OwnedResources<ShaderResources> shader_resources;
     OwnedResources<GfxPipelineResources> gfx_pipeline_resources;
+    OwnedResources<ComputePipelineResources> compute_pipeline_resources;
+    OwnedResources<ComputeCommandResources> compute_command_resources;
     OwnedResources<RenderTargetResources> render_target_resources;
     OwnedResources<GfxMemoryResources> memory_resources;
     OwnedResources<GfxBufferResources> buffer_resources;
+    OwnedResources<GeometryRangeResources> geometry_range_resources;
     OwnedResources<ImageResources> image_resources;
     OwnedResources<SamplerResources> sampler_resources;
 
     explicit Impl(vk::raii::Device vk_device)
         : vk_device(std::move(vk_device)) {}
+    ~Impl() {
+        // Uploads may still be in flight, finish them before destroying resources.
+        if (*vk_device) {
+            vk_device.waitIdle();
+        }
+    }
+
+    // Route released resources to the deletion queue instead of destroying them while GPU may use them.
+    void deferResourceDestruction() {
+        auto retire = [this](auto&& resource) {
+            deletion_queue->retire(std::move(resource));
+        };
+        shader_resources.setOnRelease(retire);
+        gfx_pipeline_resources.setOnRelease(retire);
+        compute_pipeline_resources.setOnRelease(retire);
+        compute_command_resources.setOnRelease([this](std::unique_ptr<ComputeCommandResources>&& resource) {
+            auto last_used_submission_index = resource->last_used_submission_index;
+            deletion_queue->retireAfter(std::move(resource), last_used_submission_index);
+        });
+        render_target_resources.setOnRelease([this](std::unique_ptr<RenderTargetResources>&& resource) {
+            auto last_used_submission_index = resource->last_used_submission_index;
+            deletion_queue->retireAfter(std::move(resource), last_used_submission_index);
+        });
+        memory_resources.setOnRelease(retire);
+        buffer_resources.setOnRelease(retire);
+        geometry_range_resources.setOnRelease(retire);
+        image_resources.setOnRelease(retire);
+        sampler_resources.setOnRelease(retire);
+    }
 };
 
 struct VulkanFeatures {
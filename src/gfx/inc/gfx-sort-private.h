@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace wg {
+
+// Draw command to be recorded, ordered by key and then by index.
+struct GfxDrawSortItem {
+    uint64_t key{ 0 };
+    uint32_t index{ 0 };
+};
+
+// Bits of each field of a draw sort key, from the most significant: layer, pipeline, material, mesh, depth.
+namespace gfx_draw_sort_keys {
+
+constexpr uint32_t LAYER_BITS = 4;
+constexpr uint32_t PIPELINE_BITS = 12;
+constexpr uint32_t MATERIAL_BITS = 16;
+constexpr uint32_t MESH_BITS = 16;
+constexpr uint32_t DEPTH_BITS = 16;
+
+constexpr uint32_t DEPTH_SHIFT = 0;
+constexpr uint32_t MESH_SHIFT = DEPTH_SHIFT + DEPTH_BITS;
+constexpr uint32_t MATERIAL_SHIFT = MESH_SHIFT + MESH_BITS;
+constexpr uint32_t PIPELINE_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+constexpr uint32_t LAYER_SHIFT = PIPELINE_SHIFT + PIPELINE_BITS;
+
+} // namespace gfx_draw_sort_keys
+
+// Key of the state a draw command binds. Ids larger than their fields are clamped.
+[[nodiscard]] uint64_t MakeDrawSortStateKey(uint32_t pipeline_id, uint32_t material_id, uint32_t mesh_id);
+// Add layer and view depth to a state key. Negative depth is treated as zero.
+[[nodiscard]] uint64_t MakeDrawSortKey(uint64_t state_key, uint32_t layer, float depth);
+// Stable LSD radix sort by key. scratch is used as the second buffer to avoid allocations between frames.
+void RadixSortDrawSortItems(std::vector<GfxDrawSortItem>& items, std::vector<GfxDrawSortItem>& scratch);
+
+} // namespace wg
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "platform/inc/platform.inc"
+
+#include "gfx-buffer-private.h"
+#include "gfx-upload-private.h"
+
+#include <deque>
+#include <vector>
+
+namespace wg {
+
+struct GfxStagingRegion {
+    vk::Buffer buffer;
+    vk::DeviceSize offset{ 0 };
+    vk::DeviceSize size{ 0 };
+    void* mapped{ nullptr };
+};
+
+// Persistently mapped staging buffer used as a ring. Regions are handed out in order
+// and recycled once the submission that consumed them has finished.
+class GfxStagingRing {
+public:
+    GfxStagingRing(GfxSubmissionTracker& submission_tracker, vk::DeviceSize capacity);
+    ~GfxStagingRing();
+
+    // Allocate a region, waiting for earlier submissions if the ring is full.
+    // Fails if size exceeds capacity or if the ring is filled with uncommitted regions.
+    bool allocate(vk::DeviceSize size, vk::DeviceSize alignment, GfxStagingRegion& out_region);
+    // Mark all regions allocated since last commit as read by the submission.
+    void commit(uint64_t submission_index);
+    // Recycle regions of finished submissions.
+    void reclaim(bool wait_all = false);
+
+    [[nodiscard]] vk::DeviceSize capacity() const { return capacity_; }
+    [[nodiscard]] vk::DeviceSize used_size() const { return used_size_; }
+
+public:
+    // Declared before buffer so that the buffer is destroyed first
+    GfxMemoryResources memory_resources;
+    GfxBufferResources buffer_resources;
+
+protected:
+    struct PendingSubmission {
+        uint64_t submission_index{ 0 };
+        // head_ after the last region of the submission
+        vk::DeviceSize end{ 0 };
+        vk::DeviceSize size{ 0 };
+    };
+
+    GfxSubmissionTracker& submission_tracker_;
+    vk::DeviceSize capacity_;
+    vk::DeviceSize head_{ 0 };
+    vk::DeviceSize tail_{ 0 };
+    // Bytes between tail_ and head_, including padding and wrap-around waste
+    vk::DeviceSize used_size_{ 0 };
+    vk::DeviceSize uncommitted_size_{ 0 };
+    std::deque<PendingSubmission> pending_submissions_;
+
+    bool tryAllocate(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& out_offset);
+    void popPendingSubmission();
+};
+
+} // namespace wg
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "platform/inc/platform.inc"
+
+#include "gfx/gfx-upload.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace wg {
+
+// Tracks queue submissions by fences. Submissions are identified by increasing indices.
+class GfxSubmissionTracker {
+public:
+    using OnFinishedFunc = std::function<void()>;
+
+    explicit GfxSubmissionTracker(const vk::raii::Device& vk_device);
+    ~GfxSubmissionTracker();
+
+    // Get the fence to be signaled by the next submission. on_finished is called once the fence is signaled.
+    uint64_t beginSubmission(vk::Fence& out_fence, OnFinishedFunc on_finished = {});
+    // Poll fences and return whether the submission has finished.
+    [[nodiscard]] bool finished(uint64_t submission_index);
+    void wait(uint64_t submission_index);
+    // Poll fences so that finished submissions release their resources.
+    void poll() { [[maybe_unused]] bool result = finished(0); }
+
+    [[nodiscard]] uint64_t last_submission_index() const { return next_submission_index_ - 1; }
+
+protected:
+    struct PendingSubmission {
+        uint64_t submission_index{ 0 };
+        vk::raii::Fence fence{ nullptr };
+        OnFinishedFunc on_finished;
+    };
+
+    const vk::raii::Device& vk_device_;
+    uint64_t next_submission_index_{ 1 };
+    // All submissions with index up to this one have finished
+    uint64_t finished_submission_index_{ 0 };
+    std::deque<PendingSubmission> pending_submissions_;
+    std::vector<vk::raii::Fence> free_fences_;
+
+    void popPendingSubmission();
+};
+
+// Semaphore signaled by an upload or compute submission, for later submissions reading its results
+struct GfxPendingSignal {
+    // Moved to the first submission waiting for it, null afterwards
+    vk::raii::Semaphore semaphore{ nullptr };
+    uint64_t submission_index{ 0 };
+};
+
+struct GfxBufferCopy {
+    vk::Buffer src;
+    vk::Buffer dst;
+    vk::BufferCopy region;
+};
+
+} // namespace wg
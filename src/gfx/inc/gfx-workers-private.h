@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wg {
+
+// Fixed set of threads running loops of independent jobs. The calling thread takes part in each loop.
+class GfxWorkerPool {
+public:
+    // thread_count includes the calling thread, so thread_count - 1 threads are started.
+    explicit GfxWorkerPool(uint32_t thread_count);
+    ~GfxWorkerPool();
+
+    [[nodiscard]] uint32_t thread_count() const { return static_cast<uint32_t>(threads_.size()) + 1; }
+    // Run func(job_index) for each job_index in [0, job_count) and return when all jobs have finished.
+    void parallelFor(size_t job_count, const std::function<void(size_t)>& func);
+
+protected:
+    void workerLoop();
+    void runJobs();
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_condition_;
+    std::condition_variable done_condition_;
+    // Increased for each loop, so that workers can tell a new loop from a spurious wakeup
+    uint64_t generation_{ 0 };
+    bool stopping_{ false };
+    const std::function<void(size_t)>* func_{ nullptr };
+    size_t job_count_{ 0 };
+    std::atomic<size_t> next_job_{ 0 };
+    size_t pending_workers_{ 0 };
+};
+
+// Fixed set of threads running posted tasks in order of posting, without blocking the posting thread.
+class GfxTaskQueue {
+public:
+    explicit GfxTaskQueue(uint32_t thread_count);
+    // Waits for running tasks. Tasks not started yet are dropped.
+    ~GfxTaskQueue();
+
+    [[nodiscard]] uint32_t thread_count() const { return static_cast<uint32_t>(threads_.size()); }
+    void post(std::function<void()> task);
+
+protected:
+    void workerLoop();
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_condition_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_{ false };
+};
+
+} // namespace wg
@@ -97,6 +97,8 @@ struct ImageResources {
 
 struct Image::Impl : public GfxMemoryBase::Impl {
     OwnedResourceHandle<ImageResources> resources;
+    // GPU resources were released under memory pressure and will be restored on use
+    bool evicted{ false };
 };
 
 struct SamplerResources {
@@ -9,19 +9,51 @@
 #include "gfx/gfx-buffer.h"
 #include "common/owned-resources.h"
 #include "gfx-constants-private.h"
+#include "gfx-buffer-private.h"
+#include "gfx-pipeline-cache-private.h"
+#include "gfx-sort-private.h"
 
 #include <algorithm>
 #include <iterator>
 #include <functional>
+#include <future>
+#include <map>
+#include <unordered_map>
 
 namespace wg {
 
+struct GfxPipelineResources;
+
+struct RenderTargetUniformRange {
+    uniform_attributes::UniformAttribute attribute{ uniform_attributes::none };
+    vk::DeviceSize offset{ 0 };
+    vk::DeviceSize size{ 0 };
+};
+
+// Draw command uniforms of one image packed into one buffer, bound with dynamic offsets
+struct RenderTargetUniformArena {
+    // Declared before buffer so that the buffer is destroyed first
+    GfxMemoryResources memory_resources;
+    GfxBufferResources buffer_resources;
+};
+
+struct RenderTargetUniformCopy {
+    void* dst{ nullptr };
+    const void* src{ nullptr };
+    vk::DeviceSize size{ 0 };
+    // Memory of dst, for flushing non-coherent memory
+    const GfxMemoryAllocation* allocation{ nullptr };
+    vk::DeviceSize offset{ 0 };
+};
+
 struct RenderTargetDrawCommandResources {
     vk::Pipeline pipeline;
     vk::PipelineLayout pipeline_layout;
     vk::DescriptorSet descriptor_set;
-    // Uniforms that has gpu data only
-    std::vector<std::shared_ptr<UniformBufferBase>> uniforms;
+    // Uniforms that has gpu data only, stored in uniform arena of the image
+    std::vector<RenderTargetUniformRange> uniform_ranges;
+    // Offsets of dynamic uniform buffers ordered by binding
+    std::vector<uint32_t> dynamic_offsets;
     // <binding> => sampler 
     std::map<uint32_t, std::shared_ptr<Sampler>> samplers;
     // Uniforms that has cpu data only and should be updated using push constant
@@ -30,7 +62,12 @@ struct RenderTargetDrawCommandResources {
 };
 
 struct RenderTargetPipelineResources {
-    vk::raii::Pipeline pipeline{ nullptr };
+    // Shared by draw commands and render targets with identical pipeline state.
+    // The fallback pipeline or nullptr while pending_pipeline is compiled in background.
+    std::shared_ptr<vk::raii::Pipeline> pipeline;
+    std::shared_future<std::shared_ptr<vk::raii::Pipeline>> pending_pipeline;
+    // Index of the draw command in draw_command_resources
+    size_t draw_command_index{ 0 };
     vk::raii::DescriptorPool descriptor_pool{ nullptr };
     std::vector<vk::raii::DescriptorSet> descriptor_sets;
 };
@@ -44,29 +81,80 @@ struct RenderTargetFramebufferResources {
     std::vector<std::shared_ptr<UniformBufferBase>> push_constants;
 };
 
+// Secondary command buffers recording a slice of draw commands on one worker thread
+struct RenderTargetRecordingSlice {
+    // Only used by one thread at a time
+    vk::raii::CommandPool command_pool{ nullptr };
+    // command_buffers[image_index], freed with the pool
+    std::vector<vk::CommandBuffer> command_buffers;
+};
+
 struct RenderTargetResources {
-    vk::raii::RenderPass render_pass{ nullptr };
+    // Shared by render targets with compatible attachments
+    std::shared_ptr<vk::raii::RenderPass> render_pass;
     std::vector<vk::raii::Semaphore> image_available_semaphores;
     std::vector<vk::raii::Semaphore> render_finished_semaphores;
-    std::vector<vk::raii::Fence> in_flight_fences;
+    // in_flight_submission_indices[frame_index] = last submission of the frame
+    std::vector<uint64_t> in_flight_submission_indices;
+    // upload_semaphores[frame_index] = upload and compute semaphores waited by the frame
+    std::vector<std::vector<vk::raii::Semaphore>> upload_semaphores;
+    // Last pending signal waited by frames of this render target
+    uint64_t waited_signal_submission_index{ 0 };
     std::vector<vk::CommandBuffer> command_buffers;
     std::vector<RenderTargetFramebufferResources> framebuffer_resources;
+    // Empty if draw commands are recorded into the primary command buffers directly
+    std::vector<RenderTargetRecordingSlice> recording_slices;
+    // draw_sort_state_keys[draw_command_index] = key of pipeline, descriptor set and buffers, see MakeDrawSortStateKey
+    std::vector<uint64_t> draw_sort_state_keys;
+    // Indices of draw commands to record in order, rebuilt by each recording
+    std::vector<uint32_t> draw_order;
+    std::vector<GfxDrawSortItem> draw_sort_items;
+    std::vector<GfxDrawSortItem> draw_sort_scratch;
+    // False until command_buffers are recorded for per image recording mode
+    bool command_buffers_recorded{ false };
+    // frame_command_pools[frame_index] and frame_command_buffers[frame_index] for per frame recording mode,
+    // created on the first frame recorded in this mode
+    std::vector<vk::raii::CommandPool> frame_command_pools;
+    std::vector<vk::CommandBuffer> frame_command_buffers;
     std::vector<RenderTargetPipelineResources> pipeline_resources;
+    // Number of pipeline_resources with pending_pipeline
+    size_t pending_pipeline_count{ 0 };
+    // Pipelines compiled by Gfx::prewarmPipelines, kept alive for draw commands submitted later
+    std::unordered_map<GfxPipelineStateKey, GfxPipelineFuture, GfxPipelineStateKey::Hash> prewarmed_pipelines;
+    // shared_descriptor_sets[pipeline resources] = index of pipeline_resources owning descriptor sets
+    // Draw commands of pipelines without samplers have identical descriptor sets.
+    std::map<const GfxPipelineResources*, size_t> shared_descriptor_sets;
+    // uniform_arenas[image_index], all arenas share the same layout
+    std::vector<RenderTargetUniformArena> uniform_arenas;
+    vk::DeviceSize uniform_arena_capacity{ 0 };
+    vk::DeviceSize uniform_arena_size{ 0 };
+    vk::DeviceSize uniform_arena_alignment{ 1 };
+    // Dirty uniforms gathered for the current frame, kept to reuse storage
+    std::vector<RenderTargetUniformCopy> uniform_copies;
+    // Streaming vertex buffers drawn by the renderer, whose copy of the image is updated before each frame
+    std::vector<std::shared_ptr<VertexBufferBase>> streaming_vertex_buffers;
 
     vk::raii::Device* device{ nullptr };
     std::vector<QueueInfoRef> queues; // queues needed for render target
     int graphics_queue_index{ -1 };
     // draw_command_resources[...][image_index]
     std::vector<std::vector<RenderTargetDrawCommandResources>> draw_command_resources;
+    // Draw commands of the renderer at the last submitDrawCommands, owning draw_command_resources of the same index.
+    // Draw commands of the renderer at other indices have no resources until the next submitDrawCommands.
+    std::vector<std::shared_ptr<DrawCommand>> submitted_draw_commands;
+    // Whether draw commands changed since the last submitDrawCommands have been reported
+    bool changed_draw_commands_reported{ false };
 
-    std::vector<vk::Fence> images_in_flight;
+    // images_in_flight[image_index] = last submission rendering to the image
+    std::vector<uint64_t> images_in_flight;
     int max_frames_in_flight{ 0 };
     int current_frame_index{ 0 };
+    // Resources are destroyed only after this submission has finished
+    uint64_t last_used_submission_index{ 0 };
 
     ~RenderTargetResources() {
         // handle manually for better performance
         if (graphics_queue_index >= 0) {
-            device->waitIdle();
             auto vk_command_pool = queues[graphics_queue_index].vk_command_pool;
             (**device).freeCommandBuffers(vk_command_pool, command_buffers);
         }
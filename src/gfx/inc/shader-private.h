@@ -24,6 +24,8 @@ struct Shader::Impl {
         return vk::ShaderStageFlagBits::eVertex;
     case shader_stages::frag:
         return vk::ShaderStageFlagBits::eFragment;
+    case shader_stages::comp:
+        return vk::ShaderStageFlagBits::eCompute;
     default:
         return {};
     }
@@ -37,6 +39,9 @@ struct Shader::Impl {
     if (stages & shader_stages::frag) {
         result |= vk::ShaderStageFlagBits::eFragment;
     }
+    if (stages & shader_stages::comp) {
+        result |= vk::ShaderStageFlagBits::eCompute;
+    }
     return result;
 }
 
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <utility>
 
 #include "gfx/render-target.h"
@@ -24,6 +25,18 @@ namespace {
 
 namespace wg {
 
+RenderTargetBindStatistics& RenderTargetBindStatistics::operator+=(const RenderTargetBindStatistics& other) {
+    pipeline_binds += other.pipeline_binds;
+    pipeline_binds_skipped += other.pipeline_binds_skipped;
+    descriptor_set_binds += other.descriptor_set_binds;
+    descriptor_set_binds_skipped += other.descriptor_set_binds_skipped;
+    push_constant_updates += other.push_constant_updates;
+    push_constant_updates_skipped += other.push_constant_updates_skipped;
+    buffer_binds += other.buffer_binds;
+    buffer_binds_skipped += other.buffer_binds_skipped;
+    return *this;
+}
+
 RenderTarget::RenderTarget(std::string name) : name_(std::move(name)) {}
 
 std::shared_ptr<RenderTarget> Gfx::createRenderTarget(const std::shared_ptr<Window>& window) {
@@ -187,7 +200,6 @@ void Gfx::createRenderTargetResources(const std::shared_ptr<RenderTarget>& rende
         logger().error("Cannot create render target resources because logical device is not available.");
         return;
     }
-    waitDeviceIdle();
 
     auto[width, height] = render_target->extent();
     auto image_views = render_target->impl_->get_image_views();
@@ -200,6 +212,9 @@ void Gfx::createRenderTargetResources(const std::shared_ptr<RenderTarget>& rende
 
     auto resources = std::make_unique<RenderTargetResources>();
     resources->device = &logical_device_->impl_->vk_device;
+    resources->uniform_arena_alignment = std::max<vk::DeviceSize>(
+        physical_device().impl_->vk_physical_device.getProperties().limits.minUniformBufferOffsetAlignment, 1
+    );
 
     // Render pass
     auto color_attachment = vk::AttachmentDescription{
@@ -281,8 +296,8 @@ void Gfx::createRenderTargetResources(const std::shared_ptr<RenderTarget>& rende
         .setSubpasses(subpasses)
         .setDependencies(dependencies);
 
-    resources->render_pass =
-        logical_device_->impl_->vk_device.createRenderPass(render_pass_create_info);
+    // Render targets with compatible attachments share the render pass, and thus pipelines
+    resources->render_pass = logical_device_->impl_->pipeline_cache->getRenderPass(render_pass_create_info);
 
     // Queues
     for (auto queue_id : render_target->queues()) {
@@ -302,13 +317,12 @@ void Gfx::createRenderTargetResources(const std::shared_ptr<RenderTarget>& rende
     resources->max_frames_in_flight = std::max(1, static_cast<int>(image_count - 1));
     resources->current_frame_index = 0;
     resources->images_in_flight.resize(image_count);
+    resources->in_flight_submission_indices.resize(resources->max_frames_in_flight);
     for (int i = 0; i < resources->max_frames_in_flight; ++i) {
         resources->image_available_semaphores.emplace_back(logical_device_->impl_->vk_device.createSemaphore({}));
         resources->render_finished_semaphores.emplace_back(logical_device_->impl_->vk_device.createSemaphore({}));
-        resources->in_flight_fences.emplace_back(
-            logical_device_->impl_->vk_device.createFence({ .flags = vk::FenceCreateFlagBits::eSignaled })
-        );
     }
+    resources->upload_semaphores.resize(resources->max_frames_in_flight);
 
     // Framebuffers
     resources->framebuffer_resources.reserve(image_count);
@@ -320,7 +334,7 @@ void Gfx::createRenderTargetResources(const std::shared_ptr<RenderTarget>& rende
             render_target_attachments = { image_view, depth_image_view };
         }
         auto framebuffer_create_info = vk::FramebufferCreateInfo{
-            .renderPass = *resources->render_pass,
+            .renderPass = **resources->render_pass,
             .width      = static_cast<uint32_t>(width),
             .height     = static_cast<uint32_t>(height),
             .layers     = 1
@@ -372,6 +386,44 @@ void Gfx::createRenderTargetResources(const std::shared_ptr<RenderTarget>& rende
         logical_device_->impl_->render_target_resources.store(std::move(resources));
 }
 
+void Gfx::Impl::createUniformArenas(RenderTargetResources& resources, vk::DeviceSize capacity) {
+    auto& logical_device_impl = *gfx->logical_device_->impl_;
+    resources.uniform_arenas.clear();
+    resources.uniform_arena_capacity = 0;
+    resources.uniform_arena_size = 0;
+
+    uint32_t graphics_family_index = logical_device_impl.queue_references[gfx_queues::graphics][0].queue_family_index;
+    size_t image_count = resources.framebuffer_resources.size();
+    resources.uniform_arenas.resize(image_count);
+    for (auto&& arena : resources.uniform_arenas) {
+        createBuffer(
+            capacity, vk::BufferUsageFlagBits::eUniformBuffer,
+            vk::SharingMode::eExclusive, { graphics_family_index },
+            arena.buffer_resources
+        );
+        if (!createGfxMemory(
+            arena.buffer_resources.buffer.getMemoryRequirements(), vk::MemoryPropertyFlagBits::eHostVisible,
+            arena.memory_resources, gfx_memory_kinds::linear, gfx_memory_categories::render_target
+        )) {
+            logger().error("Cannot create uniform arena because memory allocation failed.");
+            resources.uniform_arenas.clear();
+            return;
+        }
+        arena.buffer_resources.buffer.bindMemory(
+            arena.memory_resources.allocation.memory(), arena.memory_resources.allocation.offset()
+        );
+        arena.buffer_resources.cpu_data_size = capacity;
+        arena.buffer_resources.sharing_mode = vk::SharingMode::eExclusive;
+        arena.buffer_resources.mapped = arena.memory_resources.allocation.mapped();
+    }
+    resources.uniform_arena_capacity = capacity;
+}
+
+void Gfx::Impl::writeUniformArena(RenderTargetUniformArena& arena, vk::DeviceSize offset, const void* data, vk::DeviceSize size) {
+    std::memcpy(static_cast<char*>(arena.buffer_resources.mapped) + offset, data, size);
+    gfx->logical_device_->impl_->memory_allocator->addFlushRange(arena.memory_resources.allocation, offset, size);
+}
+
 void Gfx::render(const std::shared_ptr<RenderTarget>& render_target) {
 
     if (!render_target->preRendering(*this)) {
@@ -389,12 +441,26 @@ void Gfx::render(const std::shared_ptr<RenderTarget>& render_target) {
         logger().error("Cannot render because render target resources is not valid!");
         return;
     }
+    if (render_target->recording_mode() == recording_modes::per_image && !resources->command_buffers_recorded) {
+        logger().error("Cannot render because draw commands have not been submitted to render target.");
+        return;
+    }
 
-    auto result = logical_device_->impl_->vk_device.waitForFences(
-        { *resources->in_flight_fences[resources->current_frame_index] }, true, UINT64_MAX
-    );
-    if (result != vk::Result::eSuccess) {
-        logger().error("Wait for fence error: {}", vk::to_string(result));
+    auto& submission_tracker = *logical_device_->impl_->submission_tracker;
+    submission_tracker.wait(resources->in_flight_submission_indices[resources->current_frame_index]);
+    // Upload semaphores waited by the last submission of this frame can be destroyed now
+    resources->upload_semaphores[resources->current_frame_index].clear();
+    submission_tracker.poll();
+    logical_device_->impl_->deletion_queue->collect();
+
+    // Pipelines compiled in background replace fallback pipelines from this frame on
+    logical_device_->impl_->pipeline_cache->collectPendingPipelines();
+    if (impl_->resolvePendingPipelines(*resources)) {
+        Impl::UpdateDrawSortStateKeys(*resources, renderer->getDrawCommands());
+        if (render_target->recording_mode() == recording_modes::per_image) {
+            submission_tracker.wait(resources->last_used_submission_index);
+            impl_->recordCommandBuffers(*render_target, *resources);
+        }
     }
 
     // Acquire image
@@ -407,52 +473,154 @@ void Gfx::render(const std::shared_ptr<RenderTarget>& render_target) {
         return;
     }
 
-    // Update uniforms
-    for (auto it = renderer->dirty_framebuffer_uniforms_.begin();
-         it != renderer->dirty_framebuffer_uniforms_.end();) {
-        auto&&[attribute, mask] = *it;
-        commitFramebufferUniformBuffers(render_target, attribute, image_index);
-        mask |= (1 << image_index);
-        if (mask == (1 << image_count) - 1) {
-            it = renderer->dirty_framebuffer_uniforms_.erase(it);
-        } else {
-            ++it;
+    // Wait for image in flight (before updating its uniforms)
+    submission_tracker.wait(resources->images_in_flight[image_index]);
+
+    // Update uniforms: gather dirty uniforms of the image, copy them in one pass, then clear dirty state in bulk
+    const int image_mask = 1 << image_index;
+    const int all_images_mask = (1 << image_count) - 1;
+    auto& uniform_copies = resources->uniform_copies;
+    uniform_copies.clear();
+
+    auto& framebuffer_resources = resources->framebuffer_resources[image_index];
+    for (auto&&[attribute, mask] : renderer->dirty_framebuffer_uniforms_) {
+        if (mask & image_mask) {
+            continue;
+        }
+        mask |= image_mask;
+        auto cpu_it = renderer->uniform_buffers_.find(attribute);
+        if (cpu_it == renderer->uniform_buffers_.end() || !cpu_it->second->has_cpu_data()) {
+            continue;
+        }
+        for (auto&& gpu_uniform : framebuffer_resources.uniforms) {
+            if (gpu_uniform->description().attribute != attribute) {
+                continue;
+            }
+            auto* memory_resources = gpu_uniform->impl_->memory_resources.data();
+            auto* buffer_resources = gpu_uniform->impl_->resources.data();
+            if (!memory_resources || !buffer_resources || !buffer_resources->mapped) {
+                commitReferenceBuffer(cpu_it->second, gpu_uniform);
+                continue;
+            }
+            uniform_copies.emplace_back(
+                RenderTargetUniformCopy{
+                    .dst = buffer_resources->mapped,
+                    .src = cpu_it->second->data(),
+                    .size = cpu_it->second->data_size(),
+                    .allocation = &memory_resources->allocation,
+                    .offset = 0
+                }
+            );
+            gpu_uniform->has_gpu_data_ = true;
         }
     }
-    for (auto it = renderer->dirty_draw_command_uniforms_.begin();
-         it != renderer->dirty_draw_command_uniforms_.end();) {
-        auto&&[key, mask] = *it;
+
+    const auto& draw_commands = renderer->getDrawCommands();
+    for (auto&&[key, mask] : renderer->dirty_draw_command_uniforms_) {
+        if (mask & image_mask) {
+            continue;
+        }
+        mask |= image_mask;
         auto&&[draw_command_index, attribute] = key;
-        commitDrawCommandUniformBuffers(render_target, draw_command_index, attribute, image_index);
-        mask |= (1 << image_index);
-        if (mask == (1 << image_count) - 1) {
-            it = renderer->dirty_draw_command_uniforms_.erase(it);
-        } else {
-            ++it;
+        if (draw_command_index >= draw_commands.size() ||
+            draw_command_index >= resources->draw_command_resources.size() ||
+            image_index >= static_cast<int>(resources->uniform_arenas.size())) {
+            continue;
+        }
+        const auto& cpu_uniforms = draw_commands[draw_command_index]->uniform_buffers_;
+        auto cpu_it = cpu_uniforms.find(attribute);
+        if (cpu_it == cpu_uniforms.end() || !cpu_it->second->has_cpu_data()) {
+            continue;
+        }
+        auto& arena = resources->uniform_arenas[image_index];
+        for (auto&& uniform_range : resources->draw_command_resources[draw_command_index][image_index].uniform_ranges) {
+            if (uniform_range.attribute != attribute) {
+                continue;
+            }
+            uniform_copies.emplace_back(
+                RenderTargetUniformCopy{
+                    .dst = static_cast<char*>(arena.buffer_resources.mapped) + uniform_range.offset,
+                    .src = cpu_it->second->data(),
+                    .size = uniform_range.size,
+                    .allocation = &arena.memory_resources.allocation,
+                    .offset = uniform_range.offset
+                }
+            );
         }
     }
 
-    // Wait for image in flight
-    if (resources->images_in_flight[image_index]) {
-        result = logical_device_->impl_->vk_device.waitForFences(
-            { resources->images_in_flight[image_index] }, true, UINT64_MAX
-        );
-        if (result != vk::Result::eSuccess) {
-            logger().error("Wait for fence error: {}", vk::to_string(result));
-        }
+    auto& memory_allocator = *logical_device_->impl_->memory_allocator;
+    uint64_t uniform_bytes = 0;
+    for (auto&& uniform_copy : uniform_copies) {
+        std::memcpy(uniform_copy.dst, uniform_copy.src, uniform_copy.size);
+        memory_allocator.addFlushRange(*uniform_copy.allocation, uniform_copy.offset, uniform_copy.size);
+        uniform_bytes += uniform_copy.size;
+    }
+    render_target->frame_statistics_.uniform_copy_count = static_cast<uint32_t>(uniform_copies.size());
+    render_target->frame_statistics_.uniform_bytes = uniform_bytes;
+
+    // Write streaming vertex buffers to the copies read by this image only
+    uint64_t streaming_vertex_bytes = 0;
+    for (auto&& vertex_buffer : resources->streaming_vertex_buffers) {
+        streaming_vertex_bytes += impl_->updateStreamingCopy(vertex_buffer, static_cast<uint32_t>(image_index));
     }
+    render_target->frame_statistics_.streaming_vertex_bytes = streaming_vertex_bytes;
+
+    auto committed_to_all_images = [all_images_mask](const auto& dirty_uniform) {
+        return dirty_uniform.second == all_images_mask;
+    };
+    std::erase_if(renderer->dirty_framebuffer_uniforms_, committed_to_all_images);
+    std::erase_if(renderer->dirty_draw_command_uniforms_, committed_to_all_images);
 
     // Submit
-    auto wait_semaphores = std::array{ *resources->image_available_semaphores[resources->current_frame_index] };
-    auto wait_stages = std::array<vk::PipelineStageFlags, 1>{
+    auto wait_semaphores = std::vector{ *resources->image_available_semaphores[resources->current_frame_index] };
+    auto wait_stages = std::vector<vk::PipelineStageFlags>{
         vk::PipelineStageFlagBits::eColorAttachmentOutput
     };
-    auto command_buffers = std::array{ resources->command_buffers[image_index] }; // use copy (not raii)
-    auto signal_semaphores = std::array{ *resources->render_finished_semaphores[resources->current_frame_index] };
+    // Wait for uploads and compute submitted since the last frame of this render target
+    auto& upload_semaphores = resources->upload_semaphores[resources->current_frame_index];
+    impl_->waitPendingSignals(resources->waited_signal_submission_index, upload_semaphores);
+    for (auto&& semaphore : upload_semaphores) {
+        wait_semaphores.push_back(*semaphore);
+        wait_stages.emplace_back(
+            vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput |
+                vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader
+        );
+    }
 
-    auto fence = *resources->in_flight_fences[resources->current_frame_index];
-    resources->images_in_flight[image_index] = fence;
-    logical_device_->impl_->vk_device.resetFences({ fence });
+    if (resources->graphics_queue_index < 0) {
+        logger().error("Cannot render because no graphics queue has been assigned to render target.");
+        return;
+    }
+    vk::CommandBuffer command_buffer;
+    if (render_target->recording_mode() == recording_modes::per_frame) {
+        command_buffer = impl_->recordFrameCommandBuffer(*render_target, *resources, *renderer, static_cast<size_t>(image_index));
+    } else {
+        command_buffer = resources->command_buffers[image_index];
+        render_target->frame_statistics_.recorded_draw_command_count = 0;
+        render_target->frame_statistics_.record_microseconds = 0;
+        render_target->frame_statistics_.bind_statistics = {};
+    }
+    auto command_buffers = std::array{ command_buffer }; // use copy (not raii)
+    auto signal_semaphores = std::vector{ *resources->render_finished_semaphores[resources->current_frame_index] };
+
+    // Compute on another queue must not overwrite buffers this frame still reads
+    auto& logical_device_impl = *logical_device_->impl_;
+    QueueInfoRef compute_queue;
+    impl_->getComputeQueue(compute_queue);
+    bool signal_graphics_semaphore = logical_device_impl.compute_command_resources.size() > 0 &&
+        compute_queue.vk_queue != resources->queues[resources->graphics_queue_index].vk_queue;
+    if (signal_graphics_semaphore) {
+        if (logical_device_impl.graphics_semaphore) {
+            logical_device_impl.deletion_queue->retireAfter(
+                std::move(logical_device_impl.graphics_semaphore), logical_device_impl.graphics_semaphore_submission_index
+            );
+        }
+        logical_device_impl.graphics_semaphore = std::make_unique<vk::raii::Semaphore>(
+            logical_device_impl.vk_device.createSemaphore({})
+        );
+        signal_semaphores.push_back(**logical_device_impl.graphics_semaphore);
+    }
 
     auto submit_info = vk::SubmitInfo{
     }
@@ -461,12 +629,29 @@ void Gfx::render(const std::shared_ptr<RenderTarget>& render_target) {
         .setCommandBuffers(command_buffers)
         .setSignalSemaphores(signal_semaphores);
 
-    if (resources->graphics_queue_index >= 0) {
-        resources->queues[resources->graphics_queue_index].vk_queue.submit({ submit_info }, fence);
-    } else {
-        logger().error("Cannot render because no graphics queue has been assigned to render target.");
-        return;
+    // Make uniform writes to non-coherent memory visible to this submission
+    logical_device_->impl_->memory_allocator->flushMappedRanges();
+    // Frames share the submission timeline with uploads, so that released resources can be tracked by index
+    vk::Fence fence;
+    uint64_t submission_index = submission_tracker.beginSubmission(fence);
+    resources->in_flight_submission_indices[resources->current_frame_index] = submission_index;
+    resources->images_in_flight[image_index] = submission_index;
+    resources->last_used_submission_index = submission_index;
+    if (signal_graphics_semaphore) {
+        logical_device_impl.graphics_semaphore_submission_index = submission_index;
+    }
+    for (auto&& vertex_buffer : resources->streaming_vertex_buffers) {
+        auto& streaming_copies = vertex_buffer->impl_->streaming_copies;
+        if (!streaming_copies.empty()) {
+            streaming_copies[image_index % streaming_copies.size()].last_used_submission_index = submission_index;
+        }
+    }
+    for (auto&& uniform : resources->framebuffer_resources[image_index].uniforms) {
+        if (auto* uniform_resources = uniform->impl_->resources.data()) {
+            uniform_resources->last_used_submission_index = submission_index;
+        }
     }
+    resources->queues[resources->graphics_queue_index].vk_queue.submit({ submit_info }, fence);
 
     // Finish image
     render_target->finishImage(*this, image_index);
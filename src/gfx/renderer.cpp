@@ -3,8 +3,15 @@
 #include "common/logger.h"
 #include "gfx/gfx.h"
 #include "gfx-private.h"
+#include "gfx-allocator-private.h"
 #include "draw-command-private.h"
 
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <map>
+#include <tuple>
+
 namespace {
 
 [[nodiscard]] auto& logger() {
@@ -12,6 +19,9 @@ namespace {
     return *logger_;
 }
 
+constexpr vk::DeviceSize MinUniformArenaSize = 256;
+constexpr size_t MinDrawCommandsPerSlice = 64;
+
 } // unnamed namespace
 
 namespace wg {
@@ -65,15 +75,30 @@ void Renderer::markUniformDirty(
     }
 }
 
+void Renderer::setDrawCommandVisible(size_t draw_command_index, bool visible) {
+    if (draw_command_index >= draw_command_hidden_.size()) {
+        if (visible) {
+            return;
+        }
+        draw_command_hidden_.resize(draw_command_index + 1);
+    }
+    draw_command_hidden_[draw_command_index] = !visible;
+}
+
+void Renderer::setDrawCommandVisible(const std::shared_ptr<DrawCommand>& draw_command, bool visible) {
+    size_t draw_command_index = getDrawCommandIndex(draw_command);
+    if (draw_command_index != SIZE_MAX) {
+        setDrawCommandVisible(draw_command_index, visible);
+    }
+}
+
 void Gfx::submitDrawCommands(const std::shared_ptr<RenderTarget>& render_target) {
 
     if (!logical_device_) {
         logger().error("Cannot create submit draw commands because logical device is not available.");
         return;
     }
-    waitDeviceIdle();
 
-    auto[width, height] = render_target->extent();
     auto image_views = render_target->impl_->get_image_views();
     auto image_count = image_views.size();
     auto* resources = render_target->impl_->resources.data();
@@ -81,20 +106,143 @@ void Gfx::submitDrawCommands(const std::shared_ptr<RenderTarget>& render_target)
         logger().error("Cannot submit draw commands because render target resource has not been created.");
         return;
     }
+    // Command buffers are re-recorded, so wait for frames of this render target only
+    logical_device_->impl_->submission_tracker->wait(resources->last_used_submission_index);
     if (image_count != resources->framebuffer_resources.size()) {
         logger().error("Cannot submit draw commands because image count does not match framebuffer count.");
         return;
     }
 
     auto draw_commands_ = render_target->renderer()->getDrawCommands();
+
+    // Recreate draw command resources from scratch
+    resources->draw_command_resources.clear();
+    resources->shared_descriptor_sets.clear();
+    // Kept until new resources are created, so that unchanged pipelines are found in the pipeline cache
+    auto previous_pipeline_resources = std::move(resources->pipeline_resources);
+    resources->pipeline_resources.clear();
+    resources->pending_pipeline_count = 0;
+
+    // Draw command uniforms of all draw commands are packed into one arena per image
+    vk::DeviceSize uniform_arena_capacity = MinUniformArenaSize;
+    for (auto&& draw_command : draw_commands_) {
+        for (auto&&[attribute, uniform_buffer] : draw_command->uniform_buffers_) {
+            if (IsDynamicUniform(attribute)) {
+                uniform_arena_capacity += AlignUp(uniform_buffer->data_size(), resources->uniform_arena_alignment);
+            }
+        }
+    }
+    if (uniform_arena_capacity > resources->uniform_arena_capacity) {
+        impl_->createUniformArenas(*resources, uniform_arena_capacity);
+    }
+    resources->uniform_arena_size = 0;
+
+    resources->streaming_vertex_buffers.clear();
     for (auto&& draw_command : draw_commands_) {
         createDrawCommandResourcesForRenderTarget(render_target, draw_command);
+        for (auto&& vertex_buffer : draw_command->vertex_buffers()) {
+            if (vertex_buffer->streaming_copy_count() > 0 &&
+                std::find(resources->streaming_vertex_buffers.begin(), resources->streaming_vertex_buffers.end(), vertex_buffer) ==
+                resources->streaming_vertex_buffers.end()) {
+                resources->streaming_vertex_buffers.emplace_back(vertex_buffer);
+            }
+        }
     }
 
+    resources->submitted_draw_commands = draw_commands_;
+    resources->changed_draw_commands_reported = false;
+    Impl::UpdateDrawSortStateKeys(*resources, draw_commands_);
+
     // Record commands
+    impl_->recordCommandBuffers(*render_target, *resources);
+}
+
+void Gfx::Impl::recordCommandBuffers(RenderTarget& render_target, RenderTargetResources& resources) {
+    auto [width, height] = render_target.extent();
+    auto image_count = resources.framebuffer_resources.size();
+    const auto& renderer = *render_target.renderer();
+    const auto& draw_commands = renderer.getDrawCommands();
+    resources.command_buffers_recorded = false;
+    if (render_target.recording_mode() == recording_modes::per_frame) {
+        // Recorded by render, which does not need command buffers of images and slices
+        resources.recording_slices.clear();
+        render_target.record_statistics_ = {};
+        return;
+    }
+    auto record_begin_time = std::chrono::steady_clock::now();
+    auto extent = vk::Extent2D{ static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+    buildDrawOrder(resources, renderer, draw_commands);
+    const auto& draw_order = resources.draw_order;
+
+    // Slices are only worth their secondary command buffers with enough draw commands each
+    auto thread_count = static_cast<size_t>(std::max(gfx->setup_.recording_thread_count, 1));
+    auto slice_count = std::min(thread_count, (draw_order.size() + MinDrawCommandsPerSlice - 1) / MinDrawCommandsPerSlice);
+    // bind_statistics[slice_index] of image 0
+    std::vector<RenderTargetBindStatistics> bind_statistics(std::max<size_t>(slice_count, 1));
+    if (slice_count > 1 && resources.graphics_queue_index >= 0) {
+        if (!recording_workers || recording_workers->thread_count() != thread_count) {
+            recording_workers = std::make_unique<GfxWorkerPool>(static_cast<uint32_t>(thread_count));
+        }
+        if (resources.recording_slices.size() != slice_count ||
+            resources.recording_slices[0].command_buffers.size() != image_count) {
+            resources.recording_slices.clear();
+            resources.recording_slices.resize(slice_count);
+            for (auto&& recording_slice : resources.recording_slices) {
+                recording_slice.command_pool = gfx->logical_device_->impl_->vk_device.createCommandPool(
+                    vk::CommandPoolCreateInfo{
+                        .queueFamilyIndex = resources.queues[resources.graphics_queue_index].queue_family_index
+                    }
+                );
+                auto command_buffer_allocate_info = vk::CommandBufferAllocateInfo{
+                    .commandPool        = *recording_slice.command_pool,
+                    .level              = vk::CommandBufferLevel::eSecondary,
+                    .commandBufferCount = static_cast<uint32_t>(image_count)
+                };
+                recording_slice.command_buffers =
+                    (*gfx->logical_device_->impl_->vk_device).allocateCommandBuffers(command_buffer_allocate_info);
+            }
+        } else {
+            // Previous frames of this render target have finished, so all secondary command buffers can be reset at once
+            for (auto&& recording_slice : resources.recording_slices) {
+                recording_slice.command_pool.reset();
+            }
+        }
+
+        recording_workers->parallelFor(
+            slice_count, [&draw_commands, &draw_order, &bind_statistics, &resources, image_count, slice_count](size_t slice_index) {
+                auto& recording_slice = resources.recording_slices[slice_index];
+                size_t begin = draw_order.size() * slice_index / slice_count;
+                size_t end = draw_order.size() * (slice_index + 1) / slice_count;
+                for (size_t i = 0; i < image_count; ++i) {
+                    auto command_buffer = recording_slice.command_buffers[i];
+                    auto inheritance_info = vk::CommandBufferInheritanceInfo{
+                        .renderPass  = **resources.render_pass,
+                        .subpass     = 0,
+                        .framebuffer = *resources.framebuffer_resources[i].framebuffer
+                    };
+                    command_buffer.begin(
+                        {
+                            .flags            = vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+                            .pInheritanceInfo = &inheritance_info,
+                        }
+                    );
+                    RenderTargetBindStatistics image_bind_statistics;
+                    Impl::RecordDrawCommands(
+                        resources, draw_commands, command_buffer, i, begin, end, image_bind_statistics
+                    );
+                    if (i == 0) {
+                        bind_statistics[slice_index] = image_bind_statistics;
+                    }
+                    command_buffer.end();
+                }
+            }
+        );
+    } else {
+        resources.recording_slices.clear();
+    }
+
     for (size_t i = 0; i < image_count; i++) {
-        auto& framebuffer_resources = resources->framebuffer_resources[i];
-        auto command_buffer = framebuffer_resources.command_buffer;
+        auto command_buffer = resources.framebuffer_resources[i].command_buffer;
 
         command_buffer.begin(
             {
@@ -103,66 +251,327 @@ void Gfx::submitDrawCommands(const std::shared_ptr<RenderTarget>& render_target)
             }
         );
 
-        auto clear_values = std::array{
-            vk::ClearValue{
-                .color = { .float32 = std::array{ 0.f, 0.f, 0.f, 1.f } }
-            },
-            vk::ClearValue{
-                .depthStencil = { .depth  = 1.f, .stencil = 0 }
+        if (resources.recording_slices.empty()) {
+            Impl::BeginRenderPass(resources, command_buffer, i, extent, vk::SubpassContents::eInline);
+            RenderTargetBindStatistics image_bind_statistics;
+            Impl::RecordDrawCommands(resources, draw_commands, command_buffer, i, 0, draw_order.size(), image_bind_statistics);
+            if (i == 0) {
+                bind_statistics[0] = image_bind_statistics;
             }
-        };
-        auto render_pass_begin_info = vk::RenderPassBeginInfo{
-            .renderPass  = *resources->render_pass,
-            .framebuffer = *resources->framebuffer_resources[i].framebuffer,
-            .renderArea  = {
-                .offset  = { 0, 0 },
-                .extent  = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) }
+        } else {
+            Impl::BeginRenderPass(resources, command_buffer, i, extent, vk::SubpassContents::eSecondaryCommandBuffers);
+            std::vector<vk::CommandBuffer> secondary_command_buffers;
+            for (auto&& recording_slice : resources.recording_slices) {
+                secondary_command_buffers.push_back(recording_slice.command_buffers[i]);
             }
+            command_buffer.executeCommands(secondary_command_buffers);
         }
-            .setClearValues(clear_values);
 
-        command_buffer.beginRenderPass(render_pass_begin_info, vk::SubpassContents::eInline);
+        command_buffer.endRenderPass();
+        command_buffer.end();
+    }
+    resources.command_buffers_recorded = true;
 
-        for (size_t j = 0; j < draw_commands_.size(); ++j) {
-            const auto& draw_command = draw_commands_[j];
-            const auto& draw_command_resources = resources->draw_command_resources[j][i];
+    render_target.record_statistics_ = {
+        .thread_count = static_cast<uint32_t>(resources.recording_slices.empty() ? 1 : slice_count),
+        .secondary_command_buffer_count = static_cast<uint32_t>(resources.recording_slices.size() * image_count),
+        .record_microseconds = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - record_begin_time).count()
+        )
+    };
+    for (auto&& slice_bind_statistics : bind_statistics) {
+        render_target.record_statistics_.bind_statistics += slice_bind_statistics;
+    }
+}
 
-            if (draw_command_resources.descriptor_set) {
+bool Gfx::Impl::resolvePendingPipelines(RenderTargetResources& resources) {
+    if (resources.pending_pipeline_count == 0) {
+        return false;
+    }
+    bool resolved = false;
+    for (auto&& pipeline_resources : resources.pipeline_resources) {
+        auto& pending_pipeline = pipeline_resources.pending_pipeline;
+        if (!pending_pipeline.valid() || pending_pipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            continue;
+        }
+        auto pipeline = pending_pipeline.get();
+        pending_pipeline = {};
+        --resources.pending_pipeline_count;
+        if (!pipeline) {
+            // Failed to compile, keep drawing with the fallback pipeline
+            continue;
+        }
+        // Frames in flight may still use the fallback pipeline
+        if (pipeline_resources.pipeline) {
+            gfx->logical_device_->impl_->deletion_queue->retireAfter(
+                std::make_unique<std::shared_ptr<vk::raii::Pipeline>>(std::move(pipeline_resources.pipeline)),
+                resources.last_used_submission_index
+            );
+        }
+        pipeline_resources.pipeline = std::move(pipeline);
+        for (auto&& draw_command_resources : resources.draw_command_resources[pipeline_resources.draw_command_index]) {
+            draw_command_resources.pipeline = **pipeline_resources.pipeline;
+        }
+        resolved = true;
+    }
+    return resolved;
+}
+
+void Gfx::Impl::BeginRenderPass(
+    const RenderTargetResources& resources, vk::CommandBuffer command_buffer, size_t image_index,
+    vk::Extent2D extent, vk::SubpassContents contents
+) {
+    auto clear_values = std::array{
+        vk::ClearValue{
+            .color = { .float32 = std::array{ 0.f, 0.f, 0.f, 1.f } }
+        },
+        vk::ClearValue{
+            .depthStencil = { .depth  = 1.f, .stencil = 0 }
+        }
+    };
+    auto render_pass_begin_info = vk::RenderPassBeginInfo{
+        .renderPass  = **resources.render_pass,
+        .framebuffer = *resources.framebuffer_resources[image_index].framebuffer,
+        .renderArea  = {
+            .offset  = { 0, 0 },
+            .extent  = extent
+        }
+    }
+        .setClearValues(clear_values);
+
+    command_buffer.beginRenderPass(render_pass_begin_info, contents);
+}
+
+void Gfx::Impl::UpdateDrawSortStateKeys(
+    RenderTargetResources& resources, const std::vector<std::shared_ptr<DrawCommand>>& draw_commands
+) {
+    // Ids in order of first use, so that unsorted draw commands keep their order as far as possible
+    std::map<VkPipeline, uint32_t> pipeline_ids;
+    std::map<VkDescriptorSet, uint32_t> material_ids;
+    std::map<std::pair<VkBuffer, VkBuffer>, uint32_t> mesh_ids;
+    auto get_id = [](auto& ids, const auto& key) {
+        return ids.try_emplace(key, static_cast<uint32_t>(ids.size())).first->second;
+    };
+
+    resources.draw_sort_state_keys.resize(resources.draw_command_resources.size());
+    for (size_t j = 0; j < resources.draw_command_resources.size(); ++j) {
+        if (resources.draw_command_resources[j].empty()) {
+            resources.draw_sort_state_keys[j] = 0;
+            continue;
+        }
+        // Descriptor sets of all images are created in the same order, so image 0 represents all images
+        const auto& draw_command_resources = resources.draw_command_resources[j][0];
+        const auto* draw_command_impl = draw_commands[j]->getImpl();
+        VkBuffer first_vertex_buffer = draw_command_impl->vertex_buffers.empty() ? VK_NULL_HANDLE :
+            static_cast<VkBuffer>(draw_command_impl->vertex_buffers[0]);
+        resources.draw_sort_state_keys[j] = MakeDrawSortStateKey(
+            get_id(pipeline_ids, static_cast<VkPipeline>(draw_command_resources.pipeline)),
+            get_id(material_ids, static_cast<VkDescriptorSet>(draw_command_resources.descriptor_set)),
+            get_id(mesh_ids, std::make_pair(first_vertex_buffer, static_cast<VkBuffer>(draw_command_impl->index_buffer)))
+        );
+    }
+}
+
+void Gfx::Impl::buildDrawOrder(
+    RenderTargetResources& resources, const Renderer& renderer, const std::vector<std::shared_ptr<DrawCommand>>& draw_commands
+) {
+    // Draw commands added, removed or reordered after the last submitDrawCommands have no resources at their indices
+    size_t draw_command_count = std::min(draw_commands.size(), resources.submitted_draw_commands.size());
+    bool draw_commands_changed = draw_commands.size() != resources.submitted_draw_commands.size();
+    for (size_t j = 0; j < draw_command_count && !draw_commands_changed; ++j) {
+        draw_commands_changed = draw_commands[j] != resources.submitted_draw_commands[j];
+    }
+    if (draw_commands_changed && !resources.changed_draw_commands_reported) {
+        logger().warn("Draw commands of renderer changed without Gfx::submitDrawCommands, skipping changed draw commands.");
+        resources.changed_draw_commands_reported = true;
+    }
+    // Draw commands whose pipeline is compiled in background without a fallback pipeline are skipped
+    auto drawable = [&resources, &renderer, &draw_commands](size_t j) {
+        return draw_commands[j] == resources.submitted_draw_commands[j] && renderer.draw_command_visible(j) &&
+            !resources.draw_command_resources[j].empty() && resources.draw_command_resources[j][0].pipeline;
+    };
+    auto& draw_order = resources.draw_order;
+    draw_order.clear();
+    if (!gfx->setup_.sort_draw_commands) {
+        for (size_t j = 0; j < draw_command_count; ++j) {
+            if (drawable(j)) {
+                draw_order.push_back(static_cast<uint32_t>(j));
+            }
+        }
+        return;
+    }
+
+    auto& draw_sort_items = resources.draw_sort_items;
+    draw_sort_items.clear();
+    for (size_t j = 0; j < draw_command_count; ++j) {
+        if (drawable(j)) {
+            const auto& draw_command = draw_commands[j];
+            draw_sort_items.emplace_back(
+                GfxDrawSortItem{
+                    .key = MakeDrawSortKey(resources.draw_sort_state_keys[j], draw_command->render_layer(), draw_command->sort_depth()),
+                    .index = static_cast<uint32_t>(j)
+                }
+            );
+        }
+    }
+    RadixSortDrawSortItems(draw_sort_items, resources.draw_sort_scratch);
+    for (auto&& item : draw_sort_items) {
+        draw_order.push_back(item.index);
+    }
+}
+
+void Gfx::Impl::RecordDrawCommands(
+    const RenderTargetResources& resources, const std::vector<std::shared_ptr<DrawCommand>>& draw_commands,
+    vk::CommandBuffer command_buffer, size_t image_index, size_t begin, size_t end,
+    RenderTargetBindStatistics& bind_statistics
+) {
+    const auto& framebuffer_resources = resources.framebuffer_resources[image_index];
+    // State bound to the command buffer, so that binding the same state again can be skipped
+    vk::Pipeline bound_pipeline;
+    vk::PipelineLayout bound_pipeline_layout;
+    vk::DescriptorSet bound_descriptor_set;
+    const std::vector<uint32_t>* bound_dynamic_offsets = nullptr;
+    // <offset, size, data> of push constants pushed with bound_pipeline_layout
+    std::vector<std::tuple<uint32_t, uint32_t, const void*>> pushed_constants;
+    // Draw commands in the same geometry pool reuse buffer bindings.
+    DrawCommandBufferBindings buffer_bindings;
+
+    for (size_t k = begin; k < end; ++k) {
+        size_t j = resources.draw_order[k];
+        const auto& draw_command = draw_commands[j];
+        const auto& draw_command_resources = resources.draw_command_resources[j][image_index];
+
+        // Binding another pipeline layout may disturb descriptor sets and push constants
+        if (draw_command_resources.pipeline_layout != bound_pipeline_layout) {
+            bound_pipeline_layout = draw_command_resources.pipeline_layout;
+            bound_descriptor_set = nullptr;
+            bound_dynamic_offsets = nullptr;
+            pushed_constants.clear();
+        }
+
+        if (draw_command_resources.descriptor_set) {
+            if (draw_command_resources.descriptor_set != bound_descriptor_set || !bound_dynamic_offsets ||
+                *bound_dynamic_offsets != draw_command_resources.dynamic_offsets) {
                 command_buffer.bindDescriptorSets(
                     vk::PipelineBindPoint::eGraphics,
-                    draw_command_resources.pipeline_layout, 0, { draw_command_resources.descriptor_set }, {}
+                    draw_command_resources.pipeline_layout, 0, { draw_command_resources.descriptor_set },
+                    draw_command_resources.dynamic_offsets
                 );
+                bound_descriptor_set = draw_command_resources.descriptor_set;
+                bound_dynamic_offsets = &draw_command_resources.dynamic_offsets;
+                ++bind_statistics.descriptor_set_binds;
+            } else {
+                ++bind_statistics.descriptor_set_binds_skipped;
             }
+        }
+        if (draw_command_resources.pipeline != bound_pipeline) {
             command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, draw_command_resources.pipeline);
+            bound_pipeline = draw_command_resources.pipeline;
+            ++bind_statistics.pipeline_binds;
+        } else {
+            ++bind_statistics.pipeline_binds_skipped;
+        }
 
-            // push constants
-            for (auto&& description : draw_command_resources.push_constant_descriptions) {
-                const void* push_constant_data = [&description, &framebuffer_resources, &draw_command_resources]() -> const void* {
-                    for (const auto& push_constant : draw_command_resources.push_constants) {
-                        if (description.attribute == push_constant->description().attribute) {
-                            return push_constant->data();
-                        }
+        // push constants
+        for (auto&& description : draw_command_resources.push_constant_descriptions) {
+            const void* push_constant_data = [&description, &framebuffer_resources, &draw_command_resources]() -> const void* {
+                for (const auto& push_constant : draw_command_resources.push_constants) {
+                    if (description.attribute == push_constant->description().attribute) {
+                        return push_constant->data();
                     }
-                    for (const auto& push_constant : framebuffer_resources.push_constants) {
-                        if (description.attribute == push_constant->description().attribute) {
-                            return push_constant->data();
-                        }
+                }
+                for (const auto& push_constant : framebuffer_resources.push_constants) {
+                    if (description.attribute == push_constant->description().attribute) {
+                        return push_constant->data();
                     }
-                    return nullptr;
-                }();
-                if (push_constant_data) {
-                    command_buffer.pushConstants(
-                        draw_command_resources.pipeline_layout, GetShaderStageFlags(description.stages),
-                        description.push_constant_offset, description.push_constant_size, push_constant_data
-                    );
                 }
+                return nullptr;
+            }();
+            if (!push_constant_data) {
+                continue;
             }
-            draw_command->getImpl()->draw(command_buffer);
+            // Data is read while recording, so the same data pointer means the same values.
+            auto pushed_constant = std::make_tuple(description.push_constant_offset, description.push_constant_size, push_constant_data);
+            if (std::find(pushed_constants.begin(), pushed_constants.end(), pushed_constant) != pushed_constants.end()) {
+                ++bind_statistics.push_constant_updates_skipped;
+                continue;
+            }
+            command_buffer.pushConstants(
+                draw_command_resources.pipeline_layout, GetShaderStageFlags(description.stages),
+                description.push_constant_offset, description.push_constant_size, push_constant_data
+            );
+            // Drop pushed ranges overlapped by this one
+            std::erase_if(pushed_constants, [&description](const auto& pushed) {
+                auto [offset, size, data] = pushed;
+                return offset < description.push_constant_offset + description.push_constant_size &&
+                    description.push_constant_offset < offset + size;
+            });
+            pushed_constants.push_back(pushed_constant);
+            ++bind_statistics.push_constant_updates;
+        }
+        if (draw_command->getImpl()->bindBuffers(command_buffer, buffer_bindings, image_index)) {
+            ++bind_statistics.buffer_binds;
+        } else {
+            ++bind_statistics.buffer_binds_skipped;
         }
+        draw_command->getImpl()->draw(command_buffer);
+    }
+}
 
-        command_buffer.endRenderPass();
-        command_buffer.end();
+vk::CommandBuffer Gfx::Impl::recordFrameCommandBuffer(
+    RenderTarget& render_target, RenderTargetResources& resources, const Renderer& renderer, size_t image_index
+) {
+    auto& logical_device_impl = *gfx->logical_device_->impl_;
+    if (resources.frame_command_pools.empty()) {
+        for (int i = 0; i < resources.max_frames_in_flight; ++i) {
+            auto& command_pool = resources.frame_command_pools.emplace_back(
+                logical_device_impl.vk_device.createCommandPool(
+                    vk::CommandPoolCreateInfo{
+                        .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+                        .queueFamilyIndex = resources.queues[resources.graphics_queue_index].queue_family_index
+                    }
+                )
+            );
+            auto command_buffer_allocate_info = vk::CommandBufferAllocateInfo{
+                .commandPool        = *command_pool,
+                .level              = vk::CommandBufferLevel::ePrimary,
+                .commandBufferCount = 1
+            };
+            resources.frame_command_buffers.push_back(
+                (*logical_device_impl.vk_device).allocateCommandBuffers(command_buffer_allocate_info)[0]
+            );
+        }
     }
+
+    auto record_begin_time = std::chrono::steady_clock::now();
+    // The last submission of this frame in flight has finished
+    resources.frame_command_pools[resources.current_frame_index].reset();
+    auto command_buffer = resources.frame_command_buffers[resources.current_frame_index];
+    command_buffer.begin(
+        {
+            .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit
+        }
+    );
+
+    auto [width, height] = render_target.extent();
+    BeginRenderPass(
+        resources, command_buffer, image_index,
+        vk::Extent2D{ static_cast<uint32_t>(width), static_cast<uint32_t>(height) }, vk::SubpassContents::eInline
+    );
+    const auto& draw_commands = renderer.getDrawCommands();
+    // Visibility and depths may change every frame
+    buildDrawOrder(resources, renderer, draw_commands);
+    RenderTargetBindStatistics bind_statistics;
+    RecordDrawCommands(resources, draw_commands, command_buffer, image_index, 0, resources.draw_order.size(), bind_statistics);
+    render_target.frame_statistics_.recorded_draw_command_count = static_cast<uint32_t>(resources.draw_order.size());
+    render_target.frame_statistics_.bind_statistics = bind_statistics;
+    command_buffer.endRenderPass();
+    command_buffer.end();
+
+    render_target.frame_statistics_.record_microseconds = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - record_begin_time).count()
+    );
+    return command_buffer;
 }
 
 void Gfx::commitFramebufferUniformBuffers(
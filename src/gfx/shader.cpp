@@ -68,7 +68,6 @@ void Gfx::createShaderResources(const std::shared_ptr<Shader>& shader) {
     if (!logical_device_) {
         logger().error("Cannot create shader resources because logical device is not available.");
     }
-    waitDeviceIdle();
 
     if (!shader->loaded()) {
         logger().warn("Skip creating shader resources because shader \"{}\" is not loaded.", shader->filename());
@@ -3,8 +3,10 @@
 
 #include <fmt/format.h>
 #include <filesystem>
+#include <vector>
 
 #include "common/config.h"
+#include "common/owned-resources.h"
 
 TEST_CASE("config") {
 
@@ -195,4 +197,32 @@ TEST_CASE("engine config") {
 
     CHECK_EQ(config.get<bool>("gfx-separate-transfer"), true);
     CHECK_EQ(config.get<float>("gfx-max-sampler-anisotropy"), 8.0);
-}
\ No newline at end of file
+}
+
+TEST_CASE("owned resources") {
+    wg::OwnedResources<int> resources;
+    std::vector<std::unique_ptr<int>> released;
+
+    SUBCASE("destroy") {
+        auto handle = resources.store(std::make_unique<int>(1));
+        CHECK_EQ(*handle.data(), 1);
+        CHECK_EQ(resources.size(), 1);
+        handle.reset();
+        CHECK_EQ(resources.size(), 0);
+    }
+
+    SUBCASE("deferred") {
+        resources.setOnRelease([&released](std::unique_ptr<int>&& resource) {
+            released.emplace_back(std::move(resource));
+        });
+        auto handle1 = resources.store(std::make_unique<int>(1));
+        auto handle2 = resources.store(std::make_unique<int>(2));
+        auto weak_handle = wg::OwnedResourceWeakHandle<int>(handle1);
+        handle1.reset();
+        CHECK_EQ(resources.size(), 1);
+        CHECK_EQ(weak_handle.data(), nullptr);
+        REQUIRE_EQ(released.size(), 1);
+        CHECK_EQ(*released[0], 1);
+        CHECK_EQ(*handle2.data(), 2);
+    }
+}
@@ -12,14 +12,22 @@
 #include "engine/scene-renderer.h"
 #include "engine/texture.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <filesystem>
 #include <fstream>
+#include <limits>
+#include <random>
 
 struct LocalPacked {
     static std::vector<uint8_t> vert_shader;
     static std::vector<uint8_t> frag_shader;
+    static std::vector<uint8_t> instanced_vert_shader;
     static std::vector<uint8_t> grid_vert_shader;
     static std::vector<uint8_t> grid_frag_shader;
+    static std::vector<uint8_t> cull_shader;
     static std::vector<uint8_t> image;
     static std::vector<uint8_t> model;
 
@@ -53,12 +61,16 @@ TEST_CASE("gfx engine" * doctest::timeout(10)) {
     std::filesystem::create_directories("shader");
     LocalPacked::write(LocalPacked::vert_shader, "shader/simple.vert.spv");
     LocalPacked::write(LocalPacked::frag_shader, "shader/simple.frag.spv");
+    LocalPacked::write(LocalPacked::instanced_vert_shader, "shader/simple-instanced.vert.spv");
     LocalPacked::write(LocalPacked::grid_vert_shader, "shader/grid.vert.spv");
     LocalPacked::write(LocalPacked::grid_frag_shader, "shader/grid.frag.spv");
+    LocalPacked::write(LocalPacked::cull_shader, "shader/frustum-cull.comp.spv");
     CHECK(std::filesystem::exists("shader/simple.vert.spv"));
     CHECK(std::filesystem::exists("shader/simple.frag.spv"));
+    CHECK(std::filesystem::exists("shader/simple-instanced.vert.spv"));
     CHECK(std::filesystem::exists("shader/grid.vert.spv"));
     CHECK(std::filesystem::exists("shader/grid.frag.spv"));
+    CHECK(std::filesystem::exists("shader/frustum-cull.comp.spv"));
 
     // img
     std::filesystem::create_directories("resources");
@@ -98,6 +110,16 @@ TEST_CASE("gfx engine" * doctest::timeout(10)) {
     );
     render_data.emplace_back(grid_material->createRenderData());
 
+    auto instanced_material = wg::Material::Create(
+        "instanced material",
+        "shader/simple.vert.spv", "shader/simple.frag.spv"
+    );
+    instanced_material->addTexture(texture);
+    instanced_material->setInstancedVertShader("shader/simple-instanced.vert.spv");
+    render_data.emplace_back(instanced_material->createRenderData());
+    CHECK(instanced_material->render_data()->instanced_pipeline.get());
+    CHECK(!material->render_data()->instanced_pipeline.get());
+
     auto quad_vertices = std::vector<wg::SimpleVertex>{
         { .position = { -0.5f, -0.5f, 0.f }, .color = { 1.f, 0.f, 0.f }, .tex_coord = { 0.f, 1.f } },
         { .position = { 0.5f, -0.5f, 0.f }, .color = { 0.f, 1.f, 0.f }, .tex_coord = { 1.f, 1.f } },
@@ -106,15 +128,27 @@ TEST_CASE("gfx engine" * doctest::timeout(10)) {
         { .position = { -0.5f, 0.5f, 0.f }, .color = { 1.f, 1.f, 0.f }, .tex_coord = { 0.f, 0.f } },
         { .position = { -0.5f, -0.5f, 0.f }, .color = { 1.f, 0.f, 0.f }, .tex_coord = { 0.f, 1.f } },
     };
+    auto geometry_pool = wg::GeometryPool::Create(sizeof(wg::SimpleVertex), 4096, 16384);
     auto quad_mesh = wg::Mesh::CreateFromVertices("quad", quad_vertices);
+    quad_mesh->setGeometryPool(geometry_pool);
     render_data.emplace_back(quad_mesh->createRenderData());
     CHECK(quad_mesh->render_data()->vertex_buffer.get());
     CHECK(quad_mesh->render_data()->vertex_buffer->has_cpu_data());
     CHECK(!quad_mesh->render_data()->vertex_buffer->has_gpu_data());
     CHECK(!quad_mesh->render_data()->index_buffer.get());
+    CHECK(quad_mesh->bounding_box().min == glm::vec3(-0.5f, -0.5f, 0.f));
+    CHECK(quad_mesh->bounding_box().max == glm::vec3(0.5f, 0.5f, 0.f));
+    CHECK(glm::all(glm::epsilonEqual(quad_mesh->bounding_sphere(), glm::vec4(0.f, 0.f, 0.f, std::sqrt(0.5f)), 1e-5f)));
+    CHECK(quad_mesh->render_data()->bounding_sphere == quad_mesh->bounding_sphere());
 
-    auto bunny_mesh = wg::Mesh::CreateFromObjFile("bunny", "resources/model.obj");
+    auto bunny_mesh = wg::Mesh::CreateFromObjFile("bunny", "resources/model.obj", 3);
+    REQUIRE_EQ(bunny_mesh->lods().size(), 3);
+    bunny_mesh->setGeometryPool(geometry_pool);
+    bunny_mesh->setOptimization(true);
+    bunny_mesh->setOverdrawOptimization(true);
     render_data.emplace_back(bunny_mesh->createRenderData());
+    CHECK(bunny_mesh->optimized());
+    CHECK_LE(bunny_mesh->optimization_statistics().after.acmr, bunny_mesh->optimization_statistics().before.acmr);
     CHECK(bunny_mesh->render_data()->vertex_buffer.get());
     CHECK(bunny_mesh->render_data()->vertex_buffer->has_cpu_data());
     CHECK(!bunny_mesh->render_data()->vertex_buffer->has_gpu_data());
@@ -145,6 +179,21 @@ TEST_CASE("gfx engine" * doctest::timeout(10)) {
     CHECK(!bunny_component->render_data()->draw_commands.empty());
     CHECK(bunny_component->render_data()->draw_commands[0].get());
     CHECK(bunny_component->render_data()->draw_commands[0]->valid());
+    CHECK_EQ(bunny_component->render_data()->draw_commands[0]->index_count(), bunny_mesh->lods()[0].index_count);
+
+    std::vector<std::shared_ptr<wg::MeshComponent>> instanced_components;
+    for (int i = 0; i < 16; ++i) {
+        auto component = wg::MeshComponent::Create(fmt::format("instanced bunny {}", i));
+        component->setTransform(
+            wg::Transform{
+                .transform = glm::translate(glm::mat4(1.0f), glm::vec3(static_cast<float>(i % 4) - 1.5f, static_cast<float>(i / 4) - 1.5f, 0.0f))
+            }
+        );
+        component->setMaterial(instanced_material);
+        component->setMesh(bunny_mesh);
+        render_data.emplace_back(component->createRenderData());
+        instanced_components.push_back(component);
+    }
 
     auto render_target = gfx->createRenderTarget(window);
 
@@ -153,16 +202,52 @@ TEST_CASE("gfx engine" * doctest::timeout(10)) {
     renderer->setRenderTarget(render_target);
     renderer->addComponent(bunny_component);
     renderer->addComponent(quad_component);
+    for (auto&& component : instanced_components) {
+        renderer->addComponent(component);
+    }
     render_data.emplace_back(renderer->createRenderData());
     CHECK_EQ(renderer->render_data()->weak_render_target.lock(), render_target);
     CHECK(renderer->render_data()->camera_uniform_buffer.get());
     CHECK(renderer->render_data()->camera_uniform_buffer->has_cpu_data());
     CHECK(!renderer->render_data()->camera_uniform_buffer->has_gpu_data());
     CHECK(renderer->valid());
+    REQUIRE_EQ(renderer->render_data()->instance_batches.size(), 1);
+    CHECK_EQ(renderer->render_data()->instance_batches[0].components.size(), instanced_components.size());
+    CHECK_EQ(renderer->render_data()->batched_components.size(), instanced_components.size());
+    CHECK_EQ(renderer->getDrawCommands().size(), 3);
+    CHECK_EQ(renderer->render_data()->component_bounds.size(), 2 + instanced_components.size());
 
     for (auto&& data : render_data) {
         data->createGfxResources(*gfx);
     }
+    CHECK(geometry_pool->has_gpu_resources());
+    CHECK_EQ(geometry_pool->range_count(), 3);
+    CHECK_EQ(geometry_pool->used_vertex_count(), quad_vertices.size() + bunny_mesh->vertices().size());
+    CHECK_EQ(geometry_pool->used_index_count(), bunny_mesh->indices().size());
+    auto instanced_draw_command = renderer->render_data()->instance_batches[0].draw_command;
+    CHECK(instanced_draw_command->valid());
+    CHECK_EQ(instanced_draw_command->vertex_count(), bunny_mesh->vertices().size());
+    CHECK_EQ(instanced_draw_command->instance_count(), instanced_components.size());
+    CHECK_EQ(instanced_draw_command->draw_instance_count(), instanced_components.size());
+    CHECK_EQ(instanced_draw_command->index_count(), bunny_mesh->lods()[0].index_count);
+    // Every column of inInstanceModel (locations 4 to 7) is fed per instance by the instance buffer
+    size_t instance_location_count = 0;
+    for (auto&& description : instanced_draw_command->pipeline()->vertex_factory().descriptions()) {
+        if (description.location < 4) {
+            continue;
+        }
+        ++instance_location_count;
+        bool per_instance = false;
+        for (auto&& vertex_buffer : instanced_draw_command->vertex_buffers()) {
+            for (auto&& buffer_description : vertex_buffer->descriptions()) {
+                if (buffer_description.attribute == description.attribute) {
+                    per_instance = buffer_description.per_instance;
+                }
+            }
+        }
+        CHECK(per_instance);
+    }
+    CHECK_EQ(instance_location_count, 4);
 
     gfx->render(render_target);
     app->wait();
@@ -179,6 +264,53 @@ TEST_CASE("gfx engine" * doctest::timeout(10)) {
     );
     renderer->updateComponentTransform(quad_component);
     renderer->updateComponentTransform(bunny_component);
+    instanced_components[0]->setTransform(
+        wg::Transform{
+            .transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 1.0f))
+        }
+    );
+    renderer->updateComponentTransform(instanced_components[0]);
+    auto* instance_transforms = static_cast<const wg::InstanceTransform*>(renderer->render_data()->instance_batches[0].instance_buffer->data());
+    CHECK(instance_transforms[0].model_mat == instanced_components[0]->transform().transform);
+
+    gfx->render(render_target);
+
+    renderer->cullComponents();
+    CHECK_EQ(renderer->culling_statistics().visible_component_count, 2 + instanced_components.size());
+    CHECK_EQ(renderer->culling_statistics().culled_component_count, 0);
+    // Camera at distance sqrt(50) from the origin, looking at it
+    auto bunny_sort_depth = bunny_component->render_data()->draw_commands[0]->sort_depth();
+    CHECK_GT(bunny_sort_depth, 0.f);
+    CHECK_LT(bunny_sort_depth, std::sqrt(50.f));
+    CHECK_LT(instanced_draw_command->sort_depth(), std::sqrt(50.f));
+    // Behind the camera
+    bunny_component->setTransform(
+        wg::Transform{
+            .transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -50.0f, 50.0f))
+        }
+    );
+    renderer->updateComponentTransform(bunny_component);
+    renderer->cullComponents();
+    CHECK_EQ(renderer->culling_statistics().visible_component_count, 1 + instanced_components.size());
+    CHECK_EQ(renderer->culling_statistics().culled_component_count, 1);
+    CHECK(!renderer->draw_command_visible(renderer->getDrawCommandIndex(bunny_component->render_data()->draw_commands[0])));
+    CHECK(renderer->draw_command_visible(renderer->getDrawCommandIndex(instanced_draw_command)));
+    CHECK_EQ(bunny_component->render_data()->draw_commands[0]->sort_depth(), 0.f);
+    // Far away, while instances keep the original indices
+    renderer->selectLods();
+    CHECK_EQ(bunny_component->lod(), 2);
+    CHECK_EQ(bunny_component->render_data()->draw_commands[0]->index_count(), bunny_mesh->lods()[2].index_count);
+    CHECK(renderer->lod_component_counts() == std::vector<uint32_t>({ 0, 0, 1 }));
+    renderer->setBvhCulling(true);
+    renderer->cullComponents();
+    CHECK_EQ(renderer->culling_statistics().visible_component_count, 1 + instanced_components.size());
+    CHECK_EQ(renderer->culling_statistics().culled_component_count, 1);
+    CHECK_EQ(renderer->queryNearestComponent(glm::vec3(0.0f, -50.0f, 50.0f)), bunny_component);
+    auto overlapped_components = renderer->queryComponents(wg::BoundingBox{ glm::vec3(-10.0f, -10.0f, -1.0f), glm::vec3(10.0f, 10.0f, 1.0f) });
+    CHECK_EQ(overlapped_components.size(), 1 + instanced_components.size());
+    auto camera_uniform = *static_cast<const wg::CameraUniform*>(renderer->render_data()->camera_uniform_buffer->data());
+    CHECK_EQ(renderer->queryComponents(wg::Frustum::FromCameraUniform(camera_uniform)).size(), 1 + instanced_components.size());
+    renderer->setBvhCulling(false);
 
     gfx->render(render_target);
 
@@ -188,6 +320,226 @@ TEST_CASE("gfx engine" * doctest::timeout(10)) {
         }
     );
     renderer->updateComponentTransform(bunny_component);
+    renderer->cullComponents();
+    CHECK_EQ(renderer->culling_statistics().culled_component_count, 0);
+    CHECK(renderer->draw_command_visible(renderer->getDrawCommandIndex(bunny_component->render_data()->draw_commands[0])));
+    renderer->selectLods();
+    CHECK_LT(bunny_component->lod(), 2);
+
+    // Moving a component of infinite bounds keeps it out of the hierarchy
+    gfx->waitDeviceIdle();
+    auto quad_bounding_sphere = quad_mesh->bounding_sphere();
+    quad_mesh->setBoundingSphere({ 0.f, 0.f, 0.f, std::numeric_limits<float>::infinity() });
+    render_data.emplace_back(renderer->createRenderData());
+    render_data.back()->createGfxResources(*gfx);
+    CHECK_EQ(renderer->render_data()->unbounded_component_indices.size(), 1);
+    quad_component->setTransform(
+        wg::Transform{
+            .transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 1.0f))
+        }
+    );
+    renderer->updateComponentTransform(quad_component);
+    CHECK(std::isfinite(renderer->render_data()->component_bvh.cost()));
+    renderer->setBvhCulling(true);
+    renderer->cullComponents();
+    CHECK_EQ(renderer->culling_statistics().visible_component_count, 2 + instanced_components.size());
+    CHECK_EQ(renderer->culling_statistics().culled_component_count, 0);
+    camera_uniform = *static_cast<const wg::CameraUniform*>(renderer->render_data()->camera_uniform_buffer->data());
+    CHECK_EQ(renderer->queryComponents(wg::Frustum::FromCameraUniform(camera_uniform)).size(), 2 + instanced_components.size());
+    renderer->setBvhCulling(false);
+    quad_mesh->setBoundingSphere(quad_bounding_sphere);
+
+    // Cull instanced components on GPU, drawing the same as culling on CPU
+    gfx->waitDeviceIdle();
+    renderer->setGpuCullingShader("shader/frustum-cull.comp.spv");
+    render_data.emplace_back(renderer->createRenderData());
+    render_data.back()->createGfxResources(*gfx);
+    if (gfx->feature_enabled(wg::gfx_features::multi_draw_indirect)) {
+        REQUIRE_EQ(renderer->render_data()->culling_batches.size(), 1);
+        CHECK_EQ(renderer->render_data()->culled_components.size(), instanced_components.size());
+        CHECK(renderer->render_data()->instance_batches.empty());
+        auto& culling_batch = renderer->render_data()->culling_batches[0];
+        CHECK(culling_batch.cull_command->valid());
+        camera_uniform = *static_cast<const wg::CameraUniform*>(renderer->render_data()->camera_uniform_buffer->data());
+        wg::GpuCullParameters cull_parameters{
+            .planes = wg::Frustum::FromCameraUniform(camera_uniform).planes,
+            .object_count = static_cast<uint32_t>(instanced_components.size()),
+            .compact = gfx->feature_enabled(wg::gfx_features::draw_indirect_count) ? 1U : 0U
+        };
+        std::vector<wg::DrawIndexedIndirectCommand> expected_commands;
+        auto expected_draw_count = wg::CullObjects(cull_parameters, culling_batch.objects->elements(), expected_commands);
+        CHECK_GT(expected_draw_count, 0);
+        auto cull_token = renderer->submitCulling(*gfx);
+        CHECK(cull_token.valid());
+        CHECK_EQ(renderer->readCulledDrawCount(*gfx, cull_token), expected_draw_count);
+
+        gfx->render(render_target);
+    } else {
+        // Drawn as if GPU culling is disabled
+        CHECK(renderer->render_data()->culling_batches.empty());
+        CHECK_EQ(renderer->render_data()->instance_batches.size(), 1);
+        CHECK_EQ(renderer->getDrawCommands().size(), 3);
+    }
+}
+
+TEST_CASE("mesh lods" * doctest::timeout(5)) {
+    auto sphere_mesh = wg::Mesh::CreateSphere("sphere");
+    REQUIRE_EQ(sphere_mesh->lods().size(), 1);
+    auto original_index_count = sphere_mesh->indices().size();
+    CHECK_EQ(sphere_mesh->lods()[0].index_count, original_index_count);
+
+    sphere_mesh->generateLods(4);
+    REQUIRE_EQ(sphere_mesh->lods().size(), 4);
+    for (size_t i = 1; i < sphere_mesh->lods().size(); ++i) {
+        auto& lod = sphere_mesh->lods()[i];
+        auto& finer_lod = sphere_mesh->lods()[i - 1];
+        CHECK_LT(lod.index_count, finer_lod.index_count);
+        CHECK_EQ(lod.index_count % 3, 0);
+        CHECK_GE(lod.error, finer_lod.error);
+        CHECK_EQ(lod.first_index, finer_lod.first_index + finer_lod.index_count);
+        CHECK_LE(lod.first_index + lod.index_count, sphere_mesh->indices().size());
+    }
+    CHECK(std::all_of(
+        sphere_mesh->indices().begin(), sphere_mesh->indices().end(),
+        [&sphere_mesh](uint32_t index) { return index < sphere_mesh->vertices().size(); }
+    ));
+    // Simplified vertices stay on the unit sphere, with triangles not too far inside
+    CHECK_GT(sphere_mesh->lods()[3].error, 0.f);
+    CHECK_LT(sphere_mesh->lods()[3].error, 0.1f);
+
+    // Draw commands of the mesh draw the original indices by default
+    sphere_mesh->createRenderData();
+    auto draw_command = wg::SimpleDrawCommand::Create("sphere", nullptr);
+    sphere_mesh->render_data()->setIndexBuffer(*draw_command);
+    CHECK_EQ(draw_command->index_buffer(), sphere_mesh->render_data()->index_buffer);
+    REQUIRE(draw_command->index_range().has_value());
+    CHECK_EQ(draw_command->index_range()->first, sphere_mesh->lods()[0].first_index);
+    CHECK_EQ(draw_command->index_range()->second, sphere_mesh->lods()[0].index_count);
+
+    sphere_mesh->addLod({ 0, 3, 1 }, 1.f);
+    CHECK_EQ(sphere_mesh->lods().size(), 5);
+    sphere_mesh->addLod({ 0, static_cast<uint32_t>(sphere_mesh->vertices().size()), 1 }, 1.f);
+    CHECK_EQ(sphere_mesh->lods().size(), 5);
+    sphere_mesh->setIndices(std::vector<uint32_t>(sphere_mesh->indices().begin(), sphere_mesh->indices().begin() + original_index_count));
+    CHECK_EQ(sphere_mesh->lods().size(), 1);
+}
+
+TEST_CASE("mesh optimization" * doctest::timeout(5)) {
+    // Grid with shuffled triangles, as scanned models with triangles in no particular order
+    constexpr uint32_t GridSize = 64;
+    std::vector<wg::SimpleVertex> vertices;
+    for (uint32_t y = 0; y <= GridSize; ++y) {
+        for (uint32_t x = 0; x <= GridSize; ++x) {
+            auto position = glm::vec3(static_cast<float>(x), static_cast<float>(y), std::sin(static_cast<float>(x) * 0.3f));
+            vertices.push_back({ .position = position, .normal = { 0.f, 0.f, 1.f }, .color = { 1.f, 1.f, 1.f }, .tex_coord = { 0.f, 0.f } });
+        }
+    }
+    std::vector<std::array<uint32_t, 3>> triangles;
+    for (uint32_t y = 0; y < GridSize; ++y) {
+        for (uint32_t x = 0; x < GridSize; ++x) {
+            uint32_t corner = y * (GridSize + 1) + x;
+            triangles.push_back({ corner, corner + 1, corner + GridSize + 1 });
+            triangles.push_back({ corner + 1, corner + GridSize + 2, corner + GridSize + 1 });
+        }
+    }
+    std::mt19937 random_engine(42);
+    std::shuffle(triangles.begin(), triangles.end(), random_engine);
+    std::vector<uint32_t> indices;
+    for (auto&& triangle : triangles) {
+        indices.insert(indices.end(), triangle.begin(), triangle.end());
+    }
+    // Unused vertex
+    vertices.push_back(vertices[0]);
+
+    // Triangles by positions of their corners, starting from the smallest corner to keep winding
+    auto sorted_triangles = [](const wg::Mesh& mesh) {
+        std::vector<std::array<float, 9>> result;
+        for (size_t i = 0; i + 3 <= mesh.lods()[0].index_count; i += 3) {
+            std::array<float, 9> triangle{};
+            for (size_t k = 0; k < 3; ++k) {
+                auto& position = mesh.vertices()[mesh.indices()[i + k]].position;
+                triangle[k * 3] = position.x;
+                triangle[k * 3 + 1] = position.y;
+                triangle[k * 3 + 2] = position.z;
+            }
+            size_t first = 0;
+            for (size_t k = 1; k < 3; ++k) {
+                auto corner = triangle.begin() + k * 3;
+                auto first_corner = triangle.begin() + first * 3;
+                if (std::lexicographical_compare(corner, corner + 3, first_corner, first_corner + 3)) {
+                    first = k;
+                }
+            }
+            std::rotate(triangle.begin(), triangle.begin() + first * 3, triangle.end());
+            result.push_back(triangle);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+
+    for (bool overdraw_optimization : { false, true }) {
+        auto mesh = wg::Mesh::CreateFromVertices("grid", vertices, indices);
+        mesh->generateLods(2);
+        REQUIRE_EQ(mesh->lods().size(), 2);
+        auto lods = mesh->lods();
+        auto original_triangles = sorted_triangles(*mesh);
+
+        mesh->setOverdrawOptimization(overdraw_optimization);
+        auto start_time = std::chrono::high_resolution_clock::now();
+        mesh->optimize();
+        auto end_time = std::chrono::high_resolution_clock::now();
+        REQUIRE(mesh->optimized());
+        auto& statistics = mesh->optimization_statistics();
+        MESSAGE(
+            fmt::format(
+                "Optimized {} triangles{} in {:.3f}ms: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+                triangles.size(), overdraw_optimization ? " with overdraw" : "",
+                std::chrono::duration<double, std::milli>(end_time - start_time).count(),
+                statistics.before.acmr, statistics.after.acmr, statistics.before.atvr, statistics.after.atvr
+            )
+        );
+        CHECK_GT(statistics.before.acmr, 2.5f);
+        CHECK_LT(statistics.after.acmr, 0.8f);
+        CHECK_LT(statistics.after.atvr, 1.5f);
+        CHECK_EQ(statistics.after, wg::AnalyzeVertexCache(
+            std::vector<uint32_t>(mesh->indices().begin(), mesh->indices().begin() + lods[0].index_count), mesh->vertices().size()
+        ));
+
+        // Same triangles and levels of detail, with vertices in order of first use
+        CHECK_EQ(mesh->vertices().size(), vertices.size() - 1);
+        CHECK_EQ(mesh->lods().size(), lods.size());
+        for (size_t i = 0; i < lods.size(); ++i) {
+            CHECK_EQ(mesh->lods()[i].first_index, lods[i].first_index);
+            CHECK_EQ(mesh->lods()[i].index_count, lods[i].index_count);
+        }
+        CHECK(sorted_triangles(*mesh) == original_triangles);
+        uint32_t next_vertex = 0;
+        for (auto index : mesh->indices()) {
+            CHECK_LE(index, next_vertex);
+            next_vertex = std::max(next_vertex, index + 1);
+        }
+    }
+}
+
+TEST_CASE("lod selection" * doctest::timeout(1)) {
+    const std::vector<float> screen_sizes = { 0.5f, 0.25f, 0.125f };
+    CHECK_EQ(wg::SceneRenderer::SelectLod(1.f, 0, 4, screen_sizes, 0.f), 0);
+    CHECK_EQ(wg::SceneRenderer::SelectLod(0.3f, 0, 4, screen_sizes, 0.f), 1);
+    CHECK_EQ(wg::SceneRenderer::SelectLod(0.01f, 0, 4, screen_sizes, 0.f), 3);
+    // Limited by levels of the mesh
+    CHECK_EQ(wg::SceneRenderer::SelectLod(0.01f, 0, 2, screen_sizes, 0.f), 1);
+    // Stay until the threshold is passed by the hysteresis
+    CHECK_EQ(wg::SceneRenderer::SelectLod(0.48f, 0, 4, screen_sizes, 0.1f), 0);
+    CHECK_EQ(wg::SceneRenderer::SelectLod(0.4f, 0, 4, screen_sizes, 0.1f), 1);
+    CHECK_EQ(wg::SceneRenderer::SelectLod(0.52f, 1, 4, screen_sizes, 0.1f), 1);
+    CHECK_EQ(wg::SceneRenderer::SelectLod(0.6f, 1, 4, screen_sizes, 0.1f), 0);
+    CHECK_EQ(wg::SceneRenderer::SelectLod(0.2f, 3, 4, screen_sizes, 0.1f), 2);
+
+    CHECK(std::isinf(wg::SceneRenderer::ProjectedScreenSize(glm::vec4(0.f, 0.f, 0.f, 1.f), glm::vec3(0.5f, 0.f, 0.f), glm::radians(90.f))));
+    CHECK_EQ(
+        wg::SceneRenderer::ProjectedScreenSize(glm::vec4(0.f, 0.f, 0.f, 1.f), glm::vec3(10.f, 0.f, 0.f), glm::radians(90.f)),
+        doctest::Approx(0.1f)
+    );
 }
 
 // Packed data
@@ -197,12 +549,18 @@ std::vector<uint8_t> LocalPacked::vert_shader = {
 std::vector<uint8_t> LocalPacked::frag_shader = {
 #include "../resources/simple.frag.inc"
 };
+std::vector<uint8_t> LocalPacked::instanced_vert_shader = {
+#include "../resources/simple-instanced.vert.inc"
+};
 std::vector<uint8_t> LocalPacked::grid_vert_shader = {
 #include "../resources/grid.vert.inc"
 };
 std::vector<uint8_t> LocalPacked::grid_frag_shader = {
 #include "../resources/grid.frag.inc"
 };
+std::vector<uint8_t> LocalPacked::cull_shader = {
+#include "../resources/frustum-cull.comp.inc"
+};
 std::vector<uint8_t> LocalPacked::image = {
 #include "../resources/image.inc"
 };
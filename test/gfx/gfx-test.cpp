@@ -5,11 +5,20 @@
 
 #include "common/config.h"
 #include "common/logger.h"
+#include "gfx/bvh.h"
 #include "gfx/gfx.h"
 #include "gfx-private.h"
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <filesystem>
 #include <fstream>
+#include <future>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <thread>
 
 namespace {
 
@@ -20,6 +29,35 @@ public:
     };
 };
 
+// Access to implementations of private members through pointers to protected members
+class Gfx_Test : public wg::Gfx {
+public:
+    static Impl& GetImpl(wg::Gfx& gfx) { return *(gfx.*(&Gfx_Test::impl_)); }
+};
+
+class GfxBuffer_Test : public wg::GfxBufferBase {
+public:
+    static Impl& GetImpl(wg::GfxBufferBase& buffer) { return *(buffer.*(&GfxBuffer_Test::impl_)); }
+};
+
+// Boxes of spheres at random positions within [-range, range]
+std::vector<wg::BoundingBox> RandomBoxes(std::mt19937& random_engine, size_t count, float range) {
+    std::uniform_real_distribution<float> position_distribution(-range, range);
+    std::uniform_real_distribution<float> radius_distribution(0.1f, 2.f);
+    std::vector<wg::BoundingBox> boxes(count);
+    for (auto&& box : boxes) {
+        glm::vec3 center{ position_distribution(random_engine), position_distribution(random_engine), position_distribution(random_engine) };
+        box = wg::BoundingBox::FromSphere({ center, radius_distribution(random_engine) });
+    }
+    return boxes;
+}
+
+wg::Frustum BvhTestFrustum() {
+    auto project_mat = glm::perspective(glm::radians(60.f), 4.f / 3.f, 0.1f, 100.f);
+    auto view_mat = glm::lookAt(glm::vec3(0.f, -50.f, 50.f), glm::vec3(0.f), glm::vec3(0.f, 0.f, 1.f));
+    return wg::Frustum::FromViewProjection(project_mat * view_mat);
+}
+
 } // unnamed namespace
 
 namespace std {
@@ -135,9 +173,704 @@ TEST_CASE("allocate queues" * doctest::timeout(1)) {
     }
 }
 
+TEST_CASE("buddy allocator" * doctest::timeout(1)) {
+    wg::GfxBuddyAllocator allocator(1024, 64);
+
+    SUBCASE("alignment") {
+        uint64_t a = allocator.allocate(10, 1);
+        uint64_t b = allocator.allocate(100, 256);
+        uint64_t c = allocator.allocate(64, 64);
+        CHECK_EQ(a, 0);
+        CHECK_EQ(b % 256, 0);
+        CHECK_NE(c, wg::GfxBuddyAllocator::InvalidOffset);
+        CHECK_EQ(c % 64, 0);
+        CHECK_NE(c, a);
+        CHECK_EQ(allocator.allocation_count(), 3);
+        CHECK_EQ(allocator.used_size(), 64 + 256 + 64);
+    }
+
+    SUBCASE("exhaust and merge") {
+        std::vector<uint64_t> offsets;
+        for (int i = 0; i < 16; ++i) {
+            offsets.push_back(allocator.allocate(64, 64));
+            CHECK_NE(offsets.back(), wg::GfxBuddyAllocator::InvalidOffset);
+        }
+        CHECK_EQ(allocator.allocate(1, 1), wg::GfxBuddyAllocator::InvalidOffset);
+        CHECK_EQ(allocator.used_size(), 1024);
+
+        for (auto offset : offsets) {
+            allocator.free(offset);
+        }
+        CHECK(allocator.empty());
+        CHECK_EQ(allocator.used_size(), 0);
+        // All buddies merged back, so the whole block is available again.
+        CHECK_EQ(allocator.allocate(1024, 1), 0);
+    }
+
+    SUBCASE("too large") {
+        CHECK_EQ(allocator.allocate(2048, 1), wg::GfxBuddyAllocator::InvalidOffset);
+        CHECK_EQ(allocator.allocate(16, 2048), wg::GfxBuddyAllocator::InvalidOffset);
+    }
+}
+
+TEST_CASE("free list allocator" * doctest::timeout(1)) {
+    wg::GfxFreeListAllocator allocator(1000);
+
+    SUBCASE("exact sizes") {
+        uint64_t a = allocator.allocate(10);
+        uint64_t b = allocator.allocate(300);
+        uint64_t c = allocator.allocate(7, 8);
+        CHECK_EQ(a, 0);
+        CHECK_EQ(b, 10);
+        CHECK_EQ(c, 312);
+        CHECK_EQ(allocator.allocation_count(), 3);
+        CHECK_EQ(allocator.used_size(), 317);
+        // Padding before c stays free
+        CHECK_EQ(allocator.free_range_count(), 2);
+        CHECK_EQ(allocator.largest_free_range(), 1000 - 319);
+    }
+
+    SUBCASE("coalesce") {
+        uint64_t a = allocator.allocate(100);
+        uint64_t b = allocator.allocate(100);
+        uint64_t c = allocator.allocate(100);
+        allocator.free(a);
+        allocator.free(c);
+        CHECK_EQ(allocator.free_range_count(), 2);
+        // First fit reuses the hole of a
+        CHECK_EQ(allocator.allocate(50), 0);
+        allocator.free(0);
+        allocator.free(b);
+        CHECK(allocator.empty());
+        CHECK_EQ(allocator.used_size(), 0);
+        CHECK_EQ(allocator.free_range_count(), 1);
+        CHECK_EQ(allocator.allocate(1000), 0);
+    }
+
+    SUBCASE("too large") {
+        CHECK_EQ(allocator.allocate(1001), wg::GfxFreeListAllocator::InvalidOffset);
+        CHECK_NE(allocator.allocate(600), wg::GfxFreeListAllocator::InvalidOffset);
+        CHECK_EQ(allocator.allocate(600), wg::GfxFreeListAllocator::InvalidOffset);
+    }
+}
+
+TEST_CASE("memory budget estimate" * doctest::timeout(1)) {
+    vk::raii::Device vk_device{ nullptr };
+    wg::GfxSubmissionTracker submission_tracker(vk_device);
+    wg::GfxMemoryBudget memory_budget(submission_tracker);
+    // Statistics are queried until usage is estimated
+    CHECK(memory_budget.mayExceedBudget(1, 0));
+    memory_budget.setHeapUsage(1, 600, 1000);
+    CHECK(memory_budget.mayExceedBudget(0, 0));
+    CHECK(!memory_budget.mayExceedBudget(1, 400));
+    CHECK(memory_budget.mayExceedBudget(1, 401));
+    memory_budget.addHeapUsage(1, 300);
+    CHECK(!memory_budget.mayExceedBudget(1, 100));
+    CHECK(memory_budget.mayExceedBudget(1, 101));
+    memory_budget.invalidateHeapUsages();
+    CHECK(memory_budget.mayExceedBudget(1, 0));
+}
+
+TEST_CASE("index buffer" * doctest::timeout(5)) {
+    auto indices = std::vector<uint32_t>(1000003);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        indices[i] = static_cast<uint32_t>(i * 2654435761U);
+    }
+
+    // Element by element packing into 32-bit words, as done before indices were stored by width
+    auto pack_by_element = [](const std::vector<uint32_t>& indices) {
+        std::vector<uint32_t> packed((indices.size() + 1U) / 2U);
+        uint32_t mask = 0xffff;
+        const uint8_t shift[] = { 0, 16 };
+        for (size_t i = 0; i < indices.size(); ++i) {
+            packed[i / 2] &= ~mask;
+            packed[i / 2] |= (static_cast<uint16_t>(indices[i] & 0xffff) << shift[i % 2]);
+            mask = ~mask;
+        }
+        return packed;
+    };
+
+    SUBCASE("narrow") {
+        auto begin_time = std::chrono::steady_clock::now();
+        auto packed = pack_by_element(indices);
+        auto element_time = std::chrono::steady_clock::now() - begin_time;
+
+        begin_time = std::chrono::steady_clock::now();
+        auto index_buffer = wg::IndexBuffer::CreateFromIndexArray(wg::index_types::index_16, indices);
+        auto narrow_time = std::chrono::steady_clock::now() - begin_time;
+
+        CHECK_EQ(index_buffer->index_count(), indices.size());
+        CHECK_EQ(index_buffer->data_size(), indices.size() * sizeof(uint16_t));
+        CHECK(0 == std::memcmp(index_buffer->data(), packed.data(), index_buffer->data_size()));
+        MESSAGE(
+            fmt::format(
+                "Narrowing {} indices: element by element {} us, setIndexArray {} us", indices.size(),
+                std::chrono::duration_cast<std::chrono::microseconds>(element_time).count(),
+                std::chrono::duration_cast<std::chrono::microseconds>(narrow_time).count()
+            )
+        );
+    }
+
+    SUBCASE("widen") {
+        auto short_indices = std::vector<uint16_t>{ 0, 1, 2, 65535, 3 };
+        auto index_buffer = wg::IndexBuffer::CreateFromIndexArray(wg::index_types::index_32, short_indices);
+        CHECK_EQ(index_buffer->data_size(), short_indices.size() * sizeof(uint32_t));
+        CHECK_EQ(static_cast<const uint32_t*>(index_buffer->data())[3], 65535);
+    }
+
+    SUBCASE("move") {
+        const auto* data = indices.data();
+        auto index_buffer = wg::IndexBuffer::CreateFromIndexArray(wg::index_types::index_32, std::move(indices));
+        CHECK_EQ(index_buffer->data(), data);
+        CHECK_EQ(index_buffer->index_count(), 1000003);
+
+        auto short_indices = std::vector<uint16_t>{ 0, 1, 2 };
+        const auto* short_data = short_indices.data();
+        index_buffer = wg::IndexBuffer::CreateFromIndexArray(wg::index_types::index_16, std::move(short_indices));
+        CHECK_EQ(index_buffer->data(), short_data);
+        CHECK_EQ(index_buffer->data_size(), 3 * sizeof(uint16_t));
+    }
+}
+
+TEST_CASE("dirty ranges" * doctest::timeout(1)) {
+    auto vertices = std::vector<wg::SimpleVertex>(100);
+    auto vertex_buffer = wg::VertexBuffer<wg::SimpleVertex>::CreateFromVertexArray(vertices, true);
+    CHECK(vertex_buffer->dirty_ranges().empty());
+
+    auto changed_vertices = std::vector<wg::SimpleVertex>(2, wg::SimpleVertex{ .position = { 1.f, 2.f, 3.f } });
+    CHECK(vertex_buffer->setVertexRange(10, changed_vertices));
+    CHECK(vertex_buffer->setVertexRange(50, changed_vertices));
+    // Adjacent to the first range
+    CHECK(vertex_buffer->setVertexRange(12, changed_vertices));
+    CHECK(!vertex_buffer->setVertexRange(99, changed_vertices));
+
+    const auto& dirty_ranges = vertex_buffer->dirty_ranges();
+    REQUIRE_EQ(dirty_ranges.size(), 2);
+    CHECK_EQ(dirty_ranges.begin()->first, 10 * sizeof(wg::SimpleVertex));
+    CHECK_EQ(dirty_ranges.begin()->second, 4 * sizeof(wg::SimpleVertex));
+    CHECK_EQ(std::next(dirty_ranges.begin())->first, 50 * sizeof(wg::SimpleVertex));
+    CHECK_EQ(static_cast<const wg::SimpleVertex*>(vertex_buffer->data())[13].position.y, 2.f);
+
+    // Overlapping both ranges
+    vertex_buffer->markDirty(11 * sizeof(wg::SimpleVertex), 40 * sizeof(wg::SimpleVertex));
+    REQUIRE_EQ(dirty_ranges.size(), 1);
+    CHECK_EQ(dirty_ranges.begin()->second, 42 * sizeof(wg::SimpleVertex));
+
+    vertex_buffer->setVertexArray(vertices);
+    CHECK(dirty_ranges.empty());
+
+    auto index_buffer = wg::IndexBuffer::CreateFromIndexArray(wg::index_types::index_16, std::vector<uint32_t>(30), true);
+    CHECK(index_buffer->setIndexRange(6, std::vector<uint32_t>{ 1, 2, 70000 }));
+    CHECK(!index_buffer->setIndexRange(29, std::vector<uint32_t>{ 1, 2 }));
+    REQUIRE_EQ(index_buffer->dirty_ranges().size(), 1);
+    CHECK_EQ(index_buffer->dirty_ranges().begin()->first, 6 * sizeof(uint16_t));
+    CHECK_EQ(index_buffer->dirty_ranges().begin()->second, 3 * sizeof(uint16_t));
+    CHECK_EQ(static_cast<const uint16_t*>(index_buffer->data())[8], static_cast<uint16_t>(70000));
+
+    auto streaming_vertex_buffer = wg::StreamingVertexBuffer<wg::SimpleVertex>::CreateFromVertexArray(vertices, 2);
+    CHECK_EQ(streaming_vertex_buffer->streaming_copy_count(), 2);
+    CHECK_EQ(vertex_buffer->streaming_copy_count(), 0);
+    CHECK(streaming_vertex_buffer->setVertexRange(0, changed_vertices));
+    CHECK(streaming_vertex_buffer->has_cpu_data());
+    CHECK_EQ(streaming_vertex_buffer->dirty_ranges().size(), 1);
+}
+
+TEST_CASE("worker pool" * doctest::timeout(5)) {
+    for (uint32_t thread_count : { 1u, 2u, 4u }) {
+        wg::GfxWorkerPool worker_pool(thread_count);
+        CHECK_EQ(worker_pool.thread_count(), thread_count);
+        for (int loop = 0; loop < 100; ++loop) {
+            std::vector<std::atomic<int>> job_runs(37);
+            worker_pool.parallelFor(job_runs.size(), [&job_runs](size_t job_index) { ++job_runs[job_index]; });
+            for (auto&& runs : job_runs) {
+                CHECK_EQ(runs.load(), 1);
+            }
+        }
+    }
+}
+
+TEST_CASE("task queue" * doctest::timeout(5)) {
+    for (uint32_t thread_count : { 1u, 2u, 4u }) {
+        wg::GfxTaskQueue task_queue(thread_count);
+        CHECK_EQ(task_queue.thread_count(), thread_count);
+        std::vector<std::promise<void>> task_done(37);
+        std::atomic<int> task_runs{ 0 };
+        for (auto&& done : task_done) {
+            task_queue.post([&task_runs, &done]() {
+                ++task_runs;
+                done.set_value();
+            });
+        }
+        for (auto&& done : task_done) {
+            done.get_future().wait();
+        }
+        CHECK_EQ(task_runs.load(), 37);
+    }
+}
+
+TEST_CASE("draw command visibility" * doctest::timeout(1)) {
+    auto pipeline = wg::GfxPipeline::Create();
+    auto renderer = wg::BasicRenderer::Create();
+    auto first_draw_command = wg::SimpleDrawCommand::Create("first", pipeline);
+    auto second_draw_command = wg::SimpleDrawCommand::Create("second", pipeline);
+    renderer->addDrawCommand(first_draw_command);
+    renderer->addDrawCommand(second_draw_command);
+    CHECK(renderer->draw_command_visible(0));
+    CHECK(renderer->draw_command_visible(1));
+
+    renderer->setDrawCommandVisible(second_draw_command, false);
+    CHECK(renderer->draw_command_visible(0));
+    CHECK(!renderer->draw_command_visible(1));
+    renderer->setDrawCommandVisible(1, true);
+    CHECK(renderer->draw_command_visible(1));
+    // Draw commands not in the renderer are ignored
+    renderer->setDrawCommandVisible(wg::SimpleDrawCommand::Create("other", pipeline), false);
+    CHECK(renderer->draw_command_visible(0));
+    CHECK(renderer->draw_command_visible(2));
+    // Hidden state belongs to removed draw commands
+    renderer->setDrawCommandVisible(second_draw_command, false);
+    renderer->clearDrawCommands();
+    renderer->addDrawCommand(second_draw_command);
+    renderer->addDrawCommand(first_draw_command);
+    CHECK(renderer->draw_command_visible(0));
+    CHECK(renderer->draw_command_visible(1));
+}
+
+TEST_CASE("draw command index range" * doctest::timeout(1)) {
+    auto pipeline = wg::GfxPipeline::Create();
+    auto draw_command = wg::SimpleDrawCommand::Create("ranged", pipeline);
+    // No index buffer to take the range from
+    draw_command->setIndexRange(0, 3);
+    CHECK(!draw_command->index_range());
+
+    std::vector<uint32_t> indices(12);
+    std::iota(indices.begin(), indices.end(), 0);
+    draw_command->setIndexBuffer(wg::IndexBuffer::CreateFromIndexArray(wg::index_types::index_16, indices));
+    CHECK_EQ(draw_command->index_count(), 12);
+    draw_command->setIndexRange(6, 6);
+    REQUIRE(draw_command->index_range());
+    CHECK_EQ(draw_command->index_range()->first, 6);
+    CHECK_EQ(draw_command->index_count(), 6);
+    // Outside of the index buffer, keeping the last range
+    draw_command->setIndexRange(9, 6);
+    CHECK_EQ(draw_command->index_range()->first, 6);
+    CHECK_EQ(draw_command->index_count(), 6);
+    draw_command->clearIndexRange();
+    CHECK(!draw_command->index_range());
+    CHECK_EQ(draw_command->index_count(), 12);
+}
+
+TEST_CASE("draw sort keys" * doctest::timeout(1)) {
+    auto state_key = wg::MakeDrawSortStateKey(1, 2, 3);
+    // Layer first, then pipeline, material and mesh, then depth
+    CHECK_LT(wg::MakeDrawSortKey(state_key, 0, 100.f), wg::MakeDrawSortKey(wg::MakeDrawSortStateKey(0, 0, 0), 1, 0.f));
+    CHECK_LT(wg::MakeDrawSortKey(state_key, 0, 100.f), wg::MakeDrawSortKey(wg::MakeDrawSortStateKey(2, 0, 0), 0, 0.f));
+    CHECK_LT(wg::MakeDrawSortKey(state_key, 0, 100.f), wg::MakeDrawSortKey(wg::MakeDrawSortStateKey(1, 2, 4), 0, 0.f));
+    CHECK_LT(wg::MakeDrawSortKey(state_key, 0, 1.f), wg::MakeDrawSortKey(state_key, 0, 2.f));
+    CHECK_EQ(wg::MakeDrawSortKey(state_key, 0, -1.f), wg::MakeDrawSortKey(state_key, 0, 0.f));
+    // Ids out of range do not overflow into other fields
+    CHECK_EQ(wg::MakeDrawSortStateKey(0, 0, 1u << 20) >> wg::gfx_draw_sort_keys::MATERIAL_SHIFT, 0);
+
+    std::vector<wg::GfxDrawSortItem> items;
+    std::vector<wg::GfxDrawSortItem> scratch;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        auto key = wg::MakeDrawSortKey(wg::MakeDrawSortStateKey(i * 7 % 5, i % 3, 0), i % 2, 0.f);
+        items.emplace_back(wg::GfxDrawSortItem{ .key = key, .index = i });
+    }
+    wg::RadixSortDrawSortItems(items, scratch);
+    CHECK_EQ(items.size(), 1000);
+    for (size_t i = 1; i < items.size(); ++i) {
+        // Stable, so equal keys keep their order
+        CHECK((items[i - 1].key < items[i].key || (items[i - 1].key == items[i].key && items[i - 1].index < items[i].index)));
+    }
+}
+
+TEST_CASE("pipeline cache file" * doctest::timeout(1)) {
+    auto properties = vk::PhysicalDeviceProperties{
+        .driverVersion = 3,
+        .vendorID = 1,
+        .deviceID = 2,
+    };
+    properties.pipelineCacheUUID[0] = 4;
+    auto header = wg::MakePipelineCacheFileHeader(properties, 5);
+
+    // VkPipelineCacheHeaderVersionOne followed by driver data
+    std::vector<uint32_t> data_words = { 32, 1, 1, 2, 4, 0, 0, 0, 42, 43 };
+    std::vector<uint8_t> data(data_words.size() * sizeof(uint32_t));
+    std::memcpy(data.data(), data_words.data(), data.size());
+
+    auto file_content = wg::SerializePipelineCacheFile(header, data);
+    CHECK_EQ(wg::ParsePipelineCacheFile(file_content, header), data);
+
+    // Another driver or engine version
+    CHECK(wg::ParsePipelineCacheFile(file_content, wg::MakePipelineCacheFileHeader(properties, 6)).empty());
+    auto other_properties = properties;
+    other_properties.driverVersion = 4;
+    CHECK(wg::ParsePipelineCacheFile(file_content, wg::MakePipelineCacheFileHeader(other_properties, 5)).empty());
+    other_properties = properties;
+    other_properties.pipelineCacheUUID[15] = 1;
+    CHECK(wg::ParsePipelineCacheFile(file_content, wg::MakePipelineCacheFileHeader(other_properties, 5)).empty());
+
+    // Truncated or corrupted
+    auto truncated_file_content = file_content;
+    truncated_file_content.pop_back();
+    CHECK(wg::ParsePipelineCacheFile(truncated_file_content, header).empty());
+    CHECK(wg::ParsePipelineCacheFile({ file_content.begin(), file_content.begin() + 8 }, header).empty());
+    auto corrupted_file_content = file_content;
+    corrupted_file_content.back() ^= 1;
+    CHECK(wg::ParsePipelineCacheFile(corrupted_file_content, header).empty());
+
+    // Data header of another device
+    data_words[3] = 3;
+    std::memcpy(data.data(), data_words.data(), data.size());
+    CHECK(wg::ParsePipelineCacheFile(wg::SerializePipelineCacheFile(header, data), header).empty());
+}
+
+TEST_CASE("compute command" * doctest::timeout(1)) {
+    auto storage_buffer = wg::StorageBuffer<uint32_t>::Create(64, true);
+    CHECK(storage_buffer->storage());
+    CHECK(storage_buffer->host_visible());
+    CHECK_EQ(storage_buffer->element_count(), 64);
+    CHECK_EQ(storage_buffer->data_size(), 64 * sizeof(uint32_t));
+    CHECK(storage_buffer->setRange(4, { 1u, 2u, 3u }));
+    CHECK(!storage_buffer->setRange(63, { 1u, 2u }));
+    REQUIRE_EQ(storage_buffer->dirty_ranges().size(), 1);
+    CHECK_EQ(storage_buffer->dirty_ranges().begin()->first, 4 * sizeof(uint32_t));
+    CHECK_EQ(storage_buffer->elements()[5], 2u);
+
+    auto pipeline = wg::ComputePipeline::Create();
+    pipeline->setShader(wg::Shader::Load("not-exist.comp.spv", wg::shader_stages::comp));
+    pipeline->setStorageBufferLayout(
+        wg::GfxStorageBufferLayout{}
+            .addDescription({ .binding = 0, .stages = wg::shader_stages::comp })
+            .addDescription({ .binding = 1, .stages = wg::shader_stages::comp })
+    );
+    pipeline->setPushConstantSize(sizeof(uint32_t));
+
+    auto compute_command = wg::ComputeCommand::Create("test", pipeline);
+    CHECK(!compute_command->valid());
+    compute_command->setStorageBuffer(0, storage_buffer);
+    // A vertex buffer needs storage usage to be bound
+    auto vertex_buffer = wg::VertexBuffer<wg::SimpleVertex>::CreateFromVertexArray(std::vector<wg::SimpleVertex>(3));
+    compute_command->setStorageBuffer(1, vertex_buffer);
+    CHECK(!compute_command->valid());
+    vertex_buffer->setStorage(true);
+    CHECK(!compute_command->valid());
+    compute_command->setPushConstants(uint32_t{ 64 });
+    // Matches the pipeline, but the shader is not loaded to the device
+    CHECK(!compute_command->valid());
+}
+
+TEST_CASE("gpu culling" * doctest::timeout(1)) {
+    CHECK_EQ(sizeof(wg::DrawIndexedIndirectCommand), 20);
+    CHECK_EQ(sizeof(wg::GpuCullObject), 48);
+    CHECK_EQ(offsetof(wg::GpuCullObject, draw), 16);
+    CHECK_EQ(offsetof(wg::GpuCullParameters, object_count), 96);
+    CHECK_LE(sizeof(wg::GpuCullParameters), 128);
+
+    auto project_mat = glm::perspective(glm::radians(90.f), 1.f, 0.1f, 100.f);
+    auto view_mat = glm::lookAt(glm::vec3(0.f), glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
+    auto frustum = wg::Frustum::FromViewProjection(project_mat * view_mat);
+    for (auto&& plane : frustum.planes) {
+        CHECK(glm::length(glm::vec3(plane)) == doctest::Approx(1.f));
+    }
+    CHECK(frustum.intersectsSphere({ 10.f, 0.f, 0.f, 1.f }));
+    CHECK(!frustum.intersectsSphere({ -10.f, 0.f, 0.f, 1.f }));
+    CHECK(!frustum.intersectsSphere({ 200.f, 0.f, 0.f, 1.f }));
+    CHECK(!frustum.intersectsSphere({ 10.f, 20.f, 0.f, 1.f }));
+    // Outside, but touching the left or right plane
+    CHECK(frustum.intersectsSphere({ 10.f, 10.5f, 0.f, 1.f }));
+    CHECK(frustum.intersectsSphere({ 0.05f, 0.f, 0.f, 0.1f }));
+
+    std::vector<wg::GpuCullObject> objects;
+    for (uint32_t i = 0; i < 100; ++i) {
+        // Every other object behind the camera
+        float x = (i % 2 == 0 ? 1.f : -1.f) * (1.f + static_cast<float>(i));
+        objects.push_back(
+            {
+                .bounding_sphere = { x, 0.f, 0.f, 0.5f },
+                .draw = { .index_count = 3 * (i + 1), .instance_count = 1, .first_index = i * 100, .vertex_offset = static_cast<int32_t>(i), .first_instance = i }
+            }
+        );
+    }
+    wg::GpuCullParameters parameters{ .planes = frustum.planes, .object_count = static_cast<uint32_t>(objects.size()) };
+    CHECK_EQ(parameters.group_count(), 2);
+
+    std::vector<wg::DrawIndexedIndirectCommand> commands;
+    CHECK_EQ(wg::CullObjects(parameters, objects, commands), 50);
+    REQUIRE_EQ(commands.size(), objects.size());
+    CHECK(commands[0] == objects[0].draw);
+    CHECK_EQ(commands[1].instance_count, 0);
+    CHECK_EQ(commands[1].first_instance, 1);
+
+    parameters.compact = 1;
+    CHECK_EQ(wg::CullObjects(parameters, objects, commands), 50);
+    CHECK(commands[1] == objects[2].draw);
+    CHECK(commands[49] == objects[98].draw);
+    CHECK(commands[50] == wg::DrawIndexedIndirectCommand{});
+
+    auto indirect_buffer = wg::StorageBuffer<wg::DrawIndexedIndirectCommand>::Create(16);
+    auto draw_command = wg::IndirectDrawCommand::Create("indirect", wg::GfxPipeline::Create());
+    CHECK_EQ(draw_command->max_draw_count(), 0);
+    draw_command->setIndirectBuffer(indirect_buffer);
+    CHECK_EQ(draw_command->max_draw_count(), 16);
+    draw_command->setIndirectBuffer(indirect_buffer, 4);
+    CHECK_EQ(draw_command->max_draw_count(), 4);
+    draw_command->setIndirectBuffer(indirect_buffer, 32);
+    CHECK_EQ(draw_command->max_draw_count(), 16);
+    CHECK(!draw_command->count_buffer());
+    draw_command->setCountBuffer(wg::StorageBuffer<uint32_t>::Create(1, true));
+    CHECK(draw_command->count_buffer());
+
+    auto compute_command = wg::ComputeCommand::Create("cull", wg::ComputePipeline::Create());
+    compute_command->setClearStorageBuffer(2);
+    CHECK(compute_command->cleared_storage_buffers().contains(2));
+    compute_command->setClearStorageBuffer(2, false);
+    CHECK(compute_command->cleared_storage_buffers().empty());
+}
+
+TEST_CASE("frustum culling" * doctest::timeout(1)) {
+    wg::BoundingBox box;
+    CHECK(box.empty());
+    box.merge({ 1.f, -2.f, 0.f });
+    box.merge({ -1.f, 2.f, 4.f });
+    CHECK(!box.empty());
+    CHECK(box.min == glm::vec3(-1.f, -2.f, 0.f));
+    CHECK(box.max == glm::vec3(1.f, 2.f, 4.f));
+    CHECK(box.center() == glm::vec3(0.f, 0.f, 2.f));
+
+    auto transform = glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(1.f, 2.f, 3.f)), glm::vec3(1.f, 4.f, 2.f));
+    auto sphere = wg::TransformBoundingSphere({ 1.f, 0.f, 0.f, 0.5f }, transform);
+    CHECK(glm::all(glm::epsilonEqual(sphere, glm::vec4(2.f, 2.f, 3.f, 2.f), 1e-5f)));
+
+    auto project_mat = glm::perspective(glm::radians(60.f), 4.f / 3.f, 0.1f, 100.f);
+    auto view_mat = glm::lookAt(glm::vec3(0.f, -5.f, 5.f), glm::vec3(0.f), glm::vec3(0.f, 0.f, 1.f));
+    auto frustum = wg::Frustum::FromViewProjection(project_mat * view_mat);
+
+    // Not a multiple of SIMD widths, so that remaining spheres are tested one at a time
+    std::mt19937 random_engine(42);
+    std::uniform_real_distribution<float> position_distribution(-120.f, 120.f);
+    std::uniform_real_distribution<float> radius_distribution(0.f, 10.f);
+    wg::BoundingSpheres spheres;
+    spheres.resize(1003);
+    for (size_t i = 0; i < spheres.size(); ++i) {
+        spheres.set(
+            i,
+            { position_distribution(random_engine), position_distribution(random_engine), position_distribution(random_engine),
+              radius_distribution(random_engine) }
+        );
+    }
+    spheres.set(0, { 0.f, 0.f, 0.f, 1.f });
+    spheres.set(1, { 0.f, -50.f, 50.f, 1.f });
+    spheres.set(2, { 0.f, 0.f, 0.f, std::numeric_limits<float>::infinity() });
+    CHECK(spheres.get(0) == glm::vec4(0.f, 0.f, 0.f, 1.f));
+
+    std::vector<uint8_t> visible;
+    auto visible_count = wg::CullSpheres(frustum, spheres, visible);
+    REQUIRE_EQ(visible.size(), spheres.size());
+    CHECK_EQ(visible[0], 1);
+    CHECK_EQ(visible[1], 0);
+    CHECK_EQ(visible[2], 1);
+    size_t expected_visible_count = 0;
+    for (size_t i = 0; i < spheres.size(); ++i) {
+        bool expected_visible = frustum.intersectsSphere(spheres.get(i));
+        CHECK_EQ(visible[i] != 0, expected_visible);
+        expected_visible_count += expected_visible ? 1 : 0;
+    }
+    CHECK_EQ(visible_count, expected_visible_count);
+    CHECK_GT(visible_count, 0);
+    CHECK_LT(visible_count, spheres.size());
+
+    spheres.resize(0);
+    CHECK_EQ(wg::CullSpheres(frustum, spheres, visible), 0);
+    CHECK(visible.empty());
+}
+
+TEST_CASE("bvh" * doctest::timeout(5)) {
+    auto frustum = BvhTestFrustum();
+    std::mt19937 random_engine(42);
+
+    SUBCASE("queries") {
+        auto boxes = RandomBoxes(random_engine, 5000, 100.f);
+        // Not in the hierarchy
+        boxes[7] = wg::BoundingBox();
+        wg::Bvh bvh;
+        bvh.build(boxes);
+        CHECK_EQ(bvh.object_count(), boxes.size());
+        CHECK_GT(bvh.depth(), 1);
+        CHECK_EQ(bvh.cost(), bvh.build_cost());
+        CHECK(!bvh.degraded());
+
+        auto check_queries = [&bvh, &boxes, &frustum, &random_engine]() {
+            std::vector<uint32_t> objects;
+            bvh.queryFrustum(frustum, objects);
+            std::sort(objects.begin(), objects.end());
+            std::vector<uint32_t> expected_objects;
+            for (uint32_t i = 0; i < boxes.size(); ++i) {
+                if (frustum.intersectsBox(boxes[i])) {
+                    expected_objects.push_back(i);
+                }
+            }
+            CHECK(!expected_objects.empty());
+            CHECK(objects == expected_objects);
+
+            wg::BoundingBox query_box{ glm::vec3(-20.f, -30.f, -10.f), glm::vec3(10.f, 25.f, 40.f) };
+            objects.clear();
+            bvh.queryOverlap(query_box, objects);
+            std::sort(objects.begin(), objects.end());
+            expected_objects.clear();
+            for (uint32_t i = 0; i < boxes.size(); ++i) {
+                if (boxes[i].overlaps(query_box)) {
+                    expected_objects.push_back(i);
+                }
+            }
+            CHECK(!expected_objects.empty());
+            CHECK(objects == expected_objects);
+
+            std::uniform_real_distribution<float> position_distribution(-120.f, 120.f);
+            for (int i = 0; i < 100; ++i) {
+                glm::vec3 point{ position_distribution(random_engine), position_distribution(random_engine), position_distribution(random_engine) };
+                float expected_distance_squared = std::numeric_limits<float>::infinity();
+                for (auto&& box : boxes) {
+                    expected_distance_squared = std::min(expected_distance_squared, box.distance_squared(point));
+                }
+                auto nearest = bvh.queryNearest(point);
+                REQUIRE_NE(nearest, wg::Bvh::InvalidIndex);
+                CHECK_EQ(boxes[nearest].distance_squared(point), expected_distance_squared);
+            }
+            CHECK_EQ(bvh.queryNearest(glm::vec3(1000.f), 1.f), wg::Bvh::InvalidIndex);
+        };
+        check_queries();
+
+        // Refit after moving a tenth of objects far away
+        auto moved_boxes = RandomBoxes(random_engine, boxes.size() / 10, 200.f);
+        for (uint32_t i = 0; i < moved_boxes.size(); ++i) {
+            if (i * 10 != 7) {
+                boxes[i * 10] = moved_boxes[i];
+                bvh.update(i * 10, moved_boxes[i]);
+            }
+        }
+        // Inserted as it was empty when built
+        boxes[7] = moved_boxes[0];
+        bvh.update(7, boxes[7]);
+        CHECK_EQ(bvh.object_box(7), boxes[7]);
+        CHECK_GT(bvh.cost(), bvh.build_cost());
+        check_queries();
+
+        CHECK(bvh.degraded());
+        CHECK(bvh.rebuildIfDegraded());
+        CHECK(!bvh.degraded());
+        CHECK(!bvh.rebuildIfDegraded());
+        check_queries();
+    }
+
+    SUBCASE("insert") {
+        // All objects are inserted by updates
+        auto boxes = RandomBoxes(random_engine, 100, 100.f);
+        wg::Bvh bvh;
+        bvh.build(std::vector<wg::BoundingBox>(boxes.size()));
+        CHECK_EQ(bvh.node_count(), 0);
+        for (uint32_t i = 0; i < boxes.size(); ++i) {
+            bvh.update(i, boxes[i]);
+        }
+        CHECK_GT(bvh.depth(), 1);
+        std::vector<uint32_t> objects;
+        for (uint32_t i = 0; i < boxes.size(); ++i) {
+            objects.clear();
+            bvh.queryOverlap(boxes[i], objects);
+            CHECK_NE(std::find(objects.begin(), objects.end(), i), objects.end());
+        }
+        objects.clear();
+        bvh.queryOverlap({ glm::vec3(-100.f), glm::vec3(100.f) }, objects);
+        CHECK_EQ(objects.size(), boxes.size());
+        // Built without objects, so any insertion degrades it
+        CHECK(bvh.rebuildIfDegraded());
+        CHECK(!bvh.degraded());
+
+        // Infinite boxes are not inserted, and do not change boxes in the hierarchy
+        auto infinite_box = wg::BoundingBox::FromSphere({ 0.f, 0.f, 0.f, std::numeric_limits<float>::infinity() });
+        auto unbounded_boxes = boxes;
+        unbounded_boxes.emplace_back();
+        bvh.build(unbounded_boxes);
+        auto node_count = bvh.node_count();
+        auto cost = bvh.cost();
+        bvh.update(static_cast<uint32_t>(boxes.size()), infinite_box);
+        CHECK(bvh.object_box(static_cast<uint32_t>(boxes.size())).empty());
+        CHECK_EQ(bvh.node_count(), node_count);
+        bvh.update(0, infinite_box);
+        CHECK_EQ(bvh.object_box(0), boxes[0]);
+        CHECK_EQ(bvh.cost(), cost);
+    }
+}
+
+// Too slow for the default test set, run with --no-skip
+TEST_CASE("bvh benchmark" * doctest::skip()) {
+    auto frustum = BvhTestFrustum();
+    std::mt19937 random_engine(42);
+
+    // Static objects in a large area and moving objects around the origin
+    constexpr size_t StaticObjectCount = 1000000;
+    constexpr size_t MovingObjectCount = 100000;
+    auto boxes = RandomBoxes(random_engine, StaticObjectCount, 2000.f);
+    auto moving_boxes = RandomBoxes(random_engine, MovingObjectCount, 100.f);
+    boxes.insert(boxes.end(), moving_boxes.begin(), moving_boxes.end());
+
+    auto microseconds_since = [](std::chrono::steady_clock::time_point begin_time) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin_time).count();
+    };
+
+    wg::Bvh bvh;
+    auto begin_time = std::chrono::steady_clock::now();
+    bvh.build(boxes);
+    auto build_time = microseconds_since(begin_time);
+
+    std::vector<uint32_t> objects;
+    begin_time = std::chrono::steady_clock::now();
+    bvh.queryFrustum(frustum, objects);
+    auto query_time = microseconds_since(begin_time);
+
+    begin_time = std::chrono::steady_clock::now();
+    size_t expected_object_count = 0;
+    for (auto&& box : boxes) {
+        expected_object_count += frustum.intersectsBox(box) ? 1 : 0;
+    }
+    auto linear_query_time = microseconds_since(begin_time);
+    CHECK_EQ(objects.size(), expected_object_count);
+
+    // Move each moving object by a small step, as in one frame
+    std::uniform_real_distribution<float> step_distribution(-0.5f, 0.5f);
+    begin_time = std::chrono::steady_clock::now();
+    for (auto object = static_cast<uint32_t>(StaticObjectCount); object < boxes.size(); ++object) {
+        glm::vec3 step{ step_distribution(random_engine), step_distribution(random_engine), step_distribution(random_engine) };
+        bvh.update(object, { boxes[object].min + step, boxes[object].max + step });
+    }
+    auto update_time = microseconds_since(begin_time);
+
+    begin_time = std::chrono::steady_clock::now();
+    for (int i = 0; i < 1000; ++i) {
+        CHECK_NE(bvh.queryNearest(glm::vec3(static_cast<float>(i), 0.f, 0.f)), wg::Bvh::InvalidIndex);
+    }
+    auto nearest_time = microseconds_since(begin_time);
+
+    begin_time = std::chrono::steady_clock::now();
+    bvh.rebuild();
+    auto rebuild_time = microseconds_since(begin_time);
+
+    MESSAGE(
+        fmt::format(
+            "BVH of {} static and {} moving objects, depth {}: build {} us, frustum query {} us ({} objects) "
+            "vs linear {} us, refit after moving all moving objects {} us (cost ratio {:.3f}), "
+            "1000 nearest queries {} us, rebuild {} us",
+            StaticObjectCount, MovingObjectCount, bvh.depth(), build_time, query_time, objects.size(),
+            linear_query_time, update_time, bvh.cost() / bvh.build_cost(), nearest_time, rebuild_time
+        )
+    );
+}
+
 struct LocalPacked {
     static std::vector<uint8_t> vert_shader;
     static std::vector<uint8_t> frag_shader;
+    static std::vector<uint8_t> cull_shader;
     static std::vector<uint8_t> image;
 
     static void write(const std::vector<uint8_t>& content, const std::string& filename) {
@@ -154,7 +887,7 @@ struct LocalPacked {
     }
 };
 
-TEST_CASE("gfx raw" * doctest::timeout(10)) {
+TEST_CASE("gfx raw" * doctest::timeout(30)) {
     auto app = wg::App::Create("wegnine-gfx-example", std::make_tuple(0, 0, 1));
 
     // Prepare data
@@ -162,7 +895,8 @@ TEST_CASE("gfx raw" * doctest::timeout(10)) {
     std::filesystem::create_directories("config");
     {
         std::ofstream out("config/engine.json");
-        out << R"({"gfx-separate-transfer": true, "gfx-max-sampler-anisotropy": 8.0})";
+        // Small staging ring so that uploads are split into chunks
+        out << R"({"gfx-separate-transfer": true, "gfx-max-sampler-anisotropy": 8.0, "gfx-staging-buffer-size-mb": 1})";
     }
     CHECK(std::filesystem::exists("config/engine.json"));
 
@@ -289,7 +1023,13 @@ TEST_CASE("gfx raw" * doctest::timeout(10)) {
         { .position = { 0.0f, 0.5f, 0.f }, .color = { 0.f, 0.f, 1.f }, .tex_coord = { 0.5f, 1.f } },
     };
     auto triangle_vertex_buffer = wg::VertexBuffer<wg::SimpleVertex>::CreateFromVertexArray(triangle_vertices);
-    gfx->createVertexBufferResources(triangle_vertex_buffer);
+    auto upload_batch = wg::UploadBatch::Create();
+    gfx->createVertexBufferResources(triangle_vertex_buffer, upload_batch);
+    CHECK(!triangle_vertex_buffer->has_gpu_data());
+    CHECK_EQ(upload_batch->size(), 1);
+    auto upload_token = gfx->submitUploadBatch(upload_batch);
+    CHECK(upload_token.valid());
+    CHECK(triangle_vertex_buffer->has_gpu_data());
 
     auto triangle_draw_command = wg::SimpleDrawCommand::Create("triangle", pipeline);
     CHECK(!triangle_draw_command->valid());
@@ -340,6 +1080,434 @@ TEST_CASE("gfx raw" * doctest::timeout(10)) {
     renderer->markUniformDirty(triangle_draw_command, wg::uniform_attributes::model);
 
     gfx->render(render_target);
+    CHECK_GE(render_target->frame_statistics().uniform_copy_count, 1);
+    CHECK_GE(render_target->frame_statistics().uniform_bytes, sizeof(wg::ModelUniform));
+
+    gfx->waitUpload(upload_token);
+    CHECK(gfx->uploadFinished(upload_token));
+
+    // Buffers and images share memory blocks.
+    uint32_t block_count = 0;
+    uint32_t allocation_count = 0;
+    for (auto&& heap_statistics : gfx->memoryStatistics()) {
+        block_count += heap_statistics.block_count;
+        allocation_count += heap_statistics.allocation_count;
+        CHECK_LE(heap_statistics.used_bytes, heap_statistics.allocated_bytes);
+        CHECK_LE(heap_statistics.budget_limit_bytes, heap_statistics.budget_bytes);
+    }
+    CHECK_GT(allocation_count, block_count);
+
+    std::array<uint64_t, wg::gfx_memory_categories::NUM_MEMORY_CATEGORIES> category_used_bytes{};
+    for (auto&& heap_statistics : gfx->memoryStatistics()) {
+        for (size_t category = 0; category < category_used_bytes.size(); ++category) {
+            category_used_bytes[category] += heap_statistics.category_used_bytes[category];
+        }
+    }
+    CHECK_GT(category_used_bytes[wg::gfx_memory_categories::buffer], 0);
+    CHECK_GT(category_used_bytes[wg::gfx_memory_categories::image], 0);
+    CHECK_GT(category_used_bytes[wg::gfx_memory_categories::render_target], 0);
+    auto memory_statistics_json = gfx->memoryStatisticsJson();
+    CHECK(memory_statistics_json.starts_with(R"({"heaps":[)"));
+    CHECK(memory_statistics_json.ends_with("}}"));
+
+    // Images sampled by render targets are never evicted.
+    CHECK(!gfx->evictImage(image));
+    CHECK(image->has_gpu_data());
+
+    // Unused images are evicted and reloaded from file on demand.
+    auto unused_image = wg::Image::Load("resources/image.png");
+    gfx->createImageResources(unused_image);
+    CHECK(gfx->evictImage(unused_image));
+    CHECK(!unused_image->has_gpu_data());
+    auto unused_sampler = wg::Sampler::Create(unused_image);
+    gfx->createSamplerResources(unused_sampler);
+    CHECK(unused_image->has_gpu_data());
+    auto eviction_statistics = gfx->memoryEvictionStatistics();
+    CHECK_EQ(eviction_statistics.evicted_image_count, 1);
+    CHECK_EQ(eviction_statistics.restored_image_count, 1);
+    CHECK_GT(eviction_statistics.evicted_bytes, 0);
+
+    // Record many draw commands with 1 to N threads
+    auto recording_renderer = wg::BasicRenderer::Create();
+    recording_renderer->addUniformBuffer(camera_uniform_buffer);
+    for (int i = 0; i < 2048; ++i) {
+        auto draw_command = wg::SimpleDrawCommand::Create(fmt::format("recording {}", i), pipeline);
+        draw_command->addVertexBuffer(triangle_vertex_buffer);
+        draw_command->addUniformBuffer(wg::UniformBuffer<wg::ModelUniform>::Create());
+        draw_command->addSampler(2, sampler);
+        gfx->finishDrawCommand(draw_command);
+        recording_renderer->addDrawCommand(draw_command);
+    }
+    render_target->setRenderer(recording_renderer);
+    uint32_t max_thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    for (uint32_t thread_count = 1; ; thread_count = std::min(thread_count * 2, max_thread_count)) {
+        gfx->setRecordingThreadCount(static_cast<int>(thread_count));
+        gfx->submitDrawCommands(render_target);
+        const auto& record_statistics = render_target->record_statistics();
+        // Slices have at least 64 draw commands
+        CHECK_EQ(record_statistics.thread_count, std::min(thread_count, 32u));
+        CHECK_EQ(record_statistics.secondary_command_buffer_count > 0, thread_count > 1);
+        MESSAGE(
+            fmt::format(
+                "Recording {} draw commands with {} threads: {} us", recording_renderer->getDrawCommands().size(),
+                record_statistics.thread_count, record_statistics.record_microseconds
+            )
+        );
+        gfx->render(render_target);
+        if (thread_count == max_thread_count) {
+            break;
+        }
+    }
+
+    // Draw commands with the same pipeline and vertex layout share one pipeline, also across rebuilds
+    auto pipeline_cache_statistics = gfx->pipelineCacheStatistics();
+    CHECK_GE(pipeline_cache_statistics.pipeline_cache_hits, 2047);
+    CHECK_LT(pipeline_cache_statistics.pipelines_created, 2048);
+    CHECK_LE(pipeline_cache_statistics.pipeline_count, pipeline_cache_statistics.pipelines_created);
+    CHECK_EQ(pipeline_cache_statistics.render_pass_count, 1);
+    MESSAGE(
+        fmt::format(
+            "Pipeline cache: {} pipelines created, {} hits, {} live pipelines",
+            pipeline_cache_statistics.pipelines_created, pipeline_cache_statistics.pipeline_cache_hits,
+            pipeline_cache_statistics.pipeline_count
+        )
+    );
+
+    // Record only visible draw commands every frame, compared with recording them once per image
+    for (size_t i = 0; i < recording_renderer->getDrawCommands().size(); i += 2) {
+        recording_renderer->setDrawCommandVisible(i, false);
+    }
+    gfx->setRecordingThreadCount(1);
+    gfx->submitDrawCommands(render_target);
+    auto per_image_microseconds = render_target->record_statistics().record_microseconds;
+    gfx->render(render_target);
+    CHECK_EQ(render_target->frame_statistics().recorded_draw_command_count, 0);
+
+    render_target->setRecordingMode(wg::recording_modes::per_frame);
+    gfx->submitDrawCommands(render_target);
+    CHECK_EQ(render_target->record_statistics().record_microseconds, 0);
+    gfx->render(render_target);
+    CHECK_EQ(render_target->frame_statistics().recorded_draw_command_count, 1024);
+    MESSAGE(
+        fmt::format(
+            "Recording 1024 of 2048 draw commands: {} us for all images, {} us per frame",
+            per_image_microseconds, render_target->frame_statistics().record_microseconds
+        )
+    );
+    recording_renderer->setDrawCommandVisible(recording_renderer->getDrawCommands()[0], true);
+    gfx->render(render_target);
+    CHECK_EQ(render_target->frame_statistics().recorded_draw_command_count, 1025);
+
+    // Draw commands sharing state skip binding it again, with or without sorting
+    auto sorted_bind_statistics = render_target->frame_statistics().bind_statistics;
+    CHECK_GT(sorted_bind_statistics.binds_skipped(), 0);
+    CHECK_EQ(sorted_bind_statistics.pipeline_binds + sorted_bind_statistics.pipeline_binds_skipped, 1025);
+    gfx->setSortDrawCommands(false);
+    gfx->render(render_target);
+    auto unsorted_bind_statistics = render_target->frame_statistics().bind_statistics;
+    CHECK_EQ(render_target->frame_statistics().recorded_draw_command_count, 1025);
+    CHECK_LE(sorted_bind_statistics.pipeline_binds, unsorted_bind_statistics.pipeline_binds);
+    MESSAGE(
+        fmt::format(
+            "Binds of 1025 draw commands (pipeline, descriptor set, push constant, buffer): sorted {} {} {} {}, unsorted {} {} {} {}",
+            sorted_bind_statistics.pipeline_binds, sorted_bind_statistics.descriptor_set_binds,
+            sorted_bind_statistics.push_constant_updates, sorted_bind_statistics.buffer_binds,
+            unsorted_bind_statistics.pipeline_binds, unsorted_bind_statistics.descriptor_set_binds,
+            unsorted_bind_statistics.push_constant_updates, unsorted_bind_statistics.buffer_binds
+        )
+    );
+    gfx->setSortDrawCommands(true);
+}
+
+TEST_CASE("gfx pipeline cache" * doctest::timeout(30)) {
+    auto app = wg::App::Create("wegnine-gfx-example", std::make_tuple(0, 0, 1));
+    // Files of this test only, removed afterwards
+    auto test_path = std::filesystem::temp_directory_path() / fmt::format("wengine-gfx-pipeline-cache-{}", std::random_device{}());
+    std::filesystem::create_directories(test_path);
+    const auto vert_shader_path = (test_path / "simple.vert.spv").string();
+    const auto frag_shader_path = (test_path / "simple.frag.spv").string();
+    const auto image_path = (test_path / "image.png").string();
+    const auto pipeline_cache_path = (test_path / "pipeline-cache.bin").string();
+    LocalPacked::write(LocalPacked::vert_shader, vert_shader_path);
+    LocalPacked::write(LocalPacked::frag_shader, frag_shader_path);
+    LocalPacked::write(LocalPacked::image, image_path);
+
+    // Cold and warm pipeline cache, then warm pipeline cache with pipelines compiled in background
+    for (int run = 0; run < 3; ++run) {
+        bool warm = run > 0;
+        bool async = run == 2;
+        auto window = app->createWindow(800, 600, "WEngine gfx pipeline cache");
+        auto start_time = std::chrono::steady_clock::now();
+        auto gfx = wg::Gfx::Create(app);
+        gfx->setPipelineCachePath(pipeline_cache_path);
+        gfx->setPipelineCompileThreadCount(async ? 2 : 0);
+        gfx->createWindowSurface(window);
+        gfx->selectBestPhysicalDevice();
+        gfx->createLogicalDevice();
+
+        auto vert_shader = wg::Shader::Load(vert_shader_path, wg::shader_stages::vert);
+        auto frag_shader = wg::Shader::Load(frag_shader_path, wg::shader_stages::frag);
+        gfx->createShaderResources(vert_shader);
+        gfx->createShaderResources(frag_shader);
+        auto image = wg::Image::Load(image_path);
+        gfx->createImageResources(image);
+        auto sampler = wg::Sampler::Create(image);
+        gfx->createSamplerResources(sampler);
+        auto vertex_buffer = wg::VertexBuffer<wg::SimpleVertex>::CreateFromVertexArray(
+            {
+                { .position = { -0.5f, -0.5f, 0.f } },
+                { .position = { 0.5f, -0.5f, 0.f } },
+                { .position = { 0.0f, 0.5f, 0.f } },
+            }
+        );
+        gfx->createVertexBufferResources(vertex_buffer);
+
+        auto pipeline = wg::GfxPipeline::Create();
+        pipeline->addShader(vert_shader);
+        pipeline->addShader(frag_shader);
+        pipeline->setVertexFactory(
+            wg::GfxVertexFactory{
+                { .attribute = wg::vertex_attributes::position, .format = wg::gfx_formats::R32G32B32Sfloat, .location = 0 },
+                { .attribute = wg::vertex_attributes::color, .format = wg::gfx_formats::R32G32B32Sfloat, .location = 1 },
+                { .attribute = wg::vertex_attributes::tex_coord, .format = wg::gfx_formats::R32G32Sfloat, .location = 2 },
+            }
+        );
+        pipeline->setUniformLayout(
+            wg::GfxUniformLayout{}
+                .addDescription({ .attribute = wg::uniform_attributes::camera, .binding = 0, .stages = wg::shader_stages::vert | wg::shader_stages::frag })
+                .addDescription({ .attribute = wg::uniform_attributes::model, .binding = 1, .stages = wg::shader_stages::vert | wg::shader_stages::frag })
+        );
+        pipeline->setSamplerLayout(wg::GfxSamplerLayout{}.addDescription({ .binding = 2, .stages = wg::shader_stages::frag }));
+        gfx->createPipelineResources(pipeline);
+        if (async) {
+            // Shader modules of its own, so that it is a different pipeline
+            auto fallback_pipeline = wg::GfxPipeline::Create();
+            for (auto&& shader : { wg::Shader::Load(vert_shader_path, wg::shader_stages::vert),
+                                   wg::Shader::Load(frag_shader_path, wg::shader_stages::frag) }) {
+                gfx->createShaderResources(shader);
+                fallback_pipeline->addShader(shader);
+            }
+            fallback_pipeline->setVertexFactory(pipeline->vertex_factory());
+            fallback_pipeline->setUniformLayout(pipeline->uniform_layout());
+            fallback_pipeline->setSamplerLayout(pipeline->sampler_layout());
+            gfx->createPipelineResources(fallback_pipeline);
+            pipeline->setFallbackPipeline(fallback_pipeline);
+        }
+
+        auto draw_command = wg::SimpleDrawCommand::Create("triangle", pipeline);
+        draw_command->addVertexBuffer(vertex_buffer);
+        draw_command->addUniformBuffer(wg::UniformBuffer<wg::ModelUniform>::Create());
+        draw_command->addSampler(2, sampler);
+        gfx->finishDrawCommand(draw_command);
+        auto renderer = wg::BasicRenderer::Create();
+        renderer->addDrawCommand(draw_command);
+        renderer->addUniformBuffer(wg::UniformBuffer<wg::CameraUniform>::Create());
+
+        auto render_target = gfx->createRenderTarget(window);
+        render_target->setRenderer(renderer);
+        gfx->createRenderTargetResources(render_target);
+        if (async) {
+            gfx->prewarmPipelines(render_target, { draw_command });
+            // Shares the pipeline requested before
+            gfx->prewarmPipelines(render_target, { draw_command });
+            render_target->setRecordingMode(wg::recording_modes::per_frame);
+        }
+        gfx->submitDrawCommands(render_target);
+        gfx->render(render_target);
+        auto startup_microseconds = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_time
+        ).count();
+
+        if (async) {
+            // Drawn with either the fallback pipeline or the prewarmed pipeline
+            CHECK_EQ(render_target->frame_statistics().recorded_draw_command_count, 1);
+            gfx->waitPipelineCompilation();
+            gfx->render(render_target);
+            CHECK_EQ(render_target->frame_statistics().recorded_draw_command_count, 1);
+        }
+
+        auto statistics = gfx->pipelineCacheStatistics();
+        CHECK_EQ(statistics.loaded_bytes > 0, warm);
+        CHECK_EQ(statistics.pending_pipeline_count, 0);
+        if (async) {
+            // The fallback pipeline is only created if the prewarmed pipeline was not ready at submission
+            CHECK_GE(statistics.pipelines_created, 1);
+            CHECK_LE(statistics.pipelines_created, 2);
+            CHECK_GE(statistics.pipeline_cache_hits, 2);
+        } else {
+            CHECK_EQ(statistics.pipelines_created, 1);
+        }
+        MESSAGE(
+            fmt::format(
+                "Startup with {} pipeline cache{}: {} us, {} us creating pipelines", warm ? "warm" : "cold",
+                async ? " and background compilation" : "", startup_microseconds, statistics.pipeline_compile_microseconds
+            )
+        );
+        if (!warm) {
+            // Also saved on destruction of gfx
+            CHECK(gfx->savePipelineCache());
+            CHECK(std::filesystem::exists(pipeline_cache_path));
+        }
+    }
+
+    std::filesystem::remove_all(test_path);
+    CHECK(!std::filesystem::exists(pipeline_cache_path));
+}
+
+TEST_CASE("compute dispatch" * doctest::timeout(30)) {
+    auto app = wg::App::Create("wegnine-gfx-example", std::make_tuple(0, 0, 1));
+    std::filesystem::create_directories("shader");
+    LocalPacked::write(LocalPacked::cull_shader, "shader/frustum-cull.comp.spv");
+    CHECK(LocalPacked::checkSame(LocalPacked::cull_shader, "shader/frustum-cull.comp.spv"));
+
+    auto window = app->createWindow(800, 600, "WEngine gfx compute dispatch");
+    auto gfx = wg::Gfx::Create(app);
+    gfx->createWindowSurface(window);
+    gfx->selectBestPhysicalDevice();
+    gfx->createLogicalDevice();
+
+    auto shader = wg::Shader::Load("shader/frustum-cull.comp.spv", wg::shader_stages::comp);
+    CHECK(shader->loaded());
+    auto pipeline = wg::ComputePipeline::Create();
+    pipeline->setShader(shader);
+    pipeline->setStorageBufferLayout(
+        wg::GfxStorageBufferLayout{}
+            .addDescription({ .binding = 0, .stages = wg::shader_stages::comp })
+            .addDescription({ .binding = 1, .stages = wg::shader_stages::comp })
+            .addDescription({ .binding = 2, .stages = wg::shader_stages::comp })
+    );
+    pipeline->setPushConstantSize(sizeof(wg::GpuCullParameters));
+
+    auto project_mat = glm::perspective(glm::radians(90.f), 1.f, 0.1f, 100.f);
+    auto view_mat = glm::lookAt(glm::vec3(0.f), glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
+    std::vector<wg::GpuCullObject> objects;
+    for (uint32_t i = 0; i < 100; ++i) {
+        // Every other object behind the camera
+        float x = (i % 2 == 0 ? 1.f : -1.f) * (1.f + static_cast<float>(i));
+        objects.push_back(
+            {
+                .bounding_sphere = { x, 0.f, 0.f, 0.5f },
+                .draw = { .index_count = 3 * (i + 1), .instance_count = 1, .first_index = i * 100, .vertex_offset = static_cast<int32_t>(i), .first_instance = i }
+            }
+        );
+    }
+    wg::GpuCullParameters parameters{
+        .planes = wg::Frustum::FromViewProjection(project_mat * view_mat).planes,
+        .object_count = static_cast<uint32_t>(objects.size())
+    };
+    std::vector<wg::DrawIndexedIndirectCommand> expected_commands;
+    auto expected_draw_count = wg::CullObjects(parameters, objects, expected_commands);
+
+    auto objects_buffer = wg::StorageBuffer<wg::GpuCullObject>::CreateFromArray(objects);
+    auto commands_buffer = wg::StorageBuffer<wg::DrawIndexedIndirectCommand>::Create(objects.size(), true);
+    auto count_buffer = wg::StorageBuffer<uint32_t>::Create(1, true);
+    auto compute_command = wg::ComputeCommand::Create("cull", pipeline);
+    compute_command->setStorageBuffer(0, objects_buffer);
+    compute_command->setStorageBuffer(1, commands_buffer);
+    compute_command->setStorageBuffer(2, count_buffer);
+    compute_command->setClearStorageBuffer(2);
+    compute_command->setPushConstants(parameters);
+    compute_command->setGroupCount(parameters.group_count());
+    CHECK(!compute_command->valid());
+
+    gfx->createShaderResources(shader);
+    CHECK(shader->valid());
+    gfx->createComputePipelineResources(pipeline);
+    gfx->createStorageBufferResources(objects_buffer);
+    gfx->createStorageBufferResources(commands_buffer);
+    gfx->createStorageBufferResources(count_buffer);
+    CHECK(compute_command->valid());
+    compute_command->setGroupCount(0);
+    CHECK(!compute_command->valid());
+    compute_command->setGroupCount(parameters.group_count());
+    compute_command->setPushConstants(uint64_t{ 64 });
+    CHECK(!compute_command->valid());
+    compute_command->setPushConstants(parameters);
+    REQUIRE(compute_command->valid());
+    gfx->finishComputeCommand(compute_command);
+
+    // Twice, so that the count buffer is cleared before the second dispatch
+    for (int i = 0; i < 2; ++i) {
+        auto token = gfx->submitComputeCommands({ compute_command });
+        REQUIRE(token.valid());
+        gfx->waitCompute(token);
+        CHECK(gfx->computeFinished(token));
+        REQUIRE(gfx->readStorageBuffer(count_buffer));
+        REQUIRE(gfx->readStorageBuffer(commands_buffer));
+        CHECK_EQ(count_buffer->elements()[0], expected_draw_count);
+        CHECK(commands_buffer->elements() == expected_commands);
+    }
+}
+
+TEST_CASE("streaming vertex buffer" * doctest::timeout(10)) {
+    auto app = wg::App::Create("wegnine-gfx-example", std::make_tuple(0, 0, 1));
+    auto window = app->createWindow(800, 600, "WEngine gfx streaming vertex buffer");
+    auto gfx = wg::Gfx::Create(app);
+    gfx->createWindowSurface(window);
+    gfx->selectBestPhysicalDevice();
+    gfx->createLogicalDevice();
+
+    auto vertices = std::vector<wg::SimpleVertex>(4);
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        vertices[i].position = { static_cast<float>(i), 0.f, 0.f };
+    }
+    auto vertex_buffer = wg::StreamingVertexBuffer<wg::SimpleVertex>::CreateFromVertexArray(vertices, 2);
+    gfx->createVertexBufferResources(vertex_buffer);
+
+    auto& gfx_impl = Gfx_Test::GetImpl(*gfx);
+    auto& buffer_impl = GfxBuffer_Test::GetImpl(*vertex_buffer);
+    REQUIRE_EQ(buffer_impl.streaming_copies.size(), 2);
+    auto copy_vertices = [&buffer_impl](size_t copy) {
+        auto* resources = buffer_impl.streaming_copies[copy].resources.data();
+        REQUIRE(resources);
+        REQUIRE(resources->mapped);
+        return static_cast<const wg::SimpleVertex*>(resources->mapped);
+    };
+    const auto data_size = vertex_buffer->data_size();
+
+    // All copies are written when created
+    auto version = buffer_impl.streaming_version;
+    CHECK(vertex_buffer->has_gpu_data());
+    for (size_t copy = 0; copy < 2; ++copy) {
+        CHECK_EQ(buffer_impl.streaming_copies[copy].version, version);
+        CHECK_EQ(copy_vertices(copy)[3].position.x, 3.f);
+    }
+    for (uint32_t image_index = 0; image_index < 3; ++image_index) {
+        CHECK_EQ(gfx_impl.updateStreamingCopy(vertex_buffer, image_index), 0);
+    }
+
+    // A write makes all copies stale, each rewritten once by the next image using it
+    auto changed_vertices = std::vector<wg::SimpleVertex>(1, wg::SimpleVertex{ .position = { 1.f, 2.f, 3.f } });
+    REQUIRE(vertex_buffer->setVertexRange(3, changed_vertices));
+    CHECK_EQ(gfx_impl.updateStreamingCopy(vertex_buffer, 1), data_size);
+    CHECK_EQ(buffer_impl.streaming_version, version + 1);
+    CHECK(vertex_buffer->dirty_ranges().empty());
+    CHECK_EQ(buffer_impl.streaming_copies[1].version, version + 1);
+    CHECK_EQ(buffer_impl.streaming_copies[0].version, version);
+    CHECK_EQ(copy_vertices(1)[3].position.y, 2.f);
+    // Frames of image 0 may still draw the old vertices
+    CHECK_EQ(copy_vertices(0)[3].position.y, 0.f);
+    CHECK_EQ(gfx_impl.updateStreamingCopy(vertex_buffer, 1), 0);
+    CHECK_EQ(gfx_impl.updateStreamingCopy(vertex_buffer, 0), data_size);
+    CHECK_EQ(buffer_impl.streaming_copies[0].version, version + 1);
+    CHECK_EQ(copy_vertices(0)[3].position.y, 2.f);
+    CHECK_EQ(gfx_impl.updateStreamingCopy(vertex_buffer, 2), 0);
+
+    // Images 0 and 2 share copy 0, image 1 uses copy 1
+    changed_vertices[0].position.y = 5.f;
+    REQUIRE(vertex_buffer->setVertexRange(3, changed_vertices));
+    CHECK_EQ(gfx_impl.updateStreamingCopy(vertex_buffer, 2), data_size);
+    CHECK_EQ(buffer_impl.streaming_version, version + 2);
+    CHECK_EQ(copy_vertices(0)[3].position.y, 5.f);
+    CHECK_EQ(copy_vertices(1)[3].position.y, 2.f);
+    CHECK_EQ(gfx_impl.updateStreamingCopy(vertex_buffer, 0), 0);
+    CHECK_EQ(gfx_impl.updateStreamingCopy(vertex_buffer, 1), data_size);
+    CHECK_EQ(copy_vertices(1)[3].position.y, 5.f);
+
+    // Copies do not grow with CPU data
+    vertex_buffer->setVertexArray(std::vector<wg::SimpleVertex>(8));
+    CHECK_EQ(gfx_impl.updateStreamingCopy(vertex_buffer, 0), 0);
+    CHECK_EQ(copy_vertices(0)[3].position.y, 5.f);
 }
 
 // Packed data
@@ -349,6 +1517,9 @@ std::vector<uint8_t> LocalPacked::vert_shader = {
 std::vector<uint8_t> LocalPacked::frag_shader = {
 #include "../resources/simple.frag.inc"
 };
+std::vector<uint8_t> LocalPacked::cull_shader = {
+#include "../resources/frustum-cull.comp.inc"
+};
 std::vector<uint8_t> LocalPacked::image = {
 #include "../resources/image.inc"
 };
\ No newline at end of file